@@ -3,7 +3,18 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <exception>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstddef>
+#include <climits>
+#if __cplusplus >= 202002L
+#include <span>
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,17 +22,39 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <cerrno>
+
+#if defined(__linux__)
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#endif
+
+#include "SharedMemoryRing.hpp"
+#include "MessageCodec.hpp"
+#include "LatencyHistogram.hpp"
+#include "HostResolver.hpp"
+#include "ReceiveBuffer.hpp"
+#include "RecordBuffer.hpp"
+#include "Probes.hpp"
 
 #define BUFFER_SIZE 65535
+#define STREAM_CHUNK_SIZE 262144 //The bytes sendStream() asks its source for at a time
+#define CONNECT_ATTEMPT_DELAY 250 //Milliseconds each address gets to connect before the next one is tried alongside it
+#define CONNECT_TIMEOUT 10000 //Milliseconds before connecting to every address is given up on
 
 class ClientSocket {
 public:
     //Constructor
     ClientSocket() {}
-    ClientSocket(const char* hostName, int portNum) {
-        this->setSocket(hostName, portNum);
+    ClientSocket(const char* hostName, int portNum, unsigned int connectTimeoutMilliseconds = CONNECT_TIMEOUT) {
+        this->setSocket(hostName, portNum, connectTimeoutMilliseconds);
     }
     
     //Destructor
@@ -39,88 +72,53 @@ public:
     //Public member functions
     
     /*!
-     * A function to initialize the socket. This must be done before the socket can be used. Will throw an error if the socket cannot be opened or if the port is occupied, or if the socket is already set.
+     * A function to initialize the socket. This must be done before the socket can be used. The host name is resolved through HostResolver::shared(), so a host looked up recently is not looked up again. Every address it resolves to is tried, alternating between IPv6 and IPv4. Each address gets CONNECT_ATTEMPT_DELAY milliseconds before the next one starts alongside it, and the first to connect is kept. Will throw an error if no address connects before the timeout, or if the socket is already set.
      *
      * @param hostName A const char* indicating the name of the host to whom to connect. "localhost" specifies that the host is on the same machine. Otherwise, use the name of the client.
      * @param portNum The number of the port on the host at which clients should connect.
+     * @param connectTimeoutMilliseconds An optional parameter indicating how long to try connecting for. 0 waits until every address has failed. Autoinitialized as CONNECT_TIMEOUT.
      */
-    void setSocket(const char* hostName, int portNum) {
+    void setSocket(const char* hostName, int portNum, unsigned int connectTimeoutMilliseconds = CONNECT_TIMEOUT) {
         if (this->setUp)
             throw std::logic_error("Socket already set");
         
         this->portNumber = portNum;
         
-        int returnVal;
-        
-        addrinfo hints; //A struct containing information on the address. Will be passed to getaddrinfo() to give hints about the connection to be made
-        addrinfo* serverAddressList; //A pointer to an addrinfo struct that will be filled with the server address by getaddrinfo()
+        //Look the host up, or take its addresses from the cache if it was looked up recently
+        HostResolver::Addresses serverAddressList = HostResolver::shared().resolve(hostName, portNum);
         
-        memset(&hints, 0, sizeof(hints)); //Set hints
-        hints.ai_family = AF_UNSPEC; //Can be either IPv4 or IPv6
-        hints.ai_socktype = SOCK_STREAM; //TCP Socket
-        
-        /* getaddrinfo
-         The getaddrinfo() fills a given addrinfo struct with the relevant information. The return value is nonzero when there is an error.
-         
-         The first argument is the name of the host to connect with.
-         
-         The second argument is a string representation of the port number.
-         
-         The third argument is a pointer to an addrinfo struct which contains hints about the type of connection to be made.
-         
-         The fourth argument is a pointer which will be filled with a linked list of hosts returned. If just one host is being looked for, the first result can just be used.
-         */
-        returnVal = getaddrinfo(hostName, std::to_string(portNum).c_str(), &hints, &serverAddressList);
-        
-        //Check for an error with getaddrinfo()
-        if (returnVal != 0) {
-            throw std::runtime_error(strcat((char *)"ERROR getting host address: ", gai_strerror(returnVal))); //gai_strerror() returns a c string representation of the error
+        //Race the addresses of the host against each other, rather than waiting out the first one if it can't be reached
+        try {
+            this->connectionSocket = this->connectToAny(serverAddressList.get(), connectTimeoutMilliseconds);
+        } catch (...) {
+            //The cached addresses may be out of date, so the next attempt looks the host up again
+            HostResolver::shared().forget(hostName, portNum);
+            throw;
         }
         
-        //Set the first host in the list to the desired host
-        addrinfo serverAddress = *serverAddressList;
-        
-        /* socket()
-         The socket() function returns a new socket, with three parameters.
-         
-         The first argument is address of the domain of the socket.
-         The two possible address domains are the unix, for commen file system sockets, and the internet, for anywhere on the internet.
-         AF_UNIX is generally used for the former, and AF_INET generally for the latter.
-         
-         The second argument is the type of the socket.
-         The two possible types are a stream socket where characters are read in a continuous stream, and a diagram socket, which reads in chunks.
-         SOCK_STREAM is generally used for the former, and SOCK_DGRAM for the latter.
-         
-         The third argument is the protocol. It should always be 0 except in unusual circumstances, and then allows the operating system to chose TCP or UDP, based on the socket type. TCP is chosen for stream sockets, and UDP for diagram sockets
-         
-         The function returns an integer than can be used like a reference to the socket. Failure results in returning -1.
-         */
-        //In this case, the values are taken from getaddrinfo(), from the first returned addrinfo struct in the linked list.
-        this->connectionSocket = socket(serverAddress.ai_family, serverAddress.ai_socktype, serverAddress.ai_protocol);
-        
-        //Checks for errors initializing socket
-        if (socket < 0)
-            throw std::runtime_error(strcat((char *)"ERROR opening socket: ", strerror(errno)));
+        this->lastSeenTime = std::chrono::steady_clock::now();
         
-        //No need to call bind() (see server side) because the local port number doesn't matter; the kernel will find an open port.
+        this->setUp = true; //All functions ensure the socket has been set before doing anything
+    }
+    
+    /*!
+     * A function to initialize the socket as a connection through shared memory to a host in another process on the same machine, instead of through TCP. The host must be waiting in ServerSocket::addSharedMemoryClient() with the same name. Once set, the socket is used exactly as if setSocket() had been called. Will throw an error if the host is not waiting, or if the socket is already set.
+     *
+     * @param name The name of the shared memory segment, which the host also uses.
+     */
+    void setSharedMemory(const char* name) {
+        if (this->setUp)
+            throw std::logic_error("Socket already set");
         
-        /* connect()
-         The connect() function is called by the client to establish a connection with the server, with three arguments.
-         
-         The first argument is the small integer reference for the socket.
-         
-         The second argument is the address of the host to connect to, including the port number, all in the form of a sockaddr struct.
-         
-         The third argument is the size of the address.
-         
-         The function returns 0 if successful and -1 if it fails.
-         */
-        if (connect(this->connectionSocket, serverAddress.ai_addr, serverAddress.ai_addrlen) < 0)
-            throw std::runtime_error(strcat((char *)"ERROR connecting: ", strerror(errno)));
+        std::unique_ptr<SharedMemoryRing> ring(new SharedMemoryRing());
+        ring->open(name);
         
-        freeaddrinfo(serverAddressList); //Free the linked list now that we have the local host information
+        this->sharedMemoryRing = std::move(ring);
+        this->connectionSocket = -1; //There is no socket, so socket options set on it have no effect
+        this->portNumber = 0;
+        this->lastSeenTime = std::chrono::steady_clock::now();
         
-        this->setUp = true; //All functions ensure the socket has been set before doing anything
+        this->setUp = true;
     }
     
     /*!
@@ -132,88 +130,328 @@ public:
      * @return Any part of the string that wasn't sent if the given string was too large to send in full. Only part of the string would have been sent, the rest is returned.
      */
     std::string send(const char* message, bool ensureFullStringSent = false) {
+        unsigned long messageLength = message != nullptr ? strlen(message) : 0;
+        
+        unsigned long sentSize = this->sendBytes(message, messageLength, ensureFullStringSent);
+        
+        //Return any part of the string that was not sent. This occurs if the string is too long, and is the only case that allocates
+        if (sentSize < messageLength) return std::string(message + sentSize, messageLength - sentSize);
+        return "";
+    }
+    
+    /*!
+     * A function that sends a message to the host. The message can hold any bytes, including '\0', and nothing is allocated or copied. Errors are thrown in the same cases as send(const char*, bool).
+     *
+     * @param message The bytes to be sent.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
+     *
+     * @return The number of bytes sent. If less than the length of the message, the caller can send the rest later.
+     */
+    unsigned long send(std::string_view message, bool ensureFullStringSent = false) {
+        return this->sendBytes(message.data(), message.size(), ensureFullStringSent);
+    }
+    
+#if __cplusplus >= 202002L
+    /*!
+     * A function that sends binary data to the host. It works exactly like send(std::string_view, bool).
+     *
+     * @param message The bytes to be sent.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
+     *
+     * @return The number of bytes sent.
+     */
+    unsigned long send(std::span<const std::byte> message, bool ensureFullStringSent = false) {
+        return this->sendBytes((const char*)message.data(), message.size(), ensureFullStringSent);
+    }
+#endif
+    
+    /*!
+     * A function that sends a message the caller no longer needs to the host. The message can hold any bytes, including '\0'. Errors are thrown in the same cases as send(const char*, bool).
+     *
+     * @param message The message to be sent. It is moved in.
+     * @param ensureFullStringSent An optional parameter that will make sure the full string is sent if it is too long to send with one call of write(). It is automatically set to false.
+     *
+     * @return Any part of the message that wasn't sent, in the same string that was moved in, so nothing new is allocated.
+     */
+    std::string send(std::string&& message, bool ensureFullStringSent = false) {
+        unsigned long sentSize = this->sendBytes(message.data(), message.size(), ensureFullStringSent);
+        
+        //Return what was not sent in the string that was moved in, rather than in a new one
+        message.erase(0, sentSize);
+        return std::move(message);
+    }
+    
+    /*!
+     * A function that sends a typed message to the host, in the wire layout declared by MessageSchema<T>. The message is encoded on the stack, so nothing is allocated. Errors are thrown in the same cases as send(const char*, bool).
+     *
+     * @param message The message to be sent.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to true, since the other side reads messages whole.
+     *
+     * @return The number of bytes sent.
+     */
+    template <typename T>
+    unsigned long sendMessage(const T& message, bool ensureFullStringSent = true) {
+        char encoded[MessageLayout<T>::size];
+        encodeMessage(message, encoded);
+        return this->sendBytes(encoded, MessageLayout<T>::size, ensureFullStringSent);
+    }
+    
+    /*!
+     * A function that receives a message from the host. The function will wait for a short period for the client to send the message, and if the message is not received it will throw an error. An error is also thrown if the socket is not set.
+     *
+     * @param socketClosed An optional pointer to a bool that would be set to true if the client disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return The received message from the host.
+     */
+    std::string receive(bool* socketClosed = nullptr) {
         if (!this->setUp)
             throw std::logic_error("Socket not set");
         
-        //Empty messages won't be sent
-        if (std::string(message) == "")
-            throw std::logic_error("No message to send");
+        std::string str;
         
-        unsigned long messageLength = strlen(message);
-        
-        long sentSize = write(this->connectionSocket, message, messageLength);
+        //Keep reading while more of the message is already waiting
+        while (true) {
+            long messageSize; //Stores the return value from the calls to read() and write() by holding the number of characters either read or written
+            
+            /* read()
+             The read() function will read in info from the client socket, with three arguments. It will block until the client writes and there is something to read in.
+             
+             The first argument is the reference for the client's socket.
+             
+             The second argument is the buffer to store the message.
+             
+             The third argument is the maximum number of characters to to be read into the buffer.
+             */
+            if (this->sharedMemoryRing) {
+                this->receiveBuffer.reserve(this->sharedMemoryRing->available());
+                messageSize = this->sharedMemoryRing->read(this->receiveBuffer.data(), this->receiveBuffer.size(), str.empty() ? this->timeoutMilliseconds : 0);
+                if (messageSize > 0) this->recordReply();
+            } else {
+                //Size the buffer by what the kernel already has, so a large message takes a few large reads
+                int waiting = 0;
+                if (ioctl(this->connectionSocket, FIONREAD, &waiting) < 0) waiting = 0;
+                this->receiveBuffer.reserve(waiting);
+                messageSize = this->readSocket(this->receiveBuffer.data(), this->receiveBuffer.size());
+            }
+            
+            //Checks for errors reading from the socket
+            if (messageSize < 0)
+                throw std::runtime_error(strcat((char *)"ERROR reading from socket: ", strerror(errno)));
+            
+            //A blank message indicates that the socket has closed from the host side, so there is nothing more to read
+            if (messageSize == 0) {
+                if (str.empty() && socketClosed != nullptr) *socketClosed = true;
+                return str;
+            }
+            
+            this->lastSeenTime = std::chrono::steady_clock::now();
+            
+            str.append(this->receiveBuffer.data(), messageSize);
+            this->receiveBuffer.used(messageSize); //Only once the bytes are copied out, since it may replace the memory
+            
+            //A shared memory connection never has to wait for the rest of a message to arrive over the network, so only read on if more is already there
+            if (this->sharedMemoryRing) {
+                if (this->sharedMemoryRing->available() == 0) return str;
+                continue;
+            }
+            
+            //Check if there is more data waiting to be read, and if so, read it
+            fd_set readfds;
+            FD_ZERO(&readfds);
+            FD_SET(this->connectionSocket, &readfds);
+            int n = this->connectionSocket + 1;
+            
+            struct timeval timeout;
+            timeout.tv_sec = 0;
+            timeout.tv_usec = 20000;
+            
+            int returnValue = select(n, &readfds, NULL, NULL, &timeout);
+            if (returnValue < 0) {
+                throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
+            } else if (returnValue == 0) {
+                return str;
+            }
+        }
+    }
+    
+    /*!
+     * A function that receives exactly a given number of bytes from the host into the caller's buffer, waiting until all of them have arrived. Nothing is allocated. Since receive() reads whatever has arrived, the two should not be mixed on one connection. Errors are thrown in the same cases as receive().
+     *
+     * @param buffer The buffer to fill.
+     * @param length The number of bytes to receive.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the host disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return True if all the bytes were received, false if the host disconnected first.
+     */
+    bool receive(char* buffer, unsigned long length, bool* socketClosed = nullptr) {
+        return this->receiveBytes(buffer, length, socketClosed);
+    }
+    
+    /*!
+     * A function that receives exactly one typed message from the host into a buffer, waiting until all of it has arrived. Fields are then read from buffer.view() without any parsing. Since receive() reads whatever has arrived, the two should not be mixed on one connection. Errors are thrown in the same cases as receive().
+     *
+     * @param buffer The buffer to fill. It can be reused for every message.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the host disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return True if a whole message was received, false if the host disconnected first.
+     */
+    template <typename T>
+    bool receiveMessage(MessageBuffer<T>& buffer, bool* socketClosed = nullptr) {
+        return this->receiveBytes(buffer.data(), MessageLayout<T>::size, socketClosed);
+    }
+    
+    /*!
+     * A function that receives one record from the host, for protocols that end each message with a delimiter, like newline-delimited text. Whatever arrives after the record is kept for the next call, so a read that brings many records is only made once. Since the bytes kept are not seen by receive(), the two should not be mixed on one connection. Errors are thrown in the same cases as receive(), and if a record is longer than RECORD_MAX_LENGTH.
+     *
+     * @param record Set to the record, without its delimiter. It points into the socket's buffer, and stays valid until the next call or until the socket is closed. If the host disconnects without ending the last record, what it sent is returned as a record.
+     * @param delimiter An optional parameter indicating the byte that ends each record. Autoinitialized as '\n'.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the host disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return True if a record was received, false if the host disconnected first.
+     */
+    bool receiveRecord(std::string_view& record, char delimiter = '\n', bool* socketClosed = nullptr) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
         
-        if (sentSize < 0) {
-            throw std::runtime_error(strcat((char *)"ERROR sending message: ", strerror(errno)));
-        } else if (sentSize < messageLength) { //If only some of the string was sent, return what wasn't sent (or send the rest)
-            std::string extraStr; //Holds the rest of the string that was not sent
-            for (unsigned long a = sentSize; a < messageLength; a++) {
-                extraStr += message[a];
+        //Only read when no whole record is left over from the last read
+        while (!this->recordBuffer.next(record, delimiter)) {
+            size_t length;
+            char* space = this->recordBuffer.space(length);
+            
+            long messageSize;
+            if (this->sharedMemoryRing) {
+                messageSize = this->sharedMemoryRing->read(space, length, this->timeoutMilliseconds);
+                if (messageSize > 0) this->recordReply();
+            } else {
+                messageSize = this->readSocket(space, length);
             }
-            if (ensureFullStringSent) { //This optional bool is set to false. If manually changed to true send the rest. Otherwise, return the unsent part
-                this->send(extraStr.c_str(), ensureFullStringSent); //Recursively keep sending the rest of the string until it is all sent
-                return "";
+            
+            if (messageSize < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("ERROR reading from socket: ") + std::string(strerror(errno)));
             }
-            return extraStr; //Return any part of the string that was not sent. This occurs if the string is too long
+            
+            //The stream ended. A last record without a delimiter is still a record
+            if (messageSize == 0) {
+                if (this->recordBuffer.rest(record)) return true;
+                if (socketClosed != nullptr) *socketClosed = true;
+                return false;
+            }
+            
+            this->lastSeenTime = std::chrono::steady_clock::now();
+            this->recordBuffer.added(messageSize);
         }
-        return "";
+        return true;
     }
     
     /*!
-     * A function that receives a message from the host. The function will wait for a short period for the client to send the message, and if the message is not received it will throw an error. An error is also thrown if the socket is not set.
+     * A function that receives a given number of bytes from the host without holding them all at once. Each piece is passed to the sink as it arrives, and its memory is reused after the sink returns, so the memory used stays within RECEIVE_BUFFER_MAX however long the stream is. No byte past the length is read. Errors are thrown in the same cases as receive(), and if no data arrives within the timeout.
      *
-     * @param socketClosed An optional pointer to a bool that would be set to true if the client disconnected. Automatically set to a null pointer otherwise.
+     * @param sink A function called with each piece of data and its length.
+     * @param length The number of bytes to receive. ULONG_MAX receives until the host disconnects.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the host disconnected. Automatically set to a null pointer otherwise.
      *
-     * @return The received message from the host.
+     * @return The number of bytes received. Less than the length if the host disconnected first.
      */
-    std::string receive(bool* socketClosed = nullptr) {
+    unsigned long receiveStream(const std::function<void(const char*, unsigned long)>& sink, unsigned long length, bool* socketClosed = nullptr) {
         if (!this->setUp)
             throw std::logic_error("Socket not set");
         
-        //Initialize the buffer where received info is stored
-        bzero(this->buffer, BUFFER_SIZE);
+        unsigned long received = 0;
         
-        long messageSize; //Stores the return value from the calls to read() and write() by holding the number of characters either read or written
+        while (received < length) {
+            //Size the buffer by what is waiting, but never read past the end of the stream, so what follows it is left for the next receive
+            unsigned long waiting = 0;
+            if (this->sharedMemoryRing) {
+                waiting = this->sharedMemoryRing->available();
+            } else {
+                int available = 0;
+                if (ioctl(this->connectionSocket, FIONREAD, &available) == 0) waiting = available;
+            }
+            this->receiveBuffer.reserve(std::min(waiting, length - received));
+            unsigned long chunkSize = std::min((unsigned long)this->receiveBuffer.size(), length - received);
+            
+            long messageSize;
+            if (this->sharedMemoryRing) {
+                messageSize = this->sharedMemoryRing->read(this->receiveBuffer.data(), chunkSize, this->timeoutMilliseconds);
+                if (messageSize > 0) this->recordReply();
+            } else {
+                messageSize = this->readSocket(this->receiveBuffer.data(), chunkSize);
+            }
+            
+            if (messageSize < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("ERROR reading from socket: ") + std::string(strerror(errno)));
+            }
+            
+            //The host disconnected, which is the end of a stream of unknown length
+            if (messageSize == 0) {
+                if (socketClosed != nullptr) *socketClosed = true;
+                break;
+            }
+            
+            this->lastSeenTime = std::chrono::steady_clock::now();
+            
+            sink(this->receiveBuffer.data(), messageSize);
+            this->receiveBuffer.used(messageSize);
+            received += messageSize;
+        }
         
-        /* read()
-         The read() function will read in info from the client socket, with three arguments. It will block until the client writes and there is something to read in.
-         
-         The first argument is the reference for the client's socket.
-         
-         The second argument is the buffer to store the message.
-         
-         The third argument is the maximum number of characters to to be read into the buffer.
-         */
-        messageSize = read(this->connectionSocket, this->buffer, BUFFER_SIZE);
+        return received;
+    }
+    
+    /*!
+     * A function that sends data to the host as a source produces it, without holding it all at once. The source is asked for up to STREAM_CHUNK_SIZE bytes at a time, and each piece is sent in full before the next is asked for. Errors are thrown in the same cases as send(const char*, bool).
+     *
+     * @param source A function that fills the buffer it is given with up to the given number of bytes, and returns how many it filled. Returning 0 ends the stream.
+     *
+     * @return The number of bytes sent.
+     */
+    unsigned long sendStream(const std::function<unsigned long(char*, unsigned long)>& source) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
         
-        //Checks for errors reading from the socket
-        if (messageSize < 0)
-            throw std::runtime_error(strcat((char *)"ERROR reading from socket: ", strerror(errno)));
+        //One chunk is reused for the whole stream
+        std::unique_ptr<char[]> chunk(new char[STREAM_CHUNK_SIZE]);
+        unsigned long sent = 0;
         
-        if (socketClosed != nullptr && messageSize == 0) {
-            *socketClosed = true;
+        while (true) {
+            unsigned long chunkSize = std::min(source(chunk.get(), STREAM_CHUNK_SIZE), (unsigned long)STREAM_CHUNK_SIZE);
+            if (chunkSize == 0) break;
+            
+            sent += this->sendBytes(chunk.get(), chunkSize, true);
         }
         
-        std::string str = std::string(buffer, messageSize);
+        return sent;
+    }
+    
+    /*!
+     * A function that waits until something can be received from the host, without receiving it. A closed connection counts, since receiving then returns at once. An error is thrown if the socket is not set.
+     *
+     * @param timeoutMilliseconds The maximum time to wait, or a negative number to wait forever.
+     *
+     * @return True if there is something to receive, false if the time ran out.
+     */
+    bool waitForData(int timeoutMilliseconds) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
         
-        //Check if there is more data waiting to be read, and if so, read it
-        fd_set readfds;
-        FD_ZERO(&readfds);
-        FD_SET(this->connectionSocket, &readfds);
-        int n = this->connectionSocket + 1;
+        if (this->sharedMemoryRing)
+            return this->sharedMemoryRing->waitForData(timeoutMilliseconds);
         
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 20000;
+        pollfd pollInfo;
+        pollInfo.fd = this->connectionSocket;
+        pollInfo.events = POLLIN;
+        pollInfo.revents = 0;
         
-        int returnValue = select(n, &readfds, NULL, NULL, &timeout);
-        if (returnValue < 0) {
+        int returnValue;
+        while ((returnValue = poll(&pollInfo, 1, timeoutMilliseconds)) < 0 && errno == EINTR);
+        
+        if (returnValue < 0)
             throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
-        } else if (returnValue > 0) {
-            str += this->receive();
-        }
         
-        return str;
+        //POLLERR alone can be a notification, like a transmit timestamp, which is not data
+        return returnValue > 0 && (pollInfo.revents & (POLLIN | POLLHUP)) != 0;
     }
     
     /*!
@@ -223,8 +461,20 @@ public:
         if (!this->setUp)
             throw std::logic_error("Socket not set");
         
-        ::close(this->connectionSocket);
+        SOCKS_PROBE2(close, -1, this->sharedMemoryRing ? -1 : this->connectionSocket);
+        if (this->sharedMemoryRing) {
+            this->sharedMemoryRing->close();
+            this->sharedMemoryRing.reset();
+        } else {
+            ::close(this->connectionSocket);
+        }
         portNumber = 0;
+        this->receiveBuffer.release();
+        this->recordBuffer.release();
+        this->trace.reset();
+        this->timestamps = false;
+        this->awaitingReply = false;
+        this->fastOpenUsed = false;
         this->setUp = false;
     }
     
@@ -238,6 +488,8 @@ public:
         if (!this->setUp)
             throw std::logic_error("Socket not set");
         
+        this->timeoutMilliseconds = (seconds > 0 || milliseconds > 0) ? (seconds * 1000) + milliseconds : -1;
+        
 #if defined(_WIN32)
         DWORD timeout = (seconds * 1000) + milliseconds;
         setsockopt(this->hostSocket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
@@ -259,6 +511,198 @@ public:
 #endif
     }
     
+    /*!
+     * A function to enable heartbeats on the connection. Heartbeats are TCP keepalive probes: one is only sent after the connection has been idle for the given time, and it is answered by the host's kernel, so neither program is woken up and a busy connection pays nothing. If the host misses the given number of heartbeats in a row, the connection is considered dead (see isAlive()). To disable heartbeats, set idleSeconds to 0.
+     *
+     * @param idleSeconds The number of seconds the connection must be idle before the first heartbeat is sent. If 0, heartbeats are disabled.
+     * @param intervalSeconds An optional parameter indicating the number of seconds between unanswered heartbeats. Autoinitialized as 1.
+     * @param missedHeartbeats An optional parameter indicating how many heartbeats may go unanswered before the connection is considered dead. Autoinitialized as 3.
+     */
+    void setHeartbeat(unsigned int idleSeconds, unsigned int intervalSeconds = 1, unsigned int missedHeartbeats = 3) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        int enable = idleSeconds > 0 ? 1 : 0;
+        setsockopt(this->connectionSocket, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(int));
+        
+        if (intervalSeconds == 0) intervalSeconds = 1;
+        if (missedHeartbeats == 0) missedHeartbeats = 1;
+        
+#if defined(TCP_USER_TIMEOUT)
+        //Sent data that goes unacknowledged for as long as the heartbeats would is also treated as a dead connection. 0 restores the system default
+        unsigned int userTimeout = enable ? (idleSeconds + intervalSeconds * missedHeartbeats) * 1000 : 0;
+        setsockopt(this->connectionSocket, IPPROTO_TCP, TCP_USER_TIMEOUT, &userTimeout, sizeof(userTimeout));
+#endif
+        
+        if (!enable) return;
+        
+        int idle = idleSeconds;
+        int interval = intervalSeconds;
+        int count = missedHeartbeats;
+        
+#if defined(TCP_KEEPIDLE)
+        setsockopt(this->connectionSocket, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(int));
+#elif defined(TCP_KEEPALIVE)
+        setsockopt(this->connectionSocket, IPPROTO_TCP, TCP_KEEPALIVE, &idle, sizeof(int)); //macOS name for TCP_KEEPIDLE
+#endif
+#if defined(TCP_KEEPINTVL)
+        setsockopt(this->connectionSocket, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(int));
+#endif
+#if defined(TCP_KEEPCNT)
+        setsockopt(this->connectionSocket, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(int));
+#endif
+    }
+    
+    /*!
+     * A function that returns the last time the host was known to be alive. This is the later of the last time a message was received and the last time the host's kernel acknowledged anything, including a heartbeat. An error is thrown if the socket is not set.
+     *
+     * @return The last time the host was seen.
+     */
+    std::chrono::steady_clock::time_point lastSeen() const {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        std::chrono::steady_clock::time_point seen = this->lastSeenTime;
+        
+        if (this->sharedMemoryRing) return seen;
+        
+#if defined(__linux__)
+        //The kernel knows when the host last acknowledged anything, which includes heartbeats answered without waking either program
+        tcp_info info;
+        socklen_t infoSize = sizeof(info);
+        if (getsockopt(this->connectionSocket, IPPROTO_TCP, TCP_INFO, &info, &infoSize) == 0) {
+            std::chrono::steady_clock::time_point acknowledged = std::chrono::steady_clock::now() - std::chrono::milliseconds(info.tcpi_last_ack_recv);
+            if (acknowledged > seen) seen = acknowledged;
+        }
+#endif
+        
+        return seen;
+    }
+    
+    /*!
+     * A function that checks, without blocking, whether the connection is still alive. The connection is dead if the host closed it, if it was reset, or if heartbeats or sent data went unanswered (see setHeartbeat()). An error is thrown if the socket is not set.
+     *
+     * @return True if the connection is alive, false otherwise.
+     */
+    bool isAlive() const {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        //A shared memory connection is dead once the host closed it or its process exited, and everything it sent has been read
+        if (this->sharedMemoryRing)
+            return !this->sharedMemoryRing->peerClosed() || this->sharedMemoryRing->available() > 0;
+        
+        //A pending error means the connection was reset or that heartbeats or data went unanswered
+        int error = 0;
+        socklen_t errorSize = sizeof(error);
+        if (getsockopt(this->connectionSocket, SOL_SOCKET, SO_ERROR, &error, &errorSize) < 0 || error != 0)
+            return false;
+        
+        pollfd pollInfo;
+        pollInfo.fd = this->connectionSocket;
+        pollInfo.events = POLLIN;
+#if defined(POLLRDHUP)
+        pollInfo.events |= POLLRDHUP;
+#endif
+        pollInfo.revents = 0;
+        
+        //Check the state of the socket without waiting
+        if (poll(&pollInfo, 1, 0) < 0)
+            throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
+        
+        if (pollInfo.revents & (POLLERR | POLLHUP | POLLNVAL))
+            return false;
+        
+        //If the host closed its side, the connection is only dead once everything it sent has been read
+        if (pollInfo.revents & POLLIN) {
+            char byte;
+            if (recv(this->connectionSocket, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+                return false;
+        }
+        
+        return true;
+    }
+    
+    /*!
+     * @return The file descriptor of the TCP connection, so it can be waited on with poll() or handed to a Relay. -1 if the socket is not set or is connected through shared memory.
+     */
+    int connectionFD() const {
+        return this->setUp && !this->sharedMemoryRing ? this->connectionSocket : -1;
+    }
+    
+    /*!
+     * A function to turn latency tracing on or off. While on, the trace records the round trip from each send to the first reply received after it, and how long received data waited in the kernel before being read, using the kernel's software timestamps (SO_TIMESTAMPING, Linux only). Turning it off discards the trace. An error is thrown if the socket is not set.
+     *
+     * @param enable True to turn tracing on.
+     */
+    void setTracing(bool enable) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        if (!enable) {
+#if defined(SO_TIMESTAMPING)
+            if (this->timestamps) {
+                int flags = 0;
+                setsockopt(this->connectionSocket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+            }
+#endif
+            this->trace.reset();
+            this->timestamps = false;
+            this->awaitingReply = false;
+            return;
+        }
+        
+        if (this->trace) return;
+        this->trace.reset(new LatencyTrace());
+        
+        //A shared memory connection has no kernel in the way to timestamp
+        if (this->sharedMemoryRing) return;
+        
+#if defined(SO_TIMESTAMPING)
+        /* SO_TIMESTAMPING
+         The kernel timestamps data as it arrives, in software, so no hardware support is needed.
+         */
+        int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        this->timestamps = setsockopt(this->connectionSocket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+#endif
+    }
+    
+    /*!
+     * A function that gets the latency trace of the connection. An error is thrown if the socket is not set or if tracing is off.
+     *
+     * @return The trace. It stays valid until the socket is closed or tracing is turned off.
+     */
+    const LatencyTrace& latencyTrace() const {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        if (!this->trace)
+            throw std::logic_error("Tracing not on");
+        
+        return *this->trace;
+    }
+    
+    /*!
+     * A function to turn TCP Fast Open on or off for the next setSocket(). Once the client has connected to a host once and been given a cookie, later connections to it put the first send() in the SYN, so the host receives it a round trip sooner. The host must turn it on too (see ServerSocket::setFastOpen()). With a cookie, setSocket() returns without waiting for the handshake, so an unreachable host is only noticed by the first send(). For a host with several addresses, only the one tried first uses Fast Open, since a cookie shows it was reached before; the others are raced against it with a handshake as usual. Only works on Linux; elsewhere, connections are made normally.
+     *
+     * @param enable True to turn Fast Open on.
+     */
+    void setFastOpen(bool enable) {
+        this->fastOpen = enable;
+    }
+    
+    /*!
+     * A function that tells whether the connection was made with TCP Fast Open, so that setSocket() returned without a handshake and the first send() goes out in the SYN. It is false if Fast Open is off, if the client had no cookie for the host yet, or if the host was reached at an address other than the first. An error is thrown if the socket is not set.
+     *
+     * @return True if the connection was made with Fast Open.
+     */
+    bool usedFastOpen() const {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        return this->fastOpenUsed;
+    }
+    
     /*!
      * @return If this object is set.
      */
@@ -272,7 +716,340 @@ private:
     int connectionSocket; //This is the "file descriptor", which stores values from both the socket system call and the accept system call
     int portNumber; //The port nubmer where connections are accepted
     
-    char buffer[BUFFER_SIZE];
+    ReceiveBuffer receiveBuffer; //What receive() reads into, sized to the traffic
+    RecordBuffer recordBuffer; //Records received but not yet taken by receiveRecord()
+    
+    std::chrono::steady_clock::time_point lastSeenTime; //The last time a message was received from the host
+    
+    std::unique_ptr<SharedMemoryRing> sharedMemoryRing; //The shared memory connection to the host. Null when connected through TCP
+    
+    int timeoutMilliseconds = -1; //The timeout set with setTimeout(), for a shared memory connection. -1 if there is none
+    
+    bool fastOpen = false; //True if setFastOpen() turned TCP Fast Open on
+    bool fastOpenUsed = false; //True if the connection was made with a Fast Open cookie, without a handshake
+    
+    std::unique_ptr<LatencyTrace> trace; //The latency trace while tracing is on. Null otherwise
+    bool timestamps = false; //True if the kernel accepted SO_TIMESTAMPING for this connection
+    bool awaitingReply = false; //True if something was sent since the last reply
+    std::chrono::steady_clock::time_point requestTime; //When the first send since the last reply started
+    
+    //Private member functions
+    
+    /*!
+     * A function that connects to the first of a list of addresses to answer, racing them with staggered starts.
+     *
+     * @param addressList The addresses from getaddrinfo().
+     * @param timeoutMilliseconds How long to try for, or 0 to wait until every address has failed.
+     *
+     * @return The connected socket, which blocks like any other.
+     */
+    int connectToAny(const addrinfo* addressList, unsigned int timeoutMilliseconds) {
+        //Alternate between address families, starting with the one getaddrinfo() preferred, so a broken IPv6 route costs one attempt delay rather than every IPv6 address
+        std::vector<const addrinfo*> addresses;
+        std::vector<const addrinfo*> otherFamily;
+        for (const addrinfo* address = addressList; address != nullptr; address = address->ai_next) {
+            if (address->ai_family == addressList->ai_family) {
+                addresses.push_back(address);
+            } else {
+                otherFamily.push_back(address);
+            }
+        }
+        for (size_t a = 0; a < otherFamily.size(); a++) {
+            addresses.insert(addresses.begin() + std::min(a * 2 + 1, addresses.size()), otherFamily[a]);
+        }
+        
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point deadline = now + std::chrono::milliseconds(timeoutMilliseconds);
+        std::chrono::steady_clock::time_point nextStart = now;
+        
+        std::vector<pollfd> attempts; //The connections still in progress
+        size_t nextAddress = 0;
+        int lastError = ETIMEDOUT; //Reported if every attempt fails
+        int connectedSocket = -1;
+        this->fastOpenUsed = false;
+        
+        while (connectedSocket < 0) {
+            now = std::chrono::steady_clock::now();
+            
+            //Start the next address once the last one has had CONNECT_ATTEMPT_DELAY milliseconds, or straight away if nothing else is in progress
+            if (nextAddress < addresses.size() && (now >= nextStart || attempts.empty())) {
+                bool first = nextAddress == 0;
+                const addrinfo* address = addresses[nextAddress++];
+                nextStart = now + std::chrono::milliseconds(CONNECT_ATTEMPT_DELAY);
+                
+                /* socket()
+                 The socket() function returns a new socket, with three parameters.
+                 
+                 The first argument is address of the domain of the socket.
+                 The two possible address domains are the unix, for commen file system sockets, and the internet, for anywhere on the internet.
+                 AF_UNIX is generally used for the former, and AF_INET generally for the latter.
+                 
+                 The second argument is the type of the socket.
+                 The two possible types are a stream socket where characters are read in a continuous stream, and a diagram socket, which reads in chunks.
+                 SOCK_STREAM is generally used for the former, and SOCK_DGRAM for the latter.
+                 
+                 The third argument is the protocol. It should always be 0 except in unusual circumstances, and then allows the operating system to chose TCP or UDP, based on the socket type. TCP is chosen for stream sockets, and UDP for diagram sockets
+                 
+                 The function returns an integer than can be used like a reference to the socket. Failure results in returning -1.
+                 */
+                //In this case, the values are taken from getaddrinfo()
+                int socketFD = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+                if (socketFD < 0) {
+                    lastError = errno;
+                    continue;
+                }
+                
+                //The socket doesn't block while connecting, so several addresses can be tried at once
+                fcntl(socketFD, F_SETFL, fcntl(socketFD, F_GETFL) | O_NONBLOCK);
+                
+                bool fastOpenRequested = false;
+#if defined(TCP_FASTOPEN_CONNECT)
+                //With a cookie from an earlier connection, connect() succeeds at once without sending anything, and the SYN goes out with the first write. Without one, the handshake happens as usual and a cookie is asked for. A cookie means the address was reached before, so it is fair for it to win the race, but only the preferred address gets the chance; the rest shake hands so the race still picks among them
+                if (this->fastOpen && first) {
+                    int enable = 1;
+                    fastOpenRequested = setsockopt(socketFD, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &enable, sizeof(int)) == 0;
+                }
+#endif
+                
+                //No need to call bind() (see server side) because the local port number doesn't matter; the kernel will find an open port.
+                
+                /* connect()
+                 The connect() function is called by the client to establish a connection with the server, with three arguments.
+                 
+                 The first argument is the small integer reference for the socket.
+                 
+                 The second argument is the address of the host to connect to, including the port number, all in the form of a sockaddr struct.
+                 
+                 The third argument is the size of the address.
+                 
+                 The function returns 0 if successful and -1 if it fails. Since the socket doesn't block, it fails with EINPROGRESS while the connection is being made.
+                 */
+                if (connect(socketFD, address->ai_addr, address->ai_addrlen) == 0) {
+                    connectedSocket = socketFD;
+                    this->fastOpenUsed = fastOpenRequested; //A non-blocking connect() only finishes at once by deferring the handshake
+                } else if (errno == EINPROGRESS) {
+                    pollfd attempt;
+                    attempt.fd = socketFD;
+                    attempt.events = POLLOUT;
+                    attempt.revents = 0;
+                    attempts.push_back(attempt);
+                } else {
+                    lastError = errno;
+                    ::close(socketFD);
+                }
+                continue;
+            }
+            
+            //Every address failed
+            if (attempts.empty()) break;
+            
+            if (timeoutMilliseconds > 0 && now >= deadline) {
+                lastError = ETIMEDOUT;
+                break;
+            }
+            
+            //Wait for an attempt to finish, or until the next address should start
+            std::chrono::steady_clock::time_point wakeTime = nextAddress < addresses.size() ? nextStart : deadline;
+            if (timeoutMilliseconds > 0) wakeTime = std::min(wakeTime, deadline);
+            int waitMilliseconds = (nextAddress < addresses.size() || timeoutMilliseconds > 0) ? (int)std::max((long long)std::chrono::duration_cast<std::chrono::milliseconds>(wakeTime - now).count() + 1, 1LL) : -1;
+            
+            if (poll(attempts.data(), attempts.size(), waitMilliseconds) < 0) {
+                if (errno == EINTR) continue;
+                lastError = errno;
+                break;
+            }
+            
+            //Go backwards so failed attempts can be removed while iterating
+            for (int a = (int)attempts.size() - 1; a >= 0 && connectedSocket < 0; a--) {
+                if (attempts[a].revents == 0) continue;
+                
+                int error = 0;
+                socklen_t errorSize = sizeof(error);
+                if (getsockopt(attempts[a].fd, SOL_SOCKET, SO_ERROR, &error, &errorSize) < 0) error = errno;
+                
+                if (error == 0) {
+                    connectedSocket = attempts[a].fd;
+                    attempts.erase(attempts.begin() + a);
+                } else {
+                    lastError = error;
+                    ::close(attempts[a].fd);
+                    attempts.erase(attempts.begin() + a);
+                    nextStart = now; //A failed address doesn't hold up the next one
+                }
+            }
+        }
+        
+        //Abandon the attempts that lost the race
+        for (size_t a = 0; a < attempts.size(); a++) {
+            ::close(attempts[a].fd);
+        }
+        
+        if (connectedSocket < 0)
+            throw std::runtime_error(std::string("ERROR connecting: ") + std::string(strerror(lastError)));
+        
+        //The rest of the class expects a blocking socket
+        fcntl(connectedSocket, F_SETFL, fcntl(connectedSocket, F_GETFL) & ~O_NONBLOCK);
+        return connectedSocket;
+    }
+    
+    /*!
+     * A function that writes a message to the host, continuing from where each write stopped. It does all the checks for the public send functions.
+     *
+     * @param data The bytes to be sent.
+     * @param length The number of bytes to be sent.
+     * @param ensureFullStringSent If true, keep writing until the whole message is sent. Otherwise, write once.
+     *
+     * @return The number of bytes sent.
+     */
+    unsigned long sendBytes(const char* data, unsigned long length, bool ensureFullStringSent) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        //Empty messages won't be sent
+        if (length == 0)
+            throw std::logic_error("No message to send");
+        
+        //A round trip is timed from the first send after a reply, so a request sent in pieces is one round trip
+        if (this->trace && !this->awaitingReply) this->requestTime = std::chrono::steady_clock::now();
+        
+        unsigned long sent = 0;
+        
+        //Write from where the last write stopped, instead of copying what is left and starting again
+        while (sent < length) {
+            long sentSize;
+            if (this->sharedMemoryRing) {
+                sentSize = this->sharedMemoryRing->write(data + sent, length - sent, ensureFullStringSent);
+            } else {
+                sentSize = write(this->connectionSocket, data + sent, length - sent);
+                if (sentSize >= 0) {
+                    SOCKS_PROBE4(write, -1, this->connectionSocket, length - sent, sentSize);
+                    if ((unsigned long)sentSize < length - sent) SOCKS_PROBE4(partial_write, -1, this->connectionSocket, length - sent, sentSize);
+                }
+            }
+            
+            if (sentSize < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("ERROR sending message: ") + std::string(strerror(errno)));
+            }
+            
+            sent += sentSize;
+            
+            //Unless the full message must be sent, stop after one write and let the caller deal with the rest
+            if (!ensureFullStringSent || sentSize == 0) break;
+        }
+        
+        if (this->trace && sent > 0) this->awaitingReply = true;
+        return sent;
+    }
+    
+    /*!
+     * A function that reads an exact number of bytes from the host, waiting for as many reads as it takes. It does all the checks for the public receive functions.
+     *
+     * @param data Where to put the bytes.
+     * @param length The number of bytes to read.
+     * @param socketClosed If not a null pointer, set to true if the host disconnected.
+     *
+     * @return True if all the bytes were read, false if the host disconnected first.
+     */
+    bool receiveBytes(char* data, unsigned long length, bool* socketClosed) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        //Keep reading until the whole length has arrived, since it may come in pieces
+        unsigned long received = 0;
+        while (received < length) {
+            long messageSize;
+            if (this->sharedMemoryRing) {
+                messageSize = this->sharedMemoryRing->read(data + received, length - received, this->timeoutMilliseconds);
+                if (messageSize > 0) this->recordReply();
+            } else {
+                messageSize = this->readSocket(data + received, length - received);
+            }
+            
+            if (messageSize < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("ERROR reading from socket: ") + std::string(strerror(errno)));
+            }
+            
+            //The host disconnected before the whole length arrived
+            if (messageSize == 0) {
+                if (socketClosed != nullptr) *socketClosed = true;
+                return false;
+            }
+            
+            received += messageSize;
+        }
+        
+        this->lastSeenTime = std::chrono::steady_clock::now();
+        return true;
+    }
+    
+    /*!
+     * A function that reads from the socket. While tracing, the kernel's receive timestamp is read along with the data.
+     *
+     * @param data Where to put the bytes.
+     * @param length The most bytes to read.
+     *
+     * @return The number of bytes read, 0 if the host disconnected, or -1 if an error occurred, with errno set.
+     */
+    long readSocket(char* data, unsigned long length) {
+        long messageSize;
+        
+#if defined(SO_TIMESTAMPING)
+        if (this->timestamps) {
+            iovec piece;
+            piece.iov_base = data;
+            piece.iov_len = length;
+            
+            char control[256];
+            msghdr message;
+            memset(&message, 0, sizeof(message));
+            message.msg_iov = &piece;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            
+            messageSize = recvmsg(this->connectionSocket, &message, 0);
+            
+            //The kernel's receive time comes with the data. Subtracting it from now is the time the data sat in the kernel before this read
+            if (messageSize > 0) {
+                for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+                    if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_TIMESTAMPING) continue;
+                    
+                    scm_timestamping* stamps = (scm_timestamping*)CMSG_DATA(header);
+                    uint64_t received = (uint64_t)stamps->ts[0].tv_sec * 1000000000 + stamps->ts[0].tv_nsec;
+                    uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                    if (received != 0 && now > received) this->trace->receiveQueue.record(now - received);
+                }
+            }
+        } else {
+            messageSize = read(this->connectionSocket, data, length);
+        }
+#else
+        messageSize = read(this->connectionSocket, data, length);
+#endif
+        
+        //A read that fails with EAGAIN timed out, since the socket only stops blocking through setTimeout()
+        if (messageSize >= 0) {
+            SOCKS_PROBE3(read, -1, this->connectionSocket, messageSize);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            SOCKS_PROBE2(timeout, -1, this->connectionSocket);
+        }
+        
+        if (messageSize > 0) this->recordReply();
+        return messageSize;
+    }
+    
+    /*!
+     * A function that records the round trip of the last request, if tracing is on and the request has not been answered yet. Called when data arrives.
+     */
+    void recordReply() {
+        //Only the first data after a send is the reply to it
+        if (this->trace && this->awaitingReply) {
+            this->trace->roundTrip.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->requestTime).count());
+            this->awaitingReply = false;
+        }
+    }
     
     bool setUp = false; //Represents if the socket has already been set. If not, reading and writing will cause errors
 };
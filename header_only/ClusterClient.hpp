@@ -0,0 +1,312 @@
+#ifndef ClusterClient_hpp
+#define ClusterClient_hpp
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <utility>
+#include <exception>
+#include <cstdint>
+
+#include "ClientSocket.hpp"
+
+#define CLUSTER_VIRTUAL_NODES 160 //Points each node gets on the hash ring. More points spread keys more evenly
+#define CLUSTER_LOAD_FACTOR 1.25 //How far above the average load a node may go before its keys spill over to the next node on the ring
+
+/*
+ A ClusterClient holds a ClientSocket to each of several servers and picks which one a request goes to. Requests with a key go to the node the key hashes to on a consistent hash ring, so the same key keeps going to the same server. Each node has many points on the ring, so keys are spread evenly, and a node is only given a key while its load is within CLUSTER_LOAD_FACTOR of the average, so one hot key can't swamp a server. Requests without a key take turns between the nodes.
+
+ A node taken out of rotation keeps its points on the ring and is skipped, so only its own keys move, and they move back when it returns. Nodes are placed on the ring by host and port, not by the order they were added, so every client with the same nodes sends a key to the same server.
+
+ The load of a node is the number of requests routed to it that have not been marked finished.
+ */
+class ClusterClient {
+public:
+    //Constructor
+    ClusterClient(unsigned int virtualNodes = CLUSTER_VIRTUAL_NODES, double loadFactor = CLUSTER_LOAD_FACTOR) {
+        if (virtualNodes == 0)
+            throw std::logic_error("A node needs at least one point on the ring");
+        if (loadFactor < 1)
+            throw std::logic_error("Load factor below 1");
+        
+        this->virtualNodes = virtualNodes;
+        this->loadFactor = loadFactor;
+    }
+    
+    //Public member functions
+    
+    /*!
+     * A function that adds a server to the cluster and connects to it. If it cannot be connected to, it is added out of rotation, and can be brought in later with reconnect().
+     *
+     * @param hostName The name of the server.
+     * @param portNum The port on the server.
+     * @param connectTimeoutMilliseconds An optional parameter indicating how long to try connecting for. Autoinitialized as CONNECT_TIMEOUT.
+     *
+     * @return The index of the node.
+     */
+    unsigned int addNode(const char* hostName, int portNum, unsigned int connectTimeoutMilliseconds = CONNECT_TIMEOUT) {
+        unsigned int nodeIndex = (unsigned int)this->nodes.size();
+        this->nodes.emplace_back();
+        this->nodes.back().hostName = hostName;
+        this->nodes.back().portNum = portNum;
+        
+        //Place the node's points by its address, so the ring doesn't depend on the order nodes were added in
+        std::string label = std::string(hostName) + ":" + std::to_string(portNum) + "#";
+        for (unsigned int a = 0; a < this->virtualNodes; a++)
+            this->ring.emplace_back(hashOf(label + std::to_string(a)), nodeIndex);
+        std::sort(this->ring.begin(), this->ring.end());
+        
+        this->reconnect(nodeIndex, connectTimeoutMilliseconds);
+        return nodeIndex;
+    }
+    
+    /*!
+     * A function that picks the node for a key: the first node clockwise from the key on the ring that is in rotation and within the load bound. The request counts towards the node's load until finished() is called. Will throw an error if no node is in rotation.
+     *
+     * @param key The key of the request.
+     *
+     * @return The index of the node.
+     */
+    unsigned int route(std::string_view key) {
+        if (this->healthyNodes == 0)
+            throw std::runtime_error("ERROR routing request: No node in rotation");
+        
+        unsigned int bound = this->loadBound();
+        
+        //Walk clockwise from the key. Since the bound is above the average load, some node in rotation always has room
+        auto start = std::lower_bound(this->ring.begin(), this->ring.end(), std::make_pair(hashOf(key), 0u));
+        size_t position = start - this->ring.begin();
+        for (size_t a = 0; a < this->ring.size(); a++) {
+            unsigned int nodeIndex = this->ring[(position + a) % this->ring.size()].second;
+            if (this->nodes[nodeIndex].healthy && this->nodes[nodeIndex].inFlight < bound) return this->assign(nodeIndex);
+        }
+        
+        throw std::runtime_error("ERROR routing request: No node in rotation");
+    }
+    
+    /*!
+     * A function that picks a node for a request without a key, taking turns between the nodes in rotation that are within the load bound. The request counts towards the node's load until finished() is called. Will throw an error if no node is in rotation.
+     *
+     * @return The index of the node.
+     */
+    unsigned int route() {
+        if (this->healthyNodes == 0)
+            throw std::runtime_error("ERROR routing request: No node in rotation");
+        
+        unsigned int bound = this->loadBound();
+        
+        for (unsigned int a = 0; a < this->nodes.size(); a++) {
+            unsigned int nodeIndex = (this->nextUnkeyed + a) % this->nodes.size();
+            if (this->nodes[nodeIndex].healthy && this->nodes[nodeIndex].inFlight < bound) {
+                this->nextUnkeyed = nodeIndex + 1;
+                return this->assign(nodeIndex);
+            }
+        }
+        
+        throw std::runtime_error("ERROR routing request: No node in rotation");
+    }
+    
+    /*!
+     * A function that marks a request to a node as finished, so it no longer counts towards the node's load.
+     *
+     * @param nodeIndex The index of the node.
+     */
+    void finished(unsigned int nodeIndex) {
+        this->checkIndex(nodeIndex);
+        
+        //A node taken out of rotation has already dropped its load
+        if (this->nodes[nodeIndex].inFlight > 0) {
+            this->nodes[nodeIndex].inFlight--;
+            this->totalInFlight--;
+        }
+    }
+    
+    /*!
+     * @param nodeIndex The index of the node.
+     *
+     * @return The connection to the node. Only set while the node is in rotation.
+     */
+    ClientSocket& connection(unsigned int nodeIndex) {
+        this->checkIndex(nodeIndex);
+        return *this->nodes[nodeIndex].socket;
+    }
+    
+    /*!
+     * A function that takes a node out of rotation and closes its connection, for example after a send or receive to it failed. Its keys go to the next nodes on the ring until it is reconnected.
+     *
+     * @param nodeIndex The index of the node.
+     */
+    void markDown(unsigned int nodeIndex) {
+        this->checkIndex(nodeIndex);
+        
+        Node& node = this->nodes[nodeIndex];
+        if (!node.healthy) return;
+        
+        //The node is being dropped anyway, so a failure to close it cleanly changes nothing
+        try {
+            node.socket->close();
+        } catch (const std::exception&) {}
+        node.healthy = false;
+        this->healthyNodes--;
+        this->totalInFlight -= node.inFlight;
+        node.inFlight = 0;
+    }
+    
+    /*!
+     * A function that takes every node whose connection has died out of rotation (see ClientSocket::isAlive()). It does not block, so it can be called before every request.
+     *
+     * @return The number of nodes taken out of rotation.
+     */
+    unsigned int checkHealth() {
+        unsigned int removed = 0;
+        for (unsigned int a = 0; a < this->nodes.size(); a++) {
+            if (this->nodes[a].healthy && !this->nodes[a].socket->isAlive()) {
+                this->markDown(a);
+                removed++;
+            }
+        }
+        return removed;
+    }
+    
+    /*!
+     * A function that tries to connect to a node out of rotation again, and puts it back in rotation if it connects. Nothing is done to a node already in rotation.
+     *
+     * @param nodeIndex The index of the node.
+     * @param connectTimeoutMilliseconds An optional parameter indicating how long to try connecting for. Autoinitialized as CONNECT_TIMEOUT.
+     *
+     * @return True if the node is in rotation.
+     */
+    bool reconnect(unsigned int nodeIndex, unsigned int connectTimeoutMilliseconds = CONNECT_TIMEOUT) {
+        this->checkIndex(nodeIndex);
+        
+        Node& node = this->nodes[nodeIndex];
+        if (node.healthy) return true;
+        
+        node.socket.reset(new ClientSocket());
+        try {
+            node.socket->setSocket(node.hostName.c_str(), node.portNum, connectTimeoutMilliseconds);
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+        
+        node.healthy = true;
+        this->healthyNodes++;
+        return true;
+    }
+    
+    /*!
+     * @param nodeIndex The index of the node.
+     *
+     * @return If the node is in rotation.
+     */
+    bool isHealthy(unsigned int nodeIndex) const {
+        this->checkIndex(nodeIndex);
+        return this->nodes[nodeIndex].healthy;
+    }
+    
+    /*!
+     * @param nodeIndex The index of the node.
+     *
+     * @return The number of unfinished requests routed to the node.
+     */
+    unsigned int load(unsigned int nodeIndex) const {
+        this->checkIndex(nodeIndex);
+        return this->nodes[nodeIndex].inFlight;
+    }
+    
+    /*!
+     * @return The number of nodes, in rotation or not.
+     */
+    unsigned int numberOfNodes() const {
+        return (unsigned int)this->nodes.size();
+    }
+    
+    /*!
+     * @return The number of nodes in rotation.
+     */
+    unsigned int numberOfHealthyNodes() const {
+        return this->healthyNodes;
+    }
+    
+private:
+    //Private properties
+    
+    struct Node {
+        std::string hostName;
+        int portNum = 0;
+        std::unique_ptr<ClientSocket> socket; //Replaced on every reconnect, so a failed connection never leaves it half set
+        bool healthy = false;
+        unsigned int inFlight = 0; //Requests routed here and not yet finished
+    };
+    std::vector<Node> nodes;
+    
+    std::vector<std::pair<uint64_t, unsigned int>> ring; //Each node's points, as hash and node index, sorted by hash
+    
+    unsigned int virtualNodes;
+    double loadFactor;
+    
+    unsigned int healthyNodes = 0;
+    unsigned int totalInFlight = 0; //Across the nodes in rotation
+    unsigned int nextUnkeyed = 0; //The node the next request without a key starts looking from
+    
+    //Private member functions
+    
+    /*!
+     * A function that hashes bytes the same way in every process and on every machine, so all clients agree on the ring.
+     *
+     * @param bytes The bytes to hash.
+     *
+     * @return The hash.
+     */
+    static uint64_t hashOf(std::string_view bytes) {
+        //FNV-1a, then a final mix so that similar labels land far apart on the ring
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char byte : bytes) {
+            hash ^= byte;
+            hash *= 1099511628211ull;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+    
+    /*!
+     * @return The most unfinished requests a node may have and still be given another.
+     */
+    unsigned int loadBound() const {
+        //Counting the request being routed, so an idle cluster still has room
+        double average = (double)(this->totalInFlight + 1) / this->healthyNodes;
+        unsigned int bound = (unsigned int)(average * this->loadFactor);
+        return bound < average * this->loadFactor ? bound + 1 : bound;
+    }
+    
+    /*!
+     * A function that counts a request towards a node's load.
+     *
+     * @param nodeIndex The index of the node.
+     *
+     * @return The index of the node.
+     */
+    unsigned int assign(unsigned int nodeIndex) {
+        this->nodes[nodeIndex].inFlight++;
+        this->totalInFlight++;
+        return nodeIndex;
+    }
+    
+    /*!
+     * A function that throws an error if there is no node at an index.
+     *
+     * @param nodeIndex The index.
+     */
+    void checkIndex(unsigned int nodeIndex) const {
+        if (nodeIndex >= this->nodes.size())
+            throw std::logic_error("Node index out of range");
+    }
+};
+
+#endif /* ClusterClient_hpp */
@@ -0,0 +1,293 @@
+#ifndef HostResolver_hpp
+#define HostResolver_hpp
+
+#include <string>
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <exception>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#define RESOLVER_TTL 60000 //Milliseconds a resolved host is reused for. getaddrinfo() doesn't report the DNS record's own TTL
+#define RESOLVER_NEGATIVE_TTL 5000 //Milliseconds a failed lookup is remembered for, so a missing host doesn't cost a lookup on every retry
+#define RESOLVER_THREADS 2 //Helper threads for resolveAsync()
+
+/*
+ A HostResolver looks up host names with getaddrinfo() and caches the results. There is one for the whole process, shared by every ClientSocket and ServerSocket, so reconnecting to a known host doesn't wait on a lookup. Lookups of the same host at the same time share one call to getaddrinfo().
+
+ Results are addrinfo lists, which stay valid for as long as the shared pointer to them is held, even after they expire from the cache.
+ */
+class HostResolver {
+public:
+    //Public types
+    
+    typedef std::shared_ptr<const addrinfo> Addresses;
+    
+    //Constructor
+    HostResolver() {}
+    
+    //Destructor
+    ~HostResolver() {
+        std::deque<Job> unstarted;
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->stopping = true;
+            unstarted.swap(this->jobs);
+        }
+        this->jobAdded.notify_all();
+        
+        //Anyone waiting on a lookup that never started gets an error, rather than the broken promise they would get when it is destroyed
+        for (size_t a = 0; a < unstarted.size(); a++) {
+            unstarted[a].promise->set_exception(std::make_exception_ptr(std::runtime_error("ERROR getting host address: Resolver stopped")));
+        }
+        
+        //Lookups already running finish before their thread is joined
+        for (size_t a = 0; a < this->helpers.size(); a++) {
+            if (this->helpers[a].joinable()) this->helpers[a].join();
+        }
+    }
+    
+    //Static functions
+    
+    /*!
+     * @return The resolver shared by the whole process.
+     */
+    static HostResolver& shared() {
+        static HostResolver resolver;
+        return resolver;
+    }
+    
+    //Public member functions
+    
+    /*!
+     * A function that looks up the addresses of a host, waiting for the result. A result in the cache is returned without a lookup. Will throw an error if the host cannot be resolved, including if that was found out by an earlier lookup that is still cached.
+     *
+     * @param hostName The name of the host. A null pointer means the local host, for a server.
+     * @param portNum The port to connect to or listen on.
+     * @param passive An optional parameter that looks up addresses to listen on, rather than to connect to. Automatically set to false.
+     *
+     * @return The addresses, in the order getaddrinfo() prefers them.
+     */
+    Addresses resolve(const char* hostName, int portNum, bool passive = false) {
+        std::function<void()> lookup;
+        std::shared_ptr<std::promise<Addresses>> promise;
+        std::shared_future<Addresses> addresses;
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            addresses = this->findOrAdd(hostName, portNum, passive, lookup, promise);
+        }
+        
+        //A new lookup runs on this thread, since it would have to be waited for anyway
+        if (lookup) lookup();
+        
+        return addresses.get();
+    }
+    
+    /*!
+     * A function that starts looking up the addresses of a host on a helper thread, and returns at once. A later resolve() of the same host waits for this lookup rather than starting another, so it can be used to look up hosts before they are needed. Can be called from any thread.
+     *
+     * @param hostName The name of the host. A null pointer means the local host, for a server.
+     * @param portNum The port to connect to or listen on.
+     * @param passive An optional parameter that looks up addresses to listen on, rather than to connect to. Automatically set to false.
+     *
+     * @return A future holding the addresses. Getting it throws an error if the host cannot be resolved.
+     */
+    std::shared_future<Addresses> resolveAsync(const char* hostName, int portNum, bool passive = false) {
+        Job job;
+        std::lock_guard<std::mutex> guard(this->lock);
+        std::shared_future<Addresses> addresses = this->findOrAdd(hostName, portNum, passive, job.lookup, job.promise);
+        
+        if (job.lookup) {
+            if (this->helpers.empty()) {
+                for (int a = 0; a < RESOLVER_THREADS; a++) {
+                    this->helpers.push_back(std::thread(&HostResolver::runHelper, this));
+                }
+            }
+            this->jobs.push_back(std::move(job));
+            this->jobAdded.notify_one();
+        }
+        
+        return addresses;
+    }
+    
+    /*!
+     * A function that removes a host from the cache, so the next lookup asks again. Useful when none of the cached addresses could be connected to.
+     *
+     * @param hostName The name of the host.
+     * @param portNum The port.
+     * @param passive An optional parameter for addresses that were looked up to listen on. Automatically set to false.
+     */
+    void forget(const char* hostName, int portNum, bool passive = false) {
+        std::lock_guard<std::mutex> guard(this->lock);
+        
+        //A lookup in progress is left alone, since it is already asking again
+        std::map<std::string, CacheEntry>::iterator entry = this->cache.find(keyOf(hostName, portNum, passive));
+        if (entry != this->cache.end() && entry->second.expiry != std::chrono::steady_clock::time_point::max()) this->cache.erase(entry);
+    }
+    
+    /*!
+     * A function that sets how long results are cached for. Results already cached keep the time they were given.
+     *
+     * @param milliseconds How long resolved hosts are reused for. 0 turns caching off.
+     * @param negativeMilliseconds How long failed lookups are remembered for. 0 turns negative caching off.
+     */
+    void setTTL(unsigned int milliseconds, unsigned int negativeMilliseconds) {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->ttl = milliseconds;
+        this->negativeTTL = negativeMilliseconds;
+    }
+    
+    /*!
+     * A function that empties the cache.
+     */
+    void clear() {
+        std::lock_guard<std::mutex> guard(this->lock);
+        
+        //Lookups in progress stay, so whoever is waiting on them still gets the result
+        for (std::map<std::string, CacheEntry>::iterator entry = this->cache.begin(); entry != this->cache.end();) {
+            if (entry->second.expiry != std::chrono::steady_clock::time_point::max()) {
+                entry = this->cache.erase(entry);
+            } else {
+                entry++;
+            }
+        }
+    }
+    
+private:
+    //Private properties
+    
+    struct CacheEntry {
+        std::shared_future<Addresses> addresses; //Not ready while the lookup is in progress
+        std::chrono::steady_clock::time_point expiry = std::chrono::steady_clock::time_point::max(); //Set once the lookup finishes
+        unsigned long lookupID = 0; //Tells a finished lookup whether its entry was replaced in the meantime
+    };
+    std::map<std::string, CacheEntry> cache; //Keyed by host, port and whether the lookup was passive
+    unsigned long nextLookupID = 1;
+    
+    unsigned int ttl = RESOLVER_TTL;
+    unsigned int negativeTTL = RESOLVER_NEGATIVE_TTL;
+    
+    struct Job {
+        std::function<void()> lookup;
+        std::shared_ptr<std::promise<Addresses>> promise; //Failed with an error if the resolver is destroyed before the lookup runs
+    };
+    std::deque<Job> jobs; //Lookups waiting for a helper thread
+    std::vector<std::thread> helpers; //Started by the first resolveAsync()
+    bool stopping = false;
+    
+    std::mutex lock; //Guards everything above
+    std::condition_variable jobAdded;
+    
+    //Private member functions
+    
+    /*!
+     * @return The key a host is cached under.
+     */
+    static std::string keyOf(const char* hostName, int portNum, bool passive) {
+        return std::string(hostName != nullptr ? hostName : "") + ":" + std::to_string(portNum) + (passive ? ":passive" : "");
+    }
+    
+    /*!
+     * A function that finds a host in the cache, or adds an entry for it if it isn't there or has expired. Must be called with the lock held.
+     *
+     * @param hostName The name of the host, or a null pointer for the local host.
+     * @param portNum The port.
+     * @param passive If the lookup is for addresses to listen on.
+     * @param lookup Set to a function that does the lookup if a new entry was added, so the caller can run it after releasing the lock. Otherwise left empty.
+     * @param promise Set to the promise the lookup fulfills if a new entry was added. Otherwise left empty.
+     *
+     * @return The future of the entry.
+     */
+    std::shared_future<Addresses> findOrAdd(const char* hostName, int portNum, bool passive, std::function<void()>& lookup, std::shared_ptr<std::promise<Addresses>>& promise) {
+        std::string key = keyOf(hostName, portNum, passive);
+        
+        std::map<std::string, CacheEntry>::iterator entry = this->cache.find(key);
+        if (entry != this->cache.end() && std::chrono::steady_clock::now() < entry->second.expiry) return entry->second.addresses;
+        
+        promise.reset(new std::promise<Addresses>());
+        
+        CacheEntry& newEntry = this->cache[key];
+        newEntry.addresses = promise->get_future().share();
+        newEntry.expiry = std::chrono::steady_clock::time_point::max();
+        newEntry.lookupID = this->nextLookupID++;
+        
+        unsigned long lookupID = newEntry.lookupID;
+        bool hasHostName = hostName != nullptr;
+        std::string host = hasHostName ? hostName : "";
+        
+        lookup = [this, key, lookupID, hasHostName, host, portNum, passive, promise]() {
+            addrinfo hints; //A struct containing information on the address. Will be passed to getaddrinfo() to give hints about the connection to be made
+            addrinfo* addressList; //A pointer to an addrinfo struct that will be filled with the addresses by getaddrinfo()
+            
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC; //Can be either IPv4 or IPv6
+            hints.ai_socktype = SOCK_STREAM; //TCP Socket
+            if (passive) hints.ai_flags = AI_PASSIVE; //Addresses to accept connections on (as server socket)
+            
+            /* getaddrinfo
+             The getaddrinfo() fills a given addrinfo struct with the relevant information. The return value is nonzero when there is an error.
+             
+             The first argument is the name of the host to connect with.
+             
+             The second argument is a string representation of the port number.
+             
+             The third argument is a pointer to an addrinfo struct which contains hints about the type of connection to be made.
+             
+             The fourth argument is a pointer which will be filled with a linked list of hosts returned.
+             */
+            int returnVal = getaddrinfo(hasHostName ? host.c_str() : NULL, std::to_string(portNum).c_str(), &hints, &addressList);
+            
+            if (returnVal == 0) {
+                promise->set_value(Addresses(addressList, freeaddrinfo)); //The list is freed when the last user lets go of it
+            } else {
+                promise->set_exception(std::make_exception_ptr(std::runtime_error(std::string("ERROR getting host address: ") + std::string(gai_strerror(returnVal)))));
+            }
+            
+            //Start the entry's time to live now that the lookup is finished, unless it was replaced or removed in the meantime
+            std::lock_guard<std::mutex> guard(this->lock);
+            std::map<std::string, CacheEntry>::iterator entry = this->cache.find(key);
+            if (entry == this->cache.end() || entry->second.lookupID != lookupID) return;
+            
+            unsigned int timeToLive = returnVal == 0 ? this->ttl : this->negativeTTL;
+            if (timeToLive == 0) {
+                this->cache.erase(entry);
+            } else {
+                entry->second.expiry = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeToLive);
+            }
+        };
+        
+        return newEntry.addresses;
+    }
+    
+    /*!
+     * The loop each helper thread runs, doing lookups until the resolver is destroyed.
+     */
+    void runHelper() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> guard(this->lock);
+                this->jobAdded.wait(guard, [this]() { return this->stopping || !this->jobs.empty(); });
+                if (this->stopping) return;
+                
+                job = std::move(this->jobs.front().lookup);
+                this->jobs.pop_front();
+            }
+            job();
+        }
+    }
+};
+
+#endif /* HostResolver_hpp */
@@ -0,0 +1,124 @@
+#ifndef MPSCQueue_hpp
+#define MPSCQueue_hpp
+
+#include <atomic>
+#include <utility>
+
+/*
+ A lock-free, unbounded queue which any number of threads can push onto, and one thread pops from. A push is a single atomic exchange, so producers never wait on each other or on the consumer.
+
+ It is a linked list with a placeholder node: producers swap themselves in as the new head and then link the old head to themselves, and the consumer walks from the tail. Between those two steps of a push, the consumer sees the list end early. pop() then reports the queue empty, and the element is returned by a later call.
+ */
+template <typename T>
+class MPSCQueue {
+public:
+    //Constructor
+    MPSCQueue() {
+        this->head.store(&this->stub, std::memory_order_relaxed);
+        this->tail = &this->stub;
+    }
+    
+    //Destructor
+    ~MPSCQueue() {
+        T value;
+        while (this->pop(value)) {}
+    }
+    
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+    
+    //Public member functions
+    
+    /*!
+     * A function that adds an element to the queue. Can be called from any thread at any time.
+     *
+     * @param value The element to add. It is moved into the queue.
+     */
+    void push(T value) {
+        Node* node = new Node(std::move(value));
+        this->pushNode(node);
+    }
+    
+    /*!
+     * A function that removes the oldest element from the queue. Must only be called from one thread at a time.
+     *
+     * @param value Filled with the removed element, if there was one.
+     *
+     * @return True if an element was removed, false if the queue was empty.
+     */
+    bool pop(T& value) {
+        Node* tail = this->tail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        
+        //Step over the placeholder node
+        if (tail == &this->stub) {
+            if (next == nullptr) return false;
+            this->tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        
+        if (next != nullptr) {
+            this->tail = next;
+            value = std::move(tail->value);
+            delete tail;
+            return true;
+        }
+        
+        //tail is the last linked node. If it is not also the head, a push is halfway done, so report empty for now
+        if (tail != this->head.load(std::memory_order_acquire)) return false;
+        
+        //Put the placeholder back behind the last node so the last node can be removed
+        this->pushNode(&this->stub);
+        
+        next = tail->next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            this->tail = next;
+            value = std::move(tail->value);
+            delete tail;
+            return true;
+        }
+        return false;
+    }
+    
+    /*!
+     * A function that checks if the queue has no elements. Only meaningful on the thread that pops.
+     *
+     * @return True if there is nothing to pop.
+     */
+    bool empty() const {
+        return this->tail == &this->stub && this->stub.next.load(std::memory_order_acquire) == nullptr;
+    }
+    
+private:
+    //Private types
+    
+    struct Node {
+        Node() : next(nullptr) {}
+        explicit Node(T&& value) : next(nullptr), value(std::move(value)) {}
+        
+        std::atomic<Node*> next;
+        T value;
+    };
+    
+    //Private properties
+    
+    alignas(64) std::atomic<Node*> head; //Most recently pushed node. Written by every producer
+    alignas(64) Node* tail; //Oldest node. Only used by the consumer
+    Node stub; //Placeholder node, so the list is never empty
+    
+    //Private member functions
+    
+    /*!
+     * A function that links a node onto the head of the list.
+     *
+     * @param node The node to link.
+     */
+    void pushNode(Node* node) {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node* previous = this->head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+};
+
+#endif /* MPSCQueue_hpp */
@@ -0,0 +1,226 @@
+#ifndef MessageCodec_hpp
+#define MessageCodec_hpp
+
+#include <string>
+#include <string_view>
+#include <array>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+
+#include <string.h>
+
+/*
+ Typed messages with a fixed, little-endian wire layout worked out at compile time.
+
+ A message is a plain struct. Its layout is declared once by specializing MessageSchema with a tuple of pointers to its fields, in the order they are sent:
+
+     struct Quote {
+         uint32_t id;
+         double price;
+     };
+
+     template <>
+     struct MessageSchema<Quote> {
+         static constexpr auto fields = std::make_tuple(&Quote::id, &Quote::price);
+     };
+
+ Fields are packed with no padding, so Quote is always 12 bytes on the wire, on any machine. Fields can be integers, floating point numbers, bools, or enums.
+
+ encodeMessage() writes a message into a buffer. A MessageView reads single fields straight out of received bytes, so nothing is parsed or allocated up front. Both socket classes send these with sendMessage() and read them with receiveMessage().
+ */
+
+template <typename T>
+struct MessageSchema;
+
+template <typename T>
+class MessageLayout {
+private:
+    using Fields = std::remove_const_t<decltype(MessageSchema<T>::fields)>;
+    
+    template <typename Member>
+    struct MemberType;
+    
+    template <typename Field>
+    struct MemberType<Field T::*> {
+        using type = Field;
+    };
+    
+    template <std::size_t... I>
+    static constexpr std::size_t sizeOf(std::index_sequence<I...>) {
+        return (std::size_t(0) + ... + sizeof(typename MemberType<std::tuple_element_t<I, Fields>>::type));
+    }
+    
+    template <std::size_t... I>
+    static constexpr bool allScalar(std::index_sequence<I...>) {
+        return (true && ... && (std::is_arithmetic_v<typename MemberType<std::tuple_element_t<I, Fields>>::type> || std::is_enum_v<typename MemberType<std::tuple_element_t<I, Fields>>::type>));
+    }
+    
+public:
+    //The number of fields in the message
+    static constexpr std::size_t fieldCount = std::tuple_size_v<Fields>;
+    
+    //The type of field I
+    template <std::size_t I>
+    using FieldType = typename MemberType<std::tuple_element_t<I, Fields>>::type;
+    
+    //The number of bytes field I starts at on the wire
+    template <std::size_t I>
+    static constexpr std::size_t offset = sizeOf(std::make_index_sequence<I>());
+    
+    //The number of bytes the whole message takes on the wire
+    static constexpr std::size_t size = sizeOf(std::make_index_sequence<fieldCount>());
+    
+    static_assert(allScalar(std::make_index_sequence<fieldCount>()), "Message fields must be integers, floating point numbers, bools or enums");
+};
+
+namespace MessageCodecDetail {
+    //An unsigned integer with the same size as a field, used to move its bytes around
+    template <std::size_t Size>
+    struct UnsignedOfSize;
+    template <> struct UnsignedOfSize<1> { using type = uint8_t; };
+    template <> struct UnsignedOfSize<2> { using type = uint16_t; };
+    template <> struct UnsignedOfSize<4> { using type = uint32_t; };
+    template <> struct UnsignedOfSize<8> { using type = uint64_t; };
+    
+    template <typename U>
+    inline U toLittleEndian(U value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        if constexpr (sizeof(U) == 2) return __builtin_bswap16(value);
+        else if constexpr (sizeof(U) == 4) return __builtin_bswap32(value);
+        else if constexpr (sizeof(U) == 8) return __builtin_bswap64(value);
+#endif
+        return value;
+    }
+    
+    template <typename Field>
+    inline void store(char* destination, Field value) {
+        using U = typename UnsignedOfSize<sizeof(Field)>::type;
+        U bits;
+        memcpy(&bits, &value, sizeof(Field));
+        bits = toLittleEndian(bits);
+        memcpy(destination, &bits, sizeof(Field));
+    }
+    
+    template <typename Field>
+    inline Field load(const char* source) {
+        using U = typename UnsignedOfSize<sizeof(Field)>::type;
+        U bits;
+        memcpy(&bits, source, sizeof(Field));
+        bits = toLittleEndian(bits);
+        Field value;
+        memcpy(&value, &bits, sizeof(Field));
+        return value;
+    }
+    
+    template <typename T, std::size_t... I>
+    inline void encode(const T& message, char* destination, std::index_sequence<I...>) {
+        (store(destination + MessageLayout<T>::template offset<I>, message.*std::get<I>(MessageSchema<T>::fields)), ...);
+    }
+    
+    template <typename T, std::size_t... I>
+    inline void decode(const char* source, T& message, std::index_sequence<I...>) {
+        ((message.*std::get<I>(MessageSchema<T>::fields) = load<typename MessageLayout<T>::template FieldType<I>>(source + MessageLayout<T>::template offset<I>)), ...);
+    }
+}
+
+/*!
+ * A function that writes a message in its wire layout.
+ *
+ * @param message The message to write.
+ * @param destination Where to write it. Must have room for MessageLayout<T>::size bytes.
+ */
+template <typename T>
+inline void encodeMessage(const T& message, char* destination) {
+    MessageCodecDetail::encode(message, destination, std::make_index_sequence<MessageLayout<T>::fieldCount>());
+}
+
+/*!
+ * A function that writes a message in its wire layout into a new string.
+ *
+ * @param message The message to write.
+ *
+ * @return The encoded message.
+ */
+template <typename T>
+inline std::string encodeMessage(const T& message) {
+    std::string encoded(MessageLayout<T>::size, '\0');
+    encodeMessage(message, &encoded[0]);
+    return encoded;
+}
+
+/*
+ A MessageView reads the fields of an encoded message where it lies, one at a time. It does not own the bytes, which must outlive it.
+ */
+template <typename T>
+class MessageView {
+public:
+    //Constructor
+    explicit MessageView(const char* data) : data(data) {}
+    
+    /*!
+     * A function that checks if some bytes are long enough to hold a message, before viewing them.
+     *
+     * @param bytes The bytes to check.
+     *
+     * @return True if a MessageView can be made from the start of the bytes.
+     */
+    static bool fits(std::string_view bytes) {
+        return bytes.size() >= MessageLayout<T>::size;
+    }
+    
+    /*!
+     * @return The value of field I, read from the encoded bytes.
+     */
+    template <std::size_t I>
+    typename MessageLayout<T>::template FieldType<I> get() const {
+        return MessageCodecDetail::load<typename MessageLayout<T>::template FieldType<I>>(this->data + MessageLayout<T>::template offset<I>);
+    }
+    
+    /*!
+     * @return The whole message, with every field read.
+     */
+    T decode() const {
+        T message{};
+        MessageCodecDetail::decode(this->data, message, std::make_index_sequence<MessageLayout<T>::fieldCount>());
+        return message;
+    }
+    
+    /*!
+     * @return The encoded bytes.
+     */
+    std::string_view bytes() const {
+        return std::string_view(this->data, MessageLayout<T>::size);
+    }
+    
+private:
+    const char* data;
+};
+
+/*
+ A MessageBuffer holds exactly one encoded message, so receiveMessage() can fill it without allocating. It can be reused for every message.
+ */
+template <typename T>
+class MessageBuffer {
+public:
+    /*!
+     * @return A view of the message in the buffer.
+     */
+    MessageView<T> view() const {
+        return MessageView<T>(this->storage.data());
+    }
+    
+    /*!
+     * @return The start of the buffer, which holds MessageLayout<T>::size bytes.
+     */
+    char* data() {
+        return this->storage.data();
+    }
+    
+private:
+    alignas(8) std::array<char, MessageLayout<T>::size> storage{};
+};
+
+#endif /* MessageCodec_hpp */
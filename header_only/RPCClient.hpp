@@ -0,0 +1,97 @@
+#ifndef RPCClient_hpp
+#define RPCClient_hpp
+
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <exception>
+
+#include "ClientSocket.hpp"
+#include "RPCFrame.hpp"
+
+#define RPC_TIMEOUT 5000 //Milliseconds a call waits for its reply by default
+
+/*
+ An RPCClient calls methods on an RPCServer through a connected ClientSocket. Each call carries an ID that the reply repeats, so a late reply to a call that ran out of time is recognized and skipped rather than taken as the reply to the next call. The frame buffer is kept between calls, and replies are read into the caller's string, so a call whose buffers are already large enough allocates nothing.
+ */
+class RPCClient {
+public:
+    //Constructor
+    RPCClient(ClientSocket& socket) {
+        this->socket = &socket;
+    }
+    
+    //Public member functions
+    
+    /*!
+     * A function that calls a method and waits for its reply, up to a deadline. Errors are thrown if the connection fails or closes, and if a reply is larger than RPC_MAX_PAYLOAD.
+     *
+     * @param method The ID of the method.
+     * @param request The payload of the request.
+     * @param response Set to the payload of the reply. Its memory is reused, so passing the same string to every call avoids allocating.
+     * @param timeoutMilliseconds An optional parameter indicating how long to wait for the reply. Autoinitialized as RPC_TIMEOUT.
+     *
+     * @return The status of the reply: RPC_OK, another RPC_ status, or one the handler chose. RPC_DEADLINE_EXCEEDED if no reply came in time, and RPC_CHECKSUM_FAILED if checksums are on and the call or its reply was damaged.
+     */
+    uint16_t call(uint16_t method, std::string_view request, std::string& response, unsigned int timeoutMilliseconds = RPC_TIMEOUT) {
+        if (request.size() > RPC_MAX_PAYLOAD)
+            throw std::logic_error("Request too large");
+        
+        RPCHeader call;
+        call.callID = this->nextCallID++;
+        call.method = method;
+        call.status = 0;
+        call.flags = this->checksums ? RPC_FLAG_CHECKSUM : 0;
+        
+        //Send the header and payload together, so the call takes one write
+        size_t frameSize = writeRPCFrame(call, request, this->frame);
+        this->socket->send(std::string_view(this->frame.data(), frameSize), true);
+        
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+        
+        while (true) {
+            //Only wait for the start of a reply. Once it starts, the rest of it is read whatever the deadline, so the connection stays in step
+            long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0 || !this->socket->waitForData((int)remaining)) return RPC_DEADLINE_EXCEEDED;
+            
+            if (!this->socket->receiveMessage(this->header))
+                throw std::runtime_error("ERROR receiving reply: Connection closed");
+            
+            RPCHeader reply = this->header.view().decode();
+            if (reply.length > RPC_MAX_PAYLOAD)
+                throw std::runtime_error("ERROR receiving reply: Frame too large");
+            
+            response.resize(reply.length);
+            if (reply.length > 0 && !this->socket->receive(&response[0], reply.length))
+                throw std::runtime_error("ERROR receiving reply: Connection closed");
+            
+            //A damaged reply's call ID can't be trusted either, so it is taken as the reply to this call
+            if (!verifyRPCFrame(this->header, response)) return RPC_CHECKSUM_FAILED;
+            
+            //Anything else is a late reply to an earlier call that ran out of time
+            if (reply.callID == call.callID) return reply.status;
+        }
+    }
+    
+    /*!
+     * A function to turn checksums on or off for later calls. With checksums, each request carries a CRC32C of its header and payload, worked out while the frame is built, and the server checksums its reply the same way. A damaged request is answered with RPC_CHECKSUM_FAILED without running its handler, and a damaged reply makes call() return RPC_CHECKSUM_FAILED. Off by default, since TCP's own checksum is enough on most links.
+     *
+     * @param enable True to checksum calls.
+     */
+    void setChecksums(bool enable) {
+        this->checksums = enable;
+    }
+    
+private:
+    //Private properties
+    
+    ClientSocket* socket;
+    
+    uint32_t nextCallID = 1;
+    bool checksums = false;
+    
+    MessageBuffer<RPCHeader> header; //The header of the reply being read
+    std::string frame; //The request's header and payload, so they are sent in one write. Only grown, so it can be longer than the frame
+};
+
+#endif /* RPCClient_hpp */
@@ -0,0 +1,84 @@
+#ifndef RPCFrame_hpp
+#define RPCFrame_hpp
+
+#include <tuple>
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+#include "MessageCodec.hpp"
+#include "CRC32C.hpp"
+
+#define RPC_OK 0 //The handler ran and returned normally
+#define RPC_UNKNOWN_METHOD 1 //No handler is registered for the method
+#define RPC_HANDLER_FAILED 2 //The handler threw an exception. The reply holds its message
+#define RPC_DEADLINE_EXCEEDED 3 //No reply came before the deadline. Never sent, only returned by RPCClient::call()
+#define RPC_CHECKSUM_FAILED 4 //The request or the reply was damaged on the way. A damaged request is not handed to its handler
+#define RPC_FIRST_USER_STATUS 16 //Handlers can return their own statuses from here up
+
+#define RPC_MAX_PAYLOAD 67108864 //A frame claiming more than this is treated as a broken connection rather than allocated for
+
+#define RPC_FLAG_CHECKSUM 1 //The frame carries a CRC32C checksum of its header and payload
+
+/*
+ The header in front of every RPC request and reply. The payload follows it directly.
+ */
+struct RPCHeader {
+    uint32_t length; //The bytes of payload after the header
+    uint32_t callID; //Chosen by the client, and copied into the reply so it can be matched to its call
+    uint16_t method; //The method called. Copied into the reply
+    uint16_t status; //0 in requests. In replies, one of the RPC_ statuses or one the handler chose
+    uint16_t flags; //RPC_FLAG_ bits. A reply has the same flags as its request
+    uint32_t checksum; //With RPC_FLAG_CHECKSUM, the CRC32C of the header before this field and then the payload. 0 otherwise. Must stay the last field
+};
+
+template <>
+struct MessageSchema<RPCHeader> {
+    static constexpr auto fields = std::make_tuple(&RPCHeader::length, &RPCHeader::callID, &RPCHeader::method, &RPCHeader::status, &RPCHeader::flags, &RPCHeader::checksum);
+};
+
+/*!
+ * A function that writes a frame, header and then payload, into a buffer. If the header has RPC_FLAG_CHECKSUM, the checksum is worked out while the payload is copied, so the payload is only read once. The buffer's memory is reused, and it is only grown, so it may end up longer than the frame.
+ *
+ * @param header The header. Its length and checksum are filled in.
+ * @param payload The payload.
+ * @param frame The buffer to write the frame into.
+ *
+ * @return The size of the frame, from the start of the buffer.
+ */
+inline size_t writeRPCFrame(RPCHeader& header, std::string_view payload, std::string& frame) {
+    const size_t headerSize = MessageLayout<RPCHeader>::size;
+    size_t frameSize = headerSize + payload.size();
+    if (frame.size() < frameSize) frame.resize(frameSize);
+    
+    header.length = (uint32_t)payload.size();
+    header.checksum = 0;
+    encodeMessage(header, &frame[0]);
+    
+    if (header.flags & RPC_FLAG_CHECKSUM) {
+        uint32_t crc = crc32c(frame.data(), headerSize - sizeof(uint32_t));
+        header.checksum = crc32cCopy(&frame[headerSize], payload.data(), payload.size(), crc);
+        encodeMessage(header, &frame[0]);
+    } else if (!payload.empty()) {
+        memcpy(&frame[headerSize], payload.data(), payload.size());
+    }
+    return frameSize;
+}
+
+/*!
+ * A function that checks a received frame against its checksum.
+ *
+ * @param header The header, as received.
+ * @param payload The payload.
+ *
+ * @return True if the frame is intact or has no checksum.
+ */
+inline bool verifyRPCFrame(const MessageBuffer<RPCHeader>& header, std::string_view payload) {
+    RPCHeader decoded = header.view().decode();
+    if (!(decoded.flags & RPC_FLAG_CHECKSUM)) return true;
+    
+    uint32_t crc = crc32c(header.view().bytes().data(), MessageLayout<RPCHeader>::size - sizeof(uint32_t));
+    return crc32c(payload.data(), payload.size(), crc) == decoded.checksum;
+}
+
+#endif /* RPCFrame_hpp */
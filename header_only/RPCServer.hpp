@@ -0,0 +1,99 @@
+#ifndef RPCServer_hpp
+#define RPCServer_hpp
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <exception>
+
+#include "ServerSocket.hpp"
+#include "RPCFrame.hpp"
+
+/*
+ An RPCServer answers calls from RPCClients connected to a ServerSocket. Each method ID has a handler, kept in a table indexed by the ID, so dispatching a call is one lookup. The buffers for requests, replies and frames are kept between calls, so once they have grown to the largest message, handling a call allocates nothing unless the handler does.
+ */
+class RPCServer {
+public:
+    //Public types
+    
+    /*
+     A handler gets the request's payload and fills in the reply's. The response string is empty but keeps its memory from earlier calls, so assigning or appending to it does not allocate once it is large enough. The return value is the reply's status.
+     */
+    typedef std::function<uint16_t(std::string_view request, std::string& response)> Handler;
+    
+    //Constructor
+    RPCServer(ServerSocket& socket) {
+        this->socket = &socket;
+    }
+    
+    //Public member functions
+    
+    /*!
+     * A function that sets the handler for a method, replacing any handler it had.
+     *
+     * @param method The ID of the method.
+     * @param handler The handler. An empty function removes the method.
+     */
+    void registerMethod(uint16_t method, Handler handler) {
+        if (method >= this->handlers.size()) this->handlers.resize(method + 1);
+        this->handlers[method] = std::move(handler);
+    }
+    
+    /*!
+     * A function that receives one call from a client, runs its handler and sends the reply. It waits for the call if it has not arrived yet, so it is best called when the client's socket is readable. Calls to unknown methods and handlers that throw are answered with an error status rather than thrown. Errors are thrown in the same cases as ServerSocket::receive() and ServerSocket::send(), and if the frame is larger than RPC_MAX_PAYLOAD.
+     *
+     * @param clientIndex The index of the client.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the client disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return True if a call was answered, false if the client disconnected first.
+     */
+    bool handle(unsigned int clientIndex, bool* socketClosed = nullptr) {
+        if (!this->socket->receiveMessage(this->header, clientIndex, socketClosed)) return false;
+        
+        RPCHeader request = this->header.view().decode();
+        if (request.length > RPC_MAX_PAYLOAD)
+            throw std::runtime_error("ERROR receiving call: Frame too large");
+        
+        //Read the payload into memory kept from earlier calls
+        if (this->request.size() < request.length) this->request.resize(request.length);
+        if (!this->socket->receive(&this->request[0], request.length, clientIndex, socketClosed)) return false;
+        
+        RPCHeader reply = request;
+        this->response.clear();
+        
+        if (!verifyRPCFrame(this->header, std::string_view(this->request.data(), request.length))) {
+            //A damaged request is never handed to a handler, since even its method may be wrong
+            reply.status = RPC_CHECKSUM_FAILED;
+        } else if (request.method < this->handlers.size() && this->handlers[request.method]) {
+            try {
+                reply.status = this->handlers[request.method](std::string_view(this->request.data(), request.length), this->response);
+            } catch (const std::exception& error) {
+                reply.status = RPC_HANDLER_FAILED;
+                this->response = error.what();
+            }
+        } else {
+            reply.status = RPC_UNKNOWN_METHOD;
+        }
+        
+        //Send the header and payload together, so the reply takes one write. It keeps the request's flags, so it is checksummed if the request was
+        size_t frameSize = writeRPCFrame(reply, this->response, this->frame);
+        this->socket->send(std::string_view(this->frame.data(), frameSize), clientIndex, true);
+        
+        return true;
+    }
+    
+private:
+    //Private properties
+    
+    ServerSocket* socket;
+    
+    std::vector<Handler> handlers; //Indexed by method ID. Empty for IDs without a handler
+    
+    MessageBuffer<RPCHeader> header; //The header of the request being handled
+    std::string request; //Never shrinks, so it is only as long as the current request when that is the longest so far
+    std::string response;
+    std::string frame; //The reply's header and payload, so they are sent in one write. Only grown, so it can be longer than the frame
+};
+
+#endif /* RPCServer_hpp */
@@ -0,0 +1,202 @@
+#ifndef RecordBuffer_hpp
+#define RecordBuffer_hpp
+
+#include <memory>
+#include <string_view>
+#include <exception>
+#include <cstddef>
+
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define RECORD_BUFFER_X86
+#endif
+
+#define RECORD_READ_SIZE 65536 //The least free space a buffer is given before each read, so a read can take many records at once
+#define RECORD_MAX_LENGTH 16777216 //The longest record that can be received. A longer one is treated as a broken stream
+
+/*
+ A buffer that splits a stream of bytes into records ended by a delimiter, like newline-delimited text. Bytes are read into it, and each complete record is handed out as a view into the buffer, without copying. A record that is not complete yet stays in the buffer, and the next read is added after it.
+
+ The delimiter is found 32 bytes at a time with AVX2 where the processor has it, 16 at a time with SSE2 otherwise, and with memchr() on other processors. Bytes already searched are not searched again when more of a long record arrives.
+ */
+class RecordBuffer {
+public:
+    //Public member functions
+    
+    /*!
+     * A function that takes the next complete record out of the buffer.
+     *
+     * @param record Set to the record, without its delimiter. It points into the buffer, and stays valid until the buffer is next changed.
+     * @param delimiter The byte that ends each record.
+     *
+     * @return True if a whole record was buffered, false if more has to be read first.
+     */
+    bool next(std::string_view& record, char delimiter) {
+        size_t from = this->scanned > this->start ? this->scanned : this->start;
+        size_t found = from + findByte(this->bytes.get() + from, this->end - from, delimiter);
+        
+        if (found == this->end) {
+            this->scanned = this->end;
+            return false;
+        }
+        
+        record = std::string_view(this->bytes.get() + this->start, found - this->start);
+        this->start = found + 1;
+        this->scanned = this->start;
+        return true;
+    }
+    
+    /*!
+     * A function that takes whatever is left in the buffer as a record, for when the stream ends without a final delimiter.
+     *
+     * @param record Set to the bytes left. It points into the buffer, and stays valid until the buffer is next changed.
+     *
+     * @return True if anything was left.
+     */
+    bool rest(std::string_view& record) {
+        if (this->start == this->end) return false;
+        
+        record = std::string_view(this->bytes.get() + this->start, this->end - this->start);
+        this->start = this->scanned = this->end;
+        return true;
+    }
+    
+    /*!
+     * A function that makes room to read into after the buffered bytes, by moving an incomplete record to the front or growing the buffer. Records handed out before are no longer valid. Will throw an error if an incomplete record is already RECORD_MAX_LENGTH bytes long.
+     *
+     * @param length Set to the number of bytes that can be read into the space.
+     *
+     * @return The space to read into. added() must be called after reading.
+     */
+    char* space(size_t& length) {
+        if (this->start == this->end) this->start = this->end = this->scanned = 0;
+        
+        if (this->capacity - this->end < RECORD_READ_SIZE) {
+            size_t buffered = this->end - this->start;
+            if (buffered >= RECORD_MAX_LENGTH)
+                throw std::runtime_error("ERROR receiving record: Record too long");
+            
+            //Grow if the incomplete record fills more than half the buffer. Otherwise, moving it to the front frees enough
+            size_t newCapacity = this->capacity > 0 ? this->capacity : RECORD_READ_SIZE * 2;
+            while (newCapacity - buffered < RECORD_READ_SIZE || buffered > newCapacity / 2) newCapacity *= 2;
+            
+            if (newCapacity != this->capacity) {
+                char* newBytes = new char[newCapacity];
+                if (buffered > 0) memcpy(newBytes, this->bytes.get() + this->start, buffered);
+                this->bytes.reset(newBytes);
+                if (this->account != nullptr) *this->account += newCapacity - this->capacity;
+                this->capacity = newCapacity;
+            } else {
+                memmove(this->bytes.get(), this->bytes.get() + this->start, buffered);
+            }
+            this->scanned -= this->start;
+            this->end = buffered;
+            this->start = 0;
+        }
+        
+        length = this->capacity - this->end;
+        return this->bytes.get() + this->end;
+    }
+    
+    /*!
+     * A function that adds bytes read into space() to the buffer.
+     *
+     * @param length The number of bytes read.
+     */
+    void added(size_t length) {
+        this->end += length;
+    }
+    
+    /*!
+     * @return The number of bytes buffered that have not been handed out as a record.
+     */
+    size_t buffered() const {
+        return this->end - this->start;
+    }
+    
+    /*!
+     * A function that frees the buffer and discards anything in it.
+     */
+    void release() {
+        if (this->account != nullptr) *this->account -= this->capacity;
+        this->bytes.reset();
+        this->capacity = this->start = this->end = this->scanned = 0;
+    }
+    
+    /*!
+     * A function that keeps a running total of the memory held by this buffer, along with any others given the same total. The buffer must be empty.
+     *
+     * @param total The total, which the buffer adds to and takes from as it changes size. A null pointer stops counting.
+     */
+    void setAccount(size_t* total) {
+        this->account = total;
+    }
+    
+    /*!
+     * A function that finds the first occurrence of a byte.
+     *
+     * @param data The bytes to search.
+     * @param length The number of bytes.
+     * @param byte The byte to find.
+     *
+     * @return The position of the byte, or length if it is not there.
+     */
+    static size_t findByte(const char* data, size_t length, char byte) {
+#if defined(RECORD_BUFFER_X86)
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        return avx2 ? findByteAVX2(data, length, byte) : findByteSSE2(data, length, byte);
+#else
+        const void* found = memchr(data, byte, length);
+        return found != nullptr ? (const char*)found - data : length;
+#endif
+    }
+    
+private:
+    //Private properties
+    
+    std::unique_ptr<char[]> bytes;
+    size_t capacity = 0;
+    size_t start = 0; //Where the bytes not yet handed out begin
+    size_t end = 0; //Where the bytes read end
+    size_t scanned = 0; //Bytes before here have been searched for the delimiter already
+    size_t* account = nullptr; //See setAccount()
+    
+    //Private member functions
+    
+#if defined(RECORD_BUFFER_X86)
+    /*!
+     * findByte() for processors with AVX2. Compiled for AVX2 whatever the build flags, and only called once the processor is known to have it.
+     */
+    __attribute__((target("avx2"))) static size_t findByteAVX2(const char* data, size_t length, char byte) {
+        __m256i needle = _mm256_set1_epi8(byte);
+        size_t position = 0;
+        for (; position + 32 <= length; position += 32) {
+            __m256i chunk = _mm256_loadu_si256((const __m256i*)(data + position));
+            unsigned int matches = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+            if (matches != 0) return position + __builtin_ctz(matches);
+        }
+        return position + findByteSSE2(data + position, length - position, byte);
+    }
+    
+    /*!
+     * findByte() with SSE2, which every x86-64 processor has.
+     */
+    __attribute__((target("sse2"))) static size_t findByteSSE2(const char* data, size_t length, char byte) {
+        __m128i needle = _mm_set1_epi8(byte);
+        size_t position = 0;
+        for (; position + 16 <= length; position += 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i*)(data + position));
+            unsigned int matches = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+            if (matches != 0) return position + __builtin_ctz(matches);
+        }
+        for (; position < length; position++) {
+            if (data[position] == byte) return position;
+        }
+        return length;
+    }
+#endif
+};
+
+#endif /* RecordBuffer_hpp */
@@ -0,0 +1,306 @@
+#ifndef Relay_hpp
+#define Relay_hpp
+
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <exception>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <cerrno>
+
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+
+#define RELAY_PIPE_SIZE 1048576 //Bytes each direction can hold between reading and writing. The kernel may round it, or refuse to go above /proc/sys/fs/pipe-max-size
+#define RELAY_IDLE_TIMEOUT 60000 //Milliseconds without data in either direction before a relay gives up
+
+/*
+ A Relay joins a ServerSocket's client to a ClientSocket's host, passing everything each side sends to the other until both are done. On Linux the data is moved with splice() through a pipe for each direction, so it never enters user space; elsewhere it is copied through a buffer. Both connections must be TCP.
+
+ When one side closes its end, the other side's sending end is shut down once everything has been passed on, so a half-closed connection is relayed faithfully. The relay ends when both directions are done, or when either connection is reset.
+ */
+class Relay {
+public:
+    //Public types
+    
+    enum Outcome {
+        Closed, //Both sides finished, or a connection was reset
+        IdleTimeout //Nothing was sent either way for the idle timeout
+    };
+    
+    //Constructor
+    Relay(ServerSocket& server, unsigned int clientIndex, ClientSocket& upstream) {
+        int clientFD = server.clientFD(clientIndex);
+        int upstreamFD = upstream.connectionFD();
+        if (clientFD < 0 || upstreamFD < 0)
+            throw std::logic_error("Relay needs a TCP connection on both sides");
+        
+        this->toUpstream.from = clientFD;
+        this->toUpstream.to = upstreamFD;
+        this->toClient.from = upstreamFD;
+        this->toClient.to = clientFD;
+    }
+    
+    //Public member functions
+    
+    /*!
+     * A function that relays data until both sides are done or the connection goes idle. The connections are made non-blocking while it runs, and restored after. They are left open either way, to be closed by their sockets. Data already read with receive() is not relayed. Will throw an error if the pipes cannot be made, or if an error other than a reset occurs.
+     *
+     * @param idleTimeoutMilliseconds An optional parameter indicating how long the relay waits without data in either direction. 0 waits forever. Autoinitialized as RELAY_IDLE_TIMEOUT.
+     *
+     * @return Why the relay ended.
+     */
+    Outcome run(unsigned int idleTimeoutMilliseconds = RELAY_IDLE_TIMEOUT) {
+        this->toUpstream.readDone = this->toUpstream.finished = false;
+        this->toClient.readDone = this->toClient.finished = false;
+        this->reset = false;
+        
+        this->open(this->toUpstream);
+        try {
+            this->open(this->toClient);
+        } catch (const std::exception&) {
+            this->close(this->toUpstream);
+            throw;
+        }
+        
+        int clientFlags = fcntl(this->toUpstream.from, F_GETFL);
+        int upstreamFlags = fcntl(this->toUpstream.to, F_GETFL);
+        fcntl(this->toUpstream.from, F_SETFL, clientFlags | O_NONBLOCK);
+        fcntl(this->toUpstream.to, F_SETFL, upstreamFlags | O_NONBLOCK);
+        
+        //splice() has no MSG_NOSIGNAL, so hold back SIGPIPE while relaying and discard any raised
+        sigset_t pipeSignal, previousSignals;
+        sigemptyset(&pipeSignal);
+        sigaddset(&pipeSignal, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &pipeSignal, &previousSignals);
+        
+        Outcome outcome = Closed;
+        try {
+            std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(idleTimeoutMilliseconds);
+            
+            while (!this->reset && !(this->toUpstream.finished && this->toClient.finished)) {
+                pollfd pollInfo[2];
+                pollInfo[0].fd = this->toUpstream.from;
+                pollInfo[1].fd = this->toClient.from;
+                for (int a = 0; a < 2; a++) {
+                    Direction& reading = a == 0 ? this->toUpstream : this->toClient;
+                    Direction& writing = a == 0 ? this->toClient : this->toUpstream;
+                    pollInfo[a].events = 0;
+                    if (!reading.readDone && reading.pending < reading.capacity) pollInfo[a].events |= POLLIN;
+                    if (writing.pending > 0) pollInfo[a].events |= POLLOUT;
+                    if (pollInfo[a].events == 0) pollInfo[a].fd = -1; //Otherwise a hung up connection would wake poll() over and over
+                    pollInfo[a].revents = 0;
+                }
+                
+                int timeout = -1;
+                if (idleTimeoutMilliseconds > 0) {
+                    long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                    if (remaining <= 0) {
+                        outcome = IdleTimeout;
+                        break;
+                    }
+                    timeout = (int)remaining;
+                }
+                
+                int ready = poll(pollInfo, 2, timeout);
+                if (ready < 0) {
+                    if (errno == EINTR) continue;
+                    throw std::runtime_error(std::string("ERROR relaying data: ") + std::string(strerror(errno)));
+                }
+                if (ready == 0) continue;
+                
+                //Write straight after reading, so data doesn't wait a round of poll() in the pipe
+                bool moved = false;
+                if (pollInfo[0].revents & (POLLIN | POLLHUP | POLLERR)) moved |= this->fill(this->toUpstream);
+                if (pollInfo[1].revents & (POLLIN | POLLHUP | POLLERR)) moved |= this->fill(this->toClient);
+                moved |= this->drain(this->toUpstream);
+                moved |= this->drain(this->toClient);
+                
+                if (moved) deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(idleTimeoutMilliseconds);
+            }
+        } catch (const std::exception&) {
+            fcntl(this->toUpstream.from, F_SETFL, clientFlags);
+            fcntl(this->toUpstream.to, F_SETFL, upstreamFlags);
+            this->close(this->toUpstream);
+            this->close(this->toClient);
+            pthread_sigmask(SIG_SETMASK, &previousSignals, nullptr);
+            throw;
+        }
+        
+        fcntl(this->toUpstream.from, F_SETFL, clientFlags);
+        fcntl(this->toUpstream.to, F_SETFL, upstreamFlags);
+        this->close(this->toUpstream);
+        this->close(this->toClient);
+        
+        sigset_t pending;
+        sigpending(&pending);
+        if (sigismember(&pending, SIGPIPE) && !sigismember(&previousSignals, SIGPIPE)) {
+            int signal;
+            sigwait(&pipeSignal, &signal);
+        }
+        pthread_sigmask(SIG_SETMASK, &previousSignals, nullptr);
+        
+        return outcome;
+    }
+    
+    /*!
+     * @return The bytes passed from the client to the host so far. Can be read from another thread while run() is going.
+     */
+    unsigned long long bytesToUpstream() const {
+        return this->toUpstream.bytes.load(std::memory_order_relaxed);
+    }
+    
+    /*!
+     * @return The bytes passed from the host to the client so far. Can be read from another thread while run() is going.
+     */
+    unsigned long long bytesToClient() const {
+        return this->toClient.bytes.load(std::memory_order_relaxed);
+    }
+    
+private:
+    //Private properties
+    
+    struct Direction {
+        int from = -1;
+        int to = -1;
+        int pipeFDs[2] = {-1, -1}; //Linux only. The data read and not yet written sits in the pipe
+        std::unique_ptr<char[]> buffer; //Elsewhere, it sits here from start
+        size_t start = 0;
+        size_t capacity = 0;
+        size_t pending = 0; //Bytes read and not yet written
+        bool readDone = false; //The sending side closed its end
+        bool finished = false; //Everything was written and the receiving side's end shut down
+        std::atomic<unsigned long long> bytes{0};
+    };
+    Direction toUpstream;
+    Direction toClient;
+    
+    bool reset = false; //Either connection was reset, which ends the relay
+    
+    //Private member functions
+    
+    /*!
+     * A function that gets a direction ready to run, making its pipe or buffer.
+     *
+     * @param direction The direction.
+     */
+    void open(Direction& direction) {
+        direction.pending = 0;
+        direction.start = 0;
+#if defined(__linux__)
+        if (pipe2(direction.pipeFDs, O_CLOEXEC | O_NONBLOCK) < 0)
+            throw std::runtime_error(std::string("ERROR creating relay pipe: ") + std::string(strerror(errno)));
+        
+        //A larger pipe lets one splice() move more. If the kernel refuses, the default size still works
+        fcntl(direction.pipeFDs[1], F_SETPIPE_SZ, RELAY_PIPE_SIZE);
+        int size = fcntl(direction.pipeFDs[1], F_GETPIPE_SZ);
+        direction.capacity = size > 0 ? size : 65536;
+#else
+        direction.capacity = RELAY_PIPE_SIZE;
+        direction.buffer.reset(new char[direction.capacity]);
+#endif
+    }
+    
+    /*!
+     * A function that frees a direction's pipe or buffer.
+     *
+     * @param direction The direction.
+     */
+    void close(Direction& direction) {
+#if defined(__linux__)
+        for (int a = 0; a < 2; a++) {
+            if (direction.pipeFDs[a] >= 0) ::close(direction.pipeFDs[a]);
+            direction.pipeFDs[a] = -1;
+        }
+#else
+        direction.buffer.reset();
+#endif
+        direction.capacity = 0;
+        direction.pending = 0;
+    }
+    
+    /*!
+     * A function that reads what it can from a direction's sending side, without waiting.
+     *
+     * @param direction The direction.
+     *
+     * @return True if anything changed, including the sending side closing.
+     */
+    bool fill(Direction& direction) {
+        if (direction.readDone || direction.pending >= direction.capacity) return false;
+        
+#if defined(__linux__)
+        long readSize = splice(direction.from, nullptr, direction.pipeFDs[1], nullptr, direction.capacity - direction.pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+        //Move what is left to the front, so the free space is all in one piece
+        if (direction.start + direction.pending == direction.capacity) {
+            memmove(direction.buffer.get(), direction.buffer.get() + direction.start, direction.pending);
+            direction.start = 0;
+        }
+        long readSize = read(direction.from, direction.buffer.get() + direction.start + direction.pending, direction.capacity - direction.start - direction.pending);
+#endif
+        
+        if (readSize < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return false;
+            if (errno == ECONNRESET || errno == ENOTCONN) {
+                this->reset = true;
+                return true;
+            }
+            throw std::runtime_error(std::string("ERROR relaying data: ") + std::string(strerror(errno)));
+        }
+        
+        if (readSize == 0)
+            direction.readDone = true;
+        direction.pending += readSize;
+        return true;
+    }
+    
+    /*!
+     * A function that writes what it can to a direction's receiving side, without waiting, and shuts its end down once the sending side has closed and everything was written.
+     *
+     * @param direction The direction.
+     *
+     * @return True if anything was written.
+     */
+    bool drain(Direction& direction) {
+        bool wrote = false;
+        if (direction.pending > 0) {
+#if defined(__linux__)
+            long writtenSize = splice(direction.pipeFDs[0], nullptr, direction.to, nullptr, direction.pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+            long writtenSize = write(direction.to, direction.buffer.get() + direction.start, direction.pending);
+#endif
+            if (writtenSize < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return false;
+                if (errno == EPIPE || errno == ECONNRESET || errno == ENOTCONN) {
+                    this->reset = true;
+                    return false;
+                }
+                throw std::runtime_error(std::string("ERROR relaying data: ") + std::string(strerror(errno)));
+            }
+            
+            direction.pending -= writtenSize;
+            direction.start = direction.pending > 0 ? direction.start + writtenSize : 0;
+            direction.bytes.fetch_add(writtenSize, std::memory_order_relaxed);
+            wrote = writtenSize > 0;
+        }
+        
+        //Pass the close on, but only once the receiving side has everything
+        if (direction.readDone && direction.pending == 0 && !direction.finished) {
+            shutdown(direction.to, SHUT_WR);
+            direction.finished = true;
+        }
+        return wrote;
+    }
+};
+
+#endif /* Relay_hpp */
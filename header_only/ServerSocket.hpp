@@ -10,8 +10,21 @@
 #define ServerSocket_hpp
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <exception>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <climits>
+#if __cplusplus >= 202002L
+#include <span>
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,18 +32,75 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
 #include <cerrno>
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#endif
+
+#include "SharedMemoryRing.hpp"
+#include "MPSCQueue.hpp"
+#include "MessageCodec.hpp"
+#include "TrafficCapture.hpp"
+#include "LatencyHistogram.hpp"
+#include "HostResolver.hpp"
+#include "ReceiveBuffer.hpp"
+#include "RecordBuffer.hpp"
+#include "Probes.hpp"
+
 #define BUFFER_SIZE 65535
+#define ZERO_COPY_THRESHOLD 32768 //Below this size, pinning pages and handling the completion costs more than copying
+#define ZERO_COPY_LINGER 5000 //Milliseconds the destructor waits for the kernel to finish sending from memory passed without a copy
+#define TRACED_SENDS_LIMIT 4096 //The most sends kept waiting for a transmit timestamp, per client
+#define STREAM_CHUNK_SIZE 262144 //The bytes sendStream() asks its source for at a time
+#define FAST_OPEN_QUEUE 256 //Connections whose SYN data was accepted before their handshake finished, which bounds the work forged SYNs can cause
+#define LISTEN_BACKLOG SOMAXCONN //Connections the kernel holds until they are accepted. The kernel caps this at net.core.somaxconn
+
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0 //Not available on macOS, where a broken connection raises SIGPIPE instead
+#endif
 
 class ServerSocket {
 public:
+    //Public types
+    
+    enum MemoryPolicy {
+        DropOldest, //Unsent messages are dropped from the client with the most queued, oldest first. A message already partly sent is kept, so no client is sent half of one
+        DisconnectLargest, //The client with the most queued is disconnected
+        PauseReading //Nothing is dropped, but receive() stops growing its buffers and reading ahead, and isOverBudget() tells the caller to stop reading until flushPosted() has sent enough
+    };
+    
+    enum OverflowPolicy {
+        Reject, //A client that connects while every index is taken is closed at once
+        Queue, //A client that connects while every index is taken waits, already accepted, for a free index. Up to the backlog can wait, and any more are rejected
+        Grow //More indices are added, so every client is taken
+    };
+    
+    /*
+     Which core a socket serves. To spread a server over several cores, make one ServerSocket per core on the same port, each from its own thread pinned with pinThread(), with steerConnections on.
+     */
+    struct Placement {
+        int cpu; //The core the socket serves, which steerConnections sends connections to. This does not move the calling thread or its memory; for that, see pinThread(). -1 for no core
+        bool steerConnections; //Share the port with the other sockets that turned this on, and have the kernel give this one the connections whose packets the network card delivers to its core (SO_REUSEPORT and SO_INCOMING_CPU). Needs a cpu
+        
+        Placement(int cpu = -1, bool steerConnections = false) : cpu(cpu), steerConnections(steerConnections) {}
+    };
+    
     //Constructor
     ServerSocket() {}
-    ServerSocket(int portNum, int maxConnections) {
-        this->setSocket(portNum, maxConnections);
+    ServerSocket(int portNum, int maxConnections, int backlog = LISTEN_BACKLOG, const Placement& placement = Placement()) {
+        this->setSocket(portNum, maxConnections, backlog, placement);
     }
     
     //Destructor
@@ -40,18 +110,36 @@ public:
             for (int clientIndex = 0; clientIndex < this->activeConnections.size(); clientIndex++) {
                 if (this->activeConnections[clientIndex]) {
                     try {
-                        close(this->clientSocketsFD[clientIndex]);
+                        if (this->sharedMemoryRings[clientIndex]) this->sharedMemoryRings[clientIndex]->close();
+                        else this->closeClientSocket(clientIndex);
                     } catch (...) {
                         printf("Error closing client socket (server side)");
                     }
                 }
             }
+            for (size_t a = 0; a < this->overflowQueue.size(); a++) {
+                close(this->overflowQueue[a].socketFD);
+            }
             try {
                 close(this->hostSocketFD);
+                close(this->postNotifyFD);
+                if (this->postNotifyWriteFD != this->postNotifyFD) close(this->postNotifyWriteFD);
             } catch (...) {
                 printf("Error closing host server socket (server side)");
             }
         }
+        
+        //Wait a while for the kernel to finish with memory sent without a copy. Whatever it still holds after that is never freed, since the kernel would go on sending whatever reused the memory
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ZERO_COPY_LINGER);
+        this->releaseRetiredZeroCopy();
+        while (!this->retiredZeroCopy.empty() && std::chrono::steady_clock::now() < deadline) {
+            poll(nullptr, 0, 1);
+            this->releaseRetiredZeroCopy();
+        }
+        for (size_t a = 0; a < this->retiredZeroCopy.size(); a++) {
+            new std::deque<ZeroCopyBuffer>(std::move(this->retiredZeroCopy[a].pending)); //Deliberately leaked
+            close(this->retiredZeroCopy[a].socketFD);
+        }
     }
     
     //Static functions
@@ -69,53 +157,54 @@ public:
         return std::string(name);
     }
     
+    /*!
+     * A function that pins the calling thread to one core, for as long as the thread runs. Linux gives memory from the NUMA node of the core that first touches it, so calling this before setting up a ServerSocket keeps everything the thread allocates for it local, including the state added for each client. Only works on Linux; elsewhere, it does nothing. Throws an error if the thread cannot be pinned.
+     *
+     * @param cpu The core.
+     */
+    static void pinThread(int cpu) {
+#if defined(__linux__)
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+        if (error != 0)
+            throw std::runtime_error(std::string("ERROR pinning thread: ") + std::string(strerror(error)));
+#endif
+    }
+    
     //Public member functions
     
     /*!
      * A function to initialize the socket. This must be done before the socket can be used. Will throw an error if the socket cannot be opened or if the port is occupied, or if the socket is already set.
      *
      * @param portNum The number of the port on the host at which clients should connect.
-     * @param maxConnections The max number of clients that this host can theoretically connect with.
+     * @param maxConnections The number of clients that this host can connect with at first. What happens to more clients depends on setOverflowPolicy().
+     * @param backlog An optional parameter indicating the number of connections the kernel holds until they are accepted. Autoinitialized as LISTEN_BACKLOG.
+     * @param placement An optional parameter indicating which core the socket serves, and whether connections are steered to it. The calling thread's affinity is left as it was. An error will be thrown if there is no such core. Steering only works on Linux; elsewhere, it is ignored. Autoinitialized to no core.
      */
-    void setSocket(int portNum, int maxConnections) {
+    void setSocket(int portNum, int maxConnections, int backlog = LISTEN_BACKLOG, const Placement& placement = Placement()) {
         if (this->setUp)
             throw std::logic_error("Socket already set");
         
-        int returnVal;
-        
-        for (int a = 0; a < maxConnections; a++) {
-            this->activeConnections.push_back(false); //All connections initially inactive
-            this->clientSocketsFD.push_back(0); //No socket file descriptors set
-            this->clientAddresses.push_back(sockaddr_storage()); //All addresses set as empty structs
-            this->clientAddressSizes.push_back(socklen_t()); //All address sizes set as empty sizes
-        }
+        if (placement.steerConnections && placement.cpu < 0)
+            throw std::logic_error("Steering connections needs a cpu");
         
-        addrinfo hints; //A struct containing information on the address. Will be passed to getaddrinfo() to give hints about the connection to be made
-        addrinfo* serverAddressList; //A pointer to an addrinfo struct that will be filled with the server address by getaddrinfo()
+        if (placement.cpu >= sysconf(_SC_NPROCESSORS_CONF))
+            throw std::logic_error(std::string("No such cpu: ") + std::to_string(placement.cpu));
         
-        memset(&hints, 0, sizeof(hints)); //Initializes hints with all 0's
-        hints.ai_family = AF_UNSPEC; //Can be either IPv4 or IPv6
-        hints.ai_socktype = SOCK_STREAM; //TCP Socket
-        hints.ai_flags = AI_PASSIVE; //Set the socket to accept connections (as server socket)
+        this->buffer.reset(new char[BUFFER_SIZE]);
         
-        /* getaddrinfo
-         The getaddrinfo() fills a given addrinfo struct with the relevant information. The return value is nonzero when there is an error.
-         
-         The first argument is the name of the host to connect with.
-         
-         The second argument is a string representation of the port number.
-         
-         The third argument is a pointer to an addrinfo struct which contains hints about the type of connection to be made.
-         
-         The fourth argument is a pointer which will be filled with a linked list of hosts returned. If just one host is being looked for, the first result can just be used.
-         */
-        returnVal = getaddrinfo(NULL, std::to_string(portNum).c_str(), &hints, &serverAddressList);
+        for (int a = 0; a < maxConnections; a++) {
+            this->addSlot();
+        }
+        this->backlog = backlog;
         
-        //Throw an error if there is an error getting the local address
-        if (returnVal != 0) throw std::runtime_error(strcat((char *)"ERROR getting local address: ", gai_strerror(returnVal))); //gai_strerror() returns a c string representation of the error
+        //Look up the local addresses to accept connections on (as server socket). The list is kept, since serverAddress points into it
+        this->serverAddressList = HostResolver::shared().resolve(NULL, portNum, true);
         
         //Set the first host in the list to the desired host
-        this->serverAddress = *serverAddressList;
+        this->serverAddress = *this->serverAddressList;
         
         /* socket()
          The socket() function returns a new socket, with three parameters.
@@ -136,7 +225,7 @@ public:
         this->hostSocketFD = socket(this->serverAddress.ai_family, this->serverAddress.ai_socktype, this->serverAddress.ai_protocol);
         
         //Checks for errors initializing socket
-        if (socket < 0) throw std::runtime_error(strcat((char *)"ERROR opening socket", strerror(errno)));
+        if (this->hostSocketFD < 0) throw std::runtime_error(std::string("ERROR opening socket: ") + strerror(errno));
         
         int enable = 1;
         //This code tells the kernel that the port can be reused as long as there isn't an active socket listening there. This means that after the socket is closed the port can immediately be reused without giving an error
@@ -144,6 +233,16 @@ public:
             throw std::runtime_error(strcat((char *)"ERROR setting port to reusable", strerror(errno)));
         }
         
+#if defined(__linux__) && defined(SO_REUSEPORT) && defined(SO_INCOMING_CPU)
+        //Every socket on the port gets its own backlog. A connection goes to the socket whose cpu matches the core its SYN arrived on, so it is handled on the core where its packets already are
+        if (placement.steerConnections) {
+            if (setsockopt(this->hostSocketFD, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(int)) == -1)
+                throw std::runtime_error(std::string("ERROR sharing port: ") + std::string(strerror(errno)));
+            if (setsockopt(this->hostSocketFD, SOL_SOCKET, SO_INCOMING_CPU, &placement.cpu, sizeof(int)) == -1)
+                throw std::runtime_error(std::string("ERROR steering connections: ") + std::string(strerror(errno)));
+        }
+#endif
+        
         /* bind()
          The bind() function connects a socket to a local address, with three parameters.
          Here it will connect the socket to the (local) host at the proper port number.
@@ -169,30 +268,51 @@ public:
          
          This function cannot fail, as long as the socket is valid.
          */
-        if (listen(this->hostSocketFD, 1) < 0) {
+        if (listen(this->hostSocketFD, backlog) < 0) {
             throw std::runtime_error(strcat((char *)"ERROR listening for incoming connections", strerror(errno)));
         }
         
-        freeaddrinfo(serverAddressList); //Free the linked list now that we have the local host information
+        //The host socket doesn't block, so acceptClients() can take every waiting client and stop when there are none. addClient() waits with poll() instead
+        fcntl(this->hostSocketFD, F_SETFL, fcntl(this->hostSocketFD, F_GETFL) | O_NONBLOCK);
+        
+        //Create the descriptor other threads use to signal that they posted messages
+#if defined(__linux__)
+        this->postNotifyFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        this->postNotifyWriteFD = this->postNotifyFD;
+        if (this->postNotifyFD < 0)
+            throw std::runtime_error(std::string("ERROR creating post notifier: ") + std::string(strerror(errno)));
+#else
+        int pipeFDs[2];
+        if (pipe(pipeFDs) < 0)
+            throw std::runtime_error(std::string("ERROR creating post notifier: ") + std::string(strerror(errno)));
+        fcntl(pipeFDs[0], F_SETFL, O_NONBLOCK);
+        fcntl(pipeFDs[1], F_SETFL, O_NONBLOCK);
+        this->postNotifyFD = pipeFDs[0];
+        this->postNotifyWriteFD = pipeFDs[1];
+#endif
         
         this->setUp = true; //All functions ensure the socket has been set before doing anything
     }
     
     /*!
-     * A function that adds a client. If there is no client, then the function waits for a connection to be initiated by the client. Will throw an error if the maximum number of sockets (see MAXIMUM_NUMBER_OF_SOCKETS) have already been set, or if an error occurs connecting to the client.
+     * A function that adds a client. If there is no client, then the function waits for a connection to be initiated by the client, for up to the time set with setHostTimeout(). If every index is taken, the client is handled by the overflow policy. Will throw an error if no client connects in time, or if an error occurs connecting to the client.
+     *
+     * @return The index of the new client, or -1 if it was rejected or queued by the overflow policy.
      */
-    void addClient() {
+    int addClient() {
         if (!this->setUp)
             throw std::logic_error("Socket not set");
         
-        int nextIndex = this->getNextAvailableIndex(); //Find the next available index at which to set the new connection
+        //A client that was queued while the server was full is added before any new one
+        int clientIndex = this->promoteQueuedClient();
+        if (clientIndex >= 0) return clientIndex;
         
-        if (nextIndex == -1) {
-            throw std::logic_error(strcat((char *)"Max number of sockets: ", std::to_string(this->activeConnections.size()).c_str()));
-        }
+        sockaddr_storage address;
+        socklen_t addressSize;
+        int socketFD;
         
         /* accept()
-         The accept() function block the current thread until a connection is formed between the client and the server, with three arguments. It then wakes when the connection is successfully established.
+         The accept() function takes a connection that is waiting in the backlog queue, with three arguments. Since the host socket doesn't block, it fails with EAGAIN if no connection is waiting.
          
          The first argument is the host side socket, passed by its file descriptor.
          
@@ -202,13 +322,141 @@ public:
          
          The return value is a socket, passed by a small integer reference.
          */
-        this->clientSocketsFD[nextIndex] = accept(this->hostSocketFD, (struct sockaddr *)&this->clientAddresses[nextIndex], &this->clientAddressSizes[nextIndex]);
+        while ((socketFD = this->acceptSocket(address, addressSize)) < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED)
+                throw std::runtime_error(std::string("ERROR accepting client: ") + std::string(strerror(errno)));
+            
+            //Wait for a client to connect, for up to the time set with setHostTimeout()
+            pollfd pollInfo;
+            pollInfo.fd = this->hostSocketFD;
+            pollInfo.events = POLLIN;
+            pollInfo.revents = 0;
+            
+            int returnValue = poll(&pollInfo, 1, this->hostTimeoutMilliseconds);
+            if (returnValue == 0) {
+                SOCKS_PROBE2(timeout, -1, this->hostSocketFD);
+                throw std::runtime_error(std::string("ERROR accepting client: ") + std::string(strerror(EAGAIN)));
+            }
+            if (returnValue < 0 && errno != EINTR)
+                throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
+        }
+        
+        return this->placeClient(socketFD, address, addressSize);
+    }
+    
+    /*!
+     * A function that adds every client waiting to be accepted, without waiting for more. Clients queued by the overflow policy are added first, if indices have become free. It is meant to be called whenever listeningFD() is readable, and after connections are closed. Will throw an error if the socket is not set, or if an error occurs accepting a client.
+     *
+     * @param onClient An optional function called with the index of each client added.
+     *
+     * @return The number of clients added.
+     */
+    unsigned int acceptClients(const std::function<void(unsigned int)>& onClient = nullptr) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        unsigned int added = 0;
+        int clientIndex;
+        
+        //Clients queued while the server was full go first, in the order they connected
+        while ((clientIndex = this->promoteQueuedClient()) >= 0) {
+            added++;
+            if (onClient) onClient(clientIndex);
+        }
+        
+        //Take every connection waiting in the backlog, so a burst of clients costs one wakeup rather than one per client
+        sockaddr_storage address;
+        socklen_t addressSize;
+        while (true) {
+            int socketFD = this->acceptSocket(address, addressSize);
+            if (socketFD < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue; //A client that gave up while waiting doesn't stop the others
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                throw std::runtime_error(std::string("ERROR accepting client: ") + std::string(strerror(errno)));
+            }
+            
+            clientIndex = this->placeClient(socketFD, address, addressSize);
+            if (clientIndex >= 0) {
+                added++;
+                if (onClient) onClient(clientIndex);
+            }
+        }
+        
+        return added;
+    }
+    
+    /*!
+     * A function that sets what happens to a client that connects while every index is taken. Reject is the default.
+     *
+     * @param policy The overflow policy.
+     */
+    void setOverflowPolicy(OverflowPolicy policy) {
+        this->overflowPolicy = policy;
+    }
+    
+    /*!
+     * @return The number of clients accepted by the Queue overflow policy that are still waiting for an index.
+     */
+    unsigned int numberOfQueuedClients() const {
+        return (unsigned int)this->overflowQueue.size();
+    }
+    
+    /*!
+     * A function to turn TCP Fast Open on or off for new connections. Clients that turned it on too (see ClientSocket::setFastOpen()) and have connected before can send their first message in the SYN, and it is readable as soon as they are accepted, a round trip sooner. Only the first message of a connection benefits, and it may be delivered twice if the SYN is, so it should be safe to repeat. Fast Open must also be allowed by the system (net.ipv4.tcp_fastopen on Linux). An error is thrown if the socket is not set, or if the option cannot be set.
+     *
+     * @param enable True to turn Fast Open on.
+     * @param queueLength An optional parameter indicating the most connections that can be waiting on their handshake with data already accepted. Autoinitialized as FAST_OPEN_QUEUE.
+     */
+    void setFastOpen(bool enable, int queueLength = FAST_OPEN_QUEUE) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+#if defined(TCP_FASTOPEN)
+        //The option can be changed on a socket that is already listening. A queue length of 0 turns it off
+        int value = enable ? queueLength : 0;
+        if (setsockopt(this->hostSocketFD, IPPROTO_TCP, TCP_FASTOPEN, &value, sizeof(int)) < 0)
+            throw std::runtime_error(std::string("ERROR setting fast open: ") + std::string(strerror(errno)));
+#endif
+    }
+    
+    /*!
+     * @return A file descriptor that becomes readable when clients are waiting to be accepted, so it can be waited on with poll() or select() alongside postedFD() before calling acceptClients(). -1 if the socket is not set.
+     */
+    int listeningFD() const {
+        return this->setUp ? this->hostSocketFD : -1;
+    }
+    
+    /*!
+     * A function that adds a client in another process on the same machine, connected through shared memory instead of TCP. The client must call ClientSocket::setSharedMemory() with the same name. The function waits for the client to connect, for up to the time set with setHostTimeout(). Once added, the client is used like any other, through its index. Will throw an error if the maximum number of sockets have already been set, if the shared memory cannot be created, or if the client does not connect in time.
+     *
+     * @param name The name of the shared memory segment, which the client must also use.
+     * @param capacity An optional parameter indicating the number of bytes that can be waiting in each direction. Autoinitialized as SHARED_MEMORY_RING_CAPACITY.
+     */
+    void addSharedMemoryClient(const char* name, size_t capacity = SHARED_MEMORY_RING_CAPACITY) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        int nextIndex = this->reserveIndex(); //Find the next available index at which to set the new connection
+        
+        //There is no connection to reject or queue yet, so only the Grow policy applies here
+        if (nextIndex == -1) {
+            throw std::logic_error(std::string("Max number of sockets: ") + std::to_string(this->activeConnections.size()));
+        }
+        
+        std::unique_ptr<SharedMemoryRing> ring(new SharedMemoryRing());
+        ring->create(name, capacity);
         
-        //Checks for error with accepting
-        if (this->clientSocketsFD[nextIndex] < 0)
-            throw std::runtime_error(strcat((char *)"ERROR accepting client", strerror(errno)));
+        //Wait for the client to attach, like accept() waits for a TCP client
+        if (!ring->waitForPeer(this->hostTimeoutMilliseconds))
+            throw std::runtime_error(std::string("ERROR accepting client: ") + std::string(strerror(EAGAIN)));
+        
+        this->sharedMemoryRings[nextIndex] = std::move(ring);
+        this->clientSocketsFD[nextIndex] = -1; //There is no socket, so socket options set on it have no effect
+        this->setTracingOptions(nextIndex);
+        this->lastSeenTimes[nextIndex] = std::chrono::steady_clock::now();
         
         this->activeConnections[nextIndex] = true;
+        if (this->capture) this->capture->append(nextIndex, TrafficCapture::Opened, nullptr, 0);
     }
     
     /*!
@@ -225,11 +473,41 @@ public:
             throw std::logic_error("Socket index uninitialized");
         
         //Close the socket of the given index
-        close(this->clientSocketsFD[clientIndex]);
+        SOCKS_PROBE2(close, clientIndex, this->sharedMemoryRings[clientIndex] ? -1 : this->clientSocketsFD[clientIndex]);
+        if (this->sharedMemoryRings[clientIndex]) {
+            this->sharedMemoryRings[clientIndex]->close();
+            this->sharedMemoryRings[clientIndex].reset();
+        } else {
+            this->closeClientSocket(clientIndex);
+        }
+        if (this->capture) this->capture->append(clientIndex, TrafficCapture::Closed, nullptr, 0);
+        
+        //Discard anything still posted for the closed socket. Memory the kernel may still be sending from was moved out by closeClientSocket()
+        this->outboundQueues[clientIndex].clear();
+        this->outboundOffsets[clientIndex] = 0;
+        this->queuedMemory -= this->queuedBytes[clientIndex];
+        this->queuedBytes[clientIndex] = 0;
+        this->zeroCopyClients[clientIndex] = false;
+        this->zeroCopyNextIDs[clientIndex] = 0;
+        this->zeroCopyPending[clientIndex].clear();
+        
+        //Remove the closed socket from every topic it subscribed to
+        for (size_t a = 0; a < this->clientTopics[clientIndex].size(); a++) {
+            this->removeSubscriber(this->clientTopics[clientIndex][a], clientIndex);
+        }
+        this->clientTopics[clientIndex].clear();
+        
+        //An unused index holds no receive memory
+        this->receiveBuffers[clientIndex].release();
+        this->recordBuffers[clientIndex].release();
+        
+        //The next client at this index starts a new trace
+        this->traces[clientIndex].reset();
         
         //Reset the information for the closed socket
         this->clientAddresses[clientIndex] = sockaddr_storage();
         this->clientAddressSizes[clientIndex] = 0;
+        this->lastSeenTimes[clientIndex] = std::chrono::steady_clock::time_point();
         this->activeConnections[clientIndex] = false;
     }
     
@@ -243,37 +521,76 @@ public:
      * @return Any part of the string that wasn't sent if the given string was too large to send in full. Only part of the string would have been sent, the rest is returned.
      */
     std::string send(const char* message, unsigned int clientIndex, bool ensureFullStringSent = false) {
-        if (!this->setUp)
-            throw std::logic_error("Socket not set");
-        
-        //A blank message won't be sent
-        if (std::string(message) == "")
-            throw std::logic_error("No message to send");
-        
-        //Throw an error if there is no socket at the index
-        if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
-            throw std::logic_error("Socket index uninitialized");
+        unsigned long messageLength = message != nullptr ? strlen(message) : 0;
         
-        unsigned long messageLength = strlen(message);
+        unsigned long sentSize = this->sendBytes(message, messageLength, clientIndex, ensureFullStringSent);
         
-        long sentSize = write(this->clientSocketsFD[clientIndex], message, messageLength);
-        
-        if (sentSize < 0) {
-            throw std::runtime_error(strcat((char *)"ERROR sending message: ", strerror(errno)));
-        } else if (sentSize < messageLength) { //If only some of the string was sent, return what wasn't sent (or send the rest)
-            std::string extraStr; //Holds the rest of the string that was not sent
-            for (unsigned long a = sentSize; a < messageLength; a++) {
-                extraStr += message[a];
-            }
-            if (ensureFullStringSent) { //This optional bool is set to false. If manually changed to true send the rest. Otherwise, return the unsent part
-                this->send(extraStr.c_str(), clientIndex, ensureFullStringSent); //Recursively keep sending the rest of the string until it is all sent
-                return "";
-            }
-            return extraStr; //Return any part of the string that was not sent. This occurs if the string is too long
-        }
+        //Return any part of the string that was not sent. This occurs if the string is too long, and is the only case that allocates
+        if (sentSize < messageLength) return std::string(message + sentSize, messageLength - sentSize);
         return ""; //Full string was sent
     }
     
+    /*!
+     * A function that sends a message to a single client. The message can hold any bytes, including '\0', and nothing is allocated or copied. Errors are thrown in the same cases as send(const char*, unsigned int, bool).
+     *
+     * @param message The bytes to be sent.
+     * @param clientIndex An unsigned int indicating the index of the client to whom to send the message.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
+     *
+     * @return The number of bytes sent. If less than the length of the message, the caller can send the rest later.
+     */
+    unsigned long send(std::string_view message, unsigned int clientIndex, bool ensureFullStringSent = false) {
+        return this->sendBytes(message.data(), message.size(), clientIndex, ensureFullStringSent);
+    }
+    
+#if __cplusplus >= 202002L
+    /*!
+     * A function that sends binary data to a single client. It works exactly like send(std::string_view, unsigned int, bool).
+     *
+     * @param message The bytes to be sent.
+     * @param clientIndex An unsigned int indicating the index of the client to whom to send the message.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
+     *
+     * @return The number of bytes sent.
+     */
+    unsigned long send(std::span<const std::byte> message, unsigned int clientIndex, bool ensureFullStringSent = false) {
+        return this->sendBytes((const char*)message.data(), message.size(), clientIndex, ensureFullStringSent);
+    }
+#endif
+    
+    /*!
+     * A function that sends a message the caller no longer needs to a single client. The message can hold any bytes, including '\0'. Errors are thrown in the same cases as send(const char*, unsigned int, bool).
+     *
+     * @param message The message to be sent. It is moved in.
+     * @param clientIndex An unsigned int indicating the index of the client to whom to send the message.
+     * @param ensureFullStringSent An optional parameter that will make sure the full string is sent if it is too long to send with one call of write(). It is automatically set to false.
+     *
+     * @return Any part of the message that wasn't sent, in the same string that was moved in, so nothing new is allocated.
+     */
+    std::string send(std::string&& message, unsigned int clientIndex, bool ensureFullStringSent = false) {
+        unsigned long sentSize = this->sendBytes(message.data(), message.size(), clientIndex, ensureFullStringSent);
+        
+        //Return what was not sent in the string that was moved in, rather than in a new one
+        message.erase(0, sentSize);
+        return std::move(message);
+    }
+    
+    /*!
+     * A function that sends a typed message to a single client, in the wire layout declared by MessageSchema<T>. The message is encoded on the stack, so nothing is allocated. Errors are thrown in the same cases as send(const char*, unsigned int, bool).
+     *
+     * @param message The message to be sent.
+     * @param clientIndex An unsigned int indicating the index of the client to whom to send the message.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to true, since the other side reads messages whole.
+     *
+     * @return The number of bytes sent.
+     */
+    template <typename T>
+    unsigned long sendMessage(const T& message, unsigned int clientIndex, bool ensureFullStringSent = true) {
+        char encoded[MessageLayout<T>::size];
+        encodeMessage(message, encoded);
+        return this->sendBytes(encoded, MessageLayout<T>::size, clientIndex, ensureFullStringSent);
+    }
+    
     /*!
      * A function that sends a message to all clients. An error will be thrown if the socket is not set or if an error occurs in sending the message to any of the clients. If the optional parameter is set to true, an error will also be thrown if only part of the message was thrown.
      *
@@ -281,238 +598,2009 @@ public:
      * @param ensureFullStringSent An optional parameter that will make sure the full string is sent if it is too long to send with one call of write(). It is automatically set to false (so the rest of the string is not sent, but rather discarded.
      */
     void broadcast(const char* message, bool ensureFullStringSent = false) {
+        //Measure the message once rather than once per client
+        this->broadcast(std::string_view(message != nullptr ? message : ""), ensureFullStringSent);
+    }
+    
+    /*!
+     * A function that sends a message, which can hold any bytes, to all clients. It works like broadcast(const char*, bool).
+     *
+     * @param message The bytes to be sent.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
+     */
+    void broadcast(std::string_view message, bool ensureFullStringSent = false) {
         if (!this->setUp)
             throw std::logic_error("Socket not set");
         
+        SOCKS_PROBE2(broadcast_start, this->numberOfClients(), message.size());
+        unsigned int clients = 0;
+        unsigned long sent = 0;
+        
         //Send the message to each active client
         for (int a = 0; a < this->activeConnections.size(); a++) {
             if (this->activeConnections[a]) {
-                this->send(message, a, ensureFullStringSent);
+                sent += this->sendBytes(message.data(), message.size(), a, ensureFullStringSent);
+                clients++;
             }
         }
+        SOCKS_PROBE2(broadcast_end, clients, sent);
     }
     
     /*!
-     * A function that receives a message from a single client. The function will wait for a short period for the client to send the message, and if the message is not received it will throw an error. An error is also thrown if the index is out of range or if the socket is not set.
+     * A function that sends a large message to a single client without copying it into the kernel, if zero-copy sending is enabled (see setZeroCopy()). The kernel sends straight from the message's memory, so the message is held until the kernel reports it is done with it, which is noticed by releaseZeroCopyBuffers(). Smaller messages, or messages to clients that can't use zero-copy sending, are sent normally. Errors are thrown in the same cases as send(const char*, unsigned int, bool).
      *
-     * @param clientIndex An unsigned int indicating the index of the client from whom to receive the message.
-     * @param socketClosed An optional pointer to a bool that would be set to true if the client disconnected. Automatically set to a null pointer otherwise.
+     * @param message The message to be sent. It must not be changed until it is released.
+     * @param clientIndex An unsigned int indicating the index of the client to whom to send the message.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
      *
-     * @return The received message from the specified client as a std::string.
+     * @return The number of bytes sent.
      */
-    std::string receive(unsigned int clientIndex, bool* socketClosed = nullptr) {
+    unsigned long sendZeroCopy(std::shared_ptr<const std::string> message, unsigned int clientIndex, bool ensureFullStringSent = false) {
         if (!this->setUp)
             throw std::logic_error("Socket not set");
         
-        //Throw an error if there is no socket at the index from which to receive
+        //A blank message won't be sent
+        if (!message || message->empty())
+            throw std::logic_error("No message to send");
+        
+        //Throw an error if there is no socket at the index
         if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
             throw std::logic_error("Socket index uninitialized");
         
-        //Initialize the buffer where received info is stored
-        bzero(this->buffer, BUFFER_SIZE);
-        
-        long messageSize; //Stores the return value from the calls to read() and write() by holding the number of characters either read or written
-        
-        /* read()
-         The read() function will read in info from the client socket, with three arguments. It will block the thread until the client writes and there is something to read in.
-         
-         The first argument is the reference for the client's socket.
-         
-         The second argument is the buffer to store the message.
-         
-         The third argument is the maximum number of characters to to be read into the buffer.
-         */
-        messageSize = read(this->clientSocketsFD[clientIndex], this->buffer, BUFFER_SIZE);
-        
-        //Checks for errors reading from the socket
-        if (messageSize < 0)
-            throw std::runtime_error(strcat((char *)"ERROR reading from socket: ", strerror(errno)));
+        //Copying is cheaper for small messages, and the only option for some clients
+        if (!this->zeroCopyClients[clientIndex] || message->size() < this->zeroCopyThreshold)
+            return this->sendBytes(message->data(), message->size(), clientIndex, ensureFullStringSent);
         
-        //A blank message indicates that the socket has closed from the client side. If this is the case, close the connection.
-        if (socketClosed != nullptr && messageSize == 0) {
-            *socketClosed = true;
-            this->closeConnection(clientIndex);
-        }
-        
-        std::string str = std::string(buffer, messageSize);
-        
-        //Check if there is more data waiting to be read, and if so, read it
-        fd_set readfds;
-        FD_ZERO(&readfds);
-        FD_SET(this->hostSocket, &readfds);
-        int n = this->hostSocket + 1;
-        
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 20000;
+        //Free memory from earlier sends the kernel is done with
+        this->readErrorQueue(clientIndex);
+        this->releaseRetiredZeroCopy();
         
-        int returnValue = select(n, &readfds, NULL, NULL, &timeout);
-        if (returnValue < 0) {
-            throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
-        } else if (returnValue > 0) {
-            str += this->receive(clientIndex);
+        unsigned long sent = 0;
+        while (sent < message->size()) {
+            long sentSize = this->writeZeroCopy(message, sent, clientIndex, 0);
+            
+            if (sentSize < 0) {
+                if (errno == EINTR) continue;
+                //The kernel limits how much memory one socket can pin. If that is reached, wait for earlier sends to finish
+                if (errno == ENOBUFS) {
+                    pollfd pollInfo;
+                    pollInfo.fd = this->clientSocketsFD[clientIndex];
+                    pollInfo.events = 0; //Only errors, which include finished zero-copy sends, are waited for
+                    pollInfo.revents = 0;
+                    poll(&pollInfo, 1, 10);
+                    if (this->readErrorQueue(clientIndex) == 0 && !ensureFullStringSent) break;
+                    continue;
+                }
+                throw std::runtime_error(std::string("ERROR sending message: ") + std::string(strerror(errno)));
+            }
+            
+            if (this->capture && sentSize > 0) this->capture->append(clientIndex, TrafficCapture::Sent, message->data() + sent, sentSize);
+            sent += sentSize;
+            
+            //Unless the full message must be sent, stop after one write and let the caller deal with the rest
+            if (!ensureFullStringSent || sentSize == 0) break;
         }
-        
-        return str;
+        return sent;
     }
     
     /*!
-     * A function that checks if all clients sent a specific message. This function calls ServerSocket::receive() so if another message has been sent that message may be received instead, and thus will not be read or returned by the server. This function throws no errors other than those called by ServerSocket::receive() or ServerSocket::closeConnection(). Any sockets where connection was lost are automatically closed.
-     *
-     * @param messageToCompare The message that is checked with all clients, as a const char*.
+     * A function that sends a large message to all clients without copying it into the kernel, like sendZeroCopy(). Every client is sent from the same memory. An error will be thrown if the socket is not set or if an error occurs in sending the message to any of the clients.
      *
-     * @return True if all clients sent the same message as the one passed in. False otherwise.
+     * @param message The message to be sent. It must not be changed until it is released.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
      */
-    bool receivedFromAll(const char* messageToCompare) {
+    void broadcastZeroCopy(std::shared_ptr<const std::string> message, bool ensureFullStringSent = false) {
         if (!this->setUp)
             throw std::logic_error("Socket not set");
         
-        //If each client sent the same message, return true
-        for (int a = 0; a < this->activeConnections.size(); a++) {
-            bool connectionClosed = false;
-            if (this->activeConnections[a] && this->receive(a, &connectionClosed) != messageToCompare) { //Also closes sockets that closed on client side
-                return false;
+        SOCKS_PROBE2(broadcast_start, this->numberOfClients(), message->size());
+        unsigned int clients = 0;
+        unsigned long sent = 0;
+        
+        //Send the same memory to each active client
+        for (size_t a = 0; a < this->activeConnections.size(); a++) {
+            if (this->activeConnections[a]) {
+                sent += this->sendZeroCopy(message, a, ensureFullStringSent);
+                clients++;
             }
         }
-        return true;
+        SOCKS_PROBE2(broadcast_end, clients, sent);
     }
     
     /*!
-     * A function to set a timeout for reading from the socket, until otherwise specified. If a socket times out and receive()'s optional bool pointer has been into it, then it will indicate the socket closed. To reset to no timeout, set seconds to 0. Only set for the connections with other clients.
+     * A function to turn zero-copy sending on or off for every client, including clients added later. When on, sendZeroCopy(), broadcastZeroCopy() and flushPosted() send messages of at least the given size straight from their memory instead of copying them into the kernel, which saves memory bandwidth on large messages. Where the system does not support it (it needs Linux 4.14 or later), messages are copied as usual. An error will be thrown if the socket is not set.
      *
-     * @param seconds The number of seconds for which to set the timeout for. If 0, timeout will be cleared.
-     * @param milliseconds An optional parameter indicating the number of milliseconds to add to the timeout. Autoinitialized as 0.
+     * @param enable True to turn zero-copy sending on.
+     * @param threshold An optional parameter indicating the smallest message, in bytes, worth sending without a copy. Autoinitialized as ZERO_COPY_THRESHOLD.
      */
-    void setTimeout(unsigned int seconds, unsigned int milliseconds = 0) {
+    void setZeroCopy(bool enable, unsigned long threshold = ZERO_COPY_THRESHOLD) {
         if (!this->setUp)
             throw std::logic_error("Socket not set");
         
-#if defined(_WIN32)
-        DWORD timeout = (seconds * 1000) + milliseconds;
-        for (int a = 0; a < this->activeConnections.size(); a++) {
-            if (this->activeConnections[a]) setsockopt(this->clientSocketsFD[a], SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
-        }
-#else
-        struct timeval time; //Time holds the maximum time to wait
-        time.tv_sec = seconds;
-        time.tv_usec = (milliseconds * 1000);
+        this->zeroCopy = enable;
+        this->zeroCopyThreshold = threshold;
         
-        for (int a = 0; a < this->activeConnections.size(); a++) { //For each socket, set the maximum waiting time the inputted amount
-            /* setsockopt()
-             The setsockopt() function changes options for a given socket, depending on the parameters.
-             
-             The first argument is the client side socket, passed by its file descriptor.
-             
-             The second argument is ...?
-             
-             The third argument tells what setting to change. SO_RCVTIMEO indicates the socket option is for the amount of time to wait while timing out.
-             */
-            if (this->activeConnections[a]) setsockopt(this->clientSocketsFD[a], SOL_SOCKET, SO_RCVTIMEO, (struct timeval*)&time, sizeof(struct timeval));
+        //Apply the setting to each client already connected. Clients added later get it when they are accepted
+        for (size_t a = 0; a < this->activeConnections.size(); a++) {
+            if (this->activeConnections[a]) this->setZeroCopyOptions(a);
         }
-#endif
     }
     
     /*!
-     * A function to set a timeout for host socket actions, like listening for other sockets and accepting them. To reset to no timeout, set seconds to 0.
+     * A function that releases messages which the kernel has finished sending without a copy, including those sent to clients that have since been closed. It is also called before each zero-copy send, so it only needs to be called directly to free memory sooner, or after drain() to free what the kernel was still sending when it returned.
      *
-     * @param seconds The number of seconds for which to set the timeout for. If 0, timeout will be cleared.
-     * @param milliseconds An optional parameter indicating the number of milliseconds to add to the timeout. Autoinitialized as 0.
+     * @return The number of messages, or parts of messages, released.
      */
-    void setHostTimeout(unsigned int seconds, unsigned int milliseconds = 0) {
-        if (!this->setUp)
-            throw std::logic_error("Socket not set");
+    unsigned int releaseZeroCopyBuffers() {
+        unsigned int released = this->releaseRetiredZeroCopy();
+        for (size_t a = 0; a < this->activeConnections.size(); a++) {
+            if (this->activeConnections[a] && !this->zeroCopyPending[a].empty()) released += this->readErrorQueue(a);
+        }
+        return released;
+    }
+    
+    /*!
+     * A function that starts recording every message sent to or received from any client, with the time and the client's index, and when each client connects and is closed, so the traffic can be played back later with TrafficReplay. Recording is a copy into a memory-mapped file, so it adds little to each call. Will throw an error if a capture is already running, or if the file cannot be created.
+     *
+     * @param path The path of the capture file. Any existing file is replaced.
+     */
+    void startCapture(const char* path) {
+        if (this->capture)
+            throw std::logic_error("Already capturing");
         
-#if defined(_WIN32)
-        DWORD timeout = (seconds * 1000) + milliseconds;
-        setsockopt(this->hostSocketFD, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
-#else
-        struct timeval time;
-        time.tv_sec = seconds;
-        time.tv_usec = (milliseconds * 1000);
-        setsockopt(this->hostSocketFD, SOL_SOCKET, SO_RCVTIMEO, (struct timeval*)&time, sizeof(struct timeval));
-#endif
+        std::unique_ptr<TrafficCapture> capture(new TrafficCapture());
+        capture->open(path);
+        this->capture = std::move(capture);
     }
     
     /*!
-     * @return The number of clients of this socket.
+     * A function that stops recording and finishes the capture file. Nothing happens if no capture is running.
      */
-    unsigned int numberOfClients() const {
+    void stopCapture() {
+        //Destroying the capture finishes the file
+        this->capture.reset();
+    }
+    
+    /*!
+     * A function to turn latency tracing on or off for every client, including clients added later. While on, each client's LatencyTrace records how long received data waited in the kernel before being read, and how long sent data took to reach the network device, using the kernel's software timestamps (SO_TIMESTAMPING, Linux only). Turning it off discards the traces. An error will be thrown if the socket is not set.
+     *
+     * @param enable True to turn tracing on.
+     */
+    void setTracing(bool enable) {
         if (!this->setUp)
             throw std::logic_error("Socket not set");
         
-        //Count the number of connections which are active
-        int connections = 0;
-        for (int a = 0; a < this->activeConnections.size(); a++) {
-            if (this->activeConnections[a]) {
-                connections++;
-            }
+        this->tracing = enable;
+        
+        //Apply the setting to each client already connected. Clients added later get it when they are added
+        for (size_t a = 0; a < this->activeConnections.size(); a++) {
+            if (this->activeConnections[a]) this->setTracingOptions(a);
         }
-        return connections;
     }
     
     /*!
-     * @return If this object is set.
+     * A function that gets the latency trace of a single client, including any timestamps the kernel has reported since the last send. An error will be thrown if the socket is not set, if the index is out of range, or if tracing is off.
+     *
+     * @param clientIndex An unsigned int indicating the index of the client.
+     *
+     * @return The client's trace. It stays valid until the connection is closed or tracing is turned off.
      */
-    bool isSet() const {
-        return this->setUp;
-    }
+    const LatencyTrace& latencyTrace(unsigned int clientIndex) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        //Throw an error if there is no socket at the index
+        if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+            throw std::logic_error("Socket index uninitialized");
+        
+        if (!this->traces[clientIndex])
+            throw std::logic_error("Tracing not on");
+        
+        //Collect any transmit timestamps the kernel has reported since the last send
+        if (!this->sharedMemoryRings[clientIndex]) this->readErrorQueue(clientIndex);
+        
+        return this->traces[clientIndex]->trace;
+    }
     
-private:
-    //Private properties
+    /*!
+     * A function that subscribes a client to a topic, so it receives messages published to that topic. Subscribing a client twice has no effect. A client's subscriptions end when its connection is closed. An error will be thrown if the socket is not set, if the topic is an empty string, or if the index is out of range.
+     *
+     * @param topic The name of the topic.
+     * @param clientIndex An unsigned int indicating the index of the client to subscribe.
+     */
+    void subscribe(std::string_view topic, unsigned int clientIndex) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        if (topic.empty())
+            throw std::logic_error("No topic");
+        
+        //Throw an error if there is no socket at the index
+        if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+            throw std::logic_error("Socket index uninitialized");
+        
+        //Find the topic, or give it the next ID if it is new
+        std::map<std::string, unsigned int, std::less<>>::iterator found = this->topicIDs.find(topic);
+        if (found == this->topicIDs.end()) {
+            found = this->topicIDs.emplace(std::string(topic), (unsigned int)this->topicSubscribers.size()).first;
+            this->topicSubscribers.push_back(std::vector<unsigned int>());
+        }
+        unsigned int topicID = found->second;
+        
+        //Subscribers are kept sorted, so a client can be found or added without scanning every subscriber
+        std::vector<unsigned int>& subscribers = this->topicSubscribers[topicID];
+        std::vector<unsigned int>::iterator position = std::lower_bound(subscribers.begin(), subscribers.end(), clientIndex);
+        if (position != subscribers.end() && *position == clientIndex) return; //Already subscribed
+        
+        subscribers.insert(position, clientIndex);
+        this->clientTopics[clientIndex].push_back(topicID);
+    }
     
-    int portNumber; //The port nubmer where connections are accepted
+    /*!
+     * A function that unsubscribes a client from a topic. Nothing happens if the client was not subscribed. An error will be thrown if the socket is not set or if the index is out of range.
+     *
+     * @param topic The name of the topic.
+     * @param clientIndex An unsigned int indicating the index of the client to unsubscribe.
+     */
+    void unsubscribe(std::string_view topic, unsigned int clientIndex) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        //Throw an error if there is no socket at the index
+        if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+            throw std::logic_error("Socket index uninitialized");
+        
+        std::map<std::string, unsigned int, std::less<>>::iterator found = this->topicIDs.find(topic);
+        if (found == this->topicIDs.end()) return;
+        
+        this->removeSubscriber(found->second, clientIndex);
+        
+        std::vector<unsigned int>& topics = this->clientTopics[clientIndex];
+        std::vector<unsigned int>::iterator position = std::find(topics.begin(), topics.end(), found->second);
+        if (position != topics.end()) topics.erase(position);
+    }
     
-    /* struct addrinfo {
-         int ai_flags; //AI_PASSIVE, AI_CANONNAME, etc...
-         int ai_family; //AF_INET, AF_INET6, AF_UNSPEC. This is the type of IP address (IPv4, IPv6, or any, respectively)
-         int ai_socktype; //SOCK_STREAM, SOCK_DGRAM (TCP and UDP, respectively)
-         int ai_protocol; //0 represents any
-         size_t ai_addrlen; //Represents the size of the following property ai_addr, in bytes
-         struct sockaddr* ai_addr; //A struct containing the address info. Can be a sockaddr_in or sockaddr_in6
-         char* hostname; //Full hostname
-         
-         struct addrinfo* ai_next; //The next addrinfo node. Used when addrinfo structs are returned as a linked list
-     }
+    /*!
+     * A function that sends a message to every client subscribed to a topic. Its cost depends on the number of subscribers, not the number of clients. An error will be thrown if the socket is not set, if the message is empty, or if an error occurs in sending the message to any of the subscribers.
+     *
+     * @param topic The name of the topic.
+     * @param message The message to be sent. It can hold any bytes, and is not copied.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false (so the rest of the message is not sent, but rather discarded).
+     *
+     * @return The number of clients the message was sent to.
      */
-    addrinfo serverAddress;
+    unsigned int publish(std::string_view topic, std::string_view message, bool ensureFullStringSent = false) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        std::map<std::string, unsigned int, std::less<>>::const_iterator found = this->topicIDs.find(topic);
+        if (found == this->topicIDs.end()) return 0;
+        
+        //Only the subscribers are visited, however many clients there are
+        const std::vector<unsigned int>& subscribers = this->topicSubscribers[found->second];
+        for (size_t a = 0; a < subscribers.size(); a++) {
+            this->sendBytes(message.data(), message.size(), subscribers[a], ensureFullStringSent);
+        }
+        return subscribers.size();
+    }
     
-    //These are "file descriptors", which store values from both the socket system call and the accept system call
-    int hostSocketFD;
+    /*!
+     * A function that sends a message to every client subscribed to a topic, like publish(std::string_view, std::string_view, bool), but through sendZeroCopy(). All subscribers are sent from the same memory, and large messages are not copied into the kernel if zero-copy sending is on.
+     *
+     * @param topic The name of the topic.
+     * @param message The message to be sent. It must not be changed until it is released.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
+     *
+     * @return The number of clients the message was sent to.
+     */
+    unsigned int publish(std::string_view topic, std::shared_ptr<const std::string> message, bool ensureFullStringSent = false) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        std::map<std::string, unsigned int, std::less<>>::const_iterator found = this->topicIDs.find(topic);
+        if (found == this->topicIDs.end()) return 0;
+        
+        //Every subscriber is sent from the same memory, without a copy if zero-copy sending is on
+        const std::vector<unsigned int>& subscribers = this->topicSubscribers[found->second];
+        for (size_t a = 0; a < subscribers.size(); a++) {
+            this->sendZeroCopy(message, subscribers[a], ensureFullStringSent);
+        }
+        return subscribers.size();
+    }
     
-    std::vector<bool> activeConnections;//[MAX_NUMBER_OF_CONNECTIONS]; //Initialized as all false. True if the connection of that index is an active connection
+    /*!
+     * @param topic The name of the topic.
+     *
+     * @return The number of clients subscribed to the topic.
+     */
+    unsigned int numberOfSubscribers(std::string_view topic) const {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        std::map<std::string, unsigned int, std::less<>>::const_iterator found = this->topicIDs.find(topic);
+        return found == this->topicIDs.end() ? 0 : this->topicSubscribers[found->second].size();
+    }
     
-    std::vector<int> clientSocketsFD;//[MAX_NUMBER_OF_CONNECTIONS];
+    /*!
+     * A function that queues a message for a single client. Unlike every other function, it can be called from any thread at any time: the message goes into a lock-free queue, and is only sent when the thread that owns this socket calls flushPosted(). Threads posting never wait on each other. Messages for an index that has no client by the time they are flushed are discarded.
+     *
+     * @param message The message to be sent. It is moved into the queue.
+     * @param clientIndex An unsigned int indicating the index of the client to whom to send the message.
+     */
+    void post(std::string message, unsigned int clientIndex) {
+        PostedMessage posted;
+        posted.clientIndex = clientIndex;
+        posted.broadcast = false;
+        posted.message = std::make_shared<const std::string>(std::move(message));
+        this->pushPosted(std::move(posted));
+    }
     
-    /* struct sockaddr_storage {
-        sa_family_t ss_family; //Either AF_INET or AF_INET6
-        * A bunch of padding variables are also here. Ignore them. *
-     }
-     This struct is large enough that it can hold either an IPv4 or an IPv6 address (and be cast to either sockaddr_in or sockaddr_in6 if necessary)
+    /*!
+     * A function that queues a message for every client. Like post(), it can be called from any thread at any time, and the message is sent by flushPosted(). All clients share one copy of the message.
+     *
+     * @param message The message to be sent. It is moved into the queue.
      */
-    std::vector<sockaddr_storage> clientAddresses;//[MAX_NUMBER_OF_CONNECTIONS];
-    std::vector<socklen_t> clientAddressSizes;//[MAX_NUMBER_OF_CONNECTIONS];
+    void postBroadcast(std::string message) {
+        PostedMessage posted;
+        posted.clientIndex = 0;
+        posted.broadcast = true;
+        posted.message = std::make_shared<const std::string>(std::move(message));
+        this->pushPosted(std::move(posted));
+    }
     
-    char buffer[BUFFER_SIZE];
+    /*!
+     * A function that queues a message for every client subscribed to a topic. Like post(), it can be called from any thread at any time. The subscribers are looked up when flushPosted() runs, and all of them share one copy of the message.
+     *
+     * @param topic The name of the topic.
+     * @param message The message to be sent. It is moved into the queue.
+     */
+    void postPublish(std::string topic, std::string message) {
+        PostedMessage posted;
+        posted.clientIndex = 0;
+        posted.broadcast = false;
+        posted.topic = std::move(topic);
+        posted.message = std::make_shared<const std::string>(std::move(message));
+        this->pushPosted(std::move(posted));
+    }
     
-    bool setUp = false; //Represents if the socket has already been set. If not, reading and writing will cause errors
+    /*!
+     * A function that sends messages queued by post() and postBroadcast(), as far as each client can take them without waiting. What a client cannot take yet stays queued for that client, in order, until the next call. It must be called from the thread that owns this socket. An error will be thrown if the socket is not set.
+     *
+     * @return The number of bytes still queued for all clients. If not 0, flushPosted() should be called again soon.
+     */
+    unsigned long flushPosted() {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        //Clear the signal before taking messages off the queue. A post that lands after this signals again, so it is never missed
+        char signal[64];
+        while (read(this->postNotifyFD, signal, sizeof(signal)) > 0) {}
+        this->pendingPosts.store(0, std::memory_order_release);
+        
+        //Move posted messages to the queue of each client they are for
+        PostedMessage posted;
+        while (this->postedMessages.pop(posted)) {
+            this->postedMemory.fetch_sub(posted.message->size(), std::memory_order_relaxed);
+            
+            //A blank message won't be sent
+            if (posted.message->empty()) continue;
+            
+            if (!posted.topic.empty()) {
+                //Every subscriber shares the one copy of the message
+                std::map<std::string, unsigned int, std::less<>>::const_iterator topic = this->topicIDs.find(posted.topic);
+                if (topic == this->topicIDs.end()) continue;
+                
+                const std::vector<unsigned int>& subscribers = this->topicSubscribers[topic->second];
+                for (size_t a = 0; a < subscribers.size(); a++) {
+                    this->enqueue(subscribers[a], posted.message);
+                }
+            } else if (posted.broadcast) {
+                for (size_t a = 0; a < this->activeConnections.size(); a++) {
+                    if (this->activeConnections[a]) this->enqueue(a, posted.message);
+                }
+            } else if (posted.clientIndex < this->activeConnections.size() && this->activeConnections[posted.clientIndex]) {
+                this->enqueue(posted.clientIndex, posted.message);
+            }
+        }
+        
+        //Send as much as each client can take
+        for (size_t a = 0; a < this->activeConnections.size(); a++) {
+            if (!this->outboundQueues[a].empty()) this->writeQueued(a);
+        }
+        
+        //What clients could not take stays in memory, so check it against the budget
+        this->shedMemory();
+        
+        //Count what is left
+        unsigned long remaining = 0;
+        for (size_t a = 0; a < this->activeConnections.size(); a++) {
+            if (this->outboundQueues[a].empty()) continue;
+            remaining += this->queuedBytes[a] - this->outboundOffsets[a];
+        }
+        return remaining;
+    }
     
-    //Private member functions
+    /*!
+     * @return A file descriptor that becomes readable when messages have been posted, so the thread that owns this socket can wait on it with poll() or select() and then call flushPosted(). -1 if the socket is not set.
+     */
+    int postedFD() const {
+        return this->setUp ? this->postNotifyFD : -1;
+    }
     
     /*!
-     * A function to get the next index to which a client can connect. -1 is returned if there are no more available indices.
+     * @param clientIndex The index of the client.
      *
-     * @return The next available index.
+     * @return The file descriptor of the client's TCP connection, so it can be waited on with poll() or handed to a Relay. -1 if there is no client at the index or it is connected through shared memory.
      */
-    int getNextAvailableIndex() const {
+    int clientFD(unsigned int clientIndex) const {
+        if (!this->setUp || clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex] || this->sharedMemoryRings[clientIndex])
+            return -1;
+        return this->clientSocketsFD[clientIndex];
+    }
+    
+    /*!
+     * A function that limits the memory this socket holds for clients: receive buffers, messages queued by post(), postBroadcast() and postPublish() that clients have not taken yet, and posts that flushPosted() has not handled yet. A queued message is counted once for every client it is queued for, even though broadcasts share one copy. flushPosted() checks the budget after it sends. If memory is over it, every receive buffer is freed first, since they hold nothing between reads, and then the policy applies until memory is back under it. Disconnected clients' indices become free, as with closeDeadConnections().
+     *
+     * @param bytes The budget. 0 removes it.
+     * @param policy An optional parameter indicating what to do when memory is over the budget. Autoinitialized as DropOldest.
+     */
+    void setMemoryBudget(unsigned long bytes, MemoryPolicy policy = DropOldest) {
+        this->memoryBudget = bytes;
+        this->memoryPolicy = policy;
+    }
+    
+    /*!
+     * @return The bytes counted against the memory budget, whether or not a budget is set.
+     */
+    unsigned long memoryInUse() const {
+        return this->receiveMemory + this->queuedMemory + this->postedMemory.load(std::memory_order_relaxed);
+    }
+    
+    /*!
+     * @return If a memory budget is set and memory is over it. Under the PauseReading policy, the caller should stop reading from clients while this is true.
+     */
+    bool isOverBudget() const {
+        return this->memoryBudget > 0 && this->memoryInUse() > this->memoryBudget;
+    }
+    
+    /*!
+     * A function that receives a message from a single client. The function will wait for a short period for the client to send the message, and if the message is not received it will throw an error. An error is also thrown if the index is out of range or if the socket is not set.
+     *
+     * @param clientIndex An unsigned int indicating the index of the client from whom to receive the message.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the client disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return The received message from the specified client as a std::string.
+     */
+    std::string receive(unsigned int clientIndex, bool* socketClosed = nullptr) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        //Throw an error if there is no socket at the index from which to receive
+        if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+            throw std::logic_error("Socket index uninitialized");
+        
+        ReceiveBuffer& buffer = this->receiveBuffers[clientIndex];
+        std::string str;
+        
+        //Keep reading while more of the message is already waiting
+        while (true) {
+            //Over the memory budget, reading is paused: the buffer doesn't grow, and nothing more is read than one buffer's worth
+            bool paused = this->memoryPolicy == PauseReading && this->isOverBudget();
+            
+            long messageSize; //Stores the return value from the calls to read() and write() by holding the number of characters either read or written
+            
+            /* read()
+             The read() function will read in info from the client socket, with three arguments. It will block the thread until the client writes and there is something to read in.
+             
+             The first argument is the reference for the client's socket.
+             
+             The second argument is the buffer to store the message.
+             
+             The third argument is the maximum number of characters to to be read into the buffer.
+             */
+            if (this->sharedMemoryRings[clientIndex]) {
+                buffer.reserve(paused ? 0 : this->sharedMemoryRings[clientIndex]->available());
+                messageSize = this->sharedMemoryRings[clientIndex]->read(buffer.data(), buffer.size(), str.empty() ? this->timeoutMilliseconds : 0);
+            } else {
+                //Size the buffer by what the kernel already has, so a large message takes a few large reads
+                int waiting = 0;
+                if (ioctl(this->clientSocketsFD[clientIndex], FIONREAD, &waiting) < 0) waiting = 0;
+                buffer.reserve(paused ? 0 : waiting);
+                messageSize = this->readSocket(clientIndex, buffer.data(), buffer.size());
+            }
+            
+            //Checks for errors reading from the socket
+            if (messageSize < 0)
+                throw std::runtime_error(strcat((char *)"ERROR reading from socket: ", strerror(errno)));
+            
+            //A blank message indicates that the socket has closed from the client side. If this is the case, close the connection. There is nothing more to read either way.
+            if (messageSize == 0) {
+                if (str.empty() && socketClosed != nullptr) {
+                    *socketClosed = true;
+                    this->closeConnection(clientIndex);
+                }
+                return str;
+            }
+            
+            this->lastSeenTimes[clientIndex] = std::chrono::steady_clock::now();
+            if (this->capture) this->capture->append(clientIndex, TrafficCapture::Received, buffer.data(), messageSize);
+            
+            str.append(buffer.data(), messageSize);
+            buffer.used(messageSize); //Only once the bytes are copied out, since it may replace the memory
+            if (paused) return str;
+            
+            //A shared memory client never has to wait for the rest of a message to arrive over the network, so only read on if more is already there
+            if (this->sharedMemoryRings[clientIndex]) {
+                if (this->sharedMemoryRings[clientIndex]->available() == 0) return str;
+                continue;
+            }
+            
+            //Check if there is more data waiting to be read, and if so, read it. poll() is used rather than select(), which also reports a socket as readable when only notifications, like finished zero-copy sends, are waiting
+            pollfd pollInfo;
+            pollInfo.fd = this->clientSocketsFD[clientIndex];
+            pollInfo.events = POLLIN;
+            pollInfo.revents = 0;
+            
+            int returnValue = poll(&pollInfo, 1, 20);
+            if (returnValue < 0) {
+                throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
+            } else if (returnValue == 0 || (pollInfo.revents & (POLLIN | POLLHUP)) == 0) {
+                return str;
+            }
+        }
+    }
+    
+    /*!
+     * A function that receives exactly a given number of bytes from a single client into the caller's buffer, waiting until all of them have arrived. Nothing is allocated. Since receive() reads whatever has arrived, the two should not be mixed on one connection. Errors are thrown in the same cases as receive().
+     *
+     * @param buffer The buffer to fill.
+     * @param length The number of bytes to receive.
+     * @param clientIndex An unsigned int indicating the index of the client from whom to receive.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the client disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return True if all the bytes were received, false if the client disconnected first.
+     */
+    bool receive(char* buffer, unsigned long length, unsigned int clientIndex, bool* socketClosed = nullptr) {
+        return this->receiveBytes(buffer, length, clientIndex, socketClosed);
+    }
+    
+    /*!
+     * A function that receives exactly one typed message from a single client into a buffer, waiting until all of it has arrived. Fields are then read from buffer.view() without any parsing. Since receive() reads whatever has arrived, the two should not be mixed on one connection. Errors are thrown in the same cases as receive().
+     *
+     * @param buffer The buffer to fill. It can be reused for every message.
+     * @param clientIndex An unsigned int indicating the index of the client from whom to receive the message.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the client disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return True if a whole message was received, false if the client disconnected first.
+     */
+    template <typename T>
+    bool receiveMessage(MessageBuffer<T>& buffer, unsigned int clientIndex, bool* socketClosed = nullptr) {
+        return this->receiveBytes(buffer.data(), MessageLayout<T>::size, clientIndex, socketClosed);
+    }
+    
+    /*!
+     * A function that receives one record from a single client, for protocols that end each message with a delimiter, like newline-delimited text. Whatever arrives after the record is kept for the next call, so a read that brings many records is only made once. Since the bytes kept are not seen by receive(), the two should not be mixed on one connection. Errors are thrown in the same cases as receive(), and if a record is longer than RECORD_MAX_LENGTH.
+     *
+     * @param record Set to the record, without its delimiter. It points into the client's buffer, and stays valid until the next call for that client or until the connection is closed. If the client disconnects without ending the last record, what it sent is returned as a record.
+     * @param clientIndex An unsigned int indicating the index of the client from whom to receive the record.
+     * @param delimiter An optional parameter indicating the byte that ends each record. Autoinitialized as '\n'.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the client disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return True if a record was received, false if the client disconnected first.
+     */
+    bool receiveRecord(std::string_view& record, unsigned int clientIndex, char delimiter = '\n', bool* socketClosed = nullptr) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        //Throw an error if there is no socket at the index from which to receive
+        if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+            throw std::logic_error("Socket index uninitialized");
+        
+        RecordBuffer& buffer = this->recordBuffers[clientIndex];
+        
+        //Only read when no whole record is left over from the last read
+        while (!buffer.next(record, delimiter)) {
+            size_t length;
+            char* space = buffer.space(length);
+            
+            long messageSize;
+            if (this->sharedMemoryRings[clientIndex]) {
+                messageSize = this->sharedMemoryRings[clientIndex]->read(space, length, this->timeoutMilliseconds);
+            } else {
+                messageSize = this->readSocket(clientIndex, space, length);
+            }
+            
+            if (messageSize < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("ERROR reading from socket: ") + std::string(strerror(errno)));
+            }
+            
+            //The stream ended. A last record without a delimiter is still a record
+            if (messageSize == 0) {
+                if (buffer.rest(record)) return true;
+                if (socketClosed != nullptr) {
+                    *socketClosed = true;
+                    this->closeConnection(clientIndex);
+                }
+                return false;
+            }
+            
+            this->lastSeenTimes[clientIndex] = std::chrono::steady_clock::now();
+            if (this->capture) this->capture->append(clientIndex, TrafficCapture::Received, space, messageSize);
+            buffer.added(messageSize);
+        }
+        return true;
+    }
+    
+    /*!
+     * A function that receives a given number of bytes from a single client without holding them all at once. Each piece is passed to the sink as it arrives, and its memory is reused after the sink returns, so the memory used stays within RECEIVE_BUFFER_MAX however long the stream is. No byte past the length is read. Errors are thrown in the same cases as receive(), and if no data arrives within the timeout.
+     *
+     * @param sink A function called with each piece of data and its length.
+     * @param length The number of bytes to receive. ULONG_MAX receives until the client disconnects.
+     * @param clientIndex An unsigned int indicating the index of the client from whom to receive.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the client disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return The number of bytes received. Less than the length if the client disconnected first.
+     */
+    unsigned long receiveStream(const std::function<void(const char*, unsigned long)>& sink, unsigned long length, unsigned int clientIndex, bool* socketClosed = nullptr) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        //Throw an error if there is no socket at the index from which to receive
+        if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+            throw std::logic_error("Socket index uninitialized");
+        
+        ReceiveBuffer& buffer = this->receiveBuffers[clientIndex];
+        unsigned long received = 0;
+        
+        while (received < length) {
+            //Size the buffer by what is waiting, but never read past the end of the stream, so what follows it is left for the next receive
+            unsigned long waiting = 0;
+            if (this->sharedMemoryRings[clientIndex]) {
+                waiting = this->sharedMemoryRings[clientIndex]->available();
+            } else {
+                int available = 0;
+                if (ioctl(this->clientSocketsFD[clientIndex], FIONREAD, &available) == 0) waiting = available;
+            }
+            buffer.reserve(std::min(waiting, length - received));
+            unsigned long chunkSize = std::min((unsigned long)buffer.size(), length - received);
+            
+            long messageSize;
+            if (this->sharedMemoryRings[clientIndex]) {
+                messageSize = this->sharedMemoryRings[clientIndex]->read(buffer.data(), chunkSize, this->timeoutMilliseconds);
+            } else {
+                messageSize = this->readSocket(clientIndex, buffer.data(), chunkSize);
+            }
+            
+            if (messageSize < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("ERROR reading from socket: ") + std::string(strerror(errno)));
+            }
+            
+            //The client disconnected, which is the end of a stream of unknown length
+            if (messageSize == 0) {
+                if (socketClosed != nullptr) {
+                    *socketClosed = true;
+                    this->closeConnection(clientIndex);
+                }
+                break;
+            }
+            
+            this->lastSeenTimes[clientIndex] = std::chrono::steady_clock::now();
+            if (this->capture) this->capture->append(clientIndex, TrafficCapture::Received, buffer.data(), messageSize);
+            
+            sink(buffer.data(), messageSize);
+            buffer.used(messageSize);
+            received += messageSize;
+        }
+        
+        return received;
+    }
+    
+    /*!
+     * A function that sends data to a single client as a source produces it, without holding it all at once. The source is asked for up to STREAM_CHUNK_SIZE bytes at a time, and each piece is sent in full before the next is asked for. Errors are thrown in the same cases as send(const char*, unsigned int, bool).
+     *
+     * @param source A function that fills the buffer it is given with up to the given number of bytes, and returns how many it filled. Returning 0 ends the stream.
+     * @param clientIndex An unsigned int indicating the index of the client to whom to send.
+     *
+     * @return The number of bytes sent.
+     */
+    unsigned long sendStream(const std::function<unsigned long(char*, unsigned long)>& source, unsigned int clientIndex) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        //One chunk is reused for the whole stream
+        std::unique_ptr<char[]> chunk(new char[STREAM_CHUNK_SIZE]);
+        unsigned long sent = 0;
+        
+        while (true) {
+            unsigned long chunkSize = std::min(source(chunk.get(), STREAM_CHUNK_SIZE), (unsigned long)STREAM_CHUNK_SIZE);
+            if (chunkSize == 0) break;
+            
+            sent += this->sendBytes(chunk.get(), chunkSize, clientIndex, true);
+        }
+        
+        return sent;
+    }
+    
+    /*!
+     * A function that checks if all clients sent a specific message. This function calls ServerSocket::receive() so if another message has been sent that message may be received instead, and thus will not be read or returned by the server. This function throws no errors other than those called by ServerSocket::receive() or ServerSocket::closeConnection(). Any sockets where connection was lost are automatically closed.
+     *
+     * @param messageToCompare The message that is checked with all clients, as a const char*.
+     *
+     * @return True if all clients sent the same message as the one passed in. False otherwise.
+     */
+    bool receivedFromAll(const char* messageToCompare) {
         if (!this->setUp)
             throw std::logic_error("Socket not set");
         
+        //If each client sent the same message, return true
         for (int a = 0; a < this->activeConnections.size(); a++) {
-            if (!this->activeConnections[a]) return a;
+            bool connectionClosed = false;
+            if (this->activeConnections[a] && this->receive(a, &connectionClosed) != messageToCompare) { //Also closes sockets that closed on client side
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    /*!
+     * A function to set a timeout for reading from the socket, until otherwise specified. If a socket times out and receive()'s optional bool pointer has been into it, then it will indicate the socket closed. To reset to no timeout, set seconds to 0. Only set for the connections with other clients.
+     *
+     * @param seconds The number of seconds for which to set the timeout for. If 0, timeout will be cleared.
+     * @param milliseconds An optional parameter indicating the number of milliseconds to add to the timeout. Autoinitialized as 0.
+     */
+    void setTimeout(unsigned int seconds, unsigned int milliseconds = 0) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        this->timeoutMilliseconds = (seconds > 0 || milliseconds > 0) ? (seconds * 1000) + milliseconds : -1;
+        
+#if defined(_WIN32)
+        DWORD timeout = (seconds * 1000) + milliseconds;
+        for (int a = 0; a < this->activeConnections.size(); a++) {
+            if (this->activeConnections[a]) setsockopt(this->clientSocketsFD[a], SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+        }
+#else
+        struct timeval time; //Time holds the maximum time to wait
+        time.tv_sec = seconds;
+        time.tv_usec = (milliseconds * 1000);
+        
+        for (int a = 0; a < this->activeConnections.size(); a++) { //For each socket, set the maximum waiting time the inputted amount
+            /* setsockopt()
+             The setsockopt() function changes options for a given socket, depending on the parameters.
+             
+             The first argument is the client side socket, passed by its file descriptor.
+             
+             The second argument is ...?
+             
+             The third argument tells what setting to change. SO_RCVTIMEO indicates the socket option is for the amount of time to wait while timing out.
+             */
+            if (this->activeConnections[a]) setsockopt(this->clientSocketsFD[a], SOL_SOCKET, SO_RCVTIMEO, (struct timeval*)&time, sizeof(struct timeval));
+        }
+#endif
+    }
+    
+    /*!
+     * A function to set a timeout for host socket actions, like listening for other sockets and accepting them. To reset to no timeout, set seconds to 0.
+     *
+     * @param seconds The number of seconds for which to set the timeout for. If 0, timeout will be cleared.
+     * @param milliseconds An optional parameter indicating the number of milliseconds to add to the timeout. Autoinitialized as 0.
+     */
+    void setHostTimeout(unsigned int seconds, unsigned int milliseconds = 0) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        this->hostTimeoutMilliseconds = (seconds > 0 || milliseconds > 0) ? (seconds * 1000) + milliseconds : -1;
+        
+#if defined(_WIN32)
+        DWORD timeout = (seconds * 1000) + milliseconds;
+        setsockopt(this->hostSocketFD, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+#else
+        struct timeval time;
+        time.tv_sec = seconds;
+        time.tv_usec = (milliseconds * 1000);
+        setsockopt(this->hostSocketFD, SOL_SOCKET, SO_RCVTIMEO, (struct timeval*)&time, sizeof(struct timeval));
+#endif
+    }
+    
+    /*!
+     * A function to enable heartbeats on every client connection, including clients added later. Heartbeats are TCP keepalive probes: one is only sent after a connection has been idle for the given time, and it is answered by the client's kernel, so neither program is woken up and busy connections pay nothing. A client that misses the given number of heartbeats in a row is considered dead (see isAlive() and closeDeadConnections()). To disable heartbeats, set idleSeconds to 0.
+     *
+     * @param idleSeconds The number of seconds a connection must be idle before the first heartbeat is sent. If 0, heartbeats are disabled.
+     * @param intervalSeconds An optional parameter indicating the number of seconds between unanswered heartbeats. Autoinitialized as 1.
+     * @param missedHeartbeats An optional parameter indicating how many heartbeats may go unanswered before the connection is considered dead. Autoinitialized as 3.
+     */
+    void setHeartbeat(unsigned int idleSeconds, unsigned int intervalSeconds = 1, unsigned int missedHeartbeats = 3) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        this->heartbeatIdle = idleSeconds;
+        this->heartbeatInterval = intervalSeconds > 0 ? intervalSeconds : 1;
+        this->heartbeatCount = missedHeartbeats > 0 ? missedHeartbeats : 1;
+        
+        //Apply the settings to each client already connected. Clients added later get them when they are accepted
+        for (size_t a = 0; a < this->activeConnections.size(); a++) {
+            if (this->activeConnections[a]) this->setHeartbeatOptions(this->clientSocketsFD[a]);
+        }
+    }
+    
+    /*!
+     * A function that returns the last time a client was known to be alive. This is the later of the last time a message was received from the client and the last time the client's kernel acknowledged anything, including a heartbeat. An error is thrown if the index is out of range or if the socket is not set.
+     *
+     * @param clientIndex An unsigned int indicating the index of the client.
+     *
+     * @return The last time the client was seen.
+     */
+    std::chrono::steady_clock::time_point lastSeen(unsigned int clientIndex) const {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        //Throw an error if there is no socket at the index
+        if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+            throw std::logic_error("Socket index uninitialized");
+        
+        std::chrono::steady_clock::time_point seen = this->lastSeenTimes[clientIndex];
+        
+        if (this->sharedMemoryRings[clientIndex]) return seen;
+        
+#if defined(__linux__)
+        //The kernel knows when the client last acknowledged anything, which includes heartbeats answered without waking either program
+        tcp_info info;
+        socklen_t infoSize = sizeof(info);
+        if (getsockopt(this->clientSocketsFD[clientIndex], IPPROTO_TCP, TCP_INFO, &info, &infoSize) == 0) {
+            std::chrono::steady_clock::time_point acknowledged = std::chrono::steady_clock::now() - std::chrono::milliseconds(info.tcpi_last_ack_recv);
+            if (acknowledged > seen) seen = acknowledged;
+        }
+#endif
+        
+        return seen;
+    }
+    
+    /*!
+     * A function that checks, without blocking, whether a client connection is still alive. A connection is dead if the client closed it, if it was reset, or if heartbeats or sent data went unanswered (see setHeartbeat()). An error is thrown if the index is out of range or if the socket is not set.
+     *
+     * @param clientIndex An unsigned int indicating the index of the client to check.
+     *
+     * @return True if the connection is alive, false otherwise.
+     */
+    bool isAlive(unsigned int clientIndex) const {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        //Throw an error if there is no socket at the index
+        if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+            throw std::logic_error("Socket index uninitialized");
+        
+        //A shared memory client is dead once it closed or its process exited, and everything it sent has been read
+        if (this->sharedMemoryRings[clientIndex])
+            return !this->sharedMemoryRings[clientIndex]->peerClosed() || this->sharedMemoryRings[clientIndex]->available() > 0;
+        
+        int socketFD = this->clientSocketsFD[clientIndex];
+        
+        //A pending error means the connection was reset or that heartbeats or data went unanswered
+        int error = 0;
+        socklen_t errorSize = sizeof(error);
+        if (getsockopt(socketFD, SOL_SOCKET, SO_ERROR, &error, &errorSize) < 0 || error != 0)
+            return false;
+        
+        pollfd pollInfo;
+        pollInfo.fd = socketFD;
+        pollInfo.events = POLLIN;
+#if defined(POLLRDHUP)
+        pollInfo.events |= POLLRDHUP;
+#endif
+        pollInfo.revents = 0;
+        
+        //Check the state of the socket without waiting
+        if (poll(&pollInfo, 1, 0) < 0)
+            throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
+        
+        //POLLERR is not checked, since real errors were found above, and it is also raised for notifications like finished zero-copy sends
+        if (pollInfo.revents & (POLLHUP | POLLNVAL))
+            return false;
+        
+        //If the client closed its side, the connection is only dead once everything it sent has been read
+        if (pollInfo.revents & POLLIN) {
+            char byte;
+            if (recv(socketFD, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+                return false;
+        }
+        
+        return true;
+    }
+    
+    /*!
+     * A function that closes every client connection which isAlive() reports as dead. An error is thrown if the socket is not set.
+     *
+     * @return The number of connections that were closed.
+     */
+    unsigned int closeDeadConnections() {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        unsigned int closed = 0;
+        for (size_t a = 0; a < this->activeConnections.size(); a++) {
+            if (this->activeConnections[a] && !this->isAlive(a)) {
+                this->closeConnection(a);
+                closed++;
+            }
+        }
+        return closed;
+    }
+    
+    /*!
+     * A function to shut the server down without losing messages. New clients stop being accepted, the sending side of each connection is closed once everything already sent has been handed to the kernel, and the function waits for each client to finish and close its side. Once every client has finished or the deadline passes, all sockets are closed and the object returns to an unset state, so it can be set again. An error is thrown if the socket is not set.
+     *
+     * @param seconds The number of seconds to wait for clients to finish.
+     * @param milliseconds An optional parameter indicating the number of milliseconds to add to the deadline. Autoinitialized as 0.
+     * @param onMessage An optional function called with the index of a client and a message received from it while draining. Automatically set to nullptr, in which case those messages are discarded.
+     *
+     * @return True if every client finished before the deadline, false if some connections had to be cut off.
+     */
+    bool drain(unsigned int seconds, unsigned int milliseconds = 0, const std::function<void(unsigned int, const std::string&)>& onMessage = nullptr) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds) + std::chrono::milliseconds(milliseconds);
+        
+        //Stop accepting new clients. Connections still waiting in the backlog are refused by the kernel, and queued ones are closed since they were never given an index
+        close(this->hostSocketFD);
+        for (size_t a = 0; a < this->overflowQueue.size(); a++) {
+            close(this->overflowQueue[a].socketFD);
+        }
+        this->overflowQueue.clear();
+        
+        //Send everything that was posted before the drain started
+        std::vector<pollfd> pollInfo;
+        while (this->flushPosted() > 0) {
+            long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0) break;
+            
+            //Wait for any client with queued messages to have room. Shared memory clients are checked every millisecond instead
+            bool sharedMemoryWaiting = false;
+            pollInfo.clear();
+            for (size_t a = 0; a < this->activeConnections.size(); a++) {
+                if (!this->outboundQueues[a].empty()) {
+                    pollfd info;
+                    info.fd = this->clientSocketsFD[a];
+                    info.events = POLLOUT;
+                    info.revents = 0;
+                    pollInfo.push_back(info);
+                    if (this->sharedMemoryRings[a]) sharedMemoryWaiting = true;
+                }
+            }
+            if (poll(pollInfo.data(), pollInfo.size(), sharedMemoryWaiting && remaining > 1 ? 1 : (int)remaining) < 0 && errno != EINTR)
+                throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
+        }
+        
+        //Half-close every connection. The kernel sends everything already written before the end-of-stream, so nothing in flight is lost
+        std::vector<unsigned int> draining;
+        for (size_t a = 0; a < this->activeConnections.size(); a++) {
+            if (this->activeConnections[a]) {
+                if (this->sharedMemoryRings[a]) {
+                    this->sharedMemoryRings[a]->shutdownWrite();
+                } else {
+                    shutdown(this->clientSocketsFD[a], SHUT_WR);
+                }
+                draining.push_back(a);
+            }
+        }
+        
+        //Keep reading until each client closes its side. Closing a socket with unread data would reset the connection and discard what has not been delivered yet
+        while (!draining.empty()) {
+            long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0) break;
+            
+            //Shared memory clients have no file descriptor to wait on (poll() skips a negative one), so they are checked every millisecond instead
+            bool sharedMemoryDraining = false;
+            pollInfo.clear();
+            for (size_t a = 0; a < draining.size(); a++) {
+                pollfd info;
+                info.fd = this->clientSocketsFD[draining[a]];
+                info.events = POLLIN;
+                info.revents = 0;
+                pollInfo.push_back(info);
+                if (this->sharedMemoryRings[draining[a]]) sharedMemoryDraining = true;
+            }
+            
+            int returnValue = poll(pollInfo.data(), pollInfo.size(), sharedMemoryDraining && remaining > 1 ? 1 : (int)remaining);
+            if (returnValue < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
+            }
+            
+            //Go backwards so finished clients can be removed while iterating
+            for (int a = (int)pollInfo.size() - 1; a >= 0; a--) {
+                unsigned int clientIndex = draining[a];
+                long messageSize;
+                
+                if (this->sharedMemoryRings[clientIndex]) {
+                    messageSize = this->sharedMemoryRings[clientIndex]->read(this->buffer.get(), BUFFER_SIZE, 0);
+                    if (messageSize < 0) continue; //Nothing to read yet
+                } else {
+                    //POLLERR alone can be a notification like a finished zero-copy send, which is not a reason to read
+                    if (pollInfo[a].revents & POLLERR) this->readErrorQueue(clientIndex);
+                    if ((pollInfo[a].revents & (POLLIN | POLLHUP)) == 0) continue;
+                    messageSize = this->readSocket(clientIndex, this->buffer.get(), BUFFER_SIZE);
+                }
+                
+                if (messageSize > 0) {
+                    this->lastSeenTimes[clientIndex] = std::chrono::steady_clock::now();
+                    if (this->capture) this->capture->append(clientIndex, TrafficCapture::Received, this->buffer.get(), messageSize);
+                    if (onMessage) onMessage(clientIndex, std::string(this->buffer.get(), messageSize));
+                } else {
+                    //The client finished (or the connection failed), so it is done draining
+                    this->closeConnection(clientIndex);
+                    draining.erase(draining.begin() + a);
+                }
+            }
+        }
+        
+        bool finished = draining.empty();
+        
+        //Cut off any clients that did not finish in time
+        for (size_t a = 0; a < draining.size(); a++) {
+            this->closeConnection(draining[a]);
+        }
+        
+        //Closed connections the kernel is still sending to hold their memory until it is done. Anything left at the deadline is freed by a later releaseZeroCopyBuffers(), or the destructor
+        this->releaseRetiredZeroCopy();
+        while (!this->retiredZeroCopy.empty() && std::chrono::steady_clock::now() < deadline) {
+            poll(nullptr, 0, 1); //A shut down socket always polls as hung up, so the error queues are checked every millisecond instead
+            this->releaseRetiredZeroCopy();
+        }
+        
+        //Return to an unset state so the socket can be set again
+        this->activeConnections.clear();
+        this->clientSocketsFD.clear();
+        this->clientAddresses.clear();
+        this->clientAddressSizes.clear();
+        this->lastSeenTimes.clear();
+        this->sharedMemoryRings.clear();
+        this->outboundQueues.clear();
+        this->outboundOffsets.clear();
+        this->zeroCopyClients.clear();
+        this->zeroCopyNextIDs.clear();
+        this->zeroCopyPending.clear();
+        this->clientTopics.clear();
+        this->traces.clear();
+        this->receiveBuffers.clear();
+        this->recordBuffers.clear();
+        this->receiveMemory = 0;
+        this->queuedBytes.clear();
+        this->queuedMemory = 0;
+        this->topicIDs.clear();
+        this->topicSubscribers.clear();
+        close(this->postNotifyFD);
+        if (this->postNotifyWriteFD != this->postNotifyFD) close(this->postNotifyWriteFD);
+        this->postNotifyFD = -1;
+        this->postNotifyWriteFD = -1;
+        this->setUp = false;
+        
+        return finished;
+    }
+    
+    /*!
+     * @return The number of clients of this socket.
+     */
+    unsigned int numberOfClients() const {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        //Count the number of connections which are active
+        int connections = 0;
+        for (int a = 0; a < this->activeConnections.size(); a++) {
+            if (this->activeConnections[a]) {
+                connections++;
+            }
+        }
+        return connections;
+    }
+    
+    /*!
+     * @return If this object is set.
+     */
+    bool isSet() const {
+        return this->setUp;
+    }
+    
+private:
+    //Private properties
+    
+    int portNumber; //The port nubmer where connections are accepted
+    
+    /* struct addrinfo {
+         int ai_flags; //AI_PASSIVE, AI_CANONNAME, etc...
+         int ai_family; //AF_INET, AF_INET6, AF_UNSPEC. This is the type of IP address (IPv4, IPv6, or any, respectively)
+         int ai_socktype; //SOCK_STREAM, SOCK_DGRAM (TCP and UDP, respectively)
+         int ai_protocol; //0 represents any
+         size_t ai_addrlen; //Represents the size of the following property ai_addr, in bytes
+         struct sockaddr* ai_addr; //A struct containing the address info. Can be a sockaddr_in or sockaddr_in6
+         char* hostname; //Full hostname
+         
+         struct addrinfo* ai_next; //The next addrinfo node. Used when addrinfo structs are returned as a linked list
+     }
+     */
+    addrinfo serverAddress;
+    HostResolver::Addresses serverAddressList; //The list serverAddress was taken from, which owns the memory it points to
+    
+    //These are "file descriptors", which store values from both the socket system call and the accept system call
+    int hostSocketFD;
+    
+    int backlog = LISTEN_BACKLOG; //The backlog given to listen(), which also limits how many clients can be queued
+    OverflowPolicy overflowPolicy = Reject; //What happens to a client that connects while every index is taken
+    
+    struct QueuedClient {
+        int socketFD;
+        sockaddr_storage address;
+        socklen_t addressSize;
+    };
+    std::deque<QueuedClient> overflowQueue; //Clients accepted while every index was taken, oldest first
+    
+    std::vector<bool> activeConnections;//[MAX_NUMBER_OF_CONNECTIONS]; //Initialized as all false. True if the connection of that index is an active connection
+    
+    std::vector<int> clientSocketsFD;//[MAX_NUMBER_OF_CONNECTIONS];
+    
+    /* struct sockaddr_storage {
+        sa_family_t ss_family; //Either AF_INET or AF_INET6
+        * A bunch of padding variables are also here. Ignore them. *
+     }
+     This struct is large enough that it can hold either an IPv4 or an IPv6 address (and be cast to either sockaddr_in or sockaddr_in6 if necessary)
+     */
+    std::vector<sockaddr_storage> clientAddresses;//[MAX_NUMBER_OF_CONNECTIONS];
+    std::vector<socklen_t> clientAddressSizes;//[MAX_NUMBER_OF_CONNECTIONS];
+    
+    std::vector<std::chrono::steady_clock::time_point> lastSeenTimes; //The last time a message was received from each client
+    
+    std::vector<std::unique_ptr<SharedMemoryRing>> sharedMemoryRings; //The shared memory connection of each client. Null for TCP clients
+    
+    std::vector<std::deque<std::shared_ptr<const std::string>>> outboundQueues; //Posted messages each client has not taken yet. Broadcasts share one string
+    std::vector<size_t> outboundOffsets; //How much of the first message in each client's queue was already sent
+    
+    bool zeroCopy = false; //True if setZeroCopy() turned zero-copy sending on
+    unsigned long zeroCopyThreshold = ZERO_COPY_THRESHOLD; //The smallest message sent without a copy
+    std::vector<bool> zeroCopyClients; //True for each client whose socket accepted SO_ZEROCOPY
+    std::vector<uint32_t> zeroCopyNextIDs; //The ID the kernel will give the next zero-copy send to each client
+    
+    struct ZeroCopyBuffer {
+        uint32_t id; //The ID of the send which used this memory
+        std::shared_ptr<const std::string> message; //Keeps the memory alive until the kernel is done with it
+    };
+    std::vector<std::deque<ZeroCopyBuffer>> zeroCopyPending; //Memory each client's kernel socket may still be sending from, oldest first
+    
+    struct RetiredZeroCopy {
+        int socketFD; //Shut down but left open, since closing it would discard the kernel's notifications
+        std::deque<ZeroCopyBuffer> pending;
+    };
+    std::vector<RetiredZeroCopy> retiredZeroCopy; //Closed connections the kernel may still be sending from. Each socket is closed, and its memory freed, once every send has finished
+    
+    std::map<std::string, unsigned int, std::less<>> topicIDs; //The ID of each topic anyone ever subscribed to. std::less<> allows lookups by std::string_view
+    std::vector<std::vector<unsigned int>> topicSubscribers; //The sorted indices of the clients subscribed to each topic, by ID
+    std::vector<std::vector<unsigned int>> clientTopics; //The IDs of the topics each client subscribed to, so closing a connection only visits those
+    
+    struct PostedMessage {
+        unsigned int clientIndex;
+        bool broadcast;
+        std::string topic; //The topic of a message from postPublish(). Empty otherwise
+        std::shared_ptr<const std::string> message;
+    };
+    MPSCQueue<PostedMessage> postedMessages; //Messages from post(), postBroadcast() and postPublish(), waiting for flushPosted()
+    std::atomic<unsigned int> pendingPosts{0}; //Posts since the last flushPosted(). The first one signals postNotifyFD
+    int postNotifyFD = -1; //An eventfd (or the read end of a pipe) that is readable while posts are pending
+    int postNotifyWriteFD = -1; //The descriptor posts are signaled through. The same as postNotifyFD for an eventfd
+    
+    unsigned long memoryBudget = 0; //0 if there is no budget
+    MemoryPolicy memoryPolicy = DropOldest;
+    size_t receiveMemory = 0; //Held by all the receive buffers, which keep it up to date themselves
+    std::vector<unsigned long> queuedBytes; //The size of the messages in each client's outbound queue
+    unsigned long queuedMemory = 0; //The sum of queuedBytes
+    std::atomic<unsigned long> postedMemory{0}; //The size of the messages posted and not yet handled by flushPosted(). Changed from any thread
+    
+    struct TracedConnection {
+        LatencyTrace trace;
+        bool timestamps = false; //True if the kernel accepted SO_TIMESTAMPING for this client
+        uint32_t bytesSent = 0; //Bytes sent since timestamps were turned on, which is how the kernel numbers transmit timestamps
+        std::deque<std::pair<uint32_t, uint64_t>> pendingSends; //The number of the last byte and the time of each send still waiting for its timestamp
+    };
+    bool tracing = false; //True if setTracing() turned tracing on
+    std::vector<std::unique_ptr<TracedConnection>> traces; //The latency trace of each client while tracing is on. Null otherwise
+    
+    std::unique_ptr<TrafficCapture> capture; //Records traffic between startCapture() and stopCapture(). Null otherwise
+    
+    int timeoutMilliseconds = -1; //The timeout set with setTimeout(), for clients that don't use a socket. -1 if there is none
+    int hostTimeoutMilliseconds = -1; //The timeout set with setHostTimeout(), for clients that don't use a socket. -1 if there is none
+    
+    unsigned int heartbeatIdle = 0; //Seconds of idleness before a heartbeat is sent. 0 if heartbeats are disabled
+    unsigned int heartbeatInterval = 1; //Seconds between unanswered heartbeats
+    unsigned int heartbeatCount = 3; //Number of unanswered heartbeats before a connection is dead
+    
+    std::unique_ptr<char[]> buffer; //BUFFER_SIZE bytes for drain(), allocated by setSocket()
+    std::vector<ReceiveBuffer> receiveBuffers; //What receive() reads each client's data into, sized to its traffic
+    std::vector<RecordBuffer> recordBuffers; //Records received from each client but not yet taken by receiveRecord()
+    
+    bool setUp = false; //Represents if the socket has already been set. If not, reading and writing will cause errors
+    
+    //Private member functions
+    
+    /*!
+     * A function to get the next index to which a client can connect. -1 is returned if there are no more available indices.
+     *
+     * @return The next available index.
+     */
+    int getNextAvailableIndex() const {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        for (int a = 0; a < this->activeConnections.size(); a++) {
+            if (!this->activeConnections[a]) return a;
         }
         return -1;
     }
     
+    /*!
+     * A function to get the next index to which a client can connect, adding one if every index is taken and the overflow policy is Grow.
+     *
+     * @return The index, or -1 if there are no more available indices.
+     */
+    int reserveIndex() {
+        int clientIndex = this->getNextAvailableIndex();
+        if (clientIndex == -1 && this->overflowPolicy == Grow) {
+            this->addSlot();
+            clientIndex = (int)this->activeConnections.size() - 1;
+        }
+        return clientIndex;
+    }
+    
+    /*!
+     * A function that adds one more index, with nothing connected at it.
+     */
+    void addSlot() {
+        this->activeConnections.push_back(false); //All connections initially inactive
+        this->clientSocketsFD.push_back(0); //No socket file descriptors set
+        this->clientAddresses.push_back(sockaddr_storage()); //All addresses set as empty structs
+        this->clientAddressSizes.push_back(socklen_t()); //All address sizes set as empty sizes
+        this->lastSeenTimes.push_back(std::chrono::steady_clock::time_point()); //No clients seen yet
+        this->sharedMemoryRings.push_back(nullptr); //No shared memory connections
+        this->outboundQueues.push_back(std::deque<std::shared_ptr<const std::string>>()); //Nothing posted yet
+        this->outboundOffsets.push_back(0);
+        this->zeroCopyClients.push_back(false); //Zero-copy sending is off until setZeroCopy()
+        this->zeroCopyNextIDs.push_back(0);
+        this->zeroCopyPending.push_back(std::deque<ZeroCopyBuffer>());
+        this->clientTopics.push_back(std::vector<unsigned int>()); //No subscriptions
+        this->traces.push_back(nullptr); //Nothing traced until setTracing()
+        this->receiveBuffers.push_back(ReceiveBuffer()); //Allocated by the first receive()
+        this->receiveBuffers.back().setAccount(&this->receiveMemory);
+        this->recordBuffers.push_back(RecordBuffer()); //Holds nothing until the first receiveRecord()
+        this->recordBuffers.back().setAccount(&this->receiveMemory);
+        this->queuedBytes.push_back(0);
+    }
+    
+    /*!
+     * A function that accepts one connection from the backlog, without waiting.
+     *
+     * @param address Set to the address of the client.
+     * @param addressSize Set to the size of the address.
+     *
+     * @return The file descriptor of the client socket, or -1 with errno set if none could be accepted.
+     */
+    int acceptSocket(sockaddr_storage& address, socklen_t& addressSize) {
+        addressSize = sizeof(sockaddr_storage);
+#if defined(__linux__)
+        //accept4() marks the socket close-on-exec in the same call. The client socket stays blocking, since receive() and fully sent messages wait on it
+        return accept4(this->hostSocketFD, (struct sockaddr *)&address, &addressSize, SOCK_CLOEXEC);
+#else
+        int socketFD = accept(this->hostSocketFD, (struct sockaddr *)&address, &addressSize);
+        if (socketFD >= 0) {
+            fcntl(socketFD, F_SETFD, FD_CLOEXEC);
+            fcntl(socketFD, F_SETFL, fcntl(socketFD, F_GETFL) & ~O_NONBLOCK); //Some systems pass O_NONBLOCK on from the host socket
+        }
+        return socketFD;
+#endif
+    }
+    
+    /*!
+     * A function that gives an accepted client an index, or follows the overflow policy if every index is taken.
+     *
+     * @param socketFD The file descriptor of the client socket.
+     * @param address The address of the client.
+     * @param addressSize The size of the address.
+     *
+     * @return The index of the client, or -1 if it was rejected or queued.
+     */
+    int placeClient(int socketFD, const sockaddr_storage& address, socklen_t addressSize) {
+        int clientIndex = this->reserveIndex();
+        
+        if (clientIndex == -1) {
+            if (this->overflowPolicy == Queue && this->overflowQueue.size() < (size_t)this->backlog) {
+                this->overflowQueue.push_back(QueuedClient{socketFD, address, addressSize});
+            } else {
+                close(socketFD); //The client sees the connection close at once, rather than waiting for the backlog
+            }
+            return -1;
+        }
+        
+        this->activateClient(clientIndex, socketFD, address, addressSize);
+        return clientIndex;
+    }
+    
+    /*!
+     * A function that gives the oldest queued client an index, if one is free.
+     *
+     * @return The index of the client, or -1 if no client was added.
+     */
+    int promoteQueuedClient() {
+        if (this->overflowQueue.empty()) return -1;
+        
+        int clientIndex = this->reserveIndex();
+        if (clientIndex == -1) return -1;
+        
+        QueuedClient queued = this->overflowQueue.front();
+        this->overflowQueue.pop_front();
+        this->activateClient(clientIndex, queued.socketFD, queued.address, queued.addressSize);
+        return clientIndex;
+    }
+    
+    /*!
+     * A function that sets up a connected client at an index and applies the current socket options to it.
+     *
+     * @param clientIndex The index, which must be free.
+     * @param socketFD The file descriptor of the client socket.
+     * @param address The address of the client.
+     * @param addressSize The size of the address.
+     */
+    void activateClient(unsigned int clientIndex, int socketFD, const sockaddr_storage& address, socklen_t addressSize) {
+        this->clientSocketsFD[clientIndex] = socketFD;
+        this->clientAddresses[clientIndex] = address;
+        this->clientAddressSizes[clientIndex] = addressSize;
+        
+        this->setHeartbeatOptions(socketFD);
+        this->setZeroCopyOptions(clientIndex);
+        this->setTracingOptions(clientIndex);
+        this->lastSeenTimes[clientIndex] = std::chrono::steady_clock::now();
+        
+        this->activeConnections[clientIndex] = true;
+        if (this->capture) this->capture->append(clientIndex, TrafficCapture::Opened, nullptr, 0);
+        SOCKS_PROBE2(accept, clientIndex, socketFD);
+    }
+    
+    /*!
+     * A function to apply the current heartbeat settings to a client socket.
+     *
+     * @param socketFD The file descriptor of the client socket.
+     */
+    void setHeartbeatOptions(int socketFD) const {
+        int enable = this->heartbeatIdle > 0 ? 1 : 0;
+        setsockopt(socketFD, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(int));
+        
+#if defined(TCP_USER_TIMEOUT)
+        //Sent data that goes unacknowledged for as long as the heartbeats would is also treated as a dead connection. 0 restores the system default
+        unsigned int userTimeout = enable ? (this->heartbeatIdle + this->heartbeatInterval * this->heartbeatCount) * 1000 : 0;
+        setsockopt(socketFD, IPPROTO_TCP, TCP_USER_TIMEOUT, &userTimeout, sizeof(userTimeout));
+#endif
+        
+        if (!enable) return;
+        
+        int idle = this->heartbeatIdle;
+        int interval = this->heartbeatInterval;
+        int count = this->heartbeatCount;
+        
+#if defined(TCP_KEEPIDLE)
+        setsockopt(socketFD, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(int));
+#elif defined(TCP_KEEPALIVE)
+        setsockopt(socketFD, IPPROTO_TCP, TCP_KEEPALIVE, &idle, sizeof(int)); //macOS name for TCP_KEEPIDLE
+#endif
+#if defined(TCP_KEEPINTVL)
+        setsockopt(socketFD, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(int));
+#endif
+#if defined(TCP_KEEPCNT)
+        setsockopt(socketFD, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(int));
+#endif
+    }
+    
+    /*!
+     * A function that sends as much of a client's queue of posted messages as it can take without waiting. If the connection has failed, the queue is discarded.
+     *
+     * @param clientIndex The index of the client.
+     *
+     * @return True if the queue is now empty.
+     */
+    bool writeQueued(unsigned int clientIndex) {
+        std::deque<std::shared_ptr<const std::string>>& queue = this->outboundQueues[clientIndex];
+        
+        while (!queue.empty()) {
+            long sentSize;
+            
+            if (this->sharedMemoryRings[clientIndex]) {
+                const std::string& message = *queue.front();
+                sentSize = this->sharedMemoryRings[clientIndex]->write(message.data() + this->outboundOffsets[clientIndex], message.size() - this->outboundOffsets[clientIndex], false);
+            } else if (this->zeroCopyClients[clientIndex] && queue.front()->size() >= this->zeroCopyThreshold) {
+                //Large messages go out on their own, straight from their memory
+                this->readErrorQueue(clientIndex);
+                sentSize = this->writeZeroCopy(queue.front(), this->outboundOffsets[clientIndex], clientIndex, MSG_DONTWAIT);
+                if (sentSize < 0 && errno == ENOBUFS) return false; //Too much memory pinned. Try again once earlier sends finish
+            } else {
+                //Hand the kernel several queued messages with one call
+                iovec pieces[16];
+                int numberOfPieces = 0;
+                unsigned long requested = 0;
+                for (size_t a = 0; a < queue.size() && numberOfPieces < 16; a++) {
+                    size_t offset = a == 0 ? this->outboundOffsets[clientIndex] : 0;
+                    pieces[numberOfPieces].iov_base = (void*)(queue[a]->data() + offset);
+                    pieces[numberOfPieces].iov_len = queue[a]->size() - offset;
+                    requested += pieces[numberOfPieces].iov_len;
+                    numberOfPieces++;
+                }
+                
+                msghdr message;
+                memset(&message, 0, sizeof(message));
+                message.msg_iov = pieces;
+                message.msg_iovlen = numberOfPieces;
+                
+                //MSG_DONTWAIT keeps one slow client from holding up the rest
+                uint64_t sendTime = this->tracedSendTime(clientIndex);
+                sentSize = sendmsg(this->clientSocketsFD[clientIndex], &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (sentSize > 0) this->traceSend(clientIndex, sentSize, sendTime);
+                this->probeWrite(clientIndex, requested, sentSize);
+            }
+            
+            if (sentSize < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return false;
+                
+                //The connection failed. isAlive() reports it, and nothing more can be sent
+                queue.clear();
+                this->outboundOffsets[clientIndex] = 0;
+                this->queuedMemory -= this->queuedBytes[clientIndex];
+                this->queuedBytes[clientIndex] = 0;
+                return true;
+            }
+            
+            if (sentSize == 0) return false;
+            
+            //Remove the messages that were sent completely, and remember how far into the next one the kernel got
+            unsigned long sent = sentSize;
+            while (sent > 0) {
+                unsigned long remaining = queue.front()->size() - this->outboundOffsets[clientIndex];
+                if (this->capture) this->capture->append(clientIndex, TrafficCapture::Sent, queue.front()->data() + this->outboundOffsets[clientIndex], std::min(sent, remaining));
+                if (sent >= remaining) {
+                    sent -= remaining;
+                    this->dequeue(clientIndex);
+                    this->outboundOffsets[clientIndex] = 0;
+                } else {
+                    this->outboundOffsets[clientIndex] += sent;
+                    sent = 0;
+                }
+            }
+        }
+        return true;
+    }
+    
+    /*!
+     * A function that puts a message on the posted queue and wakes the thread that owns this socket if needed. Can be called from any thread.
+     *
+     * @param posted The message.
+     */
+    void pushPosted(PostedMessage posted) {
+        this->postedMemory.fetch_add(posted.message->size(), std::memory_order_relaxed);
+        this->postedMessages.push(std::move(posted));
+        
+        //Only the first post since the last flush needs to wake the owning thread
+        if (this->pendingPosts.fetch_add(1, std::memory_order_acq_rel) == 0) {
+            uint64_t one = 1;
+            if (write(this->postNotifyWriteFD, &one, sizeof(one)) < 0) {} //Already signaled if the pipe is full
+        }
+    }
+    
+    /*!
+     * A function that removes a client from the subscribers of a topic, if it is there.
+     *
+     * @param topicID The ID of the topic.
+     * @param clientIndex The index of the client.
+     */
+    void removeSubscriber(unsigned int topicID, unsigned int clientIndex) {
+        std::vector<unsigned int>& subscribers = this->topicSubscribers[topicID];
+        std::vector<unsigned int>::iterator position = std::lower_bound(subscribers.begin(), subscribers.end(), clientIndex);
+        if (position != subscribers.end() && *position == clientIndex) subscribers.erase(position);
+    }
+    
+    /*!
+     * A function that writes a message to a single client, continuing from where each write stopped. It does all the checks for the public send functions.
+     *
+     * @param data The bytes to be sent.
+     * @param length The number of bytes to be sent.
+     * @param clientIndex The index of the client.
+     * @param ensureFullStringSent If true, keep writing until the whole message is sent. Otherwise, write once.
+     *
+     * @return The number of bytes sent.
+     */
+    unsigned long sendBytes(const char* data, unsigned long length, unsigned int clientIndex, bool ensureFullStringSent) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        //A blank message won't be sent
+        if (length == 0)
+            throw std::logic_error("No message to send");
+        
+        //Throw an error if there is no socket at the index
+        if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+            throw std::logic_error("Socket index uninitialized");
+        
+        unsigned long sent = 0;
+        
+        //Write from where the last write stopped, instead of copying what is left and starting again
+        while (sent < length) {
+            long sentSize;
+            if (this->sharedMemoryRings[clientIndex]) {
+                sentSize = this->sharedMemoryRings[clientIndex]->write(data + sent, length - sent, ensureFullStringSent);
+            } else {
+                uint64_t sendTime = this->tracedSendTime(clientIndex);
+                sentSize = write(this->clientSocketsFD[clientIndex], data + sent, length - sent);
+                if (sentSize > 0) this->traceSend(clientIndex, sentSize, sendTime);
+                this->probeWrite(clientIndex, length - sent, sentSize);
+            }
+            
+            if (sentSize < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("ERROR sending message: ") + std::string(strerror(errno)));
+            }
+            
+            if (this->capture && sentSize > 0) this->capture->append(clientIndex, TrafficCapture::Sent, data + sent, sentSize);
+            sent += sentSize;
+            
+            //Unless the full message must be sent, stop after one write and let the caller deal with the rest
+            if (!ensureFullStringSent || sentSize == 0) break;
+        }
+        return sent;
+    }
+    
+    /*!
+     * A function that reads an exact number of bytes from a single client, waiting for as many reads as it takes. It does all the checks for the public receive functions.
+     *
+     * @param data Where to put the bytes.
+     * @param length The number of bytes to read.
+     * @param clientIndex The index of the client.
+     * @param socketClosed If not a null pointer, set to true and the connection closed if the client disconnected.
+     *
+     * @return True if all the bytes were read, false if the client disconnected first.
+     */
+    bool receiveBytes(char* data, unsigned long length, unsigned int clientIndex, bool* socketClosed) {
+        if (!this->setUp)
+            throw std::logic_error("Socket not set");
+        
+        //Throw an error if there is no socket at the index from which to receive
+        if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+            throw std::logic_error("Socket index uninitialized");
+        
+        //Keep reading until the whole length has arrived, since it may come in pieces
+        unsigned long received = 0;
+        while (received < length) {
+            long messageSize;
+            if (this->sharedMemoryRings[clientIndex]) {
+                messageSize = this->sharedMemoryRings[clientIndex]->read(data + received, length - received, this->timeoutMilliseconds);
+            } else {
+                messageSize = this->readSocket(clientIndex, data + received, length - received);
+            }
+            
+            if (messageSize < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("ERROR reading from socket: ") + std::string(strerror(errno)));
+            }
+            
+            //The client disconnected before the whole length arrived
+            if (messageSize == 0) {
+                if (socketClosed != nullptr) {
+                    *socketClosed = true;
+                    this->closeConnection(clientIndex);
+                }
+                return false;
+            }
+            
+            if (this->capture) this->capture->append(clientIndex, TrafficCapture::Received, data + received, messageSize);
+            received += messageSize;
+        }
+        
+        this->lastSeenTimes[clientIndex] = std::chrono::steady_clock::now();
+        return true;
+    }
+    
+    /*!
+     * A function that turns zero-copy sending on or off for one client socket, according to the current settings.
+     *
+     * @param clientIndex The index of the client.
+     */
+    void setZeroCopyOptions(unsigned int clientIndex) {
+        //Shared memory clients are never copied through the kernel anyway
+        if (this->sharedMemoryRings[clientIndex]) return;
+        
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+        //Once turned on, SO_ZEROCOPY is left on. It has no effect on sends without MSG_ZEROCOPY
+        if (this->zeroCopy && !this->zeroCopyClients[clientIndex]) {
+            int enable = 1;
+            this->zeroCopyClients[clientIndex] = setsockopt(this->clientSocketsFD[clientIndex], SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(int)) == 0;
+            return;
+        }
+#endif
+        
+        //With it off, pending zero-copy memory is still released as the kernel finishes with it
+        if (!this->zeroCopy) this->zeroCopyClients[clientIndex] = false;
+    }
+    
+    /*!
+     * A function that writes part of a message to a client without copying it, and holds the message until the kernel is done with it.
+     *
+     * @param message The message being sent.
+     * @param offset The number of bytes of the message already sent.
+     * @param clientIndex The index of the client.
+     * @param flags Flags passed to send(), along with MSG_ZEROCOPY.
+     *
+     * @return The number of bytes sent, or -1 if an error occurred, with errno set.
+     */
+    long writeZeroCopy(const std::shared_ptr<const std::string>& message, unsigned long offset, unsigned int clientIndex, int flags) {
+#if defined(MSG_ZEROCOPY)
+        uint64_t sendTime = this->tracedSendTime(clientIndex);
+        long sentSize = ::send(this->clientSocketsFD[clientIndex], message->data() + offset, message->size() - offset, flags | MSG_ZEROCOPY | MSG_NOSIGNAL);
+        if (sentSize > 0) this->traceSend(clientIndex, sentSize, sendTime);
+        this->probeWrite(clientIndex, message->size() - offset, sentSize);
+        
+        //Every send that pins memory gets the next ID, and the kernel reports finished sends by these IDs
+        if (sentSize > 0) {
+            ZeroCopyBuffer buffer;
+            buffer.id = this->zeroCopyNextIDs[clientIndex]++;
+            buffer.message = message;
+            this->zeroCopyPending[clientIndex].push_back(buffer);
+        }
+        return sentSize;
+#else
+        uint64_t sendTime = this->tracedSendTime(clientIndex);
+        long sentSize = ::send(this->clientSocketsFD[clientIndex], message->data() + offset, message->size() - offset, flags | MSG_NOSIGNAL);
+        if (sentSize > 0) this->traceSend(clientIndex, sentSize, sendTime);
+        this->probeWrite(clientIndex, message->size() - offset, sentSize);
+        return sentSize;
+#endif
+    }
+    
+    /*!
+     * A function that reads a client's kernel notifications from its error queue. Finished zero-copy sends release the memory they were sent from, and transmit timestamps are added to the client's trace.
+     *
+     * @param clientIndex The index of the client.
+     *
+     * @return The number of messages, or parts of messages, released.
+     */
+    unsigned int readErrorQueue(unsigned int clientIndex) {
+        bool copied = false;
+        unsigned int released = this->readErrorQueue(this->clientSocketsFD[clientIndex], this->zeroCopyPending[clientIndex], this->traces[clientIndex].get(), copied);
+        
+        //The kernel had to copy anyway (for example over loopback), so zero-copy sending only adds work for this client
+        if (copied) this->zeroCopyClients[clientIndex] = false;
+        return released;
+    }
+    
+    /*!
+     * A function that reads notifications from a socket's error queue.
+     *
+     * @param socketFD The socket.
+     * @param pending The memory sent from the socket without a copy. Memory the kernel is done with is removed.
+     * @param traced The trace to add transmit timestamps to, or a null pointer.
+     * @param copied Set to true if the kernel reported copying a zero-copy send anyway. Otherwise left unchanged.
+     *
+     * @return The number of messages, or parts of messages, released.
+     */
+    unsigned int readErrorQueue(int socketFD, std::deque<ZeroCopyBuffer>& pending, TracedConnection* traced, bool& copied) {
+        unsigned int released = 0;
+        
+#if defined(__linux__)
+        while (!pending.empty() || (traced != nullptr && !traced->pendingSends.empty())) {
+            char control[256];
+            msghdr message;
+            memset(&message, 0, sizeof(message));
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            
+            /* recvmsg() with MSG_ERRQUEUE
+             Finished zero-copy sends and transmit timestamps are reported on the socket's error queue, separately from the data. A zero-copy notification holds a range of send IDs in ee_info (the first) and ee_data (the last), so one notification can cover many sends. A timestamp comes with the number of the last byte it covers in ee_data.
+             */
+            if (recvmsg(socketFD, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+            
+            sock_extended_err* error = nullptr;
+            uint64_t timestamp = 0;
+            
+            for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+                if ((header->cmsg_level == SOL_IP && header->cmsg_type == IP_RECVERR) || (header->cmsg_level == SOL_IPV6 && header->cmsg_type == IPV6_RECVERR)) {
+                    error = (sock_extended_err*)CMSG_DATA(header);
+                }
+#if defined(SO_TIMESTAMPING)
+                else if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_TIMESTAMPING) {
+                    scm_timestamping* stamps = (scm_timestamping*)CMSG_DATA(header);
+                    timestamp = (uint64_t)stamps->ts[0].tv_sec * 1000000000 + stamps->ts[0].tv_nsec;
+                }
+#endif
+            }
+            if (error == nullptr) continue;
+            
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+            if (error->ee_errno == 0 && error->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                uint32_t first = error->ee_info;
+                uint32_t last = error->ee_data;
+                
+                //Pending memory is in ID order, and sends usually finish in order, so this normally only looks at the front
+                for (size_t a = 0; a < pending.size();) {
+                    if (pending[a].id - first <= last - first) {
+                        pending.erase(pending.begin() + a);
+                        released++;
+                    } else {
+                        a++;
+                    }
+                }
+                
+                if (error->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) copied = true;
+            }
+#endif
+            
+#if defined(SO_TIMESTAMPING)
+            if (error->ee_origin == SO_EE_ORIGIN_TIMESTAMPING && traced != nullptr && timestamp != 0) {
+                //Sends are timestamped in order. Any send before this one that never got a timestamp is dropped
+                uint32_t lastByte = error->ee_data;
+                while (!traced->pendingSends.empty() && (int32_t)(traced->pendingSends.front().first - lastByte) <= 0) {
+                    if (traced->pendingSends.front().first == lastByte && timestamp >= traced->pendingSends.front().second)
+                        traced->trace.transmit.record(timestamp - traced->pendingSends.front().second);
+                    traced->pendingSends.pop_front();
+                }
+            }
+#endif
+        }
+#endif
+        
+        return released;
+    }
+    
+    /*!
+     * A function that closes a client's socket. If the kernel may still be sending from memory passed without a copy, the connection is shut down instead, and the socket and memory are moved to retiredZeroCopy until the kernel reports it is done with them.
+     *
+     * @param clientIndex The index of the client.
+     */
+    void closeClientSocket(unsigned int clientIndex) {
+        int socketFD = this->clientSocketsFD[clientIndex];
+        if (!this->zeroCopyPending[clientIndex].empty()) this->readErrorQueue(clientIndex);
+        
+        //The kernel keeps sending from memory passed without a copy after the socket is closed, but would no longer say when it is done. Shut the connection down, so the client still sees it end, and keep the socket until then
+        if (!this->zeroCopyPending[clientIndex].empty()) {
+            shutdown(socketFD, SHUT_RDWR);
+            
+            RetiredZeroCopy retired;
+            retired.socketFD = socketFD;
+            retired.pending.swap(this->zeroCopyPending[clientIndex]);
+            this->retiredZeroCopy.push_back(std::move(retired));
+        } else {
+            close(socketFD);
+        }
+    }
+    
+    /*!
+     * A function that reads the notifications of each connection in retiredZeroCopy, and closes those whose sends have all finished.
+     *
+     * @return The number of messages, or parts of messages, released.
+     */
+    unsigned int releaseRetiredZeroCopy() {
+        unsigned int released = 0;
+        
+        //Go backwards so finished connections can be removed while iterating
+        for (int a = (int)this->retiredZeroCopy.size() - 1; a >= 0; a--) {
+            bool copied = false;
+            released += this->readErrorQueue(this->retiredZeroCopy[a].socketFD, this->retiredZeroCopy[a].pending, nullptr, copied);
+            
+            if (this->retiredZeroCopy[a].pending.empty()) {
+                close(this->retiredZeroCopy[a].socketFD);
+                this->retiredZeroCopy.erase(this->retiredZeroCopy.begin() + a);
+            }
+        }
+        return released;
+    }
+    
+    /*!
+     * A function that turns kernel timestamps on or off for one client, according to the current settings, and starts or discards its trace.
+     *
+     * @param clientIndex The index of the client.
+     */
+    void setTracingOptions(unsigned int clientIndex) {
+        if (!this->tracing) {
+#if defined(SO_TIMESTAMPING)
+            if (this->traces[clientIndex] && this->traces[clientIndex]->timestamps) {
+                int flags = 0;
+                setsockopt(this->clientSocketsFD[clientIndex], SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+            }
+#endif
+            this->traces[clientIndex].reset();
+            return;
+        }
+        
+        if (this->traces[clientIndex]) return;
+        this->traces[clientIndex].reset(new TracedConnection());
+        
+        //Shared memory clients have no kernel in the way to timestamp
+        if (this->sharedMemoryRings[clientIndex]) return;
+        
+#if defined(SO_TIMESTAMPING)
+        /* SO_TIMESTAMPING
+         The kernel timestamps data as it arrives and as it is handed to the network device, in software, so no hardware support is needed. OPT_ID numbers transmit timestamps by byte, so they can be matched to sends, and OPT_TSONLY leaves the sent data itself off the error queue.
+         */
+        int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+        this->traces[clientIndex]->timestamps = setsockopt(this->clientSocketsFD[clientIndex], SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+#endif
+    }
+    
+    /*!
+     * A function that reads from a client's socket. While the client is traced, the kernel's receive timestamp is read along with the data.
+     *
+     * @param clientIndex The index of the client.
+     * @param data Where to put the bytes.
+     * @param length The most bytes to read.
+     *
+     * @return The number of bytes read, 0 if the client disconnected, or -1 if an error occurred, with errno set.
+     */
+    long readSocket(unsigned int clientIndex, char* data, unsigned long length) {
+        long messageSize;
+        
+#if defined(SO_TIMESTAMPING)
+        TracedConnection* traced = this->traces[clientIndex].get();
+        if (traced != nullptr && traced->timestamps) {
+            iovec piece;
+            piece.iov_base = data;
+            piece.iov_len = length;
+            
+            char control[256];
+            msghdr message;
+            memset(&message, 0, sizeof(message));
+            message.msg_iov = &piece;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            
+            messageSize = recvmsg(this->clientSocketsFD[clientIndex], &message, 0);
+            
+            //The kernel's receive time comes with the data. Subtracting it from now is the time the data sat in the kernel before this read
+            if (messageSize > 0) {
+                for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+                    if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_TIMESTAMPING) continue;
+                    
+                    scm_timestamping* stamps = (scm_timestamping*)CMSG_DATA(header);
+                    uint64_t received = (uint64_t)stamps->ts[0].tv_sec * 1000000000 + stamps->ts[0].tv_nsec;
+                    uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                    if (received != 0 && now > received) traced->trace.receiveQueue.record(now - received);
+                }
+            }
+        } else {
+            messageSize = read(this->clientSocketsFD[clientIndex], data, length);
+        }
+#else
+        messageSize = read(this->clientSocketsFD[clientIndex], data, length);
+#endif
+        
+        //A read that fails with EAGAIN timed out, since client sockets only stop blocking through setTimeout()
+        if (messageSize >= 0) {
+            SOCKS_PROBE3(read, clientIndex, this->clientSocketsFD[clientIndex], messageSize);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            SOCKS_PROBE2(timeout, clientIndex, this->clientSocketsFD[clientIndex]);
+        }
+        return messageSize;
+    }
+    
+    /*!
+     * A function that fires the write probes for one write to a client's socket (see Probes.hpp). Nothing fires for a failed write.
+     *
+     * @param clientIndex The index of the client.
+     * @param requested The number of bytes given to the kernel.
+     * @param sentSize What the write returned.
+     */
+    void probeWrite(unsigned int clientIndex, unsigned long requested, long sentSize) const {
+        if (sentSize < 0) return;
+        
+        SOCKS_PROBE4(write, clientIndex, this->clientSocketsFD[clientIndex], requested, sentSize);
+        if ((unsigned long)sentSize < requested) SOCKS_PROBE4(partial_write, clientIndex, this->clientSocketsFD[clientIndex], requested, sentSize);
+    }
+    
+    /*!
+     * A function that adds a message to a client's outbound queue, counting it against the memory budget.
+     *
+     * @param clientIndex The index of the client.
+     * @param message The message.
+     */
+    void enqueue(unsigned int clientIndex, const std::shared_ptr<const std::string>& message) {
+        this->outboundQueues[clientIndex].push_back(message);
+        this->queuedBytes[clientIndex] += message->size();
+        this->queuedMemory += message->size();
+    }
+    
+    /*!
+     * A function that removes the first message from a client's outbound queue, and stops counting it against the memory budget.
+     *
+     * @param clientIndex The index of the client.
+     */
+    void dequeue(unsigned int clientIndex) {
+        unsigned long size = this->outboundQueues[clientIndex].front()->size();
+        this->outboundQueues[clientIndex].pop_front();
+        this->queuedBytes[clientIndex] -= size;
+        this->queuedMemory -= size;
+    }
+    
+    /*!
+     * A function that brings memory back under the budget if it is over, by freeing receive buffers and then applying the memory policy (see setMemoryBudget()).
+     */
+    void shedMemory() {
+        if (!this->isOverBudget()) return;
+        
+        //Receive buffers hold nothing between reads, so they are freed first whatever the policy. The next receive() allocates one again
+        for (size_t a = 0; a < this->receiveBuffers.size(); a++) {
+            this->receiveBuffers[a].release();
+        }
+        if (this->memoryPolicy == PauseReading) return;
+        
+        while (this->isOverBudget()) {
+            //Find the client with the most queued that can lose some of it. The first message can't be dropped once part of it was sent
+            int largest = -1;
+            for (size_t a = 0; a < this->activeConnections.size(); a++) {
+                if (!this->activeConnections[a] || (largest >= 0 && this->queuedBytes[a] <= this->queuedBytes[largest])) continue;
+                if (this->memoryPolicy == DropOldest && this->outboundQueues[a].size() <= (this->outboundOffsets[a] > 0 ? 1 : 0)) continue;
+                if (this->queuedBytes[a] > 0) largest = a;
+            }
+            
+            //The rest is posts flushPosted() hasn't handled, or memory the budget can't touch
+            if (largest < 0) return;
+            
+            if (this->memoryPolicy == DisconnectLargest) {
+                SOCKS_PROBE2(shed, largest, this->queuedBytes[largest]);
+                this->closeConnection(largest);
+                continue;
+            }
+            
+            //Drop the oldest messages that weren't started, until memory is back under or there are none left
+            std::deque<std::shared_ptr<const std::string>>& queue = this->outboundQueues[largest];
+            size_t first = this->outboundOffsets[largest] > 0 ? 1 : 0;
+            while (queue.size() > first && this->isOverBudget()) {
+                unsigned long size = queue[first]->size();
+                SOCKS_PROBE2(shed, largest, size);
+                queue.erase(queue.begin() + first);
+                this->queuedBytes[largest] -= size;
+                this->queuedMemory -= size;
+            }
+        }
+    }
+    
+    /*!
+     * A function that reads the clock before a send to a traced client, on the clock the kernel timestamps with. Untraced sends don't read the clock at all.
+     *
+     * @param clientIndex The index of the client.
+     *
+     * @return The time in nanoseconds, or 0 if the client is not traced.
+     */
+    uint64_t tracedSendTime(unsigned int clientIndex) const {
+        if (!this->traces[clientIndex] || !this->traces[clientIndex]->timestamps) return 0;
+        
+        //The kernel's timestamps are on the realtime clock
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+    
+    /*!
+     * A function that remembers when bytes were sent to a traced client, so the kernel's transmit timestamp can be matched to it later.
+     *
+     * @param clientIndex The index of the client.
+     * @param sentSize The number of bytes sent.
+     * @param sendTime The time from tracedSendTime() just before the send.
+     */
+    void traceSend(unsigned int clientIndex, long sentSize, uint64_t sendTime) {
+        TracedConnection* traced = this->traces[clientIndex].get();
+        if (traced == nullptr || !traced->timestamps) return;
+        
+        //Timestamps waiting on the error queue count against the socket's receive buffer, so collect them regularly
+        if (traced->pendingSends.size() % 32 == 31) this->readErrorQueue(clientIndex);
+        
+        //The kernel numbers the timestamp of each send by its last byte
+        traced->bytesSent += sentSize;
+        traced->pendingSends.push_back(std::make_pair(traced->bytesSent - 1, sendTime));
+        
+        //Sends the kernel never timestamps would otherwise pile up
+        if (traced->pendingSends.size() > TRACED_SENDS_LIMIT) traced->pendingSends.pop_front();
+    }
+    
     
 };
 
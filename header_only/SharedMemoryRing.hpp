@@ -0,0 +1,554 @@
+#ifndef SharedMemoryRing_hpp
+#define SharedMemoryRing_hpp
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <cerrno>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#define SHARED_MEMORY_RING_CAPACITY 1048576
+#define SHARED_MEMORY_RING_MAGIC 0x534f434b //"SOCK", set once a segment is ready to be opened
+#define SHARED_MEMORY_RING_MIN_SPIN 64
+#define SHARED_MEMORY_RING_MAX_SPIN 16384
+#define SHARED_MEMORY_RING_LIVENESS_CHECK 100 //Milliseconds a blocked read or write sleeps between checks that the other process still exists
+
+/*
+ A SharedMemoryRing is one end of a connection between two processes on the same machine. The connection is a pair of single-producer, single-consumer byte rings in a shared memory segment (in /dev/shm on Linux), one for each direction. Sending or receiving is a copy into or out of the ring, with no system call unless the other side is asleep.
+
+ The host creates the segment with create() and waits for the other process with waitForPeer(). The other process attaches with open(). Once connected, the name is removed, so the host can create another ring with the same name for the next process.
+ */
+class SharedMemoryRing {
+public:
+    //Constructor
+    SharedMemoryRing() {}
+    
+    //Destructor
+    ~SharedMemoryRing() {
+        if (this->setUp) {
+            try {
+                this->close();
+            } catch (...) {
+                printf("Error closing shared memory ring");
+            }
+        }
+    }
+    
+    //Public member functions
+    
+    /*!
+     * A function to create a new segment as the host side of the connection. Any leftover segment with the same name is replaced. Will throw an error if the segment cannot be created, or if the ring is already set.
+     *
+     * @param name The name of the segment. A leading '/' is added if there is none.
+     * @param capacity An optional parameter indicating the number of bytes each direction can hold. It is rounded up to a power of two. Autoinitialized as SHARED_MEMORY_RING_CAPACITY.
+     */
+    void create(const char* name, size_t capacity = SHARED_MEMORY_RING_CAPACITY) {
+        if (this->setUp)
+            throw std::logic_error("Ring already set");
+        
+        //Round the capacity up to a power of two, so positions can be wrapped with a mask
+        uint64_t roundedCapacity = 4096;
+        while (roundedCapacity < capacity) roundedCapacity <<= 1;
+        
+        this->segmentName = name[0] == '/' ? std::string(name) : "/" + std::string(name);
+        
+        /* shm_open()
+         The shm_open() function opens a named shared memory object, like open() does for files. On Linux these live in /dev/shm. Any segment left behind by a process that died is removed first.
+         */
+        shm_unlink(this->segmentName.c_str());
+        int fileDescriptor = shm_open(this->segmentName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fileDescriptor < 0)
+            throw std::runtime_error(std::string("ERROR creating shared memory: ") + std::string(strerror(errno)));
+        
+        size_t headerSize = (sizeof(Segment) + 63) & ~(size_t)63;
+        size_t size = headerSize + 2 * roundedCapacity;
+        
+        if (ftruncate(fileDescriptor, size) < 0) {
+            int error = errno;
+            ::close(fileDescriptor);
+            shm_unlink(this->segmentName.c_str());
+            throw std::runtime_error(std::string("ERROR sizing shared memory: ") + std::string(strerror(error)));
+        }
+        
+        //A new segment is filled with zeros, so every position, flag and futex word starts at 0
+        this->isHost = true;
+        this->mapSegment(fileDescriptor, size);
+        
+        this->segment->capacity = roundedCapacity;
+        this->segment->hostProcess = getpid();
+        this->mask = roundedCapacity - 1;
+        this->readData = (char*)this->segment + headerSize;
+        this->writeData = this->readData + roundedCapacity;
+        
+        std::atomic_thread_fence(std::memory_order_release);
+        this->segment->magic = SHARED_MEMORY_RING_MAGIC;
+        
+        this->setUp = true;
+    }
+    
+    /*!
+     * A function that waits for another process to open() the segment made by create(). Will throw an error if the ring was not made by create().
+     *
+     * @param timeoutMilliseconds The maximum time to wait, or a negative number to wait forever.
+     *
+     * @return True if the other process connected, false if the time ran out.
+     */
+    bool waitForPeer(int timeoutMilliseconds) {
+        if (!this->setUp || !this->isHost)
+            throw std::logic_error("Ring not created");
+        
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+        
+        while (this->segment->state.load(std::memory_order_acquire) == 0) {
+            long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (timeoutMilliseconds >= 0 && remaining <= 0) return false;
+            
+#if defined(__linux__)
+            timespec time;
+            time.tv_sec = remaining / 1000;
+            time.tv_nsec = (remaining % 1000) * 1000000;
+            syscall(SYS_futex, &this->segment->state, FUTEX_WAIT, 0, timeoutMilliseconds >= 0 ? &time : nullptr, nullptr, 0);
+#else
+            usleep(1000);
+#endif
+        }
+        
+        //The other process is attached, so the name is no longer needed and can be used for the next connection
+        shm_unlink(this->segmentName.c_str());
+        this->connected = true;
+        return true;
+    }
+    
+    /*!
+     * A function to attach to a segment made by create() in another process. Will throw an error if there is no such segment, if another process already attached to it, or if the ring is already set.
+     *
+     * @param name The name of the segment. A leading '/' is added if there is none.
+     */
+    void open(const char* name) {
+        if (this->setUp)
+            throw std::logic_error("Ring already set");
+        
+        this->segmentName = name[0] == '/' ? std::string(name) : "/" + std::string(name);
+        
+        int fileDescriptor = shm_open(this->segmentName.c_str(), O_RDWR, 0600);
+        if (fileDescriptor < 0)
+            throw std::runtime_error(std::string("ERROR opening shared memory: ") + std::string(strerror(errno)));
+        
+        struct stat info;
+        if (fstat(fileDescriptor, &info) < 0 || (size_t)info.st_size < sizeof(Segment)) {
+            ::close(fileDescriptor);
+            throw std::runtime_error("ERROR opening shared memory: Segment is not a ring");
+        }
+        
+        this->isHost = false;
+        this->mapSegment(fileDescriptor, info.st_size);
+        
+        if (this->segment->magic != SHARED_MEMORY_RING_MAGIC) {
+            munmap(this->segment, this->segmentSize);
+            this->segment = nullptr;
+            throw std::runtime_error("ERROR opening shared memory: Segment is not a ring");
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        
+        //A segment too small for the capacity it claims would have this side read and write past the end of the mapping
+        uint64_t capacity = this->segment->capacity;
+        size_t headerSize = (sizeof(Segment) + 63) & ~(size_t)63;
+        if (capacity == 0 || (capacity & (capacity - 1)) != 0 || this->segmentSize < headerSize || capacity > (this->segmentSize - headerSize) / 2) {
+            munmap(this->segment, this->segmentSize);
+            this->segment = nullptr;
+            throw std::runtime_error("ERROR opening shared memory: Segment is not a ring");
+        }
+        
+        //Claim the segment. Only one process can connect to each ring
+        uint32_t expected = 0;
+        if (!this->segment->state.compare_exchange_strong(expected, 1)) {
+            munmap(this->segment, this->segmentSize);
+            this->segment = nullptr;
+            throw std::runtime_error("ERROR opening shared memory: Ring already connected");
+        }
+        this->segment->peerProcess = getpid();
+#if defined(__linux__)
+        syscall(SYS_futex, &this->segment->state, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#endif
+        
+        this->mask = capacity - 1;
+        this->writeData = (char*)this->segment + headerSize;
+        this->readData = this->writeData + capacity;
+        
+        this->connected = true;
+        this->setUp = true;
+    }
+    
+    /*!
+     * A function that copies data into the ring for the other side to read. If there is not enough space, either as much as fits is written, or the function waits for the reader to make room.
+     *
+     * @param data The bytes to send.
+     * @param length The number of bytes to send.
+     * @param waitForSpace If true, the function waits until all the data has been written.
+     *
+     * @return The number of bytes written, or -1 with errno set to EPIPE if the other side closed the connection.
+     */
+    long write(const char* data, size_t length, bool waitForSpace) {
+        if (!this->setUp)
+            throw std::logic_error("Ring not set");
+        
+        uint64_t capacity = this->mask + 1;
+        size_t written = 0;
+        
+        while (written < length) {
+            if (this->writeRing->readerClosed.load(std::memory_order_acquire) || this->peerLost) {
+                errno = EPIPE;
+                return -1;
+            }
+            
+            uint64_t head = this->writeRing->head.load(std::memory_order_relaxed); //Only this side changes head
+            uint64_t tail = this->writeRing->tail.load(std::memory_order_acquire);
+            uint64_t space = capacity - (head - tail);
+            
+            if (space == 0) {
+                if (!waitForSpace) break;
+                //Wait for the reader to move tail past where it is now
+                this->waitForChange(&this->writeRing->tail, tail, &this->writeRing->spaceSignal, &this->writeRing->writerWaiting, std::chrono::steady_clock::time_point(), true);
+                continue;
+            }
+            
+            //Copy in at most two pieces, since the free space may wrap around the end of the ring
+            size_t amount = length - written < space ? length - written : space;
+            size_t offset = head & this->mask;
+            size_t firstPiece = amount < capacity - offset ? amount : capacity - offset;
+            memcpy(this->writeData + offset, data + written, firstPiece);
+            memcpy(this->writeData, data + written + firstPiece, amount - firstPiece);
+            
+            this->writeRing->head.store(head + amount, std::memory_order_release);
+            this->wake(&this->writeRing->dataSignal, &this->writeRing->readerWaiting);
+            
+            written += amount;
+        }
+        
+        return written;
+    }
+    
+    /*!
+     * A function that copies whatever the other side has written, up to the given length, into a buffer. If nothing is waiting, the function spins briefly and then sleeps until data arrives.
+     *
+     * @param buffer The buffer to fill.
+     * @param length The size of the buffer.
+     * @param timeoutMilliseconds The maximum time to wait, or a negative number to wait forever.
+     *
+     * @return The number of bytes read. 0 if the other side closed the connection and everything has been read. -1 with errno set to EAGAIN if the time ran out.
+     */
+    long read(char* buffer, size_t length, int timeoutMilliseconds) {
+        if (!this->setUp)
+            throw std::logic_error("Ring not set");
+        
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+        uint64_t capacity = this->mask + 1;
+        
+        while (true) {
+            uint64_t tail = this->readRing->tail.load(std::memory_order_relaxed); //Only this side changes tail
+            uint64_t head = this->readRing->head.load(std::memory_order_acquire);
+            
+            if (head != tail) {
+                size_t amount = head - tail < length ? head - tail : length;
+                size_t offset = tail & this->mask;
+                size_t firstPiece = amount < capacity - offset ? amount : capacity - offset;
+                memcpy(buffer, this->readData + offset, firstPiece);
+                memcpy(buffer + firstPiece, this->readData, amount - firstPiece);
+                
+                this->readRing->tail.store(tail + amount, std::memory_order_release);
+                this->wake(&this->readRing->spaceSignal, &this->readRing->writerWaiting);
+                
+                return amount;
+            }
+            
+            //The writer sets writerClosed after its last write, so check for data once more before reporting the end
+            if (this->readRing->writerClosed.load(std::memory_order_acquire) || this->peerLost) {
+                if (this->readRing->head.load(std::memory_order_acquire) != tail) continue;
+                return 0;
+            }
+            
+            if (timeoutMilliseconds == 0 || !this->waitForChange(&this->readRing->head, tail, &this->readRing->dataSignal, &this->readRing->readerWaiting, deadline, timeoutMilliseconds < 0)) {
+                errno = EAGAIN;
+                return -1;
+            }
+        }
+    }
+    
+    /*!
+     * A function that waits until something can be read, without reading it. The end of the connection counts, since read() then returns at once.
+     *
+     * @param timeoutMilliseconds The maximum time to wait, or a negative number to wait forever.
+     *
+     * @return True if read() would return without waiting, false if the time ran out.
+     */
+    bool waitForData(int timeoutMilliseconds) {
+        if (!this->setUp)
+            throw std::logic_error("Ring not set");
+        
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+        uint64_t tail = this->readRing->tail.load(std::memory_order_relaxed); //Only this side changes tail
+        
+        if (this->readRing->head.load(std::memory_order_acquire) != tail || this->readRing->writerClosed.load(std::memory_order_acquire) || this->peerLost) return true;
+        if (timeoutMilliseconds == 0) return false;
+        
+        return this->waitForChange(&this->readRing->head, tail, &this->readRing->dataSignal, &this->readRing->readerWaiting, deadline, timeoutMilliseconds < 0);
+    }
+    
+    /*!
+     * @return The number of bytes waiting to be read.
+     */
+    size_t available() const {
+        if (!this->setUp)
+            throw std::logic_error("Ring not set");
+        
+        return this->readRing->head.load(std::memory_order_acquire) - this->readRing->tail.load(std::memory_order_relaxed);
+    }
+    
+    /*!
+     * @return True if the other side closed the connection or its process is gone.
+     */
+    bool peerClosed() const {
+        if (!this->setUp)
+            throw std::logic_error("Ring not set");
+        
+        if (!this->connected) return false;
+        
+        if (this->readRing->writerClosed.load(std::memory_order_acquire) || this->writeRing->readerClosed.load(std::memory_order_acquire))
+            return true;
+        
+        //A process that crashed never marks its side closed, so check that it still exists
+        pid_t peer = this->isHost ? this->segment->peerProcess : this->segment->hostProcess;
+        return kill(peer, 0) < 0 && errno == ESRCH;
+    }
+    
+    /*!
+     * A function that tells the other side nothing more will be written. It can still read what has already been written, and this side can still read.
+     */
+    void shutdownWrite() {
+        if (!this->setUp)
+            throw std::logic_error("Ring not set");
+        
+        this->writeRing->writerClosed.store(1, std::memory_order_release);
+        this->wake(&this->writeRing->dataSignal, &this->writeRing->readerWaiting);
+    }
+    
+    /*!
+     * A function to close this side of the connection and unmap the segment. Data already written stays readable by the other side. Until it is set again, other functions cannot be called.
+     */
+    void close() {
+        if (!this->setUp)
+            throw std::logic_error("Ring not set");
+        
+        //Tell the other side, and wake it in case it is asleep waiting for this side
+        this->writeRing->writerClosed.store(1, std::memory_order_release);
+        this->readRing->readerClosed.store(1, std::memory_order_release);
+        this->wake(&this->writeRing->dataSignal, &this->writeRing->readerWaiting);
+        this->wake(&this->readRing->spaceSignal, &this->readRing->writerWaiting);
+        
+        //If nobody ever connected, the name would otherwise be left behind
+        if (this->isHost && !this->connected) shm_unlink(this->segmentName.c_str());
+        
+        munmap(this->segment, this->segmentSize);
+        
+        this->segment = nullptr;
+        this->readRing = nullptr;
+        this->writeRing = nullptr;
+        this->readData = nullptr;
+        this->writeData = nullptr;
+        this->connected = false;
+        this->peerLost = false;
+        this->setUp = false;
+    }
+    
+    /*!
+     * @return If this object is set.
+     */
+    bool isSet() const {
+        return this->setUp;
+    }
+    
+private:
+    //Private types
+    
+    //The header of one direction. The writer owns head and the reader owns tail, and they are kept on separate cache lines so the two processes don't fight over them
+    struct RingHeader {
+        alignas(64) std::atomic<uint64_t> head; //Total number of bytes ever written
+        std::atomic<uint32_t> writerClosed; //Set once the writer will not write any more
+        std::atomic<uint32_t> writerWaiting; //Set while the writer sleeps waiting for space
+        std::atomic<uint32_t> spaceSignal; //Futex word the writer sleeps on
+        alignas(64) std::atomic<uint64_t> tail; //Total number of bytes ever read
+        std::atomic<uint32_t> readerClosed; //Set once the reader will not read any more
+        std::atomic<uint32_t> readerWaiting; //Set while the reader sleeps waiting for data
+        std::atomic<uint32_t> dataSignal; //Futex word the reader sleeps on
+    };
+    
+    //The start of the shared memory segment. The data of both rings follows it
+    struct Segment {
+        alignas(64) uint32_t magic; //Set last by create(), so open() never sees a half made segment
+        uint32_t hostProcess;
+        uint32_t peerProcess;
+        std::atomic<uint32_t> state; //0 while waiting for the other process, 1 once connected. Also the futex word for waitForPeer()
+        uint64_t capacity;
+        RingHeader rings[2]; //rings[0] is written by the process that called open(), rings[1] by the host
+    };
+    
+    //Private properties
+    
+    Segment* segment = nullptr;
+    size_t segmentSize = 0;
+    
+    RingHeader* readRing = nullptr;
+    RingHeader* writeRing = nullptr;
+    char* readData = nullptr;
+    char* writeData = nullptr;
+    uint64_t mask = 0; //capacity - 1, to wrap positions into the ring
+    
+    std::string segmentName;
+    bool isHost = false;
+    bool connected = false;
+    bool peerLost = false; //Set by waitForChange() once the other process is found to be gone without closing its side
+    
+    unsigned int spinLimit = 1024; //Number of checks before sleeping. Grows while spinning pays off and shrinks while it doesn't
+    
+    bool setUp = false; //Represents if the ring has already been set. If not, reading and writing will cause errors
+    
+    //Private member functions
+    
+    /*!
+     * A function that waits until a position in shared memory moves away from a value, until either side closes, or until the other process is found to be gone. It spins for a while first, and then sleeps on a futex, waking every SHARED_MEMORY_RING_LIVENESS_CHECK milliseconds to check on the other process.
+     *
+     * @param position The position to watch.
+     * @param unchanged The value the position has while there is nothing to do.
+     * @param signal The futex word to sleep on.
+     * @param waiting The flag telling the other side this side is asleep.
+     * @param deadline The time to stop waiting.
+     * @param forever If true, the deadline is ignored.
+     *
+     * @return False if the deadline passed, true otherwise.
+     */
+    bool waitForChange(const std::atomic<uint64_t>* position, uint64_t unchanged, std::atomic<uint32_t>* signal, std::atomic<uint32_t>* waiting, std::chrono::steady_clock::time_point deadline, bool forever) {
+        //Spin first. Waking a sleeping process costs microseconds, while the other side often answers within a few hundred nanoseconds
+        for (unsigned int a = 0; a < this->spinLimit; a++) {
+            if (position->load(std::memory_order_acquire) != unchanged) {
+                if (this->spinLimit < SHARED_MEMORY_RING_MAX_SPIN) this->spinLimit *= 2;
+                return true;
+            }
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#elif defined(__aarch64__)
+            asm volatile("yield");
+#endif
+        }
+        
+        //Spinning did not pay off this time, so spin less next time
+        if (this->spinLimit > SHARED_MEMORY_RING_MIN_SPIN) this->spinLimit /= 2;
+        
+        //A process that crashed never marks its side closed, so while asleep, check now and then that the other process still exists
+        std::chrono::steady_clock::time_point nextCheck = std::chrono::steady_clock::now() + std::chrono::milliseconds(SHARED_MEMORY_RING_LIVENESS_CHECK);
+        
+        while (true) {
+            //Read the signal before announcing the wait. If the other side changes the position after this, it also changes the signal, and the futex wait returns immediately
+            uint32_t signalValue = signal->load(std::memory_order_acquire);
+            waiting->store(1, std::memory_order_seq_cst);
+            
+            if (position->load(std::memory_order_seq_cst) != unchanged || this->readRing->writerClosed.load() || this->writeRing->readerClosed.load()) {
+                waiting->store(0, std::memory_order_relaxed);
+                return true;
+            }
+            
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            long remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count();
+            if (!forever && remaining <= 0) {
+                waiting->store(0, std::memory_order_relaxed);
+                return false;
+            }
+            
+            long untilCheck = std::chrono::duration_cast<std::chrono::microseconds>(nextCheck - now).count();
+            if (forever || untilCheck < remaining) remaining = untilCheck > 0 ? untilCheck : 0;
+            
+#if defined(__linux__)
+            timespec time;
+            time.tv_sec = remaining / 1000000;
+            time.tv_nsec = (remaining % 1000000) * 1000;
+            syscall(SYS_futex, signal, FUTEX_WAIT, signalValue, &time, nullptr, 0);
+#else
+            usleep(50);
+#endif
+            waiting->store(0, std::memory_order_relaxed);
+            
+            if (position->load(std::memory_order_acquire) != unchanged) return true;
+            
+            if (std::chrono::steady_clock::now() >= nextCheck) {
+                if (this->peerClosed()) {
+                    this->peerLost = true;
+                    return true;
+                }
+                nextCheck = std::chrono::steady_clock::now() + std::chrono::milliseconds(SHARED_MEMORY_RING_LIVENESS_CHECK);
+            }
+        }
+    }
+    
+    /*!
+     * A function that wakes the other side if it is asleep on the given futex word.
+     *
+     * @param signal The futex word to change.
+     * @param waiting The flag which is set if the other side is asleep.
+     */
+    void wake(std::atomic<uint32_t>* signal, std::atomic<uint32_t>* waiting) {
+        //Pairs with the store to waiting in waitForChange(), so either this side sees the other is asleep or the other side sees the new position
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        
+        if (waiting->load(std::memory_order_relaxed)) {
+            signal->fetch_add(1, std::memory_order_release);
+#if defined(__linux__)
+            syscall(SYS_futex, signal, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#endif
+        }
+    }
+    
+    /*!
+     * A function to map a segment and set up the pointers into it.
+     *
+     * @param fileDescriptor The file descriptor of the segment.
+     * @param size The size of the segment.
+     */
+    void mapSegment(int fileDescriptor, size_t size) {
+        /* mmap()
+         The mmap() function maps the shared memory object into this process. MAP_SHARED makes writes visible to every other process mapping the same object. The file descriptor is not needed once the mapping exists.
+         */
+        void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+        int error = errno;
+        ::close(fileDescriptor);
+        
+        if (address == MAP_FAILED) {
+            if (this->isHost) shm_unlink(this->segmentName.c_str());
+            throw std::runtime_error(std::string("ERROR mapping shared memory: ") + std::string(strerror(error)));
+        }
+        
+        this->segment = (Segment*)address;
+        this->segmentSize = size;
+        
+        //The host writes to rings[1] and reads from rings[0]. The other process does the opposite
+        this->readRing = &this->segment->rings[this->isHost ? 0 : 1];
+        this->writeRing = &this->segment->rings[this->isHost ? 1 : 0];
+    }
+};
+
+#endif /* SharedMemoryRing_hpp */
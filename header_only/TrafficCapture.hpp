@@ -0,0 +1,198 @@
+#ifndef TrafficCapture_hpp
+#define TrafficCapture_hpp
+
+#include <string>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <cerrno>
+
+#define TRAFFIC_CAPTURE_INITIAL_SIZE 16777216
+#define TRAFFIC_CAPTURE_MAGIC 0x50414353 //"SCAP"
+#define TRAFFIC_CAPTURE_VERSION 2 //Version 1 files have no Opened or Closed records
+
+/*
+ A TrafficCapture records the bytes a ServerSocket sends and receives to a file, along with when each client connects and is closed, so the traffic can be played back later with TrafficReplay.
+
+ The file is memory-mapped and only ever appended to, so recording a message is a copy and a clock read, with no system call unless the file has to grow. The length in the file header is updated after every record, so a file left by a crashed process is still readable up to the last whole record.
+
+ The file is a FileHeader followed by records. Each record is a RecordHeader followed by its bytes, padded to a multiple of 8.
+ */
+class TrafficCapture {
+public:
+    //Public types
+    
+    enum Direction : uint32_t {
+        Received = 0, //From a client to the server
+        Sent = 1, //From the server to a client
+        Opened = 2, //A client was given the index. It has no bytes
+        Closed = 3 //The client at the index was closed, so the index can be given to another. It has no bytes
+    };
+    
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t startTime; //Nanoseconds since the epoch when the capture started
+        uint64_t length; //Bytes used, including this header
+    };
+    
+    struct RecordHeader {
+        uint64_t time; //Nanoseconds since the capture started
+        uint32_t clientIndex;
+        uint32_t direction;
+        uint64_t length; //Bytes in the message, not counting the padding after it
+    };
+    
+    //Constructor
+    TrafficCapture() {}
+    
+    //Destructor
+    ~TrafficCapture() {
+        if (this->setUp) {
+            try {
+                this->close();
+            } catch (...) {
+                printf("Error closing traffic capture");
+            }
+        }
+    }
+    
+    //Public member functions
+    
+    /*!
+     * A function to start a new capture file. Any existing file at the path is replaced. Will throw an error if the file cannot be created, or if the capture is already set.
+     *
+     * @param path The path of the file.
+     */
+    void open(const char* path) {
+        if (this->setUp)
+            throw std::logic_error("Capture already set");
+        
+        this->fileDescriptor = ::open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+        if (this->fileDescriptor < 0)
+            throw std::runtime_error(std::string("ERROR creating capture file: ") + std::string(strerror(errno)));
+        
+        try {
+            this->grow(TRAFFIC_CAPTURE_INITIAL_SIZE);
+        } catch (...) {
+            ::close(this->fileDescriptor);
+            this->fileDescriptor = -1;
+            throw;
+        }
+        
+        this->startTime = std::chrono::steady_clock::now();
+        
+        FileHeader* header = (FileHeader*)this->mapping;
+        header->magic = TRAFFIC_CAPTURE_MAGIC;
+        header->version = TRAFFIC_CAPTURE_VERSION;
+        header->startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        header->length = sizeof(FileHeader);
+        
+        this->setUp = true;
+    }
+    
+    /*!
+     * A function that adds one record to the end of the file. Will throw an error if the file cannot grow, or if the capture is not set.
+     *
+     * @param clientIndex The index of the client the bytes went to or came from.
+     * @param direction Whether the server received or sent the bytes, or whether the client connected or was closed.
+     * @param data The bytes. May be a null pointer if there are none.
+     * @param length The number of bytes.
+     */
+    void append(unsigned int clientIndex, Direction direction, const char* data, unsigned long length) {
+        if (!this->setUp)
+            throw std::logic_error("Capture not set");
+        
+        FileHeader* header = (FileHeader*)this->mapping;
+        size_t recordSize = sizeof(RecordHeader) + ((length + 7) & ~(unsigned long)7);
+        if (header->length + recordSize > this->mappingSize) {
+            this->grow(header->length + recordSize);
+            header = (FileHeader*)this->mapping;
+        }
+        
+        RecordHeader* record = (RecordHeader*)(this->mapping + header->length);
+        record->time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->startTime).count();
+        record->clientIndex = clientIndex;
+        record->direction = direction;
+        record->length = length;
+        if (length > 0) memcpy((char*)(record + 1), data, length);
+        
+        //The length is moved past the record last, so a reader never sees half of one
+        header->length += recordSize;
+    }
+    
+    /*!
+     * A function to finish the file, trimming it to the bytes used. Until it is set again, other functions cannot be called.
+     */
+    void close() {
+        if (!this->setUp) return;
+        
+        //Trim the unused space the file grew into
+        size_t length = ((FileHeader*)this->mapping)->length;
+        munmap(this->mapping, this->mappingSize);
+        if (ftruncate(this->fileDescriptor, length) < 0) {} //The file is still readable at its larger size
+        ::close(this->fileDescriptor);
+        
+        this->mapping = nullptr;
+        this->mappingSize = 0;
+        this->fileDescriptor = -1;
+        this->setUp = false;
+    }
+    
+    /*!
+     * @return If this object is set.
+     */
+    bool isSet() const {
+        return this->setUp;
+    }
+    
+private:
+    //Private properties
+    
+    int fileDescriptor = -1;
+    char* mapping = nullptr;
+    size_t mappingSize = 0;
+    
+    std::chrono::steady_clock::time_point startTime; //Record times are measured from here
+    
+    bool setUp = false; //Represents if the capture has already been set. If not, appending will cause errors
+    
+    //Private member functions
+    
+    /*!
+     * A function that makes the file and its mapping larger.
+     *
+     * @param size The smallest size that will do.
+     */
+    void grow(size_t size) {
+        //Double the size each time, so the cost of growing is spread over many records
+        size_t newSize = this->mappingSize > 0 ? this->mappingSize * 2 : TRAFFIC_CAPTURE_INITIAL_SIZE;
+        while (newSize < size) newSize *= 2;
+        
+        if (ftruncate(this->fileDescriptor, newSize) < 0)
+            throw std::runtime_error(std::string("ERROR growing capture file: ") + std::string(strerror(errno)));
+        
+        /* mmap()
+         The mmap() function maps the file into memory. MAP_SHARED writes records straight into the page cache, so they reach the file even if the process dies.
+         */
+        void* address = mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, this->fileDescriptor, 0);
+        if (address == MAP_FAILED)
+            throw std::runtime_error(std::string("ERROR mapping capture file: ") + std::string(strerror(errno)));
+        
+        if (this->mapping != nullptr) munmap(this->mapping, this->mappingSize);
+        this->mapping = (char*)address;
+        this->mappingSize = newSize;
+    }
+};
+
+#endif /* TrafficCapture_hpp */
@@ -0,0 +1,164 @@
+#ifndef CRC32C_hpp
+#define CRC32C_hpp
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define CRC32C_X86
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_ARM
+#endif
+
+/*
+ CRC32C (the Castagnoli polynomial, as used by iSCSI, ext4 and SCTP) for checking that frames arrive intact. It uses the processor's CRC32 instruction where there is one (SSE4.2 on x86, checked when the program runs, or the CRC extension on ARM), and tables eight bytes at a time elsewhere.
+
+ crc32cCopy() copies bytes while it checksums them, so building a frame and checksumming its payload reads the payload once.
+
+ Checksums can be continued: passing the checksum of the first part of some bytes to the call for the rest gives the checksum of all of them.
+ */
+namespace CRC32CDetail {
+    /*
+     Tables for the software fallback. Table k holds the checksum of each byte followed by k zero bytes, so eight bytes are done with eight lookups.
+     */
+    struct Tables {
+        uint32_t table[8][256];
+        
+        Tables() {
+            for (uint32_t a = 0; a < 256; a++) {
+                uint32_t crc = a;
+                for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+                this->table[0][a] = crc;
+            }
+            for (int k = 1; k < 8; k++) {
+                for (int a = 0; a < 256; a++) this->table[k][a] = (this->table[k - 1][a] >> 8) ^ this->table[0][this->table[k - 1][a] & 0xFF];
+            }
+        }
+    };
+    
+    inline const Tables& tables() {
+        static const Tables built;
+        return built;
+    }
+    
+    /*!
+     * The checksum of some bytes, optionally copying them as they are read. The checksum passed in and returned is not inverted.
+     */
+    inline uint32_t software(uint32_t crc, char* destination, const char* source, size_t length) {
+        const Tables& t = tables();
+        size_t position = 0;
+        for (; position + 8 <= length; position += 8) {
+            uint64_t word;
+            memcpy(&word, source + position, 8);
+            if (destination != nullptr) memcpy(destination + position, &word, 8);
+            
+            //The tables assume little-endian words
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            word = __builtin_bswap64(word);
+#endif
+            uint32_t low = (uint32_t)word ^ crc;
+            uint32_t high = (uint32_t)(word >> 32);
+            crc = t.table[7][low & 0xFF] ^ t.table[6][(low >> 8) & 0xFF] ^ t.table[5][(low >> 16) & 0xFF] ^ t.table[4][low >> 24]
+                ^ t.table[3][high & 0xFF] ^ t.table[2][(high >> 8) & 0xFF] ^ t.table[1][(high >> 16) & 0xFF] ^ t.table[0][high >> 24];
+        }
+        for (; position < length; position++) {
+            if (destination != nullptr) destination[position] = source[position];
+            crc = (crc >> 8) ^ t.table[0][(crc ^ (unsigned char)source[position]) & 0xFF];
+        }
+        return crc;
+    }
+    
+#if defined(CRC32C_X86)
+    /*!
+     * software() with the SSE4.2 CRC32 instruction. Compiled for SSE4.2 whatever the build flags, and only called once the processor is known to have it.
+     */
+    __attribute__((target("sse4.2"))) inline uint32_t hardware(uint32_t crc, char* destination, const char* source, size_t length) {
+        size_t position = 0;
+#if defined(__x86_64__)
+        uint64_t crc64 = crc;
+        for (; position + 8 <= length; position += 8) {
+            uint64_t word;
+            memcpy(&word, source + position, 8);
+            if (destination != nullptr) memcpy(destination + position, &word, 8);
+            crc64 = _mm_crc32_u64(crc64, word);
+        }
+        crc = (uint32_t)crc64;
+#endif
+        for (; position + 4 <= length; position += 4) {
+            uint32_t word;
+            memcpy(&word, source + position, 4);
+            if (destination != nullptr) memcpy(destination + position, &word, 4);
+            crc = _mm_crc32_u32(crc, word);
+        }
+        for (; position < length; position++) {
+            if (destination != nullptr) destination[position] = source[position];
+            crc = _mm_crc32_u8(crc, (unsigned char)source[position]);
+        }
+        return crc;
+    }
+#elif defined(CRC32C_ARM)
+    /*!
+     * software() with the ARM CRC32C instructions.
+     */
+    inline uint32_t hardware(uint32_t crc, char* destination, const char* source, size_t length) {
+        size_t position = 0;
+        for (; position + 8 <= length; position += 8) {
+            uint64_t word;
+            memcpy(&word, source + position, 8);
+            if (destination != nullptr) memcpy(destination + position, &word, 8);
+            crc = __crc32cd(crc, word);
+        }
+        for (; position < length; position++) {
+            if (destination != nullptr) destination[position] = source[position];
+            crc = __crc32cb(crc, (unsigned char)source[position]);
+        }
+        return crc;
+    }
+#endif
+    
+    inline uint32_t checksum(uint32_t crc, char* destination, const char* source, size_t length) {
+        crc = ~crc;
+#if defined(CRC32C_X86)
+        static const bool sse42 = __builtin_cpu_supports("sse4.2");
+        crc = sse42 ? hardware(crc, destination, source, length) : software(crc, destination, source, length);
+#elif defined(CRC32C_ARM)
+        crc = hardware(crc, destination, source, length);
+#else
+        crc = software(crc, destination, source, length);
+#endif
+        return ~crc;
+    }
+}
+
+/*!
+ * A function that computes the CRC32C checksum of some bytes.
+ *
+ * @param data The bytes.
+ * @param length The number of bytes.
+ * @param crc An optional parameter holding the checksum of the bytes before these, to continue it. Autoinitialized as 0, to start a new checksum.
+ *
+ * @return The checksum.
+ */
+inline uint32_t crc32c(const char* data, size_t length, uint32_t crc = 0) {
+    return CRC32CDetail::checksum(crc, nullptr, data, length);
+}
+
+/*!
+ * A function that copies bytes and computes their CRC32C checksum in the same pass. The two ranges must not overlap.
+ *
+ * @param destination Where to copy the bytes to.
+ * @param source The bytes.
+ * @param length The number of bytes.
+ * @param crc An optional parameter holding the checksum of the bytes before these, to continue it. Autoinitialized as 0, to start a new checksum.
+ *
+ * @return The checksum.
+ */
+inline uint32_t crc32cCopy(char* destination, const char* source, size_t length, uint32_t crc = 0) {
+    return CRC32CDetail::checksum(crc, destination, source, length);
+}
+
+#endif /* CRC32C_hpp */
@@ -2,173 +2,291 @@
 
 ClientSocket::ClientSocket() {}
 
-ClientSocket::ClientSocket(const char* hostName, int portNum) {
-    this->setSocket(hostName, portNum);
+ClientSocket::ClientSocket(const char* hostName, int portNum, unsigned int connectTimeoutMilliseconds) {
+    this->setSocket(hostName, portNum, connectTimeoutMilliseconds);
 }
 
-void ClientSocket::setSocket(const char* hostName, int portNum) {
+void ClientSocket::setSocket(const char* hostName, int portNum, unsigned int connectTimeoutMilliseconds) {
     if (this->setUp)
         throw std::logic_error("Socket already set");
     
     this->portNumber = portNum;
     
-    int returnVal;
+    //Look the host up, or take its addresses from the cache if it was looked up recently
+    HostResolver::Addresses serverAddressList = HostResolver::shared().resolve(hostName, portNum);
     
-    addrinfo hints; //A struct containing information on the address. Will be passed to getaddrinfo() to give hints about the connection to be made
-    addrinfo* serverAddressList; //A pointer to an addrinfo struct that will be filled with the server address by getaddrinfo()
-    
-    memset(&hints, 0, sizeof(hints)); //Set hints
-    hints.ai_family = AF_UNSPEC; //Can be either IPv4 or IPv6
-    hints.ai_socktype = SOCK_STREAM; //TCP Socket
-    
-    /* getaddrinfo
-     The getaddrinfo() fills a given addrinfo struct with the relevant information. The return value is nonzero when there is an error.
-     
-     The first argument is the name of the host to connect with.
-     
-     The second argument is a string representation of the port number.
-     
-     The third argument is a pointer to an addrinfo struct which contains hints about the type of connection to be made.
-     
-     The fourth argument is a pointer which will be filled with a linked list of hosts returned. If just one host is being looked for, the first result can just be used.
-     */
-    returnVal = getaddrinfo(hostName, std::to_string(portNum).c_str(), &hints, &serverAddressList);
-    
-    //Check for an error with getaddrinfo()
-    if (returnVal != 0) {
-        throw std::runtime_error(strcat((char *)"ERROR getting host address: ", gai_strerror(returnVal))); //gai_strerror() returns a c string representation of the error
+    //Race the addresses of the host against each other, rather than waiting out the first one if it can't be reached
+    try {
+        this->connectionSocket = this->connectToAny(serverAddressList.get(), connectTimeoutMilliseconds);
+    } catch (...) {
+        //The cached addresses may be out of date, so the next attempt looks the host up again
+        HostResolver::shared().forget(hostName, portNum);
+        throw;
     }
     
-    //Set the first host in the list to the desired host
-    addrinfo serverAddress = *serverAddressList;
+    this->lastSeenTime = std::chrono::steady_clock::now();
     
-    /* socket()
-     The socket() function returns a new socket, with three parameters.
-     
-     The first argument is address of the domain of the socket.
-     The two possible address domains are the unix, for commen file system sockets, and the internet, for anywhere on the internet.
-     AF_UNIX is generally used for the former, and AF_INET generally for the latter.
-     
-     The second argument is the type of the socket.
-     The two possible types are a stream socket where characters are read in a continuous stream, and a diagram socket, which reads in chunks.
-     SOCK_STREAM is generally used for the former, and SOCK_DGRAM for the latter.
-     
-     The third argument is the protocol. It should always be 0 except in unusual circumstances, and then allows the operating system to chose TCP or UDP, based on the socket type. TCP is chosen for stream sockets, and UDP for diagram sockets
-     
-     The function returns an integer than can be used like a reference to the socket. Failure results in returning -1.
-     */
-    //In this case, the values are taken from getaddrinfo(), from the first returned addrinfo struct in the linked list.
-    this->connectionSocket = socket(serverAddress.ai_family, serverAddress.ai_socktype, serverAddress.ai_protocol);
+    this->setUp = true; //All functions ensure the socket has been set before doing anything
+}
+
+void ClientSocket::setSharedMemory(const char* name) {
+    if (this->setUp)
+        throw std::logic_error("Socket already set");
     
-    //Checks for errors initializing socket
-    if (socket < 0)
-        throw std::runtime_error(strcat((char *)"ERROR opening socket: ", strerror(errno)));
+    std::unique_ptr<SharedMemoryRing> ring(new SharedMemoryRing());
+    ring->open(name);
     
-    //No need to call bind() (see server side) because the local port number doesn't matter; the kernel will find an open port.
+    this->sharedMemoryRing = std::move(ring);
+    this->connectionSocket = -1; //There is no socket, so socket options set on it have no effect
+    this->portNumber = 0;
+    this->lastSeenTime = std::chrono::steady_clock::now();
     
-    /* connect()
-     The connect() function is called by the client to establish a connection with the server, with three arguments.
-     
-     The first argument is the small integer reference for the socket.
-     
-     The second argument is the address of the host to connect to, including the port number, all in the form of a sockaddr struct.
-     
-     The third argument is the size of the address.
-     
-     The function returns 0 if successful and -1 if it fails.
-     */
-    if (connect(this->connectionSocket, serverAddress.ai_addr, serverAddress.ai_addrlen) < 0)
-        throw std::runtime_error(strcat((char *)"ERROR connecting: ", strerror(errno)));
+    this->setUp = true;
+}
+
+std::string ClientSocket::send(const char* message, bool ensureFullStringSent) {
+    unsigned long messageLength = message != nullptr ? strlen(message) : 0;
     
-    freeaddrinfo(serverAddressList); //Free the linked list now that we have the local host information
+    unsigned long sentSize = this->sendBytes(message, messageLength, ensureFullStringSent);
     
-    this->setUp = true; //All functions ensure the socket has been set before doing anything
+    //Return any part of the string that was not sent. This occurs if the string is too long, and is the only case that allocates
+    if (sentSize < messageLength) return std::string(message + sentSize, messageLength - sentSize);
+    return "";
 }
 
-std::string ClientSocket::send(const char* message, bool ensureFullStringSent) {
+unsigned long ClientSocket::send(std::string_view message, bool ensureFullStringSent) {
+    return this->sendBytes(message.data(), message.size(), ensureFullStringSent);
+}
+
+#if __cplusplus >= 202002L
+unsigned long ClientSocket::send(std::span<const std::byte> message, bool ensureFullStringSent) {
+    return this->sendBytes((const char*)message.data(), message.size(), ensureFullStringSent);
+}
+#endif
+
+std::string ClientSocket::send(std::string&& message, bool ensureFullStringSent) {
+    unsigned long sentSize = this->sendBytes(message.data(), message.size(), ensureFullStringSent);
+    
+    //Return what was not sent in the string that was moved in, rather than in a new one
+    message.erase(0, sentSize);
+    return std::move(message);
+}
+
+std::string ClientSocket::receive(bool* socketClosed) {
     if (!this->setUp)
         throw std::logic_error("Socket not set");
     
-    //Empty messages won't be sent
-    if (std::string(message) == "")
-        throw std::logic_error("No message to send");
-    
-    unsigned long messageLength = strlen(message);
+    std::string str;
     
-    long sentSize = write(this->connectionSocket, message, messageLength);
+    //Keep reading while more of the message is already waiting
+    while (true) {
+        long messageSize; //Stores the return value from the calls to read() and write() by holding the number of characters either read or written
+        
+        /* read()
+         The read() function will read in info from the client socket, with three arguments. It will block until the client writes and there is something to read in.
+         
+         The first argument is the reference for the client's socket.
+         
+         The second argument is the buffer to store the message.
+         
+         The third argument is the maximum number of characters to to be read into the buffer.
+         */
+        if (this->sharedMemoryRing) {
+            this->receiveBuffer.reserve(this->sharedMemoryRing->available());
+            messageSize = this->sharedMemoryRing->read(this->receiveBuffer.data(), this->receiveBuffer.size(), str.empty() ? this->timeoutMilliseconds : 0);
+            if (messageSize > 0) this->recordReply();
+        } else {
+            //Size the buffer by what the kernel already has, so a large message takes a few large reads
+            int waiting = 0;
+            if (ioctl(this->connectionSocket, FIONREAD, &waiting) < 0) waiting = 0;
+            this->receiveBuffer.reserve(waiting);
+            messageSize = this->readSocket(this->receiveBuffer.data(), this->receiveBuffer.size());
+        }
+        
+        //Checks for errors reading from the socket
+        if (messageSize < 0)
+            throw std::runtime_error(strcat((char *)"ERROR reading from socket: ", strerror(errno)));
+        
+        //A blank message indicates that the socket has closed from the host side, so there is nothing more to read
+        if (messageSize == 0) {
+            if (str.empty() && socketClosed != nullptr) *socketClosed = true;
+            return str;
+        }
+        
+        this->lastSeenTime = std::chrono::steady_clock::now();
+        
+        str.append(this->receiveBuffer.data(), messageSize);
+        this->receiveBuffer.used(messageSize); //Only once the bytes are copied out, since it may replace the memory
+        
+        //A shared memory connection never has to wait for the rest of a message to arrive over the network, so only read on if more is already there
+        if (this->sharedMemoryRing) {
+            if (this->sharedMemoryRing->available() == 0) return str;
+            continue;
+        }
+        
+        //Check if there is more data waiting to be read, and if so, read it
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(this->connectionSocket, &readfds);
+        int n = this->connectionSocket + 1;
+        
+        struct timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 20000;
+        
+        int returnValue = select(n, &readfds, NULL, NULL, &timeout);
+        if (returnValue < 0) {
+            throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
+        } else if (returnValue == 0) {
+            return str;
+        }
+    }
+}
+
+bool ClientSocket::receive(char* buffer, unsigned long length, bool* socketClosed) {
+    return this->receiveBytes(buffer, length, socketClosed);
+}
+
+bool ClientSocket::receiveRecord(std::string_view& record, char delimiter, bool* socketClosed) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
     
-    if (sentSize < 0) {
-        throw std::runtime_error(strcat((char *)"ERROR sending message: ", strerror(errno)));
-    } else if (sentSize < messageLength) { //If only some of the string was sent, return what wasn't sent (or send the rest)
-        std::string extraStr; //Holds the rest of the string that was not sent
-        for (unsigned long a = sentSize; a < messageLength; a++) {
-            extraStr += message[a];
+    //Only read when no whole record is left over from the last read
+    while (!this->recordBuffer.next(record, delimiter)) {
+        size_t length;
+        char* space = this->recordBuffer.space(length);
+        
+        long messageSize;
+        if (this->sharedMemoryRing) {
+            messageSize = this->sharedMemoryRing->read(space, length, this->timeoutMilliseconds);
+            if (messageSize > 0) this->recordReply();
+        } else {
+            messageSize = this->readSocket(space, length);
         }
-        if (ensureFullStringSent) { //This optional bool is set to false. If manually changed to true send the rest. Otherwise, return the unsent part
-            this->send(extraStr.c_str(), ensureFullStringSent); //Recursively keep sending the rest of the string until it is all sent
-            return "";
+        
+        if (messageSize < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("ERROR reading from socket: ") + std::string(strerror(errno)));
         }
-        return extraStr; //Return any part of the string that was not sent. This occurs if the string is too long
+        
+        //The stream ended. A last record without a delimiter is still a record
+        if (messageSize == 0) {
+            if (this->recordBuffer.rest(record)) return true;
+            if (socketClosed != nullptr) *socketClosed = true;
+            return false;
+        }
+        
+        this->lastSeenTime = std::chrono::steady_clock::now();
+        this->recordBuffer.added(messageSize);
     }
-    return "";
+    return true;
 }
 
-std::string ClientSocket::receive(bool* socketClosed) {
+unsigned long ClientSocket::receiveStream(const std::function<void(const char*, unsigned long)>& sink, unsigned long length, bool* socketClosed) {
     if (!this->setUp)
         throw std::logic_error("Socket not set");
     
-    //Initialize the buffer where received info is stored
-    bzero(this->buffer, BUFFER_SIZE);
+    unsigned long received = 0;
     
-    long messageSize; //Stores the return value from the calls to read() and write() by holding the number of characters either read or written
+    while (received < length) {
+        //Size the buffer by what is waiting, but never read past the end of the stream, so what follows it is left for the next receive
+        unsigned long waiting = 0;
+        if (this->sharedMemoryRing) {
+            waiting = this->sharedMemoryRing->available();
+        } else {
+            int available = 0;
+            if (ioctl(this->connectionSocket, FIONREAD, &available) == 0) waiting = available;
+        }
+        this->receiveBuffer.reserve(std::min(waiting, length - received));
+        unsigned long chunkSize = std::min((unsigned long)this->receiveBuffer.size(), length - received);
+        
+        long messageSize;
+        if (this->sharedMemoryRing) {
+            messageSize = this->sharedMemoryRing->read(this->receiveBuffer.data(), chunkSize, this->timeoutMilliseconds);
+            if (messageSize > 0) this->recordReply();
+        } else {
+            messageSize = this->readSocket(this->receiveBuffer.data(), chunkSize);
+        }
+        
+        if (messageSize < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("ERROR reading from socket: ") + std::string(strerror(errno)));
+        }
+        
+        //The host disconnected, which is the end of a stream of unknown length
+        if (messageSize == 0) {
+            if (socketClosed != nullptr) *socketClosed = true;
+            break;
+        }
+        
+        this->lastSeenTime = std::chrono::steady_clock::now();
+        
+        sink(this->receiveBuffer.data(), messageSize);
+        this->receiveBuffer.used(messageSize);
+        received += messageSize;
+    }
     
-    /* read()
-     The read() function will read in info from the client socket, with three arguments. It will block until the client writes and there is something to read in.
-     
-     The first argument is the reference for the client's socket.
-     
-     The second argument is the buffer to store the message.
-     
-     The third argument is the maximum number of characters to to be read into the buffer.
-     */
-    messageSize = read(this->connectionSocket, this->buffer, BUFFER_SIZE);
+    return received;
+}
+
+unsigned long ClientSocket::sendStream(const std::function<unsigned long(char*, unsigned long)>& source) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
     
-    //Checks for errors reading from the socket
-    if (messageSize < 0)
-        throw std::runtime_error(strcat((char *)"ERROR reading from socket: ", strerror(errno)));
+    //One chunk is reused for the whole stream
+    std::unique_ptr<char[]> chunk(new char[STREAM_CHUNK_SIZE]);
+    unsigned long sent = 0;
     
-    if (socketClosed != nullptr && messageSize == 0) {
-        *socketClosed = true;
+    while (true) {
+        unsigned long chunkSize = std::min(source(chunk.get(), STREAM_CHUNK_SIZE), (unsigned long)STREAM_CHUNK_SIZE);
+        if (chunkSize == 0) break;
+        
+        sent += this->sendBytes(chunk.get(), chunkSize, true);
     }
     
-    std::string str = std::string(buffer, messageSize);
+    return sent;
+}
+
+bool ClientSocket::waitForData(int timeoutMilliseconds) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    if (this->sharedMemoryRing)
+        return this->sharedMemoryRing->waitForData(timeoutMilliseconds);
     
-    //Check if there is more data waiting to be read, and if so, read it
-    fd_set readfds;
-    FD_ZERO(&readfds);
-    FD_SET(this->connectionSocket, &readfds);
-    int n = this->connectionSocket + 1;
+    pollfd pollInfo;
+    pollInfo.fd = this->connectionSocket;
+    pollInfo.events = POLLIN;
+    pollInfo.revents = 0;
     
-    struct timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 20000;
+    int returnValue;
+    while ((returnValue = poll(&pollInfo, 1, timeoutMilliseconds)) < 0 && errno == EINTR);
     
-    int returnValue = select(n, &readfds, NULL, NULL, &timeout);
-    if (returnValue < 0) {
+    if (returnValue < 0)
         throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
-    } else if (returnValue > 0) {
-        str += this->receive();
-    }
     
-    return str;
+    //POLLERR alone can be a notification, like a transmit timestamp, which is not data
+    return returnValue > 0 && (pollInfo.revents & (POLLIN | POLLHUP)) != 0;
 }
 
 void ClientSocket::close() {
     if (!this->setUp)
         throw std::logic_error("Socket not set");
     
-    ::close(this->connectionSocket);
+    SOCKS_PROBE2(close, -1, this->sharedMemoryRing ? -1 : this->connectionSocket);
+    if (this->sharedMemoryRing) {
+        this->sharedMemoryRing->close();
+        this->sharedMemoryRing.reset();
+    } else {
+        ::close(this->connectionSocket);
+    }
     portNumber = 0;
+    this->receiveBuffer.release();
+    this->recordBuffer.release();
+    this->trace.reset();
+    this->timestamps = false;
+    this->awaitingReply = false;
+    this->fastOpenUsed = false;
     this->setUp = false;
 }
 
@@ -176,6 +294,8 @@ void ClientSocket::setTimeout(unsigned int seconds, unsigned int milliseconds) {
     if (!this->setUp)
         throw std::logic_error("Socket not set");
     
+    this->timeoutMilliseconds = (seconds > 0 || milliseconds > 0) ? (seconds * 1000) + milliseconds : -1;
+    
 #if defined(_WIN32)
     DWORD timeout = (seconds * 1000) + milliseconds;
     setsockopt(this->hostSocket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
@@ -197,10 +317,352 @@ void ClientSocket::setTimeout(unsigned int seconds, unsigned int milliseconds) {
 #endif
 }
 
+void ClientSocket::setHeartbeat(unsigned int idleSeconds, unsigned int intervalSeconds, unsigned int missedHeartbeats) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    int enable = idleSeconds > 0 ? 1 : 0;
+    setsockopt(this->connectionSocket, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(int));
+    
+    if (intervalSeconds == 0) intervalSeconds = 1;
+    if (missedHeartbeats == 0) missedHeartbeats = 1;
+    
+#if defined(TCP_USER_TIMEOUT)
+    //Sent data that goes unacknowledged for as long as the heartbeats would is also treated as a dead connection. 0 restores the system default
+    unsigned int userTimeout = enable ? (idleSeconds + intervalSeconds * missedHeartbeats) * 1000 : 0;
+    setsockopt(this->connectionSocket, IPPROTO_TCP, TCP_USER_TIMEOUT, &userTimeout, sizeof(userTimeout));
+#endif
+    
+    if (!enable) return;
+    
+    int idle = idleSeconds;
+    int interval = intervalSeconds;
+    int count = missedHeartbeats;
+    
+#if defined(TCP_KEEPIDLE)
+    setsockopt(this->connectionSocket, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(int));
+#elif defined(TCP_KEEPALIVE)
+    setsockopt(this->connectionSocket, IPPROTO_TCP, TCP_KEEPALIVE, &idle, sizeof(int)); //macOS name for TCP_KEEPIDLE
+#endif
+#if defined(TCP_KEEPINTVL)
+    setsockopt(this->connectionSocket, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(int));
+#endif
+#if defined(TCP_KEEPCNT)
+    setsockopt(this->connectionSocket, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(int));
+#endif
+}
+
+std::chrono::steady_clock::time_point ClientSocket::lastSeen() const {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    std::chrono::steady_clock::time_point seen = this->lastSeenTime;
+    
+    if (this->sharedMemoryRing) return seen;
+    
+#if defined(__linux__)
+    //The kernel knows when the host last acknowledged anything, which includes heartbeats answered without waking either program
+    tcp_info info;
+    socklen_t infoSize = sizeof(info);
+    if (getsockopt(this->connectionSocket, IPPROTO_TCP, TCP_INFO, &info, &infoSize) == 0) {
+        std::chrono::steady_clock::time_point acknowledged = std::chrono::steady_clock::now() - std::chrono::milliseconds(info.tcpi_last_ack_recv);
+        if (acknowledged > seen) seen = acknowledged;
+    }
+#endif
+    
+    return seen;
+}
+
+bool ClientSocket::isAlive() const {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    //A shared memory connection is dead once the host closed it or its process exited, and everything it sent has been read
+    if (this->sharedMemoryRing)
+        return !this->sharedMemoryRing->peerClosed() || this->sharedMemoryRing->available() > 0;
+    
+    //A pending error means the connection was reset or that heartbeats or data went unanswered
+    int error = 0;
+    socklen_t errorSize = sizeof(error);
+    if (getsockopt(this->connectionSocket, SOL_SOCKET, SO_ERROR, &error, &errorSize) < 0 || error != 0)
+        return false;
+    
+    pollfd pollInfo;
+    pollInfo.fd = this->connectionSocket;
+    pollInfo.events = POLLIN;
+#if defined(POLLRDHUP)
+    pollInfo.events |= POLLRDHUP;
+#endif
+    pollInfo.revents = 0;
+    
+    //Check the state of the socket without waiting
+    if (poll(&pollInfo, 1, 0) < 0)
+        throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
+    
+    if (pollInfo.revents & (POLLERR | POLLHUP | POLLNVAL))
+        return false;
+    
+    //If the host closed its side, the connection is only dead once everything it sent has been read
+    if (pollInfo.revents & POLLIN) {
+        char byte;
+        if (recv(this->connectionSocket, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+            return false;
+    }
+    
+    return true;
+}
+
+int ClientSocket::connectionFD() const {
+    return this->setUp && !this->sharedMemoryRing ? this->connectionSocket : -1;
+}
+
+void ClientSocket::setTracing(bool enable) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    if (!enable) {
+#if defined(SO_TIMESTAMPING)
+        if (this->timestamps) {
+            int flags = 0;
+            setsockopt(this->connectionSocket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+        }
+#endif
+        this->trace.reset();
+        this->timestamps = false;
+        this->awaitingReply = false;
+        return;
+    }
+    
+    if (this->trace) return;
+    this->trace.reset(new LatencyTrace());
+    
+    //A shared memory connection has no kernel in the way to timestamp
+    if (this->sharedMemoryRing) return;
+    
+#if defined(SO_TIMESTAMPING)
+    /* SO_TIMESTAMPING
+     The kernel timestamps data as it arrives, in software, so no hardware support is needed.
+     */
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    this->timestamps = setsockopt(this->connectionSocket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+#endif
+}
+
+const LatencyTrace& ClientSocket::latencyTrace() const {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    if (!this->trace)
+        throw std::logic_error("Tracing not on");
+    
+    return *this->trace;
+}
+
+void ClientSocket::setFastOpen(bool enable) {
+    this->fastOpen = enable;
+}
+
+bool ClientSocket::usedFastOpen() const {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    return this->fastOpenUsed;
+}
+
 bool ClientSocket::getSet() const {
     return this->setUp;
 }
 
+int ClientSocket::connectToAny(const addrinfo* addressList, unsigned int timeoutMilliseconds) {
+    //Alternate between address families, starting with the one getaddrinfo() preferred, so a broken IPv6 route costs one attempt delay rather than every IPv6 address
+    std::vector<const addrinfo*> addresses;
+    std::vector<const addrinfo*> otherFamily;
+    for (const addrinfo* address = addressList; address != nullptr; address = address->ai_next) {
+        if (address->ai_family == addressList->ai_family) {
+            addresses.push_back(address);
+        } else {
+            otherFamily.push_back(address);
+        }
+    }
+    for (size_t a = 0; a < otherFamily.size(); a++) {
+        addresses.insert(addresses.begin() + std::min(a * 2 + 1, addresses.size()), otherFamily[a]);
+    }
+    
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point deadline = now + std::chrono::milliseconds(timeoutMilliseconds);
+    std::chrono::steady_clock::time_point nextStart = now;
+    
+    std::vector<pollfd> attempts; //The connections still in progress
+    size_t nextAddress = 0;
+    int lastError = ETIMEDOUT; //Reported if every attempt fails
+    int connectedSocket = -1;
+    this->fastOpenUsed = false;
+    
+    while (connectedSocket < 0) {
+        now = std::chrono::steady_clock::now();
+        
+        //Start the next address once the last one has had CONNECT_ATTEMPT_DELAY milliseconds, or straight away if nothing else is in progress
+        if (nextAddress < addresses.size() && (now >= nextStart || attempts.empty())) {
+            bool first = nextAddress == 0;
+            const addrinfo* address = addresses[nextAddress++];
+            nextStart = now + std::chrono::milliseconds(CONNECT_ATTEMPT_DELAY);
+            
+            /* socket()
+             The socket() function returns a new socket, with three parameters.
+             
+             The first argument is address of the domain of the socket.
+             The two possible address domains are the unix, for commen file system sockets, and the internet, for anywhere on the internet.
+             AF_UNIX is generally used for the former, and AF_INET generally for the latter.
+             
+             The second argument is the type of the socket.
+             The two possible types are a stream socket where characters are read in a continuous stream, and a diagram socket, which reads in chunks.
+             SOCK_STREAM is generally used for the former, and SOCK_DGRAM for the latter.
+             
+             The third argument is the protocol. It should always be 0 except in unusual circumstances, and then allows the operating system to chose TCP or UDP, based on the socket type. TCP is chosen for stream sockets, and UDP for diagram sockets
+             
+             The function returns an integer than can be used like a reference to the socket. Failure results in returning -1.
+             */
+            //In this case, the values are taken from getaddrinfo()
+            int socketFD = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (socketFD < 0) {
+                lastError = errno;
+                continue;
+            }
+            
+            //The socket doesn't block while connecting, so several addresses can be tried at once
+            fcntl(socketFD, F_SETFL, fcntl(socketFD, F_GETFL) | O_NONBLOCK);
+            
+            bool fastOpenRequested = false;
+#if defined(TCP_FASTOPEN_CONNECT)
+            //With a cookie from an earlier connection, connect() succeeds at once without sending anything, and the SYN goes out with the first write. Without one, the handshake happens as usual and a cookie is asked for. A cookie means the address was reached before, so it is fair for it to win the race, but only the preferred address gets the chance; the rest shake hands so the race still picks among them
+            if (this->fastOpen && first) {
+                int enable = 1;
+                fastOpenRequested = setsockopt(socketFD, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &enable, sizeof(int)) == 0;
+            }
+#endif
+            
+            //No need to call bind() (see server side) because the local port number doesn't matter; the kernel will find an open port.
+            
+            /* connect()
+             The connect() function is called by the client to establish a connection with the server, with three arguments.
+             
+             The first argument is the small integer reference for the socket.
+             
+             The second argument is the address of the host to connect to, including the port number, all in the form of a sockaddr struct.
+             
+             The third argument is the size of the address.
+             
+             The function returns 0 if successful and -1 if it fails. Since the socket doesn't block, it fails with EINPROGRESS while the connection is being made.
+             */
+            if (connect(socketFD, address->ai_addr, address->ai_addrlen) == 0) {
+                connectedSocket = socketFD;
+                this->fastOpenUsed = fastOpenRequested; //A non-blocking connect() only finishes at once by deferring the handshake
+            } else if (errno == EINPROGRESS) {
+                pollfd attempt;
+                attempt.fd = socketFD;
+                attempt.events = POLLOUT;
+                attempt.revents = 0;
+                attempts.push_back(attempt);
+            } else {
+                lastError = errno;
+                ::close(socketFD);
+            }
+            continue;
+        }
+        
+        //Every address failed
+        if (attempts.empty()) break;
+        
+        if (timeoutMilliseconds > 0 && now >= deadline) {
+            lastError = ETIMEDOUT;
+            break;
+        }
+        
+        //Wait for an attempt to finish, or until the next address should start
+        std::chrono::steady_clock::time_point wakeTime = nextAddress < addresses.size() ? nextStart : deadline;
+        if (timeoutMilliseconds > 0) wakeTime = std::min(wakeTime, deadline);
+        int waitMilliseconds = (nextAddress < addresses.size() || timeoutMilliseconds > 0) ? (int)std::max((long long)std::chrono::duration_cast<std::chrono::milliseconds>(wakeTime - now).count() + 1, 1LL) : -1;
+        
+        if (poll(attempts.data(), attempts.size(), waitMilliseconds) < 0) {
+            if (errno == EINTR) continue;
+            lastError = errno;
+            break;
+        }
+        
+        //Go backwards so failed attempts can be removed while iterating
+        for (int a = (int)attempts.size() - 1; a >= 0 && connectedSocket < 0; a--) {
+            if (attempts[a].revents == 0) continue;
+            
+            int error = 0;
+            socklen_t errorSize = sizeof(error);
+            if (getsockopt(attempts[a].fd, SOL_SOCKET, SO_ERROR, &error, &errorSize) < 0) error = errno;
+            
+            if (error == 0) {
+                connectedSocket = attempts[a].fd;
+                attempts.erase(attempts.begin() + a);
+            } else {
+                lastError = error;
+                ::close(attempts[a].fd);
+                attempts.erase(attempts.begin() + a);
+                nextStart = now; //A failed address doesn't hold up the next one
+            }
+        }
+    }
+    
+    //Abandon the attempts that lost the race
+    for (size_t a = 0; a < attempts.size(); a++) {
+        ::close(attempts[a].fd);
+    }
+    
+    if (connectedSocket < 0)
+        throw std::runtime_error(std::string("ERROR connecting: ") + std::string(strerror(lastError)));
+    
+    //The rest of the class expects a blocking socket
+    fcntl(connectedSocket, F_SETFL, fcntl(connectedSocket, F_GETFL) & ~O_NONBLOCK);
+    return connectedSocket;
+}
+
+unsigned long ClientSocket::sendBytes(const char* data, unsigned long length, bool ensureFullStringSent) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    //Empty messages won't be sent
+    if (length == 0)
+        throw std::logic_error("No message to send");
+    
+    //A round trip is timed from the first send after a reply, so a request sent in pieces is one round trip
+    if (this->trace && !this->awaitingReply) this->requestTime = std::chrono::steady_clock::now();
+    
+    unsigned long sent = 0;
+    
+    //Write from where the last write stopped, instead of copying what is left and starting again
+    while (sent < length) {
+        long sentSize;
+        if (this->sharedMemoryRing) {
+            sentSize = this->sharedMemoryRing->write(data + sent, length - sent, ensureFullStringSent);
+        } else {
+            sentSize = write(this->connectionSocket, data + sent, length - sent);
+            if (sentSize >= 0) {
+                SOCKS_PROBE4(write, -1, this->connectionSocket, length - sent, sentSize);
+                if ((unsigned long)sentSize < length - sent) SOCKS_PROBE4(partial_write, -1, this->connectionSocket, length - sent, sentSize);
+            }
+        }
+        
+        if (sentSize < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("ERROR sending message: ") + std::string(strerror(errno)));
+        }
+        
+        sent += sentSize;
+        
+        //Unless the full message must be sent, stop after one write and let the caller deal with the rest
+        if (!ensureFullStringSent || sentSize == 0) break;
+    }
+    
+    if (this->trace && sent > 0) this->awaitingReply = true;
+    return sent;
+}
+
 ClientSocket::~ClientSocket() {
     if (this->setUp) {
         //Properly terminate the sockets
@@ -211,3 +673,92 @@ ClientSocket::~ClientSocket() {
         }
     }
 }
+
+bool ClientSocket::receiveBytes(char* data, unsigned long length, bool* socketClosed) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    //Keep reading until the whole length has arrived, since it may come in pieces
+    unsigned long received = 0;
+    while (received < length) {
+        long messageSize;
+        if (this->sharedMemoryRing) {
+            messageSize = this->sharedMemoryRing->read(data + received, length - received, this->timeoutMilliseconds);
+            if (messageSize > 0) this->recordReply();
+        } else {
+            messageSize = this->readSocket(data + received, length - received);
+        }
+        
+        if (messageSize < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("ERROR reading from socket: ") + std::string(strerror(errno)));
+        }
+        
+        //The host disconnected before the whole length arrived
+        if (messageSize == 0) {
+            if (socketClosed != nullptr) *socketClosed = true;
+            return false;
+        }
+        
+        received += messageSize;
+    }
+    
+    this->lastSeenTime = std::chrono::steady_clock::now();
+    return true;
+}
+
+long ClientSocket::readSocket(char* data, unsigned long length) {
+    long messageSize;
+    
+#if defined(SO_TIMESTAMPING)
+    if (this->timestamps) {
+        iovec piece;
+        piece.iov_base = data;
+        piece.iov_len = length;
+        
+        char control[256];
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &piece;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        
+        messageSize = recvmsg(this->connectionSocket, &message, 0);
+        
+        //The kernel's receive time comes with the data. Subtracting it from now is the time the data sat in the kernel before this read
+        if (messageSize > 0) {
+            for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+                if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_TIMESTAMPING) continue;
+                
+                scm_timestamping* stamps = (scm_timestamping*)CMSG_DATA(header);
+                uint64_t received = (uint64_t)stamps->ts[0].tv_sec * 1000000000 + stamps->ts[0].tv_nsec;
+                uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                if (received != 0 && now > received) this->trace->receiveQueue.record(now - received);
+            }
+        }
+    } else {
+        messageSize = read(this->connectionSocket, data, length);
+    }
+#else
+    messageSize = read(this->connectionSocket, data, length);
+#endif
+    
+    //A read that fails with EAGAIN timed out, since the socket only stops blocking through setTimeout()
+    if (messageSize >= 0) {
+        SOCKS_PROBE3(read, -1, this->connectionSocket, messageSize);
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        SOCKS_PROBE2(timeout, -1, this->connectionSocket);
+    }
+    
+    if (messageSize > 0) this->recordReply();
+    return messageSize;
+}
+
+void ClientSocket::recordReply() {
+    //Only the first data after a send is the reply to it
+    if (this->trace && this->awaitingReply) {
+        this->trace->roundTrip.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->requestTime).count());
+        this->awaitingReply = false;
+    }
+}
@@ -3,7 +3,18 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <exception>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstddef>
+#include <climits>
+#if __cplusplus >= 202002L
+#include <span>
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,16 +22,38 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <cerrno>
+
+#if defined(__linux__)
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#endif
+
+#include "SharedMemoryRing.hpp"
+#include "MessageCodec.hpp"
+#include "LatencyHistogram.hpp"
+#include "HostResolver.hpp"
+#include "ReceiveBuffer.hpp"
+#include "RecordBuffer.hpp"
+#include "Probes.hpp"
 
 #define BUFFER_SIZE 65535
+#define STREAM_CHUNK_SIZE 262144 //The bytes sendStream() asks its source for at a time
+#define CONNECT_ATTEMPT_DELAY 250 //Milliseconds each address gets to connect before the next one is tried alongside it
+#define CONNECT_TIMEOUT 10000 //Milliseconds before connecting to every address is given up on
 
 class ClientSocket {
 public:
     //Constructor
     ClientSocket();
-    ClientSocket(const char* hostName, int portNum);
+    ClientSocket(const char* hostName, int portNum, unsigned int connectTimeoutMilliseconds = CONNECT_TIMEOUT);
     
     //Destructor
     ~ClientSocket();
@@ -28,12 +61,20 @@ public:
     //Public member functions
     
     /*!
-     * A function to initialize the socket. This must be done before the socket can be used. Will throw an error if the socket cannot be opened or if the port is occupied, or if the socket is already set.
+     * A function to initialize the socket. This must be done before the socket can be used. The host name is resolved through HostResolver::shared(), so a host looked up recently is not looked up again. Every address it resolves to is tried, alternating between IPv6 and IPv4. Each address gets CONNECT_ATTEMPT_DELAY milliseconds before the next one starts alongside it, and the first to connect is kept. Will throw an error if no address connects before the timeout, or if the socket is already set.
      *
      * @param hostName A const char* indicating the name of the host to whom to connect. "localhost" specifies that the host is on the same machine. Otherwise, use the name of the client.
      * @param portNum The number of the port on the host at which clients should connect.
+     * @param connectTimeoutMilliseconds An optional parameter indicating how long to try connecting for. 0 waits until every address has failed. Autoinitialized as CONNECT_TIMEOUT.
+     */
+    void setSocket(const char* hostName, int portNum, unsigned int connectTimeoutMilliseconds = CONNECT_TIMEOUT);
+    
+    /*!
+     * A function to initialize the socket as a connection through shared memory to a host in another process on the same machine, instead of through TCP. The host must be waiting in ServerSocket::addSharedMemoryClient() with the same name. Once set, the socket is used exactly as if setSocket() had been called. Will throw an error if the host is not waiting, or if the socket is already set.
+     *
+     * @param name The name of the shared memory segment, which the host also uses.
      */
-    void setSocket(const char* hostName, int portNum);
+    void setSharedMemory(const char* name);
     
     /*!
      * A function that sends a message to the host. An error will be thrown if the socket is not set, if an error occurs in sending the message, or if the message is an empty string.
@@ -45,6 +86,53 @@ public:
      */
     std::string send(const char* message, bool ensureFullStringSent = false);
     
+    /*!
+     * A function that sends a message to the host. The message can hold any bytes, including '\0', and nothing is allocated or copied. Errors are thrown in the same cases as send(const char*, bool).
+     *
+     * @param message The bytes to be sent.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
+     *
+     * @return The number of bytes sent. If less than the length of the message, the caller can send the rest later.
+     */
+    unsigned long send(std::string_view message, bool ensureFullStringSent = false);
+    
+#if __cplusplus >= 202002L
+    /*!
+     * A function that sends binary data to the host. It works exactly like send(std::string_view, bool).
+     *
+     * @param message The bytes to be sent.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
+     *
+     * @return The number of bytes sent.
+     */
+    unsigned long send(std::span<const std::byte> message, bool ensureFullStringSent = false);
+#endif
+    
+    /*!
+     * A function that sends a message the caller no longer needs to the host. The message can hold any bytes, including '\0'. Errors are thrown in the same cases as send(const char*, bool).
+     *
+     * @param message The message to be sent. It is moved in.
+     * @param ensureFullStringSent An optional parameter that will make sure the full string is sent if it is too long to send with one call of write(). It is automatically set to false.
+     *
+     * @return Any part of the message that wasn't sent, in the same string that was moved in, so nothing new is allocated.
+     */
+    std::string send(std::string&& message, bool ensureFullStringSent = false);
+    
+    /*!
+     * A function that sends a typed message to the host, in the wire layout declared by MessageSchema<T>. The message is encoded on the stack, so nothing is allocated. Errors are thrown in the same cases as send(const char*, bool).
+     *
+     * @param message The message to be sent.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to true, since the other side reads messages whole.
+     *
+     * @return The number of bytes sent.
+     */
+    template <typename T>
+    unsigned long sendMessage(const T& message, bool ensureFullStringSent = true) {
+        char encoded[MessageLayout<T>::size];
+        encodeMessage(message, encoded);
+        return this->sendBytes(encoded, MessageLayout<T>::size, ensureFullStringSent);
+    }
+    
     /*!
      * A function that receives a message from the host. The function will wait for a short period for the client to send the message, and if the message is not received it will throw an error. An error is also thrown if the socket is not set.
      *
@@ -54,6 +142,70 @@ public:
      */
     std::string receive(bool* socketClosed = nullptr);
     
+    /*!
+     * A function that receives exactly a given number of bytes from the host into the caller's buffer, waiting until all of them have arrived. Nothing is allocated. Since receive() reads whatever has arrived, the two should not be mixed on one connection. Errors are thrown in the same cases as receive().
+     *
+     * @param buffer The buffer to fill.
+     * @param length The number of bytes to receive.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the host disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return True if all the bytes were received, false if the host disconnected first.
+     */
+    bool receive(char* buffer, unsigned long length, bool* socketClosed = nullptr);
+    
+    /*!
+     * A function that receives exactly one typed message from the host into a buffer, waiting until all of it has arrived. Fields are then read from buffer.view() without any parsing. Since receive() reads whatever has arrived, the two should not be mixed on one connection. Errors are thrown in the same cases as receive().
+     *
+     * @param buffer The buffer to fill. It can be reused for every message.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the host disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return True if a whole message was received, false if the host disconnected first.
+     */
+    template <typename T>
+    bool receiveMessage(MessageBuffer<T>& buffer, bool* socketClosed = nullptr) {
+        return this->receiveBytes(buffer.data(), MessageLayout<T>::size, socketClosed);
+    }
+    
+    /*!
+     * A function that receives one record from the host, for protocols that end each message with a delimiter, like newline-delimited text. Whatever arrives after the record is kept for the next call, so a read that brings many records is only made once. Since the bytes kept are not seen by receive(), the two should not be mixed on one connection. Errors are thrown in the same cases as receive(), and if a record is longer than RECORD_MAX_LENGTH.
+     *
+     * @param record Set to the record, without its delimiter. It points into the socket's buffer, and stays valid until the next call or until the socket is closed. If the host disconnects without ending the last record, what it sent is returned as a record.
+     * @param delimiter An optional parameter indicating the byte that ends each record. Autoinitialized as '\n'.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the host disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return True if a record was received, false if the host disconnected first.
+     */
+    bool receiveRecord(std::string_view& record, char delimiter = '\n', bool* socketClosed = nullptr);
+    
+    /*!
+     * A function that receives a given number of bytes from the host without holding them all at once. Each piece is passed to the sink as it arrives, and its memory is reused after the sink returns, so the memory used stays within RECEIVE_BUFFER_MAX however long the stream is. No byte past the length is read. Errors are thrown in the same cases as receive(), and if no data arrives within the timeout.
+     *
+     * @param sink A function called with each piece of data and its length.
+     * @param length The number of bytes to receive. ULONG_MAX receives until the host disconnects.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the host disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return The number of bytes received. Less than the length if the host disconnected first.
+     */
+    unsigned long receiveStream(const std::function<void(const char*, unsigned long)>& sink, unsigned long length, bool* socketClosed = nullptr);
+    
+    /*!
+     * A function that sends data to the host as a source produces it, without holding it all at once. The source is asked for up to STREAM_CHUNK_SIZE bytes at a time, and each piece is sent in full before the next is asked for. Errors are thrown in the same cases as send(const char*, bool).
+     *
+     * @param source A function that fills the buffer it is given with up to the given number of bytes, and returns how many it filled. Returning 0 ends the stream.
+     *
+     * @return The number of bytes sent.
+     */
+    unsigned long sendStream(const std::function<unsigned long(char*, unsigned long)>& source);
+    
+    /*!
+     * A function that waits until something can be received from the host, without receiving it. A closed connection counts, since receiving then returns at once. An error is thrown if the socket is not set.
+     *
+     * @param timeoutMilliseconds The maximum time to wait, or a negative number to wait forever.
+     *
+     * @return True if there is something to receive, false if the time ran out.
+     */
+    bool waitForData(int timeoutMilliseconds);
+    
     /*!
      * A function to close the socket, so it can be rebound. Until it is set, other functions cannot be called.
      */
@@ -67,6 +219,62 @@ public:
      */
     void setTimeout(unsigned int seconds, unsigned int milliseconds = 0);
     
+    /*!
+     * A function to enable heartbeats on the connection. Heartbeats are TCP keepalive probes: one is only sent after the connection has been idle for the given time, and it is answered by the host's kernel, so neither program is woken up and a busy connection pays nothing. If the host misses the given number of heartbeats in a row, the connection is considered dead (see isAlive()). To disable heartbeats, set idleSeconds to 0.
+     *
+     * @param idleSeconds The number of seconds the connection must be idle before the first heartbeat is sent. If 0, heartbeats are disabled.
+     * @param intervalSeconds An optional parameter indicating the number of seconds between unanswered heartbeats. Autoinitialized as 1.
+     * @param missedHeartbeats An optional parameter indicating how many heartbeats may go unanswered before the connection is considered dead. Autoinitialized as 3.
+     */
+    void setHeartbeat(unsigned int idleSeconds, unsigned int intervalSeconds = 1, unsigned int missedHeartbeats = 3);
+    
+    /*!
+     * A function that returns the last time the host was known to be alive. This is the later of the last time a message was received and the last time the host's kernel acknowledged anything, including a heartbeat. An error is thrown if the socket is not set.
+     *
+     * @return The last time the host was seen.
+     */
+    std::chrono::steady_clock::time_point lastSeen() const;
+    
+    /*!
+     * A function that checks, without blocking, whether the connection is still alive. The connection is dead if the host closed it, if it was reset, or if heartbeats or sent data went unanswered (see setHeartbeat()). An error is thrown if the socket is not set.
+     *
+     * @return True if the connection is alive, false otherwise.
+     */
+    bool isAlive() const;
+    
+    /*!
+     * @return The file descriptor of the TCP connection, so it can be waited on with poll() or handed to a Relay. -1 if the socket is not set or is connected through shared memory.
+     */
+    int connectionFD() const;
+    
+    /*!
+     * A function to turn latency tracing on or off. While on, the trace records the round trip from each send to the first reply received after it, and how long received data waited in the kernel before being read, using the kernel's software timestamps (SO_TIMESTAMPING, Linux only). Turning it off discards the trace. An error is thrown if the socket is not set.
+     *
+     * @param enable True to turn tracing on.
+     */
+    void setTracing(bool enable);
+    
+    /*!
+     * A function that gets the latency trace of the connection. An error is thrown if the socket is not set or if tracing is off.
+     *
+     * @return The trace. It stays valid until the socket is closed or tracing is turned off.
+     */
+    const LatencyTrace& latencyTrace() const;
+    
+    /*!
+     * A function to turn TCP Fast Open on or off for the next setSocket(). Once the client has connected to a host once and been given a cookie, later connections to it put the first send() in the SYN, so the host receives it a round trip sooner. The host must turn it on too (see ServerSocket::setFastOpen()). With a cookie, setSocket() returns without waiting for the handshake, so an unreachable host is only noticed by the first send(). For a host with several addresses, only the one tried first uses Fast Open, since a cookie shows it was reached before; the others are raced against it with a handshake as usual. Only works on Linux; elsewhere, connections are made normally.
+     *
+     * @param enable True to turn Fast Open on.
+     */
+    void setFastOpen(bool enable);
+    
+    /*!
+     * A function that tells whether the connection was made with TCP Fast Open, so that setSocket() returned without a handshake and the first send() goes out in the SYN. It is false if Fast Open is off, if the client had no cookie for the host yet, or if the host was reached at an address other than the first. An error is thrown if the socket is not set.
+     *
+     * @return True if the connection was made with Fast Open.
+     */
+    bool usedFastOpen() const;
+    
     /*!
      * @return If this object is set.
      */
@@ -78,7 +286,71 @@ private:
     int connectionSocket; //This is the "file descriptor", which stores values from both the socket system call and the accept system call
     int portNumber; //The port nubmer where connections are accepted
     
-    char buffer[BUFFER_SIZE];
+    ReceiveBuffer receiveBuffer; //What receive() reads into, sized to the traffic
+    RecordBuffer recordBuffer; //Records received but not yet taken by receiveRecord()
+    
+    std::chrono::steady_clock::time_point lastSeenTime; //The last time a message was received from the host
+    
+    std::unique_ptr<SharedMemoryRing> sharedMemoryRing; //The shared memory connection to the host. Null when connected through TCP
+    
+    int timeoutMilliseconds = -1; //The timeout set with setTimeout(), for a shared memory connection. -1 if there is none
+    
+    bool fastOpen = false; //True if setFastOpen() turned TCP Fast Open on
+    bool fastOpenUsed = false; //True if the connection was made with a Fast Open cookie, without a handshake
+    
+    std::unique_ptr<LatencyTrace> trace; //The latency trace while tracing is on. Null otherwise
+    bool timestamps = false; //True if the kernel accepted SO_TIMESTAMPING for this connection
+    bool awaitingReply = false; //True if something was sent since the last reply
+    std::chrono::steady_clock::time_point requestTime; //When the first send since the last reply started
+    
+    //Private member functions
+    
+    /*!
+     * A function that connects to the first of a list of addresses to answer, racing them with staggered starts.
+     *
+     * @param addressList The addresses from getaddrinfo().
+     * @param timeoutMilliseconds How long to try for, or 0 to wait until every address has failed.
+     *
+     * @return The connected socket, which blocks like any other.
+     */
+    int connectToAny(const addrinfo* addressList, unsigned int timeoutMilliseconds);
+    
+    /*!
+     * A function that writes a message to the host, continuing from where each write stopped. It does all the checks for the public send functions.
+     *
+     * @param data The bytes to be sent.
+     * @param length The number of bytes to be sent.
+     * @param ensureFullStringSent If true, keep writing until the whole message is sent. Otherwise, write once.
+     *
+     * @return The number of bytes sent.
+     */
+    unsigned long sendBytes(const char* data, unsigned long length, bool ensureFullStringSent);
+    
+    /*!
+     * A function that reads an exact number of bytes from the host, waiting for as many reads as it takes. It does all the checks for the public receive functions.
+     *
+     * @param data Where to put the bytes.
+     * @param length The number of bytes to read.
+     * @param socketClosed If not a null pointer, set to true if the host disconnected.
+     *
+     * @return True if all the bytes were read, false if the host disconnected first.
+     */
+    bool receiveBytes(char* data, unsigned long length, bool* socketClosed);
+    
+    /*!
+     * A function that reads from the socket. While tracing, the kernel's receive timestamp is read along with the data.
+     *
+     * @param data Where to put the bytes.
+     * @param length The most bytes to read.
+     *
+     * @return The number of bytes read, 0 if the host disconnected, or -1 if an error occurred, with errno set.
+     */
+    long readSocket(char* data, unsigned long length);
+    
+    /*!
+     * A function that records the round trip of the last request, if tracing is on and the request has not been answered yet. Called when data arrives.
+     */
+    void recordReply();
     
     bool setUp = false; //Represents if the socket has already been set. If not, reading and writing will cause errors
 };
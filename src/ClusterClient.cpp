@@ -0,0 +1,176 @@
+#include "ClusterClient.hpp"
+
+ClusterClient::ClusterClient(unsigned int virtualNodes, double loadFactor) {
+    if (virtualNodes == 0)
+        throw std::logic_error("A node needs at least one point on the ring");
+    if (loadFactor < 1)
+        throw std::logic_error("Load factor below 1");
+    
+    this->virtualNodes = virtualNodes;
+    this->loadFactor = loadFactor;
+}
+
+//Public member functions
+
+unsigned int ClusterClient::addNode(const char* hostName, int portNum, unsigned int connectTimeoutMilliseconds) {
+    unsigned int nodeIndex = (unsigned int)this->nodes.size();
+    this->nodes.emplace_back();
+    this->nodes.back().hostName = hostName;
+    this->nodes.back().portNum = portNum;
+    
+    //Place the node's points by its address, so the ring doesn't depend on the order nodes were added in
+    std::string label = std::string(hostName) + ":" + std::to_string(portNum) + "#";
+    for (unsigned int a = 0; a < this->virtualNodes; a++)
+        this->ring.emplace_back(hashOf(label + std::to_string(a)), nodeIndex);
+    std::sort(this->ring.begin(), this->ring.end());
+    
+    this->reconnect(nodeIndex, connectTimeoutMilliseconds);
+    return nodeIndex;
+}
+
+unsigned int ClusterClient::route(std::string_view key) {
+    if (this->healthyNodes == 0)
+        throw std::runtime_error("ERROR routing request: No node in rotation");
+    
+    unsigned int bound = this->loadBound();
+    
+    //Walk clockwise from the key. Since the bound is above the average load, some node in rotation always has room
+    auto start = std::lower_bound(this->ring.begin(), this->ring.end(), std::make_pair(hashOf(key), 0u));
+    size_t position = start - this->ring.begin();
+    for (size_t a = 0; a < this->ring.size(); a++) {
+        unsigned int nodeIndex = this->ring[(position + a) % this->ring.size()].second;
+        if (this->nodes[nodeIndex].healthy && this->nodes[nodeIndex].inFlight < bound) return this->assign(nodeIndex);
+    }
+    
+    throw std::runtime_error("ERROR routing request: No node in rotation");
+}
+
+unsigned int ClusterClient::route() {
+    if (this->healthyNodes == 0)
+        throw std::runtime_error("ERROR routing request: No node in rotation");
+    
+    unsigned int bound = this->loadBound();
+    
+    for (unsigned int a = 0; a < this->nodes.size(); a++) {
+        unsigned int nodeIndex = (this->nextUnkeyed + a) % this->nodes.size();
+        if (this->nodes[nodeIndex].healthy && this->nodes[nodeIndex].inFlight < bound) {
+            this->nextUnkeyed = nodeIndex + 1;
+            return this->assign(nodeIndex);
+        }
+    }
+    
+    throw std::runtime_error("ERROR routing request: No node in rotation");
+}
+
+void ClusterClient::finished(unsigned int nodeIndex) {
+    this->checkIndex(nodeIndex);
+    
+    //A node taken out of rotation has already dropped its load
+    if (this->nodes[nodeIndex].inFlight > 0) {
+        this->nodes[nodeIndex].inFlight--;
+        this->totalInFlight--;
+    }
+}
+
+ClientSocket& ClusterClient::connection(unsigned int nodeIndex) {
+    this->checkIndex(nodeIndex);
+    return *this->nodes[nodeIndex].socket;
+}
+
+void ClusterClient::markDown(unsigned int nodeIndex) {
+    this->checkIndex(nodeIndex);
+    
+    Node& node = this->nodes[nodeIndex];
+    if (!node.healthy) return;
+    
+    //The node is being dropped anyway, so a failure to close it cleanly changes nothing
+    try {
+        node.socket->close();
+    } catch (const std::exception&) {}
+    node.healthy = false;
+    this->healthyNodes--;
+    this->totalInFlight -= node.inFlight;
+    node.inFlight = 0;
+}
+
+unsigned int ClusterClient::checkHealth() {
+    unsigned int removed = 0;
+    for (unsigned int a = 0; a < this->nodes.size(); a++) {
+        if (this->nodes[a].healthy && !this->nodes[a].socket->isAlive()) {
+            this->markDown(a);
+            removed++;
+        }
+    }
+    return removed;
+}
+
+bool ClusterClient::reconnect(unsigned int nodeIndex, unsigned int connectTimeoutMilliseconds) {
+    this->checkIndex(nodeIndex);
+    
+    Node& node = this->nodes[nodeIndex];
+    if (node.healthy) return true;
+    
+    node.socket.reset(new ClientSocket());
+    try {
+        node.socket->setSocket(node.hostName.c_str(), node.portNum, connectTimeoutMilliseconds);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    
+    node.healthy = true;
+    this->healthyNodes++;
+    return true;
+}
+
+bool ClusterClient::isHealthy(unsigned int nodeIndex) const {
+    this->checkIndex(nodeIndex);
+    return this->nodes[nodeIndex].healthy;
+}
+
+unsigned int ClusterClient::load(unsigned int nodeIndex) const {
+    this->checkIndex(nodeIndex);
+    return this->nodes[nodeIndex].inFlight;
+}
+
+unsigned int ClusterClient::numberOfNodes() const {
+    return (unsigned int)this->nodes.size();
+}
+
+unsigned int ClusterClient::numberOfHealthyNodes() const {
+    return this->healthyNodes;
+}
+
+//Private member functions
+
+uint64_t ClusterClient::hashOf(std::string_view bytes) {
+    //FNV-1a, then a final mix so that similar labels land far apart on the ring
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char byte : bytes) {
+        hash ^= byte;
+        hash *= 1099511628211ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+unsigned int ClusterClient::loadBound() const {
+    //Counting the request being routed, so an idle cluster still has room
+    double average = (double)(this->totalInFlight + 1) / this->healthyNodes;
+    unsigned int bound = (unsigned int)(average * this->loadFactor);
+    return bound < average * this->loadFactor ? bound + 1 : bound;
+}
+
+unsigned int ClusterClient::assign(unsigned int nodeIndex) {
+    this->nodes[nodeIndex].inFlight++;
+    this->totalInFlight++;
+    return nodeIndex;
+}
+
+void ClusterClient::checkIndex(unsigned int nodeIndex) const {
+    if (nodeIndex >= this->nodes.size())
+        throw std::logic_error("Node index out of range");
+}
@@ -0,0 +1,175 @@
+#ifndef ClusterClient_hpp
+#define ClusterClient_hpp
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <utility>
+#include <exception>
+#include <cstdint>
+
+#include "ClientSocket.hpp"
+
+#define CLUSTER_VIRTUAL_NODES 160 //Points each node gets on the hash ring. More points spread keys more evenly
+#define CLUSTER_LOAD_FACTOR 1.25 //How far above the average load a node may go before its keys spill over to the next node on the ring
+
+/*
+ A ClusterClient holds a ClientSocket to each of several servers and picks which one a request goes to. Requests with a key go to the node the key hashes to on a consistent hash ring, so the same key keeps going to the same server. Each node has many points on the ring, so keys are spread evenly, and a node is only given a key while its load is within CLUSTER_LOAD_FACTOR of the average, so one hot key can't swamp a server. Requests without a key take turns between the nodes.
+
+ A node taken out of rotation keeps its points on the ring and is skipped, so only its own keys move, and they move back when it returns. Nodes are placed on the ring by host and port, not by the order they were added, so every client with the same nodes sends a key to the same server.
+
+ The load of a node is the number of requests routed to it that have not been marked finished.
+ */
+class ClusterClient {
+public:
+    //Constructor
+    ClusterClient(unsigned int virtualNodes = CLUSTER_VIRTUAL_NODES, double loadFactor = CLUSTER_LOAD_FACTOR);
+    
+    //Public member functions
+    
+    /*!
+     * A function that adds a server to the cluster and connects to it. If it cannot be connected to, it is added out of rotation, and can be brought in later with reconnect().
+     *
+     * @param hostName The name of the server.
+     * @param portNum The port on the server.
+     * @param connectTimeoutMilliseconds An optional parameter indicating how long to try connecting for. Autoinitialized as CONNECT_TIMEOUT.
+     *
+     * @return The index of the node.
+     */
+    unsigned int addNode(const char* hostName, int portNum, unsigned int connectTimeoutMilliseconds = CONNECT_TIMEOUT);
+    
+    /*!
+     * A function that picks the node for a key: the first node clockwise from the key on the ring that is in rotation and within the load bound. The request counts towards the node's load until finished() is called. Will throw an error if no node is in rotation.
+     *
+     * @param key The key of the request.
+     *
+     * @return The index of the node.
+     */
+    unsigned int route(std::string_view key);
+    
+    /*!
+     * A function that picks a node for a request without a key, taking turns between the nodes in rotation that are within the load bound. The request counts towards the node's load until finished() is called. Will throw an error if no node is in rotation.
+     *
+     * @return The index of the node.
+     */
+    unsigned int route();
+    
+    /*!
+     * A function that marks a request to a node as finished, so it no longer counts towards the node's load.
+     *
+     * @param nodeIndex The index of the node.
+     */
+    void finished(unsigned int nodeIndex);
+    
+    /*!
+     * @param nodeIndex The index of the node.
+     *
+     * @return The connection to the node. Only set while the node is in rotation.
+     */
+    ClientSocket& connection(unsigned int nodeIndex);
+    
+    /*!
+     * A function that takes a node out of rotation and closes its connection, for example after a send or receive to it failed. Its keys go to the next nodes on the ring until it is reconnected.
+     *
+     * @param nodeIndex The index of the node.
+     */
+    void markDown(unsigned int nodeIndex);
+    
+    /*!
+     * A function that takes every node whose connection has died out of rotation (see ClientSocket::isAlive()). It does not block, so it can be called before every request.
+     *
+     * @return The number of nodes taken out of rotation.
+     */
+    unsigned int checkHealth();
+    
+    /*!
+     * A function that tries to connect to a node out of rotation again, and puts it back in rotation if it connects. Nothing is done to a node already in rotation.
+     *
+     * @param nodeIndex The index of the node.
+     * @param connectTimeoutMilliseconds An optional parameter indicating how long to try connecting for. Autoinitialized as CONNECT_TIMEOUT.
+     *
+     * @return True if the node is in rotation.
+     */
+    bool reconnect(unsigned int nodeIndex, unsigned int connectTimeoutMilliseconds = CONNECT_TIMEOUT);
+    
+    /*!
+     * @param nodeIndex The index of the node.
+     *
+     * @return If the node is in rotation.
+     */
+    bool isHealthy(unsigned int nodeIndex) const;
+    
+    /*!
+     * @param nodeIndex The index of the node.
+     *
+     * @return The number of unfinished requests routed to the node.
+     */
+    unsigned int load(unsigned int nodeIndex) const;
+    
+    /*!
+     * @return The number of nodes, in rotation or not.
+     */
+    unsigned int numberOfNodes() const;
+    
+    /*!
+     * @return The number of nodes in rotation.
+     */
+    unsigned int numberOfHealthyNodes() const;
+    
+private:
+    //Private properties
+    
+    struct Node {
+        std::string hostName;
+        int portNum = 0;
+        std::unique_ptr<ClientSocket> socket; //Replaced on every reconnect, so a failed connection never leaves it half set
+        bool healthy = false;
+        unsigned int inFlight = 0; //Requests routed here and not yet finished
+    };
+    std::vector<Node> nodes;
+    
+    std::vector<std::pair<uint64_t, unsigned int>> ring; //Each node's points, as hash and node index, sorted by hash
+    
+    unsigned int virtualNodes;
+    double loadFactor;
+    
+    unsigned int healthyNodes = 0;
+    unsigned int totalInFlight = 0; //Across the nodes in rotation
+    unsigned int nextUnkeyed = 0; //The node the next request without a key starts looking from
+    
+    //Private member functions
+    
+    /*!
+     * A function that hashes bytes the same way in every process and on every machine, so all clients agree on the ring.
+     *
+     * @param bytes The bytes to hash.
+     *
+     * @return The hash.
+     */
+    static uint64_t hashOf(std::string_view bytes);
+    
+    /*!
+     * @return The most unfinished requests a node may have and still be given another.
+     */
+    unsigned int loadBound() const;
+    
+    /*!
+     * A function that counts a request towards a node's load.
+     *
+     * @param nodeIndex The index of the node.
+     *
+     * @return The index of the node.
+     */
+    unsigned int assign(unsigned int nodeIndex);
+    
+    /*!
+     * A function that throws an error if there is no node at an index.
+     *
+     * @param nodeIndex The index.
+     */
+    void checkIndex(unsigned int nodeIndex) const;
+};
+
+#endif /* ClusterClient_hpp */
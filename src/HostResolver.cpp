@@ -0,0 +1,176 @@
+#include "HostResolver.hpp"
+
+HostResolver::HostResolver() {}
+
+//Static functions
+
+HostResolver& HostResolver::shared() {
+    static HostResolver resolver;
+    return resolver;
+}
+
+//Public member functions
+
+HostResolver::Addresses HostResolver::resolve(const char* hostName, int portNum, bool passive) {
+    std::function<void()> lookup;
+    std::shared_ptr<std::promise<Addresses>> promise;
+    std::shared_future<Addresses> addresses;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        addresses = this->findOrAdd(hostName, portNum, passive, lookup, promise);
+    }
+    
+    //A new lookup runs on this thread, since it would have to be waited for anyway
+    if (lookup) lookup();
+    
+    return addresses.get();
+}
+
+std::shared_future<HostResolver::Addresses> HostResolver::resolveAsync(const char* hostName, int portNum, bool passive) {
+    Job job;
+    std::lock_guard<std::mutex> guard(this->lock);
+    std::shared_future<Addresses> addresses = this->findOrAdd(hostName, portNum, passive, job.lookup, job.promise);
+    
+    if (job.lookup) {
+        if (this->helpers.empty()) {
+            for (int a = 0; a < RESOLVER_THREADS; a++) {
+                this->helpers.push_back(std::thread(&HostResolver::runHelper, this));
+            }
+        }
+        this->jobs.push_back(std::move(job));
+        this->jobAdded.notify_one();
+    }
+    
+    return addresses;
+}
+
+void HostResolver::forget(const char* hostName, int portNum, bool passive) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    
+    //A lookup in progress is left alone, since it is already asking again
+    std::map<std::string, CacheEntry>::iterator entry = this->cache.find(keyOf(hostName, portNum, passive));
+    if (entry != this->cache.end() && entry->second.expiry != std::chrono::steady_clock::time_point::max()) this->cache.erase(entry);
+}
+
+void HostResolver::setTTL(unsigned int milliseconds, unsigned int negativeMilliseconds) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->ttl = milliseconds;
+    this->negativeTTL = negativeMilliseconds;
+}
+
+void HostResolver::clear() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    
+    //Lookups in progress stay, so whoever is waiting on them still gets the result
+    for (std::map<std::string, CacheEntry>::iterator entry = this->cache.begin(); entry != this->cache.end();) {
+        if (entry->second.expiry != std::chrono::steady_clock::time_point::max()) {
+            entry = this->cache.erase(entry);
+        } else {
+            entry++;
+        }
+    }
+}
+
+//Private member functions
+
+std::string HostResolver::keyOf(const char* hostName, int portNum, bool passive) {
+    return std::string(hostName != nullptr ? hostName : "") + ":" + std::to_string(portNum) + (passive ? ":passive" : "");
+}
+
+std::shared_future<HostResolver::Addresses> HostResolver::findOrAdd(const char* hostName, int portNum, bool passive, std::function<void()>& lookup, std::shared_ptr<std::promise<Addresses>>& promise) {
+    std::string key = keyOf(hostName, portNum, passive);
+    
+    std::map<std::string, CacheEntry>::iterator entry = this->cache.find(key);
+    if (entry != this->cache.end() && std::chrono::steady_clock::now() < entry->second.expiry) return entry->second.addresses;
+    
+    promise.reset(new std::promise<Addresses>());
+    
+    CacheEntry& newEntry = this->cache[key];
+    newEntry.addresses = promise->get_future().share();
+    newEntry.expiry = std::chrono::steady_clock::time_point::max();
+    newEntry.lookupID = this->nextLookupID++;
+    
+    unsigned long lookupID = newEntry.lookupID;
+    bool hasHostName = hostName != nullptr;
+    std::string host = hasHostName ? hostName : "";
+    
+    lookup = [this, key, lookupID, hasHostName, host, portNum, passive, promise]() {
+        addrinfo hints; //A struct containing information on the address. Will be passed to getaddrinfo() to give hints about the connection to be made
+        addrinfo* addressList; //A pointer to an addrinfo struct that will be filled with the addresses by getaddrinfo()
+        
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC; //Can be either IPv4 or IPv6
+        hints.ai_socktype = SOCK_STREAM; //TCP Socket
+        if (passive) hints.ai_flags = AI_PASSIVE; //Addresses to accept connections on (as server socket)
+        
+        /* getaddrinfo
+         The getaddrinfo() fills a given addrinfo struct with the relevant information. The return value is nonzero when there is an error.
+         
+         The first argument is the name of the host to connect with.
+         
+         The second argument is a string representation of the port number.
+         
+         The third argument is a pointer to an addrinfo struct which contains hints about the type of connection to be made.
+         
+         The fourth argument is a pointer which will be filled with a linked list of hosts returned.
+         */
+        int returnVal = getaddrinfo(hasHostName ? host.c_str() : NULL, std::to_string(portNum).c_str(), &hints, &addressList);
+        
+        if (returnVal == 0) {
+            promise->set_value(Addresses(addressList, freeaddrinfo)); //The list is freed when the last user lets go of it
+        } else {
+            promise->set_exception(std::make_exception_ptr(std::runtime_error(std::string("ERROR getting host address: ") + std::string(gai_strerror(returnVal)))));
+        }
+        
+        //Start the entry's time to live now that the lookup is finished, unless it was replaced or removed in the meantime
+        std::lock_guard<std::mutex> guard(this->lock);
+        std::map<std::string, CacheEntry>::iterator entry = this->cache.find(key);
+        if (entry == this->cache.end() || entry->second.lookupID != lookupID) return;
+        
+        unsigned int timeToLive = returnVal == 0 ? this->ttl : this->negativeTTL;
+        if (timeToLive == 0) {
+            this->cache.erase(entry);
+        } else {
+            entry->second.expiry = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeToLive);
+        }
+    };
+    
+    return newEntry.addresses;
+}
+
+void HostResolver::runHelper() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> guard(this->lock);
+            this->jobAdded.wait(guard, [this]() { return this->stopping || !this->jobs.empty(); });
+            if (this->stopping) return;
+            
+            job = std::move(this->jobs.front().lookup);
+            this->jobs.pop_front();
+        }
+        job();
+    }
+}
+
+//Destructor
+
+HostResolver::~HostResolver() {
+    std::deque<Job> unstarted;
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+        unstarted.swap(this->jobs);
+    }
+    this->jobAdded.notify_all();
+    
+    //Anyone waiting on a lookup that never started gets an error, rather than the broken promise they would get when it is destroyed
+    for (size_t a = 0; a < unstarted.size(); a++) {
+        unstarted[a].promise->set_exception(std::make_exception_ptr(std::runtime_error("ERROR getting host address: Resolver stopped")));
+    }
+    
+    //Lookups already running finish before their thread is joined
+    for (size_t a = 0; a < this->helpers.size(); a++) {
+        if (this->helpers[a].joinable()) this->helpers[a].join();
+    }
+}
@@ -0,0 +1,148 @@
+#ifndef HostResolver_hpp
+#define HostResolver_hpp
+
+#include <string>
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <exception>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#define RESOLVER_TTL 60000 //Milliseconds a resolved host is reused for. getaddrinfo() doesn't report the DNS record's own TTL
+#define RESOLVER_NEGATIVE_TTL 5000 //Milliseconds a failed lookup is remembered for, so a missing host doesn't cost a lookup on every retry
+#define RESOLVER_THREADS 2 //Helper threads for resolveAsync()
+
+/*
+ A HostResolver looks up host names with getaddrinfo() and caches the results. There is one for the whole process, shared by every ClientSocket and ServerSocket, so reconnecting to a known host doesn't wait on a lookup. Lookups of the same host at the same time share one call to getaddrinfo().
+
+ Results are addrinfo lists, which stay valid for as long as the shared pointer to them is held, even after they expire from the cache.
+ */
+class HostResolver {
+public:
+    //Public types
+    
+    typedef std::shared_ptr<const addrinfo> Addresses;
+    
+    //Constructor
+    HostResolver();
+    
+    //Destructor
+    ~HostResolver();
+    
+    //Static functions
+    
+    /*!
+     * @return The resolver shared by the whole process.
+     */
+    static HostResolver& shared();
+    
+    //Public member functions
+    
+    /*!
+     * A function that looks up the addresses of a host, waiting for the result. A result in the cache is returned without a lookup. Will throw an error if the host cannot be resolved, including if that was found out by an earlier lookup that is still cached.
+     *
+     * @param hostName The name of the host. A null pointer means the local host, for a server.
+     * @param portNum The port to connect to or listen on.
+     * @param passive An optional parameter that looks up addresses to listen on, rather than to connect to. Automatically set to false.
+     *
+     * @return The addresses, in the order getaddrinfo() prefers them.
+     */
+    Addresses resolve(const char* hostName, int portNum, bool passive = false);
+    
+    /*!
+     * A function that starts looking up the addresses of a host on a helper thread, and returns at once. A later resolve() of the same host waits for this lookup rather than starting another, so it can be used to look up hosts before they are needed. Can be called from any thread.
+     *
+     * @param hostName The name of the host. A null pointer means the local host, for a server.
+     * @param portNum The port to connect to or listen on.
+     * @param passive An optional parameter that looks up addresses to listen on, rather than to connect to. Automatically set to false.
+     *
+     * @return A future holding the addresses. Getting it throws an error if the host cannot be resolved.
+     */
+    std::shared_future<Addresses> resolveAsync(const char* hostName, int portNum, bool passive = false);
+    
+    /*!
+     * A function that removes a host from the cache, so the next lookup asks again. Useful when none of the cached addresses could be connected to.
+     *
+     * @param hostName The name of the host.
+     * @param portNum The port.
+     * @param passive An optional parameter for addresses that were looked up to listen on. Automatically set to false.
+     */
+    void forget(const char* hostName, int portNum, bool passive = false);
+    
+    /*!
+     * A function that sets how long results are cached for. Results already cached keep the time they were given.
+     *
+     * @param milliseconds How long resolved hosts are reused for. 0 turns caching off.
+     * @param negativeMilliseconds How long failed lookups are remembered for. 0 turns negative caching off.
+     */
+    void setTTL(unsigned int milliseconds, unsigned int negativeMilliseconds);
+    
+    /*!
+     * A function that empties the cache.
+     */
+    void clear();
+    
+private:
+    //Private properties
+    
+    struct CacheEntry {
+        std::shared_future<Addresses> addresses; //Not ready while the lookup is in progress
+        std::chrono::steady_clock::time_point expiry = std::chrono::steady_clock::time_point::max(); //Set once the lookup finishes
+        unsigned long lookupID = 0; //Tells a finished lookup whether its entry was replaced in the meantime
+    };
+    std::map<std::string, CacheEntry> cache; //Keyed by host, port and whether the lookup was passive
+    unsigned long nextLookupID = 1;
+    
+    unsigned int ttl = RESOLVER_TTL;
+    unsigned int negativeTTL = RESOLVER_NEGATIVE_TTL;
+    
+    struct Job {
+        std::function<void()> lookup;
+        std::shared_ptr<std::promise<Addresses>> promise; //Failed with an error if the resolver is destroyed before the lookup runs
+    };
+    std::deque<Job> jobs; //Lookups waiting for a helper thread
+    std::vector<std::thread> helpers; //Started by the first resolveAsync()
+    bool stopping = false;
+    
+    std::mutex lock; //Guards everything above
+    std::condition_variable jobAdded;
+    
+    //Private member functions
+    
+    /*!
+     * @return The key a host is cached under.
+     */
+    static std::string keyOf(const char* hostName, int portNum, bool passive);
+    
+    /*!
+     * A function that finds a host in the cache, or adds an entry for it if it isn't there or has expired. Must be called with the lock held.
+     *
+     * @param hostName The name of the host, or a null pointer for the local host.
+     * @param portNum The port.
+     * @param passive If the lookup is for addresses to listen on.
+     * @param lookup Set to a function that does the lookup if a new entry was added, so the caller can run it after releasing the lock. Otherwise left empty.
+     * @param promise Set to the promise the lookup fulfills if a new entry was added. Otherwise left empty.
+     *
+     * @return The future of the entry.
+     */
+    std::shared_future<Addresses> findOrAdd(const char* hostName, int portNum, bool passive, std::function<void()>& lookup, std::shared_ptr<std::promise<Addresses>>& promise);
+    
+    /*!
+     * The loop each helper thread runs, doing lookups until the resolver is destroyed.
+     */
+    void runHelper();
+};
+
+#endif /* HostResolver_hpp */
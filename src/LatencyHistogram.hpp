@@ -0,0 +1,138 @@
+#ifndef LatencyHistogram_hpp
+#define LatencyHistogram_hpp
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#define LATENCY_HISTOGRAM_SUB_BUCKETS 64 //Buckets per power of two, so every value is recorded within about 1.5%
+#define LATENCY_HISTOGRAM_POWERS 40 //Values up to about 18 minutes in nanoseconds
+
+/*
+ A log-linear (HDR-style) histogram of latencies in nanoseconds. Values below LATENCY_HISTOGRAM_SUB_BUCKETS get a bucket each, and above that each power of two is split into LATENCY_HISTOGRAM_SUB_BUCKETS equal buckets. Recording is an index calculation and an increment, so it can sit on the hot path.
+ */
+class LatencyHistogram {
+public:
+    //Constructor
+    LatencyHistogram() : counts(LATENCY_HISTOGRAM_POWERS * LATENCY_HISTOGRAM_SUB_BUCKETS, 0) {}
+    
+    //Public member functions
+    
+    /*!
+     * A function that adds one value to the histogram.
+     *
+     * @param nanoseconds The value.
+     */
+    void record(uint64_t nanoseconds) {
+        this->counts[this->bucketOf(nanoseconds)]++;
+        this->total++;
+        this->sum += nanoseconds;
+        this->maximum = std::max(this->maximum, nanoseconds);
+    }
+    
+    /*!
+     * A function that adds every value in another histogram to this one.
+     *
+     * @param other The histogram to add.
+     */
+    void merge(const LatencyHistogram& other) {
+        for (size_t a = 0; a < this->counts.size(); a++) this->counts[a] += other.counts[a];
+        this->total += other.total;
+        this->sum += other.sum;
+        this->maximum = std::max(this->maximum, other.maximum);
+    }
+    
+    /*!
+     * A function that removes every value.
+     */
+    void reset() {
+        std::fill(this->counts.begin(), this->counts.end(), 0);
+        this->total = 0;
+        this->sum = 0;
+        this->maximum = 0;
+    }
+    
+    /*!
+     * @param fraction The fraction of values, like 0.99 for the 99th percentile.
+     *
+     * @return The smallest value which at least that fraction of values are at or below, to within the bucket size. 0 if there are no values.
+     */
+    uint64_t percentile(double fraction) const {
+        if (this->total == 0) return 0;
+        
+        uint64_t target = (uint64_t)(fraction * this->total);
+        if (target == 0) target = 1;
+        
+        uint64_t seen = 0;
+        for (size_t a = 0; a < this->counts.size(); a++) {
+            seen += this->counts[a];
+            if (seen >= target) return std::min(this->upperBoundOf(a), this->maximum);
+        }
+        return this->maximum;
+    }
+    
+    /*!
+     * @return The number of values recorded.
+     */
+    uint64_t count() const {
+        return this->total;
+    }
+    
+    /*!
+     * @return The mean of the values, or 0 if there are none.
+     */
+    uint64_t mean() const {
+        return this->total == 0 ? 0 : this->sum / this->total;
+    }
+    
+    /*!
+     * @return The largest value recorded.
+     */
+    uint64_t max() const {
+        return this->maximum;
+    }
+    
+private:
+    //Private properties
+    
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t maximum = 0;
+    
+    //Private member functions
+    
+    /*!
+     * @return The index of the bucket a value goes in.
+     */
+    size_t bucketOf(uint64_t value) const {
+        if (value < LATENCY_HISTOGRAM_SUB_BUCKETS) return value;
+        
+        int power = 63 - __builtin_clzll(value);
+        int shift = power - 6; //log2(LATENCY_HISTOGRAM_SUB_BUCKETS)
+        size_t bucket = (size_t)(shift + 1) * LATENCY_HISTOGRAM_SUB_BUCKETS + ((value >> shift) - LATENCY_HISTOGRAM_SUB_BUCKETS);
+        return std::min(bucket, this->counts.size() - 1);
+    }
+    
+    /*!
+     * @return The largest value that goes in a bucket.
+     */
+    uint64_t upperBoundOf(size_t bucket) const {
+        if (bucket < LATENCY_HISTOGRAM_SUB_BUCKETS) return bucket;
+        
+        int shift = (int)(bucket / LATENCY_HISTOGRAM_SUB_BUCKETS) - 1;
+        uint64_t subBucket = bucket % LATENCY_HISTOGRAM_SUB_BUCKETS + LATENCY_HISTOGRAM_SUB_BUCKETS;
+        return ((subBucket + 1) << shift) - 1;
+    }
+};
+
+/*
+ The latency of one connection, split up by where the time went. Filled in by the sockets while tracing is on.
+ */
+struct LatencyTrace {
+    LatencyHistogram receiveQueue; //From the kernel receiving data to the program reading it
+    LatencyHistogram transmit; //From the program sending data to the kernel handing it to the network device. ServerSocket only
+    LatencyHistogram roundTrip; //From sending a request to reading the first of the reply. ClientSocket only
+};
+
+#endif /* LatencyHistogram_hpp */
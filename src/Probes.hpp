@@ -0,0 +1,40 @@
+#ifndef Probes_hpp
+#define Probes_hpp
+
+/*
+ Static tracepoints (USDT) on the sockets' hot paths, under the provider "socks". Until a tracer like bpftrace or perf attaches, each one is a single nop and a note in the binary, so they are built in wherever <sys/sdt.h> is found (from the systemtap-sdt-dev package). Without it, or with SOCKS_NO_PROBES defined, they compile to nothing.
+
+ The probes and their arguments, in order. The client index is -1 in a ClientSocket, and the descriptor is -1 for a shared memory connection.
+    accept(clientIndex, fd)
+    read(clientIndex, fd, bytes) - one read() from the kernel. 0 bytes means the other side closed
+    write(clientIndex, fd, requested, sent) - one write() to the kernel
+    partial_write(clientIndex, fd, requested, sent) - also fires for a write() that took less than it was given
+    close(clientIndex, fd)
+    timeout(clientIndex, fd) - a read or accept that gave up waiting. The client index is -1 for an accept
+    broadcast_start(clients, bytes)
+    broadcast_end(clients, bytes) - the clients sent to and the bytes sent to them in total
+    shed(clientIndex, bytes) - a queued message dropped, or a client disconnected with that much queued, to keep within the memory budget
+
+ For example, to see how large reads are:
+    bpftrace -e 'usdt:./server:socks:read { @bytes = hist(arg2); }'
+ */
+
+#if !defined(SOCKS_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SOCKS_PROBES_ENABLED
+#endif
+#endif
+
+#if defined(SOCKS_PROBES_ENABLED)
+#define SOCKS_PROBE2(name, a, b) DTRACE_PROBE2(socks, name, a, b)
+#define SOCKS_PROBE3(name, a, b, c) DTRACE_PROBE3(socks, name, a, b, c)
+#define SOCKS_PROBE4(name, a, b, c, d) DTRACE_PROBE4(socks, name, a, b, c, d)
+#else
+//The arguments are never evaluated, but still count as used
+#define SOCKS_PROBE2(name, a, b) do {if (false) {(void)(a); (void)(b);}} while (0)
+#define SOCKS_PROBE3(name, a, b, c) do {if (false) {(void)(a); (void)(b); (void)(c);}} while (0)
+#define SOCKS_PROBE4(name, a, b, c, d) do {if (false) {(void)(a); (void)(b); (void)(c); (void)(d);}} while (0)
+#endif
+
+#endif /* Probes_hpp */
@@ -0,0 +1,51 @@
+#include "RPCClient.hpp"
+
+RPCClient::RPCClient(ClientSocket& socket) {
+    this->socket = &socket;
+}
+
+//Public member functions
+
+uint16_t RPCClient::call(uint16_t method, std::string_view request, std::string& response, unsigned int timeoutMilliseconds) {
+    if (request.size() > RPC_MAX_PAYLOAD)
+        throw std::logic_error("Request too large");
+    
+    RPCHeader call;
+    call.callID = this->nextCallID++;
+    call.method = method;
+    call.status = 0;
+    call.flags = this->checksums ? RPC_FLAG_CHECKSUM : 0;
+    
+    //Send the header and payload together, so the call takes one write
+    size_t frameSize = writeRPCFrame(call, request, this->frame);
+    this->socket->send(std::string_view(this->frame.data(), frameSize), true);
+    
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+    
+    while (true) {
+        //Only wait for the start of a reply. Once it starts, the rest of it is read whatever the deadline, so the connection stays in step
+        long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0 || !this->socket->waitForData((int)remaining)) return RPC_DEADLINE_EXCEEDED;
+        
+        if (!this->socket->receiveMessage(this->header))
+            throw std::runtime_error("ERROR receiving reply: Connection closed");
+        
+        RPCHeader reply = this->header.view().decode();
+        if (reply.length > RPC_MAX_PAYLOAD)
+            throw std::runtime_error("ERROR receiving reply: Frame too large");
+        
+        response.resize(reply.length);
+        if (reply.length > 0 && !this->socket->receive(&response[0], reply.length))
+            throw std::runtime_error("ERROR receiving reply: Connection closed");
+        
+        //A damaged reply's call ID can't be trusted either, so it is taken as the reply to this call
+        if (!verifyRPCFrame(this->header, response)) return RPC_CHECKSUM_FAILED;
+        
+        //Anything else is a late reply to an earlier call that ran out of time
+        if (reply.callID == call.callID) return reply.status;
+    }
+}
+
+void RPCClient::setChecksums(bool enable) {
+    this->checksums = enable;
+}
@@ -0,0 +1,47 @@
+#include "RPCServer.hpp"
+
+RPCServer::RPCServer(ServerSocket& socket) {
+    this->socket = &socket;
+}
+
+//Public member functions
+
+void RPCServer::registerMethod(uint16_t method, Handler handler) {
+    if (method >= this->handlers.size()) this->handlers.resize(method + 1);
+    this->handlers[method] = std::move(handler);
+}
+
+bool RPCServer::handle(unsigned int clientIndex, bool* socketClosed) {
+    if (!this->socket->receiveMessage(this->header, clientIndex, socketClosed)) return false;
+    
+    RPCHeader request = this->header.view().decode();
+    if (request.length > RPC_MAX_PAYLOAD)
+        throw std::runtime_error("ERROR receiving call: Frame too large");
+    
+    //Read the payload into memory kept from earlier calls
+    if (this->request.size() < request.length) this->request.resize(request.length);
+    if (!this->socket->receive(&this->request[0], request.length, clientIndex, socketClosed)) return false;
+    
+    RPCHeader reply = request;
+    this->response.clear();
+    
+    if (!verifyRPCFrame(this->header, std::string_view(this->request.data(), request.length))) {
+        //A damaged request is never handed to a handler, since even its method may be wrong
+        reply.status = RPC_CHECKSUM_FAILED;
+    } else if (request.method < this->handlers.size() && this->handlers[request.method]) {
+        try {
+            reply.status = this->handlers[request.method](std::string_view(this->request.data(), request.length), this->response);
+        } catch (const std::exception& error) {
+            reply.status = RPC_HANDLER_FAILED;
+            this->response = error.what();
+        }
+    } else {
+        reply.status = RPC_UNKNOWN_METHOD;
+    }
+    
+    //Send the header and payload together, so the reply takes one write. It keeps the request's flags, so it is checksummed if the request was
+    size_t frameSize = writeRPCFrame(reply, this->response, this->frame);
+    this->socket->send(std::string_view(this->frame.data(), frameSize), clientIndex, true);
+    
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef RPCServer_hpp
+#define RPCServer_hpp
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <exception>
+
+#include "ServerSocket.hpp"
+#include "RPCFrame.hpp"
+
+/*
+ An RPCServer answers calls from RPCClients connected to a ServerSocket. Each method ID has a handler, kept in a table indexed by the ID, so dispatching a call is one lookup. The buffers for requests, replies and frames are kept between calls, so once they have grown to the largest message, handling a call allocates nothing unless the handler does.
+ */
+class RPCServer {
+public:
+    //Public types
+    
+    /*
+     A handler gets the request's payload and fills in the reply's. The response string is empty but keeps its memory from earlier calls, so assigning or appending to it does not allocate once it is large enough. The return value is the reply's status.
+     */
+    typedef std::function<uint16_t(std::string_view request, std::string& response)> Handler;
+    
+    //Constructor
+    RPCServer(ServerSocket& socket);
+    
+    //Public member functions
+    
+    /*!
+     * A function that sets the handler for a method, replacing any handler it had.
+     *
+     * @param method The ID of the method.
+     * @param handler The handler. An empty function removes the method.
+     */
+    void registerMethod(uint16_t method, Handler handler);
+    
+    /*!
+     * A function that receives one call from a client, runs its handler and sends the reply. It waits for the call if it has not arrived yet, so it is best called when the client's socket is readable. Calls to unknown methods and handlers that throw are answered with an error status rather than thrown. Errors are thrown in the same cases as ServerSocket::receive() and ServerSocket::send(), and if the frame is larger than RPC_MAX_PAYLOAD.
+     *
+     * @param clientIndex The index of the client.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the client disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return True if a call was answered, false if the client disconnected first.
+     */
+    bool handle(unsigned int clientIndex, bool* socketClosed = nullptr);
+    
+private:
+    //Private properties
+    
+    ServerSocket* socket;
+    
+    std::vector<Handler> handlers; //Indexed by method ID. Empty for IDs without a handler
+    
+    MessageBuffer<RPCHeader> header; //The header of the request being handled
+    std::string request; //Never shrinks, so it is only as long as the current request when that is the longest so far
+    std::string response;
+    std::string frame; //The reply's header and payload, so they are sent in one write. Only grown, so it can be longer than the frame
+};
+
+#endif /* RPCServer_hpp */
@@ -0,0 +1,105 @@
+#ifndef ReceiveBuffer_hpp
+#define ReceiveBuffer_hpp
+
+#include <memory>
+#include <cstddef>
+
+#define RECEIVE_BUFFER_MIN 4096 //The size a buffer starts at and never shrinks below
+#define RECEIVE_BUFFER_MAX 16777216 //The size a buffer never grows past. Larger messages take more than one read
+#define RECEIVE_BUFFER_SHRINK_READS 64 //Reads in a row that use at most a quarter of the buffer before it is halved
+
+/*
+ A buffer for reading one connection's data into, which sizes itself to the traffic. Before a read it is grown to fit what is waiting, doubling each time, and after a run of small reads it is halved again. A connection that only sees small messages holds RECEIVE_BUFFER_MIN bytes, and a large message is read in a few large reads.
+ */
+class ReceiveBuffer {
+public:
+    //Public member functions
+    
+    /*!
+     * A function that makes the buffer large enough for the bytes waiting to be read, up to RECEIVE_BUFFER_MAX. What the buffer held is not kept.
+     *
+     * @param waiting The number of bytes waiting to be read.
+     */
+    void reserve(size_t waiting) {
+        if (this->capacity >= waiting && this->capacity > 0) return;
+        
+        size_t newCapacity = this->capacity > 0 ? this->capacity : RECEIVE_BUFFER_MIN;
+        while (newCapacity < waiting && newCapacity < RECEIVE_BUFFER_MAX) newCapacity *= 2;
+        
+        this->resize(newCapacity);
+        this->smallReads = 0;
+    }
+    
+    /*!
+     * A function that tells the buffer how much of it the last read used, so it can shrink once traffic has been small for a while. The memory may be replaced, so the bytes must be used first.
+     *
+     * @param length The number of bytes read.
+     */
+    void used(size_t length) {
+        if (this->capacity <= RECEIVE_BUFFER_MIN || length > this->capacity / 4) {
+            this->smallReads = 0;
+            return;
+        }
+        
+        if (++this->smallReads >= RECEIVE_BUFFER_SHRINK_READS) {
+            this->resize(this->capacity / 2);
+            this->smallReads = 0;
+        }
+    }
+    
+    /*!
+     * A function that frees the buffer. The next reserve() allocates it again.
+     */
+    void release() {
+        if (this->account != nullptr) *this->account -= this->capacity;
+        this->bytes.reset();
+        this->capacity = 0;
+        this->smallReads = 0;
+    }
+    
+    /*!
+     * @return The memory to read into.
+     */
+    char* data() {
+        return this->bytes.get();
+    }
+    
+    /*!
+     * @return The number of bytes that can be read into data().
+     */
+    size_t size() const {
+        return this->capacity;
+    }
+    
+    /*!
+     * A function that keeps a running total of the memory held by this buffer, along with any others given the same total. The buffer must be empty.
+     *
+     * @param total The total, which the buffer adds to and takes from as it changes size. A null pointer stops counting.
+     */
+    void setAccount(size_t* total) {
+        this->account = total;
+    }
+    
+private:
+    //Private properties
+    
+    std::unique_ptr<char[]> bytes;
+    size_t capacity = 0;
+    unsigned int smallReads = 0; //Reads in a row that used at most a quarter of the buffer
+    size_t* account = nullptr; //See setAccount()
+    
+    //Private member functions
+    
+    /*!
+     * A function that replaces the memory with a new block, without copying, since nothing is kept between reads.
+     *
+     * @param newCapacity The size of the new block.
+     */
+    void resize(size_t newCapacity) {
+        this->bytes.reset(new char[newCapacity]);
+        if (this->account != nullptr) *this->account += newCapacity - this->capacity;
+        this->capacity = newCapacity;
+    }
+};
+
+#endif /* ReceiveBuffer_hpp */
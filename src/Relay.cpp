@@ -0,0 +1,208 @@
+#include "Relay.hpp"
+
+Relay::Relay(ServerSocket& server, unsigned int clientIndex, ClientSocket& upstream) {
+    int clientFD = server.clientFD(clientIndex);
+    int upstreamFD = upstream.connectionFD();
+    if (clientFD < 0 || upstreamFD < 0)
+        throw std::logic_error("Relay needs a TCP connection on both sides");
+    
+    this->toUpstream.from = clientFD;
+    this->toUpstream.to = upstreamFD;
+    this->toClient.from = upstreamFD;
+    this->toClient.to = clientFD;
+}
+
+//Public member functions
+
+Relay::Outcome Relay::run(unsigned int idleTimeoutMilliseconds) {
+    this->toUpstream.readDone = this->toUpstream.finished = false;
+    this->toClient.readDone = this->toClient.finished = false;
+    this->reset = false;
+    
+    this->open(this->toUpstream);
+    try {
+        this->open(this->toClient);
+    } catch (const std::exception&) {
+        this->close(this->toUpstream);
+        throw;
+    }
+    
+    int clientFlags = fcntl(this->toUpstream.from, F_GETFL);
+    int upstreamFlags = fcntl(this->toUpstream.to, F_GETFL);
+    fcntl(this->toUpstream.from, F_SETFL, clientFlags | O_NONBLOCK);
+    fcntl(this->toUpstream.to, F_SETFL, upstreamFlags | O_NONBLOCK);
+    
+    //splice() has no MSG_NOSIGNAL, so hold back SIGPIPE while relaying and discard any raised
+    sigset_t pipeSignal, previousSignals;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, &previousSignals);
+    
+    Outcome outcome = Closed;
+    try {
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(idleTimeoutMilliseconds);
+        
+        while (!this->reset && !(this->toUpstream.finished && this->toClient.finished)) {
+            pollfd pollInfo[2];
+            pollInfo[0].fd = this->toUpstream.from;
+            pollInfo[1].fd = this->toClient.from;
+            for (int a = 0; a < 2; a++) {
+                Direction& reading = a == 0 ? this->toUpstream : this->toClient;
+                Direction& writing = a == 0 ? this->toClient : this->toUpstream;
+                pollInfo[a].events = 0;
+                if (!reading.readDone && reading.pending < reading.capacity) pollInfo[a].events |= POLLIN;
+                if (writing.pending > 0) pollInfo[a].events |= POLLOUT;
+                if (pollInfo[a].events == 0) pollInfo[a].fd = -1; //Otherwise a hung up connection would wake poll() over and over
+                pollInfo[a].revents = 0;
+            }
+            
+            int timeout = -1;
+            if (idleTimeoutMilliseconds > 0) {
+                long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                if (remaining <= 0) {
+                    outcome = IdleTimeout;
+                    break;
+                }
+                timeout = (int)remaining;
+            }
+            
+            int ready = poll(pollInfo, 2, timeout);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("ERROR relaying data: ") + std::string(strerror(errno)));
+            }
+            if (ready == 0) continue;
+            
+            //Write straight after reading, so data doesn't wait a round of poll() in the pipe
+            bool moved = false;
+            if (pollInfo[0].revents & (POLLIN | POLLHUP | POLLERR)) moved |= this->fill(this->toUpstream);
+            if (pollInfo[1].revents & (POLLIN | POLLHUP | POLLERR)) moved |= this->fill(this->toClient);
+            moved |= this->drain(this->toUpstream);
+            moved |= this->drain(this->toClient);
+            
+            if (moved) deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(idleTimeoutMilliseconds);
+        }
+    } catch (const std::exception&) {
+        fcntl(this->toUpstream.from, F_SETFL, clientFlags);
+        fcntl(this->toUpstream.to, F_SETFL, upstreamFlags);
+        this->close(this->toUpstream);
+        this->close(this->toClient);
+        pthread_sigmask(SIG_SETMASK, &previousSignals, nullptr);
+        throw;
+    }
+    
+    fcntl(this->toUpstream.from, F_SETFL, clientFlags);
+    fcntl(this->toUpstream.to, F_SETFL, upstreamFlags);
+    this->close(this->toUpstream);
+    this->close(this->toClient);
+    
+    sigset_t pending;
+    sigpending(&pending);
+    if (sigismember(&pending, SIGPIPE) && !sigismember(&previousSignals, SIGPIPE)) {
+        int signal;
+        sigwait(&pipeSignal, &signal);
+    }
+    pthread_sigmask(SIG_SETMASK, &previousSignals, nullptr);
+    
+    return outcome;
+}
+
+unsigned long long Relay::bytesToUpstream() const {
+    return this->toUpstream.bytes.load(std::memory_order_relaxed);
+}
+
+unsigned long long Relay::bytesToClient() const {
+    return this->toClient.bytes.load(std::memory_order_relaxed);
+}
+
+//Private member functions
+
+void Relay::open(Direction& direction) {
+    direction.pending = 0;
+    direction.start = 0;
+#if defined(__linux__)
+    if (pipe2(direction.pipeFDs, O_CLOEXEC | O_NONBLOCK) < 0)
+        throw std::runtime_error(std::string("ERROR creating relay pipe: ") + std::string(strerror(errno)));
+    
+    //A larger pipe lets one splice() move more. If the kernel refuses, the default size still works
+    fcntl(direction.pipeFDs[1], F_SETPIPE_SZ, RELAY_PIPE_SIZE);
+    int size = fcntl(direction.pipeFDs[1], F_GETPIPE_SZ);
+    direction.capacity = size > 0 ? size : 65536;
+#else
+    direction.capacity = RELAY_PIPE_SIZE;
+    direction.buffer.reset(new char[direction.capacity]);
+#endif
+}
+
+void Relay::close(Direction& direction) {
+#if defined(__linux__)
+    for (int a = 0; a < 2; a++) {
+        if (direction.pipeFDs[a] >= 0) ::close(direction.pipeFDs[a]);
+        direction.pipeFDs[a] = -1;
+    }
+#else
+    direction.buffer.reset();
+#endif
+    direction.capacity = 0;
+    direction.pending = 0;
+}
+
+bool Relay::fill(Direction& direction) {
+    if (direction.readDone || direction.pending >= direction.capacity) return false;
+    
+#if defined(__linux__)
+    long readSize = splice(direction.from, nullptr, direction.pipeFDs[1], nullptr, direction.capacity - direction.pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+    //Move what is left to the front, so the free space is all in one piece
+    if (direction.start + direction.pending == direction.capacity) {
+        memmove(direction.buffer.get(), direction.buffer.get() + direction.start, direction.pending);
+        direction.start = 0;
+    }
+    long readSize = read(direction.from, direction.buffer.get() + direction.start + direction.pending, direction.capacity - direction.start - direction.pending);
+#endif
+    
+    if (readSize < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return false;
+        if (errno == ECONNRESET || errno == ENOTCONN) {
+            this->reset = true;
+            return true;
+        }
+        throw std::runtime_error(std::string("ERROR relaying data: ") + std::string(strerror(errno)));
+    }
+    
+    if (readSize == 0)
+        direction.readDone = true;
+    direction.pending += readSize;
+    return true;
+}
+
+bool Relay::drain(Direction& direction) {
+    bool wrote = false;
+    if (direction.pending > 0) {
+#if defined(__linux__)
+        long writtenSize = splice(direction.pipeFDs[0], nullptr, direction.to, nullptr, direction.pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#else
+        long writtenSize = write(direction.to, direction.buffer.get() + direction.start, direction.pending);
+#endif
+        if (writtenSize < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return false;
+            if (errno == EPIPE || errno == ECONNRESET || errno == ENOTCONN) {
+                this->reset = true;
+                return false;
+            }
+            throw std::runtime_error(std::string("ERROR relaying data: ") + std::string(strerror(errno)));
+        }
+        
+        direction.pending -= writtenSize;
+        direction.start = direction.pending > 0 ? direction.start + writtenSize : 0;
+        direction.bytes.fetch_add(writtenSize, std::memory_order_relaxed);
+        wrote = writtenSize > 0;
+    }
+    
+    //Pass the close on, but only once the receiving side has everything
+    if (direction.readDone && direction.pending == 0 && !direction.finished) {
+        shutdown(direction.to, SHUT_WR);
+        direction.finished = true;
+    }
+    return wrote;
+}
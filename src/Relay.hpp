@@ -0,0 +1,119 @@
+#ifndef Relay_hpp
+#define Relay_hpp
+
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <exception>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <cerrno>
+
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+
+#define RELAY_PIPE_SIZE 1048576 //Bytes each direction can hold between reading and writing. The kernel may round it, or refuse to go above /proc/sys/fs/pipe-max-size
+#define RELAY_IDLE_TIMEOUT 60000 //Milliseconds without data in either direction before a relay gives up
+
+/*
+ A Relay joins a ServerSocket's client to a ClientSocket's host, passing everything each side sends to the other until both are done. On Linux the data is moved with splice() through a pipe for each direction, so it never enters user space; elsewhere it is copied through a buffer. Both connections must be TCP.
+
+ When one side closes its end, the other side's sending end is shut down once everything has been passed on, so a half-closed connection is relayed faithfully. The relay ends when both directions are done, or when either connection is reset.
+ */
+class Relay {
+public:
+    //Public types
+    
+    enum Outcome {
+        Closed, //Both sides finished, or a connection was reset
+        IdleTimeout //Nothing was sent either way for the idle timeout
+    };
+    
+    //Constructor
+    Relay(ServerSocket& server, unsigned int clientIndex, ClientSocket& upstream);
+    
+    //Public member functions
+    
+    /*!
+     * A function that relays data until both sides are done or the connection goes idle. The connections are made non-blocking while it runs, and restored after. They are left open either way, to be closed by their sockets. Data already read with receive() is not relayed. Will throw an error if the pipes cannot be made, or if an error other than a reset occurs.
+     *
+     * @param idleTimeoutMilliseconds An optional parameter indicating how long the relay waits without data in either direction. 0 waits forever. Autoinitialized as RELAY_IDLE_TIMEOUT.
+     *
+     * @return Why the relay ended.
+     */
+    Outcome run(unsigned int idleTimeoutMilliseconds = RELAY_IDLE_TIMEOUT);
+    
+    /*!
+     * @return The bytes passed from the client to the host so far. Can be read from another thread while run() is going.
+     */
+    unsigned long long bytesToUpstream() const;
+    
+    /*!
+     * @return The bytes passed from the host to the client so far. Can be read from another thread while run() is going.
+     */
+    unsigned long long bytesToClient() const;
+    
+private:
+    //Private properties
+    
+    struct Direction {
+        int from = -1;
+        int to = -1;
+        int pipeFDs[2] = {-1, -1}; //Linux only. The data read and not yet written sits in the pipe
+        std::unique_ptr<char[]> buffer; //Elsewhere, it sits here from start
+        size_t start = 0;
+        size_t capacity = 0;
+        size_t pending = 0; //Bytes read and not yet written
+        bool readDone = false; //The sending side closed its end
+        bool finished = false; //Everything was written and the receiving side's end shut down
+        std::atomic<unsigned long long> bytes{0};
+    };
+    Direction toUpstream;
+    Direction toClient;
+    
+    bool reset = false; //Either connection was reset, which ends the relay
+    
+    //Private member functions
+    
+    /*!
+     * A function that gets a direction ready to run, making its pipe or buffer.
+     *
+     * @param direction The direction.
+     */
+    void open(Direction& direction);
+    
+    /*!
+     * A function that frees a direction's pipe or buffer.
+     *
+     * @param direction The direction.
+     */
+    void close(Direction& direction);
+    
+    /*!
+     * A function that reads what it can from a direction's sending side, without waiting.
+     *
+     * @param direction The direction.
+     *
+     * @return True if anything changed, including the sending side closing.
+     */
+    bool fill(Direction& direction);
+    
+    /*!
+     * A function that writes what it can to a direction's receiving side, without waiting, and shuts its end down once the sending side has closed and everything was written.
+     *
+     * @param direction The direction.
+     *
+     * @return True if anything was written.
+     */
+    bool drain(Direction& direction);
+};
+
+#endif /* Relay_hpp */
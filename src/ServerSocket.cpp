@@ -2,8 +2,8 @@
 
 ServerSocket::ServerSocket() {}
 
-ServerSocket::ServerSocket(int portNum, int maxConnections) {
-    this->setSocket(portNum, maxConnections);
+ServerSocket::ServerSocket(int portNum, int maxConnections, int backlog, const Placement& placement) {
+    this->setSocket(portNum, maxConnections, backlog, placement);
 }
 
 //Static functions
@@ -16,47 +16,41 @@ std::string ServerSocket::getHostName() {
     return std::string(name);
 }
 
+void ServerSocket::pinThread(int cpu) {
+#if defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+    if (error != 0)
+        throw std::runtime_error(std::string("ERROR pinning thread: ") + std::string(strerror(error)));
+#endif
+}
+
 //Public member functions
 
-void ServerSocket::setSocket(int portNum, int maxConnections) {
+void ServerSocket::setSocket(int portNum, int maxConnections, int backlog, const Placement& placement) {
     if (this->setUp)
         throw std::logic_error("Socket already set");
     
-    int returnVal;
-    
-    for (int a = 0; a < maxConnections; a++) {
-        this->activeConnections.push_back(false); //All connections initially inactive
-        this->clientSocketsFD.push_back(0); //No socket file descriptors set
-        this->clientAddresses.push_back(sockaddr_storage()); //All addresses set as empty structs
-        this->clientAddressSizes.push_back(socklen_t()); //All address sizes set as empty sizes
-    }
+    if (placement.steerConnections && placement.cpu < 0)
+        throw std::logic_error("Steering connections needs a cpu");
     
-    addrinfo hints; //A struct containing information on the address. Will be passed to getaddrinfo() to give hints about the connection to be made
-    addrinfo* serverAddressList; //A pointer to an addrinfo struct that will be filled with the server address by getaddrinfo()
+    if (placement.cpu >= sysconf(_SC_NPROCESSORS_CONF))
+        throw std::logic_error(std::string("No such cpu: ") + std::to_string(placement.cpu));
     
-    memset(&hints, 0, sizeof(hints)); //Initializes hints with all 0's
-    hints.ai_family = AF_UNSPEC; //Can be either IPv4 or IPv6
-    hints.ai_socktype = SOCK_STREAM; //TCP Socket
-    hints.ai_flags = AI_PASSIVE; //Set the socket to accept connections (as server socket)
+    this->buffer.reset(new char[BUFFER_SIZE]);
     
-    /* getaddrinfo
-     The getaddrinfo() fills a given addrinfo struct with the relevant information. The return value is nonzero when there is an error.
-     
-     The first argument is the name of the host to connect with.
-     
-     The second argument is a string representation of the port number.
-     
-     The third argument is a pointer to an addrinfo struct which contains hints about the type of connection to be made.
-     
-     The fourth argument is a pointer which will be filled with a linked list of hosts returned. If just one host is being looked for, the first result can just be used.
-     */
-    returnVal = getaddrinfo(NULL, std::to_string(portNum).c_str(), &hints, &serverAddressList);
+    for (int a = 0; a < maxConnections; a++) {
+        this->addSlot();
+    }
+    this->backlog = backlog;
     
-    //Throw an error if there is an error getting the local address
-    if (returnVal != 0) throw std::runtime_error(strcat((char *)"ERROR getting local address: ", gai_strerror(returnVal))); //gai_strerror() returns a c string representation of the error
+    //Look up the local addresses to accept connections on (as server socket). The list is kept, since serverAddress points into it
+    this->serverAddressList = HostResolver::shared().resolve(NULL, portNum, true);
     
     //Set the first host in the list to the desired host
-    this->serverAddress = *serverAddressList;
+    this->serverAddress = *this->serverAddressList;
     
     /* socket()
      The socket() function returns a new socket, with three parameters.
@@ -77,7 +71,7 @@ void ServerSocket::setSocket(int portNum, int maxConnections) {
     this->hostSocketFD = socket(this->serverAddress.ai_family, this->serverAddress.ai_socktype, this->serverAddress.ai_protocol);
     
     //Checks for errors initializing socket
-    if (socket < 0) throw std::runtime_error(strcat((char *)"ERROR opening socket", strerror(errno)));
+    if (this->hostSocketFD < 0) throw std::runtime_error(std::string("ERROR opening socket: ") + strerror(errno));
     
     int enable = 1;
     //This code tells the kernel that the port can be reused as long as there isn't an active socket listening there. This means that after the socket is closed the port can immediately be reused without giving an error
@@ -85,6 +79,16 @@ void ServerSocket::setSocket(int portNum, int maxConnections) {
         throw std::runtime_error(strcat((char *)"ERROR setting port to reusable", strerror(errno)));
     }
     
+#if defined(__linux__) && defined(SO_REUSEPORT) && defined(SO_INCOMING_CPU)
+    //Every socket on the port gets its own backlog. A connection goes to the socket whose cpu matches the core its SYN arrived on, so it is handled on the core where its packets already are
+    if (placement.steerConnections) {
+        if (setsockopt(this->hostSocketFD, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(int)) == -1)
+            throw std::runtime_error(std::string("ERROR sharing port: ") + std::string(strerror(errno)));
+        if (setsockopt(this->hostSocketFD, SOL_SOCKET, SO_INCOMING_CPU, &placement.cpu, sizeof(int)) == -1)
+            throw std::runtime_error(std::string("ERROR steering connections: ") + std::string(strerror(errno)));
+    }
+#endif
+    
     /* bind()
      The bind() function connects a socket to a local address, with three parameters.
      Here it will connect the socket to the (local) host at the proper port number.
@@ -110,27 +114,46 @@ void ServerSocket::setSocket(int portNum, int maxConnections) {
      
      This function cannot fail, as long as the socket is valid.
      */
-    if (listen(this->hostSocketFD, 1) < 0) {
+    if (listen(this->hostSocketFD, backlog) < 0) {
         throw std::runtime_error(strcat((char *)"ERROR listening for incoming connections", strerror(errno)));
     }
     
-    freeaddrinfo(serverAddressList); //Free the linked list now that we have the local host information
+    //The host socket doesn't block, so acceptClients() can take every waiting client and stop when there are none. addClient() waits with poll() instead
+    fcntl(this->hostSocketFD, F_SETFL, fcntl(this->hostSocketFD, F_GETFL) | O_NONBLOCK);
+    
+    //Create the descriptor other threads use to signal that they posted messages
+#if defined(__linux__)
+    this->postNotifyFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    this->postNotifyWriteFD = this->postNotifyFD;
+    if (this->postNotifyFD < 0)
+        throw std::runtime_error(std::string("ERROR creating post notifier: ") + std::string(strerror(errno)));
+#else
+    int pipeFDs[2];
+    if (pipe(pipeFDs) < 0)
+        throw std::runtime_error(std::string("ERROR creating post notifier: ") + std::string(strerror(errno)));
+    fcntl(pipeFDs[0], F_SETFL, O_NONBLOCK);
+    fcntl(pipeFDs[1], F_SETFL, O_NONBLOCK);
+    this->postNotifyFD = pipeFDs[0];
+    this->postNotifyWriteFD = pipeFDs[1];
+#endif
     
     this->setUp = true; //All functions ensure the socket has been set before doing anything
 }
 
-void ServerSocket::addClient() {
+int ServerSocket::addClient() {
     if (!this->setUp)
         throw std::logic_error("Socket not set");
     
-    int nextIndex = this->getNextAvailableIndex(); //Find the next available index at which to set the new connection
+    //A client that was queued while the server was full is added before any new one
+    int clientIndex = this->promoteQueuedClient();
+    if (clientIndex >= 0) return clientIndex;
     
-    if (nextIndex == -1) {
-        throw std::logic_error(strcat((char *)"Max number of sockets: ", std::to_string(this->activeConnections.size()).c_str()));
-    }
+    sockaddr_storage address;
+    socklen_t addressSize;
+    int socketFD;
     
     /* accept()
-     The accept() function block the current thread until a connection is formed between the client and the server, with three arguments. It then wakes when the connection is successfully established.
+     The accept() function takes a connection that is waiting in the backlog queue, with three arguments. Since the host socket doesn't block, it fails with EAGAIN if no connection is waiting.
      
      The first argument is the host side socket, passed by its file descriptor.
      
@@ -140,13 +163,111 @@ void ServerSocket::addClient() {
      
      The return value is a socket, passed by a small integer reference.
      */
-    this->clientSocketsFD[nextIndex] = accept(this->hostSocketFD, (struct sockaddr *)&this->clientAddresses[nextIndex], &this->clientAddressSizes[nextIndex]);
+    while ((socketFD = this->acceptSocket(address, addressSize)) < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED)
+            throw std::runtime_error(std::string("ERROR accepting client: ") + std::string(strerror(errno)));
+        
+        //Wait for a client to connect, for up to the time set with setHostTimeout()
+        pollfd pollInfo;
+        pollInfo.fd = this->hostSocketFD;
+        pollInfo.events = POLLIN;
+        pollInfo.revents = 0;
+        
+        int returnValue = poll(&pollInfo, 1, this->hostTimeoutMilliseconds);
+        if (returnValue == 0) {
+            SOCKS_PROBE2(timeout, -1, this->hostSocketFD);
+            throw std::runtime_error(std::string("ERROR accepting client: ") + std::string(strerror(EAGAIN)));
+        }
+        if (returnValue < 0 && errno != EINTR)
+            throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
+    }
+    
+    return this->placeClient(socketFD, address, addressSize);
+}
+
+unsigned int ServerSocket::acceptClients(const std::function<void(unsigned int)>& onClient) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    unsigned int added = 0;
+    int clientIndex;
+    
+    //Clients queued while the server was full go first, in the order they connected
+    while ((clientIndex = this->promoteQueuedClient()) >= 0) {
+        added++;
+        if (onClient) onClient(clientIndex);
+    }
+    
+    //Take every connection waiting in the backlog, so a burst of clients costs one wakeup rather than one per client
+    sockaddr_storage address;
+    socklen_t addressSize;
+    while (true) {
+        int socketFD = this->acceptSocket(address, addressSize);
+        if (socketFD < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue; //A client that gave up while waiting doesn't stop the others
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            throw std::runtime_error(std::string("ERROR accepting client: ") + std::string(strerror(errno)));
+        }
+        
+        clientIndex = this->placeClient(socketFD, address, addressSize);
+        if (clientIndex >= 0) {
+            added++;
+            if (onClient) onClient(clientIndex);
+        }
+    }
+    
+    return added;
+}
+
+void ServerSocket::setOverflowPolicy(OverflowPolicy policy) {
+    this->overflowPolicy = policy;
+}
+
+unsigned int ServerSocket::numberOfQueuedClients() const {
+    return (unsigned int)this->overflowQueue.size();
+}
+
+void ServerSocket::setFastOpen(bool enable, int queueLength) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+#if defined(TCP_FASTOPEN)
+    //The option can be changed on a socket that is already listening. A queue length of 0 turns it off
+    int value = enable ? queueLength : 0;
+    if (setsockopt(this->hostSocketFD, IPPROTO_TCP, TCP_FASTOPEN, &value, sizeof(int)) < 0)
+        throw std::runtime_error(std::string("ERROR setting fast open: ") + std::string(strerror(errno)));
+#endif
+}
+
+int ServerSocket::listeningFD() const {
+    return this->setUp ? this->hostSocketFD : -1;
+}
+
+void ServerSocket::addSharedMemoryClient(const char* name, size_t capacity) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    int nextIndex = this->reserveIndex(); //Find the next available index at which to set the new connection
+    
+    //There is no connection to reject or queue yet, so only the Grow policy applies here
+    if (nextIndex == -1) {
+        throw std::logic_error(std::string("Max number of sockets: ") + std::to_string(this->activeConnections.size()));
+    }
     
-    //Checks for error with accepting
-    if (this->clientSocketsFD[nextIndex] < 0)
-        throw std::runtime_error(strcat((char *)"ERROR accepting client", strerror(errno)));
+    std::unique_ptr<SharedMemoryRing> ring(new SharedMemoryRing());
+    ring->create(name, capacity);
+    
+    //Wait for the client to attach, like accept() waits for a TCP client
+    if (!ring->waitForPeer(this->hostTimeoutMilliseconds))
+        throw std::runtime_error(std::string("ERROR accepting client: ") + std::string(strerror(EAGAIN)));
+    
+    this->sharedMemoryRings[nextIndex] = std::move(ring);
+    this->clientSocketsFD[nextIndex] = -1; //There is no socket, so socket options set on it have no effect
+    this->setTracingOptions(nextIndex);
+    this->lastSeenTimes[nextIndex] = std::chrono::steady_clock::now();
     
     this->activeConnections[nextIndex] = true;
+    if (this->capture) this->capture->append(nextIndex, TrafficCapture::Opened, nullptr, 0);
 }
 
 void ServerSocket::closeConnection(unsigned int clientIndex) {
@@ -158,56 +279,407 @@ void ServerSocket::closeConnection(unsigned int clientIndex) {
         throw std::logic_error("Socket index uninitialized");
     
     //Close the socket of the given index
-    close(this->clientSocketsFD[clientIndex]);
+    SOCKS_PROBE2(close, clientIndex, this->sharedMemoryRings[clientIndex] ? -1 : this->clientSocketsFD[clientIndex]);
+    if (this->sharedMemoryRings[clientIndex]) {
+        this->sharedMemoryRings[clientIndex]->close();
+        this->sharedMemoryRings[clientIndex].reset();
+    } else {
+        this->closeClientSocket(clientIndex);
+    }
+    if (this->capture) this->capture->append(clientIndex, TrafficCapture::Closed, nullptr, 0);
+    
+    //Discard anything still posted for the closed socket. Memory the kernel may still be sending from was moved out by closeClientSocket()
+    this->outboundQueues[clientIndex].clear();
+    this->outboundOffsets[clientIndex] = 0;
+    this->queuedMemory -= this->queuedBytes[clientIndex];
+    this->queuedBytes[clientIndex] = 0;
+    this->zeroCopyClients[clientIndex] = false;
+    this->zeroCopyNextIDs[clientIndex] = 0;
+    this->zeroCopyPending[clientIndex].clear();
+    
+    //Remove the closed socket from every topic it subscribed to
+    for (size_t a = 0; a < this->clientTopics[clientIndex].size(); a++) {
+        this->removeSubscriber(this->clientTopics[clientIndex][a], clientIndex);
+    }
+    this->clientTopics[clientIndex].clear();
+    
+    //An unused index holds no receive memory
+    this->receiveBuffers[clientIndex].release();
+    this->recordBuffers[clientIndex].release();
+    
+    //The next client at this index starts a new trace
+    this->traces[clientIndex].reset();
     
     //Reset the information for the closed socket
     this->clientAddresses[clientIndex] = sockaddr_storage();
     this->clientAddressSizes[clientIndex] = 0;
+    this->lastSeenTimes[clientIndex] = std::chrono::steady_clock::time_point();
     this->activeConnections[clientIndex] = false;
 }
 
 std::string ServerSocket::send(const char* message, unsigned int clientIndex, bool ensureFullStringSent) {
+    unsigned long messageLength = message != nullptr ? strlen(message) : 0;
+    
+    unsigned long sentSize = this->sendBytes(message, messageLength, clientIndex, ensureFullStringSent);
+    
+    //Return any part of the string that was not sent. This occurs if the string is too long, and is the only case that allocates
+    if (sentSize < messageLength) return std::string(message + sentSize, messageLength - sentSize);
+    return ""; //Full string was sent
+}
+
+unsigned long ServerSocket::send(std::string_view message, unsigned int clientIndex, bool ensureFullStringSent) {
+    return this->sendBytes(message.data(), message.size(), clientIndex, ensureFullStringSent);
+}
+
+#if __cplusplus >= 202002L
+unsigned long ServerSocket::send(std::span<const std::byte> message, unsigned int clientIndex, bool ensureFullStringSent) {
+    return this->sendBytes((const char*)message.data(), message.size(), clientIndex, ensureFullStringSent);
+}
+#endif
+
+std::string ServerSocket::send(std::string&& message, unsigned int clientIndex, bool ensureFullStringSent) {
+    unsigned long sentSize = this->sendBytes(message.data(), message.size(), clientIndex, ensureFullStringSent);
+    
+    //Return what was not sent in the string that was moved in, rather than in a new one
+    message.erase(0, sentSize);
+    return std::move(message);
+}
+
+void ServerSocket::broadcast(const char* message, bool ensureFullStringSent) {
+    //Measure the message once rather than once per client
+    this->broadcast(std::string_view(message != nullptr ? message : ""), ensureFullStringSent);
+}
+
+void ServerSocket::broadcast(std::string_view message, bool ensureFullStringSent) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    SOCKS_PROBE2(broadcast_start, this->numberOfClients(), message.size());
+    unsigned int clients = 0;
+    unsigned long sent = 0;
+    
+    //Send the message to each active client
+    for (int a = 0; a < this->activeConnections.size(); a++) {
+        if (this->activeConnections[a]) {
+            sent += this->sendBytes(message.data(), message.size(), a, ensureFullStringSent);
+            clients++;
+        }
+    }
+    SOCKS_PROBE2(broadcast_end, clients, sent);
+}
+
+unsigned long ServerSocket::sendZeroCopy(std::shared_ptr<const std::string> message, unsigned int clientIndex, bool ensureFullStringSent) {
     if (!this->setUp)
         throw std::logic_error("Socket not set");
     
     //A blank message won't be sent
-    if (std::string(message) == "")
+    if (!message || message->empty())
         throw std::logic_error("No message to send");
     
     //Throw an error if there is no socket at the index
     if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
         throw std::logic_error("Socket index uninitialized");
     
-    unsigned long messageLength = strlen(message);
+    //Copying is cheaper for small messages, and the only option for some clients
+    if (!this->zeroCopyClients[clientIndex] || message->size() < this->zeroCopyThreshold)
+        return this->sendBytes(message->data(), message->size(), clientIndex, ensureFullStringSent);
     
-    long sentSize = write(this->clientSocketsFD[clientIndex], message, messageLength);
+    //Free memory from earlier sends the kernel is done with
+    this->readErrorQueue(clientIndex);
+    this->releaseRetiredZeroCopy();
     
-    if (sentSize < 0) {
-        throw std::runtime_error(strcat((char *)"ERROR sending message: ", strerror(errno)));
-    } else if (sentSize < messageLength) { //If only some of the string was sent, return what wasn't sent (or send the rest)
-        std::string extraStr; //Holds the rest of the string that was not sent
-        for (unsigned long a = sentSize; a < messageLength; a++) {
-            extraStr += message[a];
-        }
-        if (ensureFullStringSent) { //This optional bool is set to false. If manually changed to true send the rest. Otherwise, return the unsent part
-            this->send(extraStr.c_str(), clientIndex, ensureFullStringSent); //Recursively keep sending the rest of the string until it is all sent
-            return "";
+    unsigned long sent = 0;
+    while (sent < message->size()) {
+        long sentSize = this->writeZeroCopy(message, sent, clientIndex, 0);
+        
+        if (sentSize < 0) {
+            if (errno == EINTR) continue;
+            //The kernel limits how much memory one socket can pin. If that is reached, wait for earlier sends to finish
+            if (errno == ENOBUFS) {
+                pollfd pollInfo;
+                pollInfo.fd = this->clientSocketsFD[clientIndex];
+                pollInfo.events = 0; //Only errors, which include finished zero-copy sends, are waited for
+                pollInfo.revents = 0;
+                poll(&pollInfo, 1, 10);
+                if (this->readErrorQueue(clientIndex) == 0 && !ensureFullStringSent) break;
+                continue;
+            }
+            throw std::runtime_error(std::string("ERROR sending message: ") + std::string(strerror(errno)));
         }
-        return extraStr; //Return any part of the string that was not sent. This occurs if the string is too long
+        
+        if (this->capture && sentSize > 0) this->capture->append(clientIndex, TrafficCapture::Sent, message->data() + sent, sentSize);
+        sent += sentSize;
+        
+        //Unless the full message must be sent, stop after one write and let the caller deal with the rest
+        if (!ensureFullStringSent || sentSize == 0) break;
     }
-    return ""; //Full string was sent
+    return sent;
 }
 
-void ServerSocket::broadcast(const char* message, bool ensureFullStringSent) {
+void ServerSocket::broadcastZeroCopy(std::shared_ptr<const std::string> message, bool ensureFullStringSent) {
     if (!this->setUp)
         throw std::logic_error("Socket not set");
     
-    //Send the message to each active client
-    for (int a = 0; a < this->activeConnections.size(); a++) {
+    SOCKS_PROBE2(broadcast_start, this->numberOfClients(), message->size());
+    unsigned int clients = 0;
+    unsigned long sent = 0;
+    
+    //Send the same memory to each active client
+    for (size_t a = 0; a < this->activeConnections.size(); a++) {
         if (this->activeConnections[a]) {
-            this->send(message, a, ensureFullStringSent);
+            sent += this->sendZeroCopy(message, a, ensureFullStringSent);
+            clients++;
+        }
+    }
+    SOCKS_PROBE2(broadcast_end, clients, sent);
+}
+
+void ServerSocket::setZeroCopy(bool enable, unsigned long threshold) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    this->zeroCopy = enable;
+    this->zeroCopyThreshold = threshold;
+    
+    //Apply the setting to each client already connected. Clients added later get it when they are accepted
+    for (size_t a = 0; a < this->activeConnections.size(); a++) {
+        if (this->activeConnections[a]) this->setZeroCopyOptions(a);
+    }
+}
+
+unsigned int ServerSocket::releaseZeroCopyBuffers() {
+    unsigned int released = this->releaseRetiredZeroCopy();
+    for (size_t a = 0; a < this->activeConnections.size(); a++) {
+        if (this->activeConnections[a] && !this->zeroCopyPending[a].empty()) released += this->readErrorQueue(a);
+    }
+    return released;
+}
+
+void ServerSocket::startCapture(const char* path) {
+    if (this->capture)
+        throw std::logic_error("Already capturing");
+    
+    std::unique_ptr<TrafficCapture> capture(new TrafficCapture());
+    capture->open(path);
+    this->capture = std::move(capture);
+}
+
+void ServerSocket::stopCapture() {
+    //Destroying the capture finishes the file
+    this->capture.reset();
+}
+
+void ServerSocket::setTracing(bool enable) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    this->tracing = enable;
+    
+    //Apply the setting to each client already connected. Clients added later get it when they are added
+    for (size_t a = 0; a < this->activeConnections.size(); a++) {
+        if (this->activeConnections[a]) this->setTracingOptions(a);
+    }
+}
+
+const LatencyTrace& ServerSocket::latencyTrace(unsigned int clientIndex) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    //Throw an error if there is no socket at the index
+    if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+        throw std::logic_error("Socket index uninitialized");
+    
+    if (!this->traces[clientIndex])
+        throw std::logic_error("Tracing not on");
+    
+    //Collect any transmit timestamps the kernel has reported since the last send
+    if (!this->sharedMemoryRings[clientIndex]) this->readErrorQueue(clientIndex);
+    
+    return this->traces[clientIndex]->trace;
+}
+
+void ServerSocket::subscribe(std::string_view topic, unsigned int clientIndex) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    if (topic.empty())
+        throw std::logic_error("No topic");
+    
+    //Throw an error if there is no socket at the index
+    if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+        throw std::logic_error("Socket index uninitialized");
+    
+    //Find the topic, or give it the next ID if it is new
+    std::map<std::string, unsigned int, std::less<>>::iterator found = this->topicIDs.find(topic);
+    if (found == this->topicIDs.end()) {
+        found = this->topicIDs.emplace(std::string(topic), (unsigned int)this->topicSubscribers.size()).first;
+        this->topicSubscribers.push_back(std::vector<unsigned int>());
+    }
+    unsigned int topicID = found->second;
+    
+    //Subscribers are kept sorted, so a client can be found or added without scanning every subscriber
+    std::vector<unsigned int>& subscribers = this->topicSubscribers[topicID];
+    std::vector<unsigned int>::iterator position = std::lower_bound(subscribers.begin(), subscribers.end(), clientIndex);
+    if (position != subscribers.end() && *position == clientIndex) return; //Already subscribed
+    
+    subscribers.insert(position, clientIndex);
+    this->clientTopics[clientIndex].push_back(topicID);
+}
+
+void ServerSocket::unsubscribe(std::string_view topic, unsigned int clientIndex) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    //Throw an error if there is no socket at the index
+    if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+        throw std::logic_error("Socket index uninitialized");
+    
+    std::map<std::string, unsigned int, std::less<>>::iterator found = this->topicIDs.find(topic);
+    if (found == this->topicIDs.end()) return;
+    
+    this->removeSubscriber(found->second, clientIndex);
+    
+    std::vector<unsigned int>& topics = this->clientTopics[clientIndex];
+    std::vector<unsigned int>::iterator position = std::find(topics.begin(), topics.end(), found->second);
+    if (position != topics.end()) topics.erase(position);
+}
+
+unsigned int ServerSocket::publish(std::string_view topic, std::string_view message, bool ensureFullStringSent) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    std::map<std::string, unsigned int, std::less<>>::const_iterator found = this->topicIDs.find(topic);
+    if (found == this->topicIDs.end()) return 0;
+    
+    //Only the subscribers are visited, however many clients there are
+    const std::vector<unsigned int>& subscribers = this->topicSubscribers[found->second];
+    for (size_t a = 0; a < subscribers.size(); a++) {
+        this->sendBytes(message.data(), message.size(), subscribers[a], ensureFullStringSent);
+    }
+    return subscribers.size();
+}
+
+unsigned int ServerSocket::publish(std::string_view topic, std::shared_ptr<const std::string> message, bool ensureFullStringSent) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    std::map<std::string, unsigned int, std::less<>>::const_iterator found = this->topicIDs.find(topic);
+    if (found == this->topicIDs.end()) return 0;
+    
+    //Every subscriber is sent from the same memory, without a copy if zero-copy sending is on
+    const std::vector<unsigned int>& subscribers = this->topicSubscribers[found->second];
+    for (size_t a = 0; a < subscribers.size(); a++) {
+        this->sendZeroCopy(message, subscribers[a], ensureFullStringSent);
+    }
+    return subscribers.size();
+}
+
+unsigned int ServerSocket::numberOfSubscribers(std::string_view topic) const {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    std::map<std::string, unsigned int, std::less<>>::const_iterator found = this->topicIDs.find(topic);
+    return found == this->topicIDs.end() ? 0 : this->topicSubscribers[found->second].size();
+}
+
+void ServerSocket::post(std::string message, unsigned int clientIndex) {
+    PostedMessage posted;
+    posted.clientIndex = clientIndex;
+    posted.broadcast = false;
+    posted.message = std::make_shared<const std::string>(std::move(message));
+    this->pushPosted(std::move(posted));
+}
+
+void ServerSocket::postBroadcast(std::string message) {
+    PostedMessage posted;
+    posted.clientIndex = 0;
+    posted.broadcast = true;
+    posted.message = std::make_shared<const std::string>(std::move(message));
+    this->pushPosted(std::move(posted));
+}
+
+void ServerSocket::postPublish(std::string topic, std::string message) {
+    PostedMessage posted;
+    posted.clientIndex = 0;
+    posted.broadcast = false;
+    posted.topic = std::move(topic);
+    posted.message = std::make_shared<const std::string>(std::move(message));
+    this->pushPosted(std::move(posted));
+}
+
+unsigned long ServerSocket::flushPosted() {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    //Clear the signal before taking messages off the queue. A post that lands after this signals again, so it is never missed
+    char signal[64];
+    while (read(this->postNotifyFD, signal, sizeof(signal)) > 0) {}
+    this->pendingPosts.store(0, std::memory_order_release);
+    
+    //Move posted messages to the queue of each client they are for
+    PostedMessage posted;
+    while (this->postedMessages.pop(posted)) {
+        this->postedMemory.fetch_sub(posted.message->size(), std::memory_order_relaxed);
+        
+        //A blank message won't be sent
+        if (posted.message->empty()) continue;
+        
+        if (!posted.topic.empty()) {
+            //Every subscriber shares the one copy of the message
+            std::map<std::string, unsigned int, std::less<>>::const_iterator topic = this->topicIDs.find(posted.topic);
+            if (topic == this->topicIDs.end()) continue;
+            
+            const std::vector<unsigned int>& subscribers = this->topicSubscribers[topic->second];
+            for (size_t a = 0; a < subscribers.size(); a++) {
+                this->enqueue(subscribers[a], posted.message);
+            }
+        } else if (posted.broadcast) {
+            for (size_t a = 0; a < this->activeConnections.size(); a++) {
+                if (this->activeConnections[a]) this->enqueue(a, posted.message);
+            }
+        } else if (posted.clientIndex < this->activeConnections.size() && this->activeConnections[posted.clientIndex]) {
+            this->enqueue(posted.clientIndex, posted.message);
         }
     }
+    
+    //Send as much as each client can take
+    for (size_t a = 0; a < this->activeConnections.size(); a++) {
+        if (!this->outboundQueues[a].empty()) this->writeQueued(a);
+    }
+    
+    //What clients could not take stays in memory, so check it against the budget
+    this->shedMemory();
+    
+    //Count what is left
+    unsigned long remaining = 0;
+    for (size_t a = 0; a < this->activeConnections.size(); a++) {
+        if (this->outboundQueues[a].empty()) continue;
+        remaining += this->queuedBytes[a] - this->outboundOffsets[a];
+    }
+    return remaining;
+}
+
+int ServerSocket::postedFD() const {
+    return this->setUp ? this->postNotifyFD : -1;
+}
+
+int ServerSocket::clientFD(unsigned int clientIndex) const {
+    if (!this->setUp || clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex] || this->sharedMemoryRings[clientIndex])
+        return -1;
+    return this->clientSocketsFD[clientIndex];
+}
+
+void ServerSocket::setMemoryBudget(unsigned long bytes, MemoryPolicy policy) {
+    this->memoryBudget = bytes;
+    this->memoryPolicy = policy;
+}
+
+unsigned long ServerSocket::memoryInUse() const {
+    return this->receiveMemory + this->queuedMemory + this->postedMemory.load(std::memory_order_relaxed);
+}
+
+bool ServerSocket::isOverBudget() const {
+    return this->memoryBudget > 0 && this->memoryInUse() > this->memoryBudget;
 }
 
 std::string ServerSocket::receive(unsigned int clientIndex, bool* socketClosed) {
@@ -218,52 +690,196 @@ std::string ServerSocket::receive(unsigned int clientIndex, bool* socketClosed)
     if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
         throw std::logic_error("Socket index uninitialized");
     
-    //Initialize the buffer where received info is stored
-    bzero(this->buffer, BUFFER_SIZE);
+    ReceiveBuffer& buffer = this->receiveBuffers[clientIndex];
+    std::string str;
     
-    long messageSize; //Stores the return value from the calls to read() and write() by holding the number of characters either read or written
+    //Keep reading while more of the message is already waiting
+    while (true) {
+        //Over the memory budget, reading is paused: the buffer doesn't grow, and nothing more is read than one buffer's worth
+        bool paused = this->memoryPolicy == PauseReading && this->isOverBudget();
+        
+        long messageSize; //Stores the return value from the calls to read() and write() by holding the number of characters either read or written
+        
+        /* read()
+         The read() function will read in info from the client socket, with three arguments. It will block the thread until the client writes and there is something to read in.
+         
+         The first argument is the reference for the client's socket.
+         
+         The second argument is the buffer to store the message.
+         
+         The third argument is the maximum number of characters to to be read into the buffer.
+         */
+        if (this->sharedMemoryRings[clientIndex]) {
+            buffer.reserve(paused ? 0 : this->sharedMemoryRings[clientIndex]->available());
+            messageSize = this->sharedMemoryRings[clientIndex]->read(buffer.data(), buffer.size(), str.empty() ? this->timeoutMilliseconds : 0);
+        } else {
+            //Size the buffer by what the kernel already has, so a large message takes a few large reads
+            int waiting = 0;
+            if (ioctl(this->clientSocketsFD[clientIndex], FIONREAD, &waiting) < 0) waiting = 0;
+            buffer.reserve(paused ? 0 : waiting);
+            messageSize = this->readSocket(clientIndex, buffer.data(), buffer.size());
+        }
+        
+        //Checks for errors reading from the socket
+        if (messageSize < 0)
+            throw std::runtime_error(strcat((char *)"ERROR reading from socket: ", strerror(errno)));
+        
+        //A blank message indicates that the socket has closed from the client side. If this is the case, close the connection. There is nothing more to read either way.
+        if (messageSize == 0) {
+            if (str.empty() && socketClosed != nullptr) {
+                *socketClosed = true;
+                this->closeConnection(clientIndex);
+            }
+            return str;
+        }
+        
+        this->lastSeenTimes[clientIndex] = std::chrono::steady_clock::now();
+        if (this->capture) this->capture->append(clientIndex, TrafficCapture::Received, buffer.data(), messageSize);
+        
+        str.append(buffer.data(), messageSize);
+        buffer.used(messageSize); //Only once the bytes are copied out, since it may replace the memory
+        if (paused) return str;
+        
+        //A shared memory client never has to wait for the rest of a message to arrive over the network, so only read on if more is already there
+        if (this->sharedMemoryRings[clientIndex]) {
+            if (this->sharedMemoryRings[clientIndex]->available() == 0) return str;
+            continue;
+        }
+        
+        //Check if there is more data waiting to be read, and if so, read it. poll() is used rather than select(), which also reports a socket as readable when only notifications, like finished zero-copy sends, are waiting
+        pollfd pollInfo;
+        pollInfo.fd = this->clientSocketsFD[clientIndex];
+        pollInfo.events = POLLIN;
+        pollInfo.revents = 0;
+        
+        int returnValue = poll(&pollInfo, 1, 20);
+        if (returnValue < 0) {
+            throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
+        } else if (returnValue == 0 || (pollInfo.revents & (POLLIN | POLLHUP)) == 0) {
+            return str;
+        }
+    }
+}
+
+bool ServerSocket::receive(char* buffer, unsigned long length, unsigned int clientIndex, bool* socketClosed) {
+    return this->receiveBytes(buffer, length, clientIndex, socketClosed);
+}
+
+bool ServerSocket::receiveRecord(std::string_view& record, unsigned int clientIndex, char delimiter, bool* socketClosed) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
     
-    /* read()
-     The read() function will read in info from the client socket, with three arguments. It will block the thread until the client writes and there is something to read in.
-     
-     The first argument is the reference for the client's socket.
-     
-     The second argument is the buffer to store the message.
-     
-     The third argument is the maximum number of characters to to be read into the buffer.
-     */
-    messageSize = read(this->clientSocketsFD[clientIndex], this->buffer, BUFFER_SIZE);
+    //Throw an error if there is no socket at the index from which to receive
+    if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+        throw std::logic_error("Socket index uninitialized");
     
-    //Checks for errors reading from the socket
-    if (messageSize < 0)
-        throw std::runtime_error(strcat((char *)"ERROR reading from socket: ", strerror(errno)));
+    RecordBuffer& buffer = this->recordBuffers[clientIndex];
     
-    //A blank message indicates that the socket has closed from the client side. If this is the case, close the connection.
-    if (socketClosed != nullptr && messageSize == 0) {
-        *socketClosed = true;
-        this->closeConnection(clientIndex);
+    //Only read when no whole record is left over from the last read
+    while (!buffer.next(record, delimiter)) {
+        size_t length;
+        char* space = buffer.space(length);
+        
+        long messageSize;
+        if (this->sharedMemoryRings[clientIndex]) {
+            messageSize = this->sharedMemoryRings[clientIndex]->read(space, length, this->timeoutMilliseconds);
+        } else {
+            messageSize = this->readSocket(clientIndex, space, length);
+        }
+        
+        if (messageSize < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("ERROR reading from socket: ") + std::string(strerror(errno)));
+        }
+        
+        //The stream ended. A last record without a delimiter is still a record
+        if (messageSize == 0) {
+            if (buffer.rest(record)) return true;
+            if (socketClosed != nullptr) {
+                *socketClosed = true;
+                this->closeConnection(clientIndex);
+            }
+            return false;
+        }
+        
+        this->lastSeenTimes[clientIndex] = std::chrono::steady_clock::now();
+        if (this->capture) this->capture->append(clientIndex, TrafficCapture::Received, space, messageSize);
+        buffer.added(messageSize);
     }
+    return true;
+}
+
+unsigned long ServerSocket::receiveStream(const std::function<void(const char*, unsigned long)>& sink, unsigned long length, unsigned int clientIndex, bool* socketClosed) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
     
-    std::string str = std::string(buffer, messageSize);
+    //Throw an error if there is no socket at the index from which to receive
+    if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+        throw std::logic_error("Socket index uninitialized");
     
-    //Check if there is more data waiting to be read, and if so, read it
-    fd_set readfds;
-    FD_ZERO(&readfds);
-    FD_SET(this->hostSocket, &readfds);
-    int n = this->hostSocket + 1;
+    ReceiveBuffer& buffer = this->receiveBuffers[clientIndex];
+    unsigned long received = 0;
     
-    struct timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 20000;
+    while (received < length) {
+        //Size the buffer by what is waiting, but never read past the end of the stream, so what follows it is left for the next receive
+        unsigned long waiting = 0;
+        if (this->sharedMemoryRings[clientIndex]) {
+            waiting = this->sharedMemoryRings[clientIndex]->available();
+        } else {
+            int available = 0;
+            if (ioctl(this->clientSocketsFD[clientIndex], FIONREAD, &available) == 0) waiting = available;
+        }
+        buffer.reserve(std::min(waiting, length - received));
+        unsigned long chunkSize = std::min((unsigned long)buffer.size(), length - received);
+        
+        long messageSize;
+        if (this->sharedMemoryRings[clientIndex]) {
+            messageSize = this->sharedMemoryRings[clientIndex]->read(buffer.data(), chunkSize, this->timeoutMilliseconds);
+        } else {
+            messageSize = this->readSocket(clientIndex, buffer.data(), chunkSize);
+        }
+        
+        if (messageSize < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("ERROR reading from socket: ") + std::string(strerror(errno)));
+        }
+        
+        //The client disconnected, which is the end of a stream of unknown length
+        if (messageSize == 0) {
+            if (socketClosed != nullptr) {
+                *socketClosed = true;
+                this->closeConnection(clientIndex);
+            }
+            break;
+        }
+        
+        this->lastSeenTimes[clientIndex] = std::chrono::steady_clock::now();
+        if (this->capture) this->capture->append(clientIndex, TrafficCapture::Received, buffer.data(), messageSize);
+        
+        sink(buffer.data(), messageSize);
+        buffer.used(messageSize);
+        received += messageSize;
+    }
     
-    int returnValue = select(n, &readfds, NULL, NULL, &timeout);
-    if (returnValue < 0) {
-        throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
-    } else if (returnValue > 0) {
-        str += this->receive(clientIndex);
+    return received;
+}
+
+unsigned long ServerSocket::sendStream(const std::function<unsigned long(char*, unsigned long)>& source, unsigned int clientIndex) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    //One chunk is reused for the whole stream
+    std::unique_ptr<char[]> chunk(new char[STREAM_CHUNK_SIZE]);
+    unsigned long sent = 0;
+    
+    while (true) {
+        unsigned long chunkSize = std::min(source(chunk.get(), STREAM_CHUNK_SIZE), (unsigned long)STREAM_CHUNK_SIZE);
+        if (chunkSize == 0) break;
+        
+        sent += this->sendBytes(chunk.get(), chunkSize, clientIndex, true);
     }
     
-    return str;
+    return sent;
 }
 
 bool ServerSocket::receivedFromAll(const char* messageToCompare) {
@@ -284,6 +900,8 @@ void ServerSocket::setTimeout(unsigned int seconds, unsigned int milliseconds) {
     if (!this->setUp)
         throw std::logic_error("Socket not set");
     
+    this->timeoutMilliseconds = (seconds > 0 || milliseconds > 0) ? (seconds * 1000) + milliseconds : -1;
+    
 #if defined(_WIN32)
     DWORD timeout = (seconds * 1000) + milliseconds;
     for (int a = 0; a < this->activeConnections.size(); a++) {
@@ -313,6 +931,8 @@ void ServerSocket::setHostTimeout(unsigned int seconds, unsigned int millisecond
     if (!this->setUp)
         throw std::logic_error("Socket not set");
     
+    this->hostTimeoutMilliseconds = (seconds > 0 || milliseconds > 0) ? (seconds * 1000) + milliseconds : -1;
+    
 #if defined(_WIN32)
     DWORD timeout = (seconds * 1000) + milliseconds;
     setsockopt(this->hostSocketFD, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
@@ -324,6 +944,248 @@ void ServerSocket::setHostTimeout(unsigned int seconds, unsigned int millisecond
 #endif
 }
 
+void ServerSocket::setHeartbeat(unsigned int idleSeconds, unsigned int intervalSeconds, unsigned int missedHeartbeats) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    this->heartbeatIdle = idleSeconds;
+    this->heartbeatInterval = intervalSeconds > 0 ? intervalSeconds : 1;
+    this->heartbeatCount = missedHeartbeats > 0 ? missedHeartbeats : 1;
+    
+    //Apply the settings to each client already connected. Clients added later get them when they are accepted
+    for (size_t a = 0; a < this->activeConnections.size(); a++) {
+        if (this->activeConnections[a]) this->setHeartbeatOptions(this->clientSocketsFD[a]);
+    }
+}
+
+std::chrono::steady_clock::time_point ServerSocket::lastSeen(unsigned int clientIndex) const {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    //Throw an error if there is no socket at the index
+    if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+        throw std::logic_error("Socket index uninitialized");
+    
+    std::chrono::steady_clock::time_point seen = this->lastSeenTimes[clientIndex];
+    
+    if (this->sharedMemoryRings[clientIndex]) return seen;
+    
+#if defined(__linux__)
+    //The kernel knows when the client last acknowledged anything, which includes heartbeats answered without waking either program
+    tcp_info info;
+    socklen_t infoSize = sizeof(info);
+    if (getsockopt(this->clientSocketsFD[clientIndex], IPPROTO_TCP, TCP_INFO, &info, &infoSize) == 0) {
+        std::chrono::steady_clock::time_point acknowledged = std::chrono::steady_clock::now() - std::chrono::milliseconds(info.tcpi_last_ack_recv);
+        if (acknowledged > seen) seen = acknowledged;
+    }
+#endif
+    
+    return seen;
+}
+
+bool ServerSocket::isAlive(unsigned int clientIndex) const {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    //Throw an error if there is no socket at the index
+    if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+        throw std::logic_error("Socket index uninitialized");
+    
+    //A shared memory client is dead once it closed or its process exited, and everything it sent has been read
+    if (this->sharedMemoryRings[clientIndex])
+        return !this->sharedMemoryRings[clientIndex]->peerClosed() || this->sharedMemoryRings[clientIndex]->available() > 0;
+    
+    int socketFD = this->clientSocketsFD[clientIndex];
+    
+    //A pending error means the connection was reset or that heartbeats or data went unanswered
+    int error = 0;
+    socklen_t errorSize = sizeof(error);
+    if (getsockopt(socketFD, SOL_SOCKET, SO_ERROR, &error, &errorSize) < 0 || error != 0)
+        return false;
+    
+    pollfd pollInfo;
+    pollInfo.fd = socketFD;
+    pollInfo.events = POLLIN;
+#if defined(POLLRDHUP)
+    pollInfo.events |= POLLRDHUP;
+#endif
+    pollInfo.revents = 0;
+    
+    //Check the state of the socket without waiting
+    if (poll(&pollInfo, 1, 0) < 0)
+        throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
+    
+    //POLLERR is not checked, since real errors were found above, and it is also raised for notifications like finished zero-copy sends
+    if (pollInfo.revents & (POLLHUP | POLLNVAL))
+        return false;
+    
+    //If the client closed its side, the connection is only dead once everything it sent has been read
+    if (pollInfo.revents & POLLIN) {
+        char byte;
+        if (recv(socketFD, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+            return false;
+    }
+    
+    return true;
+}
+
+unsigned int ServerSocket::closeDeadConnections() {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    unsigned int closed = 0;
+    for (size_t a = 0; a < this->activeConnections.size(); a++) {
+        if (this->activeConnections[a] && !this->isAlive(a)) {
+            this->closeConnection(a);
+            closed++;
+        }
+    }
+    return closed;
+}
+
+bool ServerSocket::drain(unsigned int seconds, unsigned int milliseconds, const std::function<void(unsigned int, const std::string&)>& onMessage) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds) + std::chrono::milliseconds(milliseconds);
+    
+    //Stop accepting new clients. Connections still waiting in the backlog are refused by the kernel, and queued ones are closed since they were never given an index
+    close(this->hostSocketFD);
+    for (size_t a = 0; a < this->overflowQueue.size(); a++) {
+        close(this->overflowQueue[a].socketFD);
+    }
+    this->overflowQueue.clear();
+    
+    //Send everything that was posted before the drain started
+    std::vector<pollfd> pollInfo;
+    while (this->flushPosted() > 0) {
+        long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) break;
+        
+        //Wait for any client with queued messages to have room. Shared memory clients are checked every millisecond instead
+        bool sharedMemoryWaiting = false;
+        pollInfo.clear();
+        for (size_t a = 0; a < this->activeConnections.size(); a++) {
+            if (!this->outboundQueues[a].empty()) {
+                pollfd info;
+                info.fd = this->clientSocketsFD[a];
+                info.events = POLLOUT;
+                info.revents = 0;
+                pollInfo.push_back(info);
+                if (this->sharedMemoryRings[a]) sharedMemoryWaiting = true;
+            }
+        }
+        if (poll(pollInfo.data(), pollInfo.size(), sharedMemoryWaiting && remaining > 1 ? 1 : (int)remaining) < 0 && errno != EINTR)
+            throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
+    }
+    
+    //Half-close every connection. The kernel sends everything already written before the end-of-stream, so nothing in flight is lost
+    std::vector<unsigned int> draining;
+    for (size_t a = 0; a < this->activeConnections.size(); a++) {
+        if (this->activeConnections[a]) {
+            if (this->sharedMemoryRings[a]) {
+                this->sharedMemoryRings[a]->shutdownWrite();
+            } else {
+                shutdown(this->clientSocketsFD[a], SHUT_WR);
+            }
+            draining.push_back(a);
+        }
+    }
+    
+    //Keep reading until each client closes its side. Closing a socket with unread data would reset the connection and discard what has not been delivered yet
+    while (!draining.empty()) {
+        long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) break;
+        
+        //Shared memory clients have no file descriptor to wait on (poll() skips a negative one), so they are checked every millisecond instead
+        bool sharedMemoryDraining = false;
+        pollInfo.clear();
+        for (size_t a = 0; a < draining.size(); a++) {
+            pollfd info;
+            info.fd = this->clientSocketsFD[draining[a]];
+            info.events = POLLIN;
+            info.revents = 0;
+            pollInfo.push_back(info);
+            if (this->sharedMemoryRings[draining[a]]) sharedMemoryDraining = true;
+        }
+        
+        int returnValue = poll(pollInfo.data(), pollInfo.size(), sharedMemoryDraining && remaining > 1 ? 1 : (int)remaining);
+        if (returnValue < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("ERROR finding information about socket: ") + std::string(strerror(errno)));
+        }
+        
+        //Go backwards so finished clients can be removed while iterating
+        for (int a = (int)pollInfo.size() - 1; a >= 0; a--) {
+            unsigned int clientIndex = draining[a];
+            long messageSize;
+            
+            if (this->sharedMemoryRings[clientIndex]) {
+                messageSize = this->sharedMemoryRings[clientIndex]->read(this->buffer.get(), BUFFER_SIZE, 0);
+                if (messageSize < 0) continue; //Nothing to read yet
+            } else {
+                //POLLERR alone can be a notification like a finished zero-copy send, which is not a reason to read
+                if (pollInfo[a].revents & POLLERR) this->readErrorQueue(clientIndex);
+                if ((pollInfo[a].revents & (POLLIN | POLLHUP)) == 0) continue;
+                messageSize = this->readSocket(clientIndex, this->buffer.get(), BUFFER_SIZE);
+            }
+            
+            if (messageSize > 0) {
+                this->lastSeenTimes[clientIndex] = std::chrono::steady_clock::now();
+                if (this->capture) this->capture->append(clientIndex, TrafficCapture::Received, this->buffer.get(), messageSize);
+                if (onMessage) onMessage(clientIndex, std::string(this->buffer.get(), messageSize));
+            } else {
+                //The client finished (or the connection failed), so it is done draining
+                this->closeConnection(clientIndex);
+                draining.erase(draining.begin() + a);
+            }
+        }
+    }
+    
+    bool finished = draining.empty();
+    
+    //Cut off any clients that did not finish in time
+    for (size_t a = 0; a < draining.size(); a++) {
+        this->closeConnection(draining[a]);
+    }
+    
+    //Closed connections the kernel is still sending to hold their memory until it is done. Anything left at the deadline is freed by a later releaseZeroCopyBuffers(), or the destructor
+    this->releaseRetiredZeroCopy();
+    while (!this->retiredZeroCopy.empty() && std::chrono::steady_clock::now() < deadline) {
+        poll(nullptr, 0, 1); //A shut down socket always polls as hung up, so the error queues are checked every millisecond instead
+        this->releaseRetiredZeroCopy();
+    }
+    
+    //Return to an unset state so the socket can be set again
+    this->activeConnections.clear();
+    this->clientSocketsFD.clear();
+    this->clientAddresses.clear();
+    this->clientAddressSizes.clear();
+    this->lastSeenTimes.clear();
+    this->sharedMemoryRings.clear();
+    this->outboundQueues.clear();
+    this->outboundOffsets.clear();
+    this->zeroCopyClients.clear();
+    this->zeroCopyNextIDs.clear();
+    this->zeroCopyPending.clear();
+    this->clientTopics.clear();
+    this->traces.clear();
+    this->receiveBuffers.clear();
+    this->recordBuffers.clear();
+    this->receiveMemory = 0;
+    this->queuedBytes.clear();
+    this->queuedMemory = 0;
+    this->topicIDs.clear();
+    this->topicSubscribers.clear();
+    close(this->postNotifyFD);
+    if (this->postNotifyWriteFD != this->postNotifyFD) close(this->postNotifyWriteFD);
+    this->postNotifyFD = -1;
+    this->postNotifyWriteFD = -1;
+    this->setUp = false;
+    
+    return finished;
+}
+
 unsigned int ServerSocket::numberOfClients() const {
     if (!this->setUp)
         throw std::logic_error("Socket not set");
@@ -354,6 +1216,597 @@ int ServerSocket::getNextAvailableIndex() const {
     return -1;
 }
 
+int ServerSocket::reserveIndex() {
+    int clientIndex = this->getNextAvailableIndex();
+    if (clientIndex == -1 && this->overflowPolicy == Grow) {
+        this->addSlot();
+        clientIndex = (int)this->activeConnections.size() - 1;
+    }
+    return clientIndex;
+}
+
+void ServerSocket::addSlot() {
+    this->activeConnections.push_back(false); //All connections initially inactive
+    this->clientSocketsFD.push_back(0); //No socket file descriptors set
+    this->clientAddresses.push_back(sockaddr_storage()); //All addresses set as empty structs
+    this->clientAddressSizes.push_back(socklen_t()); //All address sizes set as empty sizes
+    this->lastSeenTimes.push_back(std::chrono::steady_clock::time_point()); //No clients seen yet
+    this->sharedMemoryRings.push_back(nullptr); //No shared memory connections
+    this->outboundQueues.push_back(std::deque<std::shared_ptr<const std::string>>()); //Nothing posted yet
+    this->outboundOffsets.push_back(0);
+    this->zeroCopyClients.push_back(false); //Zero-copy sending is off until setZeroCopy()
+    this->zeroCopyNextIDs.push_back(0);
+    this->zeroCopyPending.push_back(std::deque<ZeroCopyBuffer>());
+    this->clientTopics.push_back(std::vector<unsigned int>()); //No subscriptions
+    this->traces.push_back(nullptr); //Nothing traced until setTracing()
+    this->receiveBuffers.push_back(ReceiveBuffer()); //Allocated by the first receive()
+    this->receiveBuffers.back().setAccount(&this->receiveMemory);
+    this->recordBuffers.push_back(RecordBuffer()); //Holds nothing until the first receiveRecord()
+    this->recordBuffers.back().setAccount(&this->receiveMemory);
+    this->queuedBytes.push_back(0);
+}
+
+int ServerSocket::acceptSocket(sockaddr_storage& address, socklen_t& addressSize) {
+    addressSize = sizeof(sockaddr_storage);
+#if defined(__linux__)
+    //accept4() marks the socket close-on-exec in the same call. The client socket stays blocking, since receive() and fully sent messages wait on it
+    return accept4(this->hostSocketFD, (struct sockaddr *)&address, &addressSize, SOCK_CLOEXEC);
+#else
+    int socketFD = accept(this->hostSocketFD, (struct sockaddr *)&address, &addressSize);
+    if (socketFD >= 0) {
+        fcntl(socketFD, F_SETFD, FD_CLOEXEC);
+        fcntl(socketFD, F_SETFL, fcntl(socketFD, F_GETFL) & ~O_NONBLOCK); //Some systems pass O_NONBLOCK on from the host socket
+    }
+    return socketFD;
+#endif
+}
+
+int ServerSocket::placeClient(int socketFD, const sockaddr_storage& address, socklen_t addressSize) {
+    int clientIndex = this->reserveIndex();
+    
+    if (clientIndex == -1) {
+        if (this->overflowPolicy == Queue && this->overflowQueue.size() < (size_t)this->backlog) {
+            this->overflowQueue.push_back(QueuedClient{socketFD, address, addressSize});
+        } else {
+            close(socketFD); //The client sees the connection close at once, rather than waiting for the backlog
+        }
+        return -1;
+    }
+    
+    this->activateClient(clientIndex, socketFD, address, addressSize);
+    return clientIndex;
+}
+
+int ServerSocket::promoteQueuedClient() {
+    if (this->overflowQueue.empty()) return -1;
+    
+    int clientIndex = this->reserveIndex();
+    if (clientIndex == -1) return -1;
+    
+    QueuedClient queued = this->overflowQueue.front();
+    this->overflowQueue.pop_front();
+    this->activateClient(clientIndex, queued.socketFD, queued.address, queued.addressSize);
+    return clientIndex;
+}
+
+void ServerSocket::activateClient(unsigned int clientIndex, int socketFD, const sockaddr_storage& address, socklen_t addressSize) {
+    this->clientSocketsFD[clientIndex] = socketFD;
+    this->clientAddresses[clientIndex] = address;
+    this->clientAddressSizes[clientIndex] = addressSize;
+    
+    this->setHeartbeatOptions(socketFD);
+    this->setZeroCopyOptions(clientIndex);
+    this->setTracingOptions(clientIndex);
+    this->lastSeenTimes[clientIndex] = std::chrono::steady_clock::now();
+    
+    this->activeConnections[clientIndex] = true;
+    if (this->capture) this->capture->append(clientIndex, TrafficCapture::Opened, nullptr, 0);
+    SOCKS_PROBE2(accept, clientIndex, socketFD);
+}
+
+void ServerSocket::setHeartbeatOptions(int socketFD) const {
+    int enable = this->heartbeatIdle > 0 ? 1 : 0;
+    setsockopt(socketFD, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(int));
+    
+#if defined(TCP_USER_TIMEOUT)
+    //Sent data that goes unacknowledged for as long as the heartbeats would is also treated as a dead connection. 0 restores the system default
+    unsigned int userTimeout = enable ? (this->heartbeatIdle + this->heartbeatInterval * this->heartbeatCount) * 1000 : 0;
+    setsockopt(socketFD, IPPROTO_TCP, TCP_USER_TIMEOUT, &userTimeout, sizeof(userTimeout));
+#endif
+    
+    if (!enable) return;
+    
+    int idle = this->heartbeatIdle;
+    int interval = this->heartbeatInterval;
+    int count = this->heartbeatCount;
+    
+#if defined(TCP_KEEPIDLE)
+    setsockopt(socketFD, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(int));
+#elif defined(TCP_KEEPALIVE)
+    setsockopt(socketFD, IPPROTO_TCP, TCP_KEEPALIVE, &idle, sizeof(int)); //macOS name for TCP_KEEPIDLE
+#endif
+#if defined(TCP_KEEPINTVL)
+    setsockopt(socketFD, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(int));
+#endif
+#if defined(TCP_KEEPCNT)
+    setsockopt(socketFD, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(int));
+#endif
+}
+
+bool ServerSocket::writeQueued(unsigned int clientIndex) {
+    std::deque<std::shared_ptr<const std::string>>& queue = this->outboundQueues[clientIndex];
+    
+    while (!queue.empty()) {
+        long sentSize;
+        
+        if (this->sharedMemoryRings[clientIndex]) {
+            const std::string& message = *queue.front();
+            sentSize = this->sharedMemoryRings[clientIndex]->write(message.data() + this->outboundOffsets[clientIndex], message.size() - this->outboundOffsets[clientIndex], false);
+        } else if (this->zeroCopyClients[clientIndex] && queue.front()->size() >= this->zeroCopyThreshold) {
+            //Large messages go out on their own, straight from their memory
+            this->readErrorQueue(clientIndex);
+            sentSize = this->writeZeroCopy(queue.front(), this->outboundOffsets[clientIndex], clientIndex, MSG_DONTWAIT);
+            if (sentSize < 0 && errno == ENOBUFS) return false; //Too much memory pinned. Try again once earlier sends finish
+        } else {
+            //Hand the kernel several queued messages with one call
+            iovec pieces[16];
+            int numberOfPieces = 0;
+            unsigned long requested = 0;
+            for (size_t a = 0; a < queue.size() && numberOfPieces < 16; a++) {
+                size_t offset = a == 0 ? this->outboundOffsets[clientIndex] : 0;
+                pieces[numberOfPieces].iov_base = (void*)(queue[a]->data() + offset);
+                pieces[numberOfPieces].iov_len = queue[a]->size() - offset;
+                requested += pieces[numberOfPieces].iov_len;
+                numberOfPieces++;
+            }
+            
+            msghdr message;
+            memset(&message, 0, sizeof(message));
+            message.msg_iov = pieces;
+            message.msg_iovlen = numberOfPieces;
+            
+            //MSG_DONTWAIT keeps one slow client from holding up the rest
+            uint64_t sendTime = this->tracedSendTime(clientIndex);
+            sentSize = sendmsg(this->clientSocketsFD[clientIndex], &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sentSize > 0) this->traceSend(clientIndex, sentSize, sendTime);
+            this->probeWrite(clientIndex, requested, sentSize);
+        }
+        
+        if (sentSize < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return false;
+            
+            //The connection failed. isAlive() reports it, and nothing more can be sent
+            queue.clear();
+            this->outboundOffsets[clientIndex] = 0;
+            this->queuedMemory -= this->queuedBytes[clientIndex];
+            this->queuedBytes[clientIndex] = 0;
+            return true;
+        }
+        
+        if (sentSize == 0) return false;
+        
+        //Remove the messages that were sent completely, and remember how far into the next one the kernel got
+        unsigned long sent = sentSize;
+        while (sent > 0) {
+            unsigned long remaining = queue.front()->size() - this->outboundOffsets[clientIndex];
+            if (this->capture) this->capture->append(clientIndex, TrafficCapture::Sent, queue.front()->data() + this->outboundOffsets[clientIndex], std::min(sent, remaining));
+            if (sent >= remaining) {
+                sent -= remaining;
+                this->dequeue(clientIndex);
+                this->outboundOffsets[clientIndex] = 0;
+            } else {
+                this->outboundOffsets[clientIndex] += sent;
+                sent = 0;
+            }
+        }
+    }
+    return true;
+}
+
+unsigned long ServerSocket::sendBytes(const char* data, unsigned long length, unsigned int clientIndex, bool ensureFullStringSent) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    //A blank message won't be sent
+    if (length == 0)
+        throw std::logic_error("No message to send");
+    
+    //Throw an error if there is no socket at the index
+    if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+        throw std::logic_error("Socket index uninitialized");
+    
+    unsigned long sent = 0;
+    
+    //Write from where the last write stopped, instead of copying what is left and starting again
+    while (sent < length) {
+        long sentSize;
+        if (this->sharedMemoryRings[clientIndex]) {
+            sentSize = this->sharedMemoryRings[clientIndex]->write(data + sent, length - sent, ensureFullStringSent);
+        } else {
+            uint64_t sendTime = this->tracedSendTime(clientIndex);
+            sentSize = write(this->clientSocketsFD[clientIndex], data + sent, length - sent);
+            if (sentSize > 0) this->traceSend(clientIndex, sentSize, sendTime);
+            this->probeWrite(clientIndex, length - sent, sentSize);
+        }
+        
+        if (sentSize < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("ERROR sending message: ") + std::string(strerror(errno)));
+        }
+        
+        if (this->capture && sentSize > 0) this->capture->append(clientIndex, TrafficCapture::Sent, data + sent, sentSize);
+        sent += sentSize;
+        
+        //Unless the full message must be sent, stop after one write and let the caller deal with the rest
+        if (!ensureFullStringSent || sentSize == 0) break;
+    }
+    return sent;
+}
+
+bool ServerSocket::receiveBytes(char* data, unsigned long length, unsigned int clientIndex, bool* socketClosed) {
+    if (!this->setUp)
+        throw std::logic_error("Socket not set");
+    
+    //Throw an error if there is no socket at the index from which to receive
+    if (clientIndex >= this->activeConnections.size() || !this->activeConnections[clientIndex])
+        throw std::logic_error("Socket index uninitialized");
+    
+    //Keep reading until the whole length has arrived, since it may come in pieces
+    unsigned long received = 0;
+    while (received < length) {
+        long messageSize;
+        if (this->sharedMemoryRings[clientIndex]) {
+            messageSize = this->sharedMemoryRings[clientIndex]->read(data + received, length - received, this->timeoutMilliseconds);
+        } else {
+            messageSize = this->readSocket(clientIndex, data + received, length - received);
+        }
+        
+        if (messageSize < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("ERROR reading from socket: ") + std::string(strerror(errno)));
+        }
+        
+        //The client disconnected before the whole length arrived
+        if (messageSize == 0) {
+            if (socketClosed != nullptr) {
+                *socketClosed = true;
+                this->closeConnection(clientIndex);
+            }
+            return false;
+        }
+        
+        if (this->capture) this->capture->append(clientIndex, TrafficCapture::Received, data + received, messageSize);
+        received += messageSize;
+    }
+    
+    this->lastSeenTimes[clientIndex] = std::chrono::steady_clock::now();
+    return true;
+}
+
+void ServerSocket::setZeroCopyOptions(unsigned int clientIndex) {
+    //Shared memory clients are never copied through the kernel anyway
+    if (this->sharedMemoryRings[clientIndex]) return;
+    
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+    //Once turned on, SO_ZEROCOPY is left on. It has no effect on sends without MSG_ZEROCOPY
+    if (this->zeroCopy && !this->zeroCopyClients[clientIndex]) {
+        int enable = 1;
+        this->zeroCopyClients[clientIndex] = setsockopt(this->clientSocketsFD[clientIndex], SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(int)) == 0;
+        return;
+    }
+#endif
+    
+    //With it off, pending zero-copy memory is still released as the kernel finishes with it
+    if (!this->zeroCopy) this->zeroCopyClients[clientIndex] = false;
+}
+
+void ServerSocket::setTracingOptions(unsigned int clientIndex) {
+    if (!this->tracing) {
+#if defined(SO_TIMESTAMPING)
+        if (this->traces[clientIndex] && this->traces[clientIndex]->timestamps) {
+            int flags = 0;
+            setsockopt(this->clientSocketsFD[clientIndex], SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+        }
+#endif
+        this->traces[clientIndex].reset();
+        return;
+    }
+    
+    if (this->traces[clientIndex]) return;
+    this->traces[clientIndex].reset(new TracedConnection());
+    
+    //Shared memory clients have no kernel in the way to timestamp
+    if (this->sharedMemoryRings[clientIndex]) return;
+    
+#if defined(SO_TIMESTAMPING)
+    /* SO_TIMESTAMPING
+     The kernel timestamps data as it arrives and as it is handed to the network device, in software, so no hardware support is needed. OPT_ID numbers transmit timestamps by byte, so they can be matched to sends, and OPT_TSONLY leaves the sent data itself off the error queue.
+     */
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    this->traces[clientIndex]->timestamps = setsockopt(this->clientSocketsFD[clientIndex], SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+#endif
+}
+
+long ServerSocket::readSocket(unsigned int clientIndex, char* data, unsigned long length) {
+    long messageSize;
+    
+#if defined(SO_TIMESTAMPING)
+    TracedConnection* traced = this->traces[clientIndex].get();
+    if (traced != nullptr && traced->timestamps) {
+        iovec piece;
+        piece.iov_base = data;
+        piece.iov_len = length;
+        
+        char control[256];
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &piece;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        
+        messageSize = recvmsg(this->clientSocketsFD[clientIndex], &message, 0);
+        
+        //The kernel's receive time comes with the data. Subtracting it from now is the time the data sat in the kernel before this read
+        if (messageSize > 0) {
+            for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+                if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_TIMESTAMPING) continue;
+                
+                scm_timestamping* stamps = (scm_timestamping*)CMSG_DATA(header);
+                uint64_t received = (uint64_t)stamps->ts[0].tv_sec * 1000000000 + stamps->ts[0].tv_nsec;
+                uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                if (received != 0 && now > received) traced->trace.receiveQueue.record(now - received);
+            }
+        }
+    } else {
+        messageSize = read(this->clientSocketsFD[clientIndex], data, length);
+    }
+#else
+    messageSize = read(this->clientSocketsFD[clientIndex], data, length);
+#endif
+    
+    //A read that fails with EAGAIN timed out, since client sockets only stop blocking through setTimeout()
+    if (messageSize >= 0) {
+        SOCKS_PROBE3(read, clientIndex, this->clientSocketsFD[clientIndex], messageSize);
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        SOCKS_PROBE2(timeout, clientIndex, this->clientSocketsFD[clientIndex]);
+    }
+    return messageSize;
+}
+
+void ServerSocket::enqueue(unsigned int clientIndex, const std::shared_ptr<const std::string>& message) {
+    this->outboundQueues[clientIndex].push_back(message);
+    this->queuedBytes[clientIndex] += message->size();
+    this->queuedMemory += message->size();
+}
+
+void ServerSocket::dequeue(unsigned int clientIndex) {
+    unsigned long size = this->outboundQueues[clientIndex].front()->size();
+    this->outboundQueues[clientIndex].pop_front();
+    this->queuedBytes[clientIndex] -= size;
+    this->queuedMemory -= size;
+}
+
+void ServerSocket::shedMemory() {
+    if (!this->isOverBudget()) return;
+    
+    //Receive buffers hold nothing between reads, so they are freed first whatever the policy. The next receive() allocates one again
+    for (size_t a = 0; a < this->receiveBuffers.size(); a++) {
+        this->receiveBuffers[a].release();
+    }
+    if (this->memoryPolicy == PauseReading) return;
+    
+    while (this->isOverBudget()) {
+        //Find the client with the most queued that can lose some of it. The first message can't be dropped once part of it was sent
+        int largest = -1;
+        for (size_t a = 0; a < this->activeConnections.size(); a++) {
+            if (!this->activeConnections[a] || (largest >= 0 && this->queuedBytes[a] <= this->queuedBytes[largest])) continue;
+            if (this->memoryPolicy == DropOldest && this->outboundQueues[a].size() <= (this->outboundOffsets[a] > 0 ? 1 : 0)) continue;
+            if (this->queuedBytes[a] > 0) largest = a;
+        }
+        
+        //The rest is posts flushPosted() hasn't handled, or memory the budget can't touch
+        if (largest < 0) return;
+        
+        if (this->memoryPolicy == DisconnectLargest) {
+            SOCKS_PROBE2(shed, largest, this->queuedBytes[largest]);
+            this->closeConnection(largest);
+            continue;
+        }
+        
+        //Drop the oldest messages that weren't started, until memory is back under or there are none left
+        std::deque<std::shared_ptr<const std::string>>& queue = this->outboundQueues[largest];
+        size_t first = this->outboundOffsets[largest] > 0 ? 1 : 0;
+        while (queue.size() > first && this->isOverBudget()) {
+            unsigned long size = queue[first]->size();
+            SOCKS_PROBE2(shed, largest, size);
+            queue.erase(queue.begin() + first);
+            this->queuedBytes[largest] -= size;
+            this->queuedMemory -= size;
+        }
+    }
+}
+
+void ServerSocket::probeWrite(unsigned int clientIndex, unsigned long requested, long sentSize) const {
+    if (sentSize < 0) return;
+    
+    SOCKS_PROBE4(write, clientIndex, this->clientSocketsFD[clientIndex], requested, sentSize);
+    if ((unsigned long)sentSize < requested) SOCKS_PROBE4(partial_write, clientIndex, this->clientSocketsFD[clientIndex], requested, sentSize);
+}
+
+uint64_t ServerSocket::tracedSendTime(unsigned int clientIndex) const {
+    if (!this->traces[clientIndex] || !this->traces[clientIndex]->timestamps) return 0;
+    
+    //The kernel's timestamps are on the realtime clock
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void ServerSocket::traceSend(unsigned int clientIndex, long sentSize, uint64_t sendTime) {
+    TracedConnection* traced = this->traces[clientIndex].get();
+    if (traced == nullptr || !traced->timestamps) return;
+    
+    //Timestamps waiting on the error queue count against the socket's receive buffer, so collect them regularly
+    if (traced->pendingSends.size() % 32 == 31) this->readErrorQueue(clientIndex);
+    
+    //The kernel numbers the timestamp of each send by its last byte
+    traced->bytesSent += sentSize;
+    traced->pendingSends.push_back(std::make_pair(traced->bytesSent - 1, sendTime));
+    
+    //Sends the kernel never timestamps would otherwise pile up
+    if (traced->pendingSends.size() > TRACED_SENDS_LIMIT) traced->pendingSends.pop_front();
+}
+
+long ServerSocket::writeZeroCopy(const std::shared_ptr<const std::string>& message, unsigned long offset, unsigned int clientIndex, int flags) {
+#if defined(MSG_ZEROCOPY)
+    uint64_t sendTime = this->tracedSendTime(clientIndex);
+    long sentSize = ::send(this->clientSocketsFD[clientIndex], message->data() + offset, message->size() - offset, flags | MSG_ZEROCOPY | MSG_NOSIGNAL);
+    if (sentSize > 0) this->traceSend(clientIndex, sentSize, sendTime);
+    this->probeWrite(clientIndex, message->size() - offset, sentSize);
+    
+    //Every send that pins memory gets the next ID, and the kernel reports finished sends by these IDs
+    if (sentSize > 0) {
+        ZeroCopyBuffer buffer;
+        buffer.id = this->zeroCopyNextIDs[clientIndex]++;
+        buffer.message = message;
+        this->zeroCopyPending[clientIndex].push_back(buffer);
+    }
+    return sentSize;
+#else
+    uint64_t sendTime = this->tracedSendTime(clientIndex);
+    long sentSize = ::send(this->clientSocketsFD[clientIndex], message->data() + offset, message->size() - offset, flags | MSG_NOSIGNAL);
+    if (sentSize > 0) this->traceSend(clientIndex, sentSize, sendTime);
+    this->probeWrite(clientIndex, message->size() - offset, sentSize);
+    return sentSize;
+#endif
+}
+
+unsigned int ServerSocket::readErrorQueue(unsigned int clientIndex) {
+    bool copied = false;
+    unsigned int released = this->readErrorQueue(this->clientSocketsFD[clientIndex], this->zeroCopyPending[clientIndex], this->traces[clientIndex].get(), copied);
+    
+    //The kernel had to copy anyway (for example over loopback), so zero-copy sending only adds work for this client
+    if (copied) this->zeroCopyClients[clientIndex] = false;
+    return released;
+}
+
+unsigned int ServerSocket::readErrorQueue(int socketFD, std::deque<ZeroCopyBuffer>& pending, TracedConnection* traced, bool& copied) {
+    unsigned int released = 0;
+    
+#if defined(__linux__)
+    while (!pending.empty() || (traced != nullptr && !traced->pendingSends.empty())) {
+        char control[256];
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        
+        /* recvmsg() with MSG_ERRQUEUE
+         Finished zero-copy sends and transmit timestamps are reported on the socket's error queue, separately from the data. A zero-copy notification holds a range of send IDs in ee_info (the first) and ee_data (the last), so one notification can cover many sends. A timestamp comes with the number of the last byte it covers in ee_data.
+         */
+        if (recvmsg(socketFD, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+        
+        sock_extended_err* error = nullptr;
+        uint64_t timestamp = 0;
+        
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+            if ((header->cmsg_level == SOL_IP && header->cmsg_type == IP_RECVERR) || (header->cmsg_level == SOL_IPV6 && header->cmsg_type == IPV6_RECVERR)) {
+                error = (sock_extended_err*)CMSG_DATA(header);
+            }
+#if defined(SO_TIMESTAMPING)
+            else if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_TIMESTAMPING) {
+                scm_timestamping* stamps = (scm_timestamping*)CMSG_DATA(header);
+                timestamp = (uint64_t)stamps->ts[0].tv_sec * 1000000000 + stamps->ts[0].tv_nsec;
+            }
+#endif
+        }
+        if (error == nullptr) continue;
+        
+#if defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+        if (error->ee_errno == 0 && error->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+            uint32_t first = error->ee_info;
+            uint32_t last = error->ee_data;
+            
+            //Pending memory is in ID order, and sends usually finish in order, so this normally only looks at the front
+            for (size_t a = 0; a < pending.size();) {
+                if (pending[a].id - first <= last - first) {
+                    pending.erase(pending.begin() + a);
+                    released++;
+                } else {
+                    a++;
+                }
+            }
+            
+            if (error->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) copied = true;
+        }
+#endif
+        
+#if defined(SO_TIMESTAMPING)
+        if (error->ee_origin == SO_EE_ORIGIN_TIMESTAMPING && traced != nullptr && timestamp != 0) {
+            //Sends are timestamped in order. Any send before this one that never got a timestamp is dropped
+            uint32_t lastByte = error->ee_data;
+            while (!traced->pendingSends.empty() && (int32_t)(traced->pendingSends.front().first - lastByte) <= 0) {
+                if (traced->pendingSends.front().first == lastByte && timestamp >= traced->pendingSends.front().second)
+                    traced->trace.transmit.record(timestamp - traced->pendingSends.front().second);
+                traced->pendingSends.pop_front();
+            }
+        }
+#endif
+    }
+#endif
+    
+    return released;
+}
+
+void ServerSocket::closeClientSocket(unsigned int clientIndex) {
+    int socketFD = this->clientSocketsFD[clientIndex];
+    if (!this->zeroCopyPending[clientIndex].empty()) this->readErrorQueue(clientIndex);
+    
+    //The kernel keeps sending from memory passed without a copy after the socket is closed, but would no longer say when it is done. Shut the connection down, so the client still sees it end, and keep the socket until then
+    if (!this->zeroCopyPending[clientIndex].empty()) {
+        shutdown(socketFD, SHUT_RDWR);
+        
+        RetiredZeroCopy retired;
+        retired.socketFD = socketFD;
+        retired.pending.swap(this->zeroCopyPending[clientIndex]);
+        this->retiredZeroCopy.push_back(std::move(retired));
+    } else {
+        close(socketFD);
+    }
+}
+
+unsigned int ServerSocket::releaseRetiredZeroCopy() {
+    unsigned int released = 0;
+    
+    //Go backwards so finished connections can be removed while iterating
+    for (int a = (int)this->retiredZeroCopy.size() - 1; a >= 0; a--) {
+        bool copied = false;
+        released += this->readErrorQueue(this->retiredZeroCopy[a].socketFD, this->retiredZeroCopy[a].pending, nullptr, copied);
+        
+        if (this->retiredZeroCopy[a].pending.empty()) {
+            close(this->retiredZeroCopy[a].socketFD);
+            this->retiredZeroCopy.erase(this->retiredZeroCopy.begin() + a);
+        }
+    }
+    return released;
+}
+
+void ServerSocket::pushPosted(PostedMessage posted) {
+    this->postedMemory.fetch_add(posted.message->size(), std::memory_order_relaxed);
+    this->postedMessages.push(std::move(posted));
+    
+    //Only the first post since the last flush needs to wake the owning thread
+    if (this->pendingPosts.fetch_add(1, std::memory_order_acq_rel) == 0) {
+        uint64_t one = 1;
+        if (write(this->postNotifyWriteFD, &one, sizeof(one)) < 0) {} //Already signaled if the pipe is full
+    }
+}
+
+void ServerSocket::removeSubscriber(unsigned int topicID, unsigned int clientIndex) {
+    std::vector<unsigned int>& subscribers = this->topicSubscribers[topicID];
+    std::vector<unsigned int>::iterator position = std::lower_bound(subscribers.begin(), subscribers.end(), clientIndex);
+    if (position != subscribers.end() && *position == clientIndex) subscribers.erase(position);
+}
+
 //Destructor
 
 ServerSocket::~ServerSocket() {
@@ -362,16 +1815,34 @@ ServerSocket::~ServerSocket() {
         for (int clientIndex = 0; clientIndex < this->activeConnections.size(); clientIndex++) {
             if (this->activeConnections[clientIndex]) {
                 try {
-                    close(this->clientSocketsFD[clientIndex]);
+                    if (this->sharedMemoryRings[clientIndex]) this->sharedMemoryRings[clientIndex]->close();
+                    else this->closeClientSocket(clientIndex);
                 } catch (...) {
                     printf("Error closing client socket (server side)");
                 }
             }
         }
+        for (size_t a = 0; a < this->overflowQueue.size(); a++) {
+            close(this->overflowQueue[a].socketFD);
+        }
         try {
             close(this->hostSocketFD);
+            close(this->postNotifyFD);
+            if (this->postNotifyWriteFD != this->postNotifyFD) close(this->postNotifyWriteFD);
         } catch (...) {
             printf("Error closing host server socket (server side)");
         }
     }
+    
+    //Wait a while for the kernel to finish with memory sent without a copy. Whatever it still holds after that is never freed, since the kernel would go on sending whatever reused the memory
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ZERO_COPY_LINGER);
+    this->releaseRetiredZeroCopy();
+    while (!this->retiredZeroCopy.empty() && std::chrono::steady_clock::now() < deadline) {
+        poll(nullptr, 0, 1);
+        this->releaseRetiredZeroCopy();
+    }
+    for (size_t a = 0; a < this->retiredZeroCopy.size(); a++) {
+        new std::deque<ZeroCopyBuffer>(std::move(this->retiredZeroCopy[a].pending)); //Deliberately leaked
+        close(this->retiredZeroCopy[a].socketFD);
+    }
 }
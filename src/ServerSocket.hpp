@@ -10,8 +10,21 @@
 #define ServerSocket_hpp
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <exception>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <climits>
+#if __cplusplus >= 202002L
+#include <span>
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,17 +32,74 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
 #include <cerrno>
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#endif
+
+#include "SharedMemoryRing.hpp"
+#include "MPSCQueue.hpp"
+#include "MessageCodec.hpp"
+#include "TrafficCapture.hpp"
+#include "LatencyHistogram.hpp"
+#include "HostResolver.hpp"
+#include "ReceiveBuffer.hpp"
+#include "RecordBuffer.hpp"
+#include "Probes.hpp"
+
 #define BUFFER_SIZE 65535
+#define ZERO_COPY_THRESHOLD 32768 //Below this size, pinning pages and handling the completion costs more than copying
+#define ZERO_COPY_LINGER 5000 //Milliseconds the destructor waits for the kernel to finish sending from memory passed without a copy
+#define TRACED_SENDS_LIMIT 4096 //The most sends kept waiting for a transmit timestamp, per client
+#define STREAM_CHUNK_SIZE 262144 //The bytes sendStream() asks its source for at a time
+#define FAST_OPEN_QUEUE 256 //Connections whose SYN data was accepted before their handshake finished, which bounds the work forged SYNs can cause
+#define LISTEN_BACKLOG SOMAXCONN //Connections the kernel holds until they are accepted. The kernel caps this at net.core.somaxconn
+
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0 //Not available on macOS, where a broken connection raises SIGPIPE instead
+#endif
 
 class ServerSocket {
 public:
+    //Public types
+    
+    enum MemoryPolicy {
+        DropOldest, //Unsent messages are dropped from the client with the most queued, oldest first. A message already partly sent is kept, so no client is sent half of one
+        DisconnectLargest, //The client with the most queued is disconnected
+        PauseReading //Nothing is dropped, but receive() stops growing its buffers and reading ahead, and isOverBudget() tells the caller to stop reading until flushPosted() has sent enough
+    };
+    
+    enum OverflowPolicy {
+        Reject, //A client that connects while every index is taken is closed at once
+        Queue, //A client that connects while every index is taken waits, already accepted, for a free index. Up to the backlog can wait, and any more are rejected
+        Grow //More indices are added, so every client is taken
+    };
+    
+    /*
+     Which core a socket serves. To spread a server over several cores, make one ServerSocket per core on the same port, each from its own thread pinned with pinThread(), with steerConnections on.
+     */
+    struct Placement {
+        int cpu; //The core the socket serves, which steerConnections sends connections to. This does not move the calling thread or its memory; for that, see pinThread(). -1 for no core
+        bool steerConnections; //Share the port with the other sockets that turned this on, and have the kernel give this one the connections whose packets the network card delivers to its core (SO_REUSEPORT and SO_INCOMING_CPU). Needs a cpu
+        
+        Placement(int cpu = -1, bool steerConnections = false) : cpu(cpu), steerConnections(steerConnections) {}
+    };
+    
     //Constructor
     ServerSocket();
-    ServerSocket(int portNum, int maxConnections);
+    ServerSocket(int portNum, int maxConnections, int backlog = LISTEN_BACKLOG, const Placement& placement = Placement());
     
     //Destructor
     ~ServerSocket();
@@ -43,20 +113,73 @@ public:
      */
     static std::string getHostName();
     
+    /*!
+     * A function that pins the calling thread to one core, for as long as the thread runs. Linux gives memory from the NUMA node of the core that first touches it, so calling this before setting up a ServerSocket keeps everything the thread allocates for it local, including the state added for each client. Only works on Linux; elsewhere, it does nothing. Throws an error if the thread cannot be pinned.
+     *
+     * @param cpu The core.
+     */
+    static void pinThread(int cpu);
+    
     //Public member functions
     
     /*!
      * A function to initialize the socket. This must be done before the socket can be used. Will throw an error if the socket cannot be opened or if the port is occupied, or if the socket is already set.
      *
      * @param portNum The number of the port on the host at which clients should connect.
-     * @param maxConnections The max number of clients that this host can theoretically connect with.
+     * @param maxConnections The number of clients that this host can connect with at first. What happens to more clients depends on setOverflowPolicy().
+     * @param backlog An optional parameter indicating the number of connections the kernel holds until they are accepted. Autoinitialized as LISTEN_BACKLOG.
+     * @param placement An optional parameter indicating which core the socket serves, and whether connections are steered to it. The calling thread's affinity is left as it was. An error will be thrown if there is no such core. Steering only works on Linux; elsewhere, it is ignored. Autoinitialized to no core.
+     */
+    void setSocket(int portNum, int maxConnections, int backlog = LISTEN_BACKLOG, const Placement& placement = Placement());
+    
+    /*!
+     * A function that adds a client. If there is no client, then the function waits for a connection to be initiated by the client, for up to the time set with setHostTimeout(). If every index is taken, the client is handled by the overflow policy. Will throw an error if no client connects in time, or if an error occurs connecting to the client.
+     *
+     * @return The index of the new client, or -1 if it was rejected or queued by the overflow policy.
+     */
+    int addClient();
+    
+    /*!
+     * A function that adds every client waiting to be accepted, without waiting for more. Clients queued by the overflow policy are added first, if indices have become free. It is meant to be called whenever listeningFD() is readable, and after connections are closed. Will throw an error if the socket is not set, or if an error occurs accepting a client.
+     *
+     * @param onClient An optional function called with the index of each client added.
+     *
+     * @return The number of clients added.
      */
-    void setSocket(int portNum, int maxConnections);
+    unsigned int acceptClients(const std::function<void(unsigned int)>& onClient = nullptr);
     
     /*!
-     * A function that adds a client. If there is no client, then the function waits for a connection to be initiated by the client. Will throw an error if the maximum number of sockets (see MAXIMUM_NUMBER_OF_SOCKETS) have already been set, or if an error occurs connecting to the client.
+     * A function that sets what happens to a client that connects while every index is taken. Reject is the default.
+     *
+     * @param policy The overflow policy.
+     */
+    void setOverflowPolicy(OverflowPolicy policy);
+    
+    /*!
+     * @return The number of clients accepted by the Queue overflow policy that are still waiting for an index.
+     */
+    unsigned int numberOfQueuedClients() const;
+    
+    /*!
+     * A function to turn TCP Fast Open on or off for new connections. Clients that turned it on too (see ClientSocket::setFastOpen()) and have connected before can send their first message in the SYN, and it is readable as soon as they are accepted, a round trip sooner. Only the first message of a connection benefits, and it may be delivered twice if the SYN is, so it should be safe to repeat. Fast Open must also be allowed by the system (net.ipv4.tcp_fastopen on Linux). An error is thrown if the socket is not set, or if the option cannot be set.
+     *
+     * @param enable True to turn Fast Open on.
+     * @param queueLength An optional parameter indicating the most connections that can be waiting on their handshake with data already accepted. Autoinitialized as FAST_OPEN_QUEUE.
+     */
+    void setFastOpen(bool enable, int queueLength = FAST_OPEN_QUEUE);
+    
+    /*!
+     * @return A file descriptor that becomes readable when clients are waiting to be accepted, so it can be waited on with poll() or select() alongside postedFD() before calling acceptClients(). -1 if the socket is not set.
      */
-    void addClient();
+    int listeningFD() const;
+    
+    /*!
+     * A function that adds a client in another process on the same machine, connected through shared memory instead of TCP. The client must call ClientSocket::setSharedMemory() with the same name. The function waits for the client to connect, for up to the time set with setHostTimeout(). Once added, the client is used like any other, through its index. Will throw an error if the maximum number of sockets have already been set, if the shared memory cannot be created, or if the client does not connect in time.
+     *
+     * @param name The name of the shared memory segment, which the client must also use.
+     * @param capacity An optional parameter indicating the number of bytes that can be waiting in each direction. Autoinitialized as SHARED_MEMORY_RING_CAPACITY.
+     */
+    void addSharedMemoryClient(const char* name, size_t capacity = SHARED_MEMORY_RING_CAPACITY);
     
     /*!
      * A function that removes a client at a given index. If there is no client at that index, an error is thrown. An error will also be thrown if the socket has not been set.
@@ -76,6 +199,57 @@ public:
      */
     std::string send(const char* message, unsigned int clientIndex, bool ensureFullStringSent = false);
     
+    /*!
+     * A function that sends a message to a single client. The message can hold any bytes, including '\0', and nothing is allocated or copied. Errors are thrown in the same cases as send(const char*, unsigned int, bool).
+     *
+     * @param message The bytes to be sent.
+     * @param clientIndex An unsigned int indicating the index of the client to whom to send the message.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
+     *
+     * @return The number of bytes sent. If less than the length of the message, the caller can send the rest later.
+     */
+    unsigned long send(std::string_view message, unsigned int clientIndex, bool ensureFullStringSent = false);
+    
+#if __cplusplus >= 202002L
+    /*!
+     * A function that sends binary data to a single client. It works exactly like send(std::string_view, unsigned int, bool).
+     *
+     * @param message The bytes to be sent.
+     * @param clientIndex An unsigned int indicating the index of the client to whom to send the message.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
+     *
+     * @return The number of bytes sent.
+     */
+    unsigned long send(std::span<const std::byte> message, unsigned int clientIndex, bool ensureFullStringSent = false);
+#endif
+    
+    /*!
+     * A function that sends a message the caller no longer needs to a single client. The message can hold any bytes, including '\0'. Errors are thrown in the same cases as send(const char*, unsigned int, bool).
+     *
+     * @param message The message to be sent. It is moved in.
+     * @param clientIndex An unsigned int indicating the index of the client to whom to send the message.
+     * @param ensureFullStringSent An optional parameter that will make sure the full string is sent if it is too long to send with one call of write(). It is automatically set to false.
+     *
+     * @return Any part of the message that wasn't sent, in the same string that was moved in, so nothing new is allocated.
+     */
+    std::string send(std::string&& message, unsigned int clientIndex, bool ensureFullStringSent = false);
+    
+    /*!
+     * A function that sends a typed message to a single client, in the wire layout declared by MessageSchema<T>. The message is encoded on the stack, so nothing is allocated. Errors are thrown in the same cases as send(const char*, unsigned int, bool).
+     *
+     * @param message The message to be sent.
+     * @param clientIndex An unsigned int indicating the index of the client to whom to send the message.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to true, since the other side reads messages whole.
+     *
+     * @return The number of bytes sent.
+     */
+    template <typename T>
+    unsigned long sendMessage(const T& message, unsigned int clientIndex, bool ensureFullStringSent = true) {
+        char encoded[MessageLayout<T>::size];
+        encodeMessage(message, encoded);
+        return this->sendBytes(encoded, MessageLayout<T>::size, clientIndex, ensureFullStringSent);
+    }
+    
     /*!
      * A function that sends a message to all clients. An error will be thrown if the socket is not set or if an error occurs in sending the message to any of the clients. If the optional parameter is set to true, an error will also be thrown if only part of the message was thrown.
      *
@@ -84,6 +258,181 @@ public:
      */
     void broadcast(const char* message, bool ensureFullStringSent = false);
     
+    /*!
+     * A function that sends a message, which can hold any bytes, to all clients. It works like broadcast(const char*, bool).
+     *
+     * @param message The bytes to be sent.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
+     */
+    void broadcast(std::string_view message, bool ensureFullStringSent = false);
+    
+    /*!
+     * A function that sends a large message to a single client without copying it into the kernel, if zero-copy sending is enabled (see setZeroCopy()). The kernel sends straight from the message's memory, so the message is held until the kernel reports it is done with it, which is noticed by releaseZeroCopyBuffers(). Smaller messages, or messages to clients that can't use zero-copy sending, are sent normally. Errors are thrown in the same cases as send(const char*, unsigned int, bool).
+     *
+     * @param message The message to be sent. It must not be changed until it is released.
+     * @param clientIndex An unsigned int indicating the index of the client to whom to send the message.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
+     *
+     * @return The number of bytes sent.
+     */
+    unsigned long sendZeroCopy(std::shared_ptr<const std::string> message, unsigned int clientIndex, bool ensureFullStringSent = false);
+    
+    /*!
+     * A function that sends a large message to all clients without copying it into the kernel, like sendZeroCopy(). Every client is sent from the same memory. An error will be thrown if the socket is not set or if an error occurs in sending the message to any of the clients.
+     *
+     * @param message The message to be sent. It must not be changed until it is released.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
+     */
+    void broadcastZeroCopy(std::shared_ptr<const std::string> message, bool ensureFullStringSent = false);
+    
+    /*!
+     * A function to turn zero-copy sending on or off for every client, including clients added later. When on, sendZeroCopy(), broadcastZeroCopy() and flushPosted() send messages of at least the given size straight from their memory instead of copying them into the kernel, which saves memory bandwidth on large messages. Where the system does not support it (it needs Linux 4.14 or later), messages are copied as usual. An error will be thrown if the socket is not set.
+     *
+     * @param enable True to turn zero-copy sending on.
+     * @param threshold An optional parameter indicating the smallest message, in bytes, worth sending without a copy. Autoinitialized as ZERO_COPY_THRESHOLD.
+     */
+    void setZeroCopy(bool enable, unsigned long threshold = ZERO_COPY_THRESHOLD);
+    
+    /*!
+     * A function that releases messages which the kernel has finished sending without a copy, including those sent to clients that have since been closed. It is also called before each zero-copy send, so it only needs to be called directly to free memory sooner, or after drain() to free what the kernel was still sending when it returned.
+     *
+     * @return The number of messages, or parts of messages, released.
+     */
+    unsigned int releaseZeroCopyBuffers();
+    
+    /*!
+     * A function that starts recording every message sent to or received from any client, with the time and the client's index, and when each client connects and is closed, so the traffic can be played back later with TrafficReplay. Recording is a copy into a memory-mapped file, so it adds little to each call. Will throw an error if a capture is already running, or if the file cannot be created.
+     *
+     * @param path The path of the capture file. Any existing file is replaced.
+     */
+    void startCapture(const char* path);
+    
+    /*!
+     * A function that stops recording and finishes the capture file. Nothing happens if no capture is running.
+     */
+    void stopCapture();
+    
+    /*!
+     * A function to turn latency tracing on or off for every client, including clients added later. While on, each client's LatencyTrace records how long received data waited in the kernel before being read, and how long sent data took to reach the network device, using the kernel's software timestamps (SO_TIMESTAMPING, Linux only). Turning it off discards the traces. An error will be thrown if the socket is not set.
+     *
+     * @param enable True to turn tracing on.
+     */
+    void setTracing(bool enable);
+    
+    /*!
+     * A function that gets the latency trace of a single client, including any timestamps the kernel has reported since the last send. An error will be thrown if the socket is not set, if the index is out of range, or if tracing is off.
+     *
+     * @param clientIndex An unsigned int indicating the index of the client.
+     *
+     * @return The client's trace. It stays valid until the connection is closed or tracing is turned off.
+     */
+    const LatencyTrace& latencyTrace(unsigned int clientIndex);
+    
+    /*!
+     * A function that subscribes a client to a topic, so it receives messages published to that topic. Subscribing a client twice has no effect. A client's subscriptions end when its connection is closed. An error will be thrown if the socket is not set, if the topic is an empty string, or if the index is out of range.
+     *
+     * @param topic The name of the topic.
+     * @param clientIndex An unsigned int indicating the index of the client to subscribe.
+     */
+    void subscribe(std::string_view topic, unsigned int clientIndex);
+    
+    /*!
+     * A function that unsubscribes a client from a topic. Nothing happens if the client was not subscribed. An error will be thrown if the socket is not set or if the index is out of range.
+     *
+     * @param topic The name of the topic.
+     * @param clientIndex An unsigned int indicating the index of the client to unsubscribe.
+     */
+    void unsubscribe(std::string_view topic, unsigned int clientIndex);
+    
+    /*!
+     * A function that sends a message to every client subscribed to a topic. Its cost depends on the number of subscribers, not the number of clients. An error will be thrown if the socket is not set, if the message is empty, or if an error occurs in sending the message to any of the subscribers.
+     *
+     * @param topic The name of the topic.
+     * @param message The message to be sent. It can hold any bytes, and is not copied.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false (so the rest of the message is not sent, but rather discarded).
+     *
+     * @return The number of clients the message was sent to.
+     */
+    unsigned int publish(std::string_view topic, std::string_view message, bool ensureFullStringSent = false);
+    
+    /*!
+     * A function that sends a message to every client subscribed to a topic, like publish(std::string_view, std::string_view, bool), but through sendZeroCopy(). All subscribers are sent from the same memory, and large messages are not copied into the kernel if zero-copy sending is on.
+     *
+     * @param topic The name of the topic.
+     * @param message The message to be sent. It must not be changed until it is released.
+     * @param ensureFullStringSent An optional parameter that will make sure the full message is sent if it is too long to send with one call of write(). It is automatically set to false.
+     *
+     * @return The number of clients the message was sent to.
+     */
+    unsigned int publish(std::string_view topic, std::shared_ptr<const std::string> message, bool ensureFullStringSent = false);
+    
+    /*!
+     * @param topic The name of the topic.
+     *
+     * @return The number of clients subscribed to the topic.
+     */
+    unsigned int numberOfSubscribers(std::string_view topic) const;
+    
+    /*!
+     * A function that queues a message for a single client. Unlike every other function, it can be called from any thread at any time: the message goes into a lock-free queue, and is only sent when the thread that owns this socket calls flushPosted(). Threads posting never wait on each other. Messages for an index that has no client by the time they are flushed are discarded.
+     *
+     * @param message The message to be sent. It is moved into the queue.
+     * @param clientIndex An unsigned int indicating the index of the client to whom to send the message.
+     */
+    void post(std::string message, unsigned int clientIndex);
+    
+    /*!
+     * A function that queues a message for every client. Like post(), it can be called from any thread at any time, and the message is sent by flushPosted(). All clients share one copy of the message.
+     *
+     * @param message The message to be sent. It is moved into the queue.
+     */
+    void postBroadcast(std::string message);
+    
+    /*!
+     * A function that queues a message for every client subscribed to a topic. Like post(), it can be called from any thread at any time. The subscribers are looked up when flushPosted() runs, and all of them share one copy of the message.
+     *
+     * @param topic The name of the topic.
+     * @param message The message to be sent. It is moved into the queue.
+     */
+    void postPublish(std::string topic, std::string message);
+    
+    /*!
+     * A function that sends messages queued by post() and postBroadcast(), as far as each client can take them without waiting. What a client cannot take yet stays queued for that client, in order, until the next call. It must be called from the thread that owns this socket. An error will be thrown if the socket is not set.
+     *
+     * @return The number of bytes still queued for all clients. If not 0, flushPosted() should be called again soon.
+     */
+    unsigned long flushPosted();
+    
+    /*!
+     * @return A file descriptor that becomes readable when messages have been posted, so the thread that owns this socket can wait on it with poll() or select() and then call flushPosted(). -1 if the socket is not set.
+     */
+    int postedFD() const;
+    
+    /*!
+     * @param clientIndex The index of the client.
+     *
+     * @return The file descriptor of the client's TCP connection, so it can be waited on with poll() or handed to a Relay. -1 if there is no client at the index or it is connected through shared memory.
+     */
+    int clientFD(unsigned int clientIndex) const;
+    
+    /*!
+     * A function that limits the memory this socket holds for clients: receive buffers, messages queued by post(), postBroadcast() and postPublish() that clients have not taken yet, and posts that flushPosted() has not handled yet. A queued message is counted once for every client it is queued for, even though broadcasts share one copy. flushPosted() checks the budget after it sends. If memory is over it, every receive buffer is freed first, since they hold nothing between reads, and then the policy applies until memory is back under it. Disconnected clients' indices become free, as with closeDeadConnections().
+     *
+     * @param bytes The budget. 0 removes it.
+     * @param policy An optional parameter indicating what to do when memory is over the budget. Autoinitialized as DropOldest.
+     */
+    void setMemoryBudget(unsigned long bytes, MemoryPolicy policy = DropOldest);
+    
+    /*!
+     * @return The bytes counted against the memory budget, whether or not a budget is set.
+     */
+    unsigned long memoryInUse() const;
+    
+    /*!
+     * @return If a memory budget is set and memory is over it. Under the PauseReading policy, the caller should stop reading from clients while this is true.
+     */
+    bool isOverBudget() const;
+    
     /*!
      * A function that receives a message from a single client. The function will wait for a short period for the client to send the message, and if the message is not received it will throw an error. An error is also thrown if the index is out of range or if the socket is not set.
      *
@@ -94,6 +443,66 @@ public:
      */
     std::string receive(unsigned int clientIndex, bool* socketClosed = nullptr);
     
+    /*!
+     * A function that receives exactly a given number of bytes from a single client into the caller's buffer, waiting until all of them have arrived. Nothing is allocated. Since receive() reads whatever has arrived, the two should not be mixed on one connection. Errors are thrown in the same cases as receive().
+     *
+     * @param buffer The buffer to fill.
+     * @param length The number of bytes to receive.
+     * @param clientIndex An unsigned int indicating the index of the client from whom to receive.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the client disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return True if all the bytes were received, false if the client disconnected first.
+     */
+    bool receive(char* buffer, unsigned long length, unsigned int clientIndex, bool* socketClosed = nullptr);
+    
+    /*!
+     * A function that receives exactly one typed message from a single client into a buffer, waiting until all of it has arrived. Fields are then read from buffer.view() without any parsing. Since receive() reads whatever has arrived, the two should not be mixed on one connection. Errors are thrown in the same cases as receive().
+     *
+     * @param buffer The buffer to fill. It can be reused for every message.
+     * @param clientIndex An unsigned int indicating the index of the client from whom to receive the message.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the client disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return True if a whole message was received, false if the client disconnected first.
+     */
+    template <typename T>
+    bool receiveMessage(MessageBuffer<T>& buffer, unsigned int clientIndex, bool* socketClosed = nullptr) {
+        return this->receiveBytes(buffer.data(), MessageLayout<T>::size, clientIndex, socketClosed);
+    }
+    
+    /*!
+     * A function that receives one record from a single client, for protocols that end each message with a delimiter, like newline-delimited text. Whatever arrives after the record is kept for the next call, so a read that brings many records is only made once. Since the bytes kept are not seen by receive(), the two should not be mixed on one connection. Errors are thrown in the same cases as receive(), and if a record is longer than RECORD_MAX_LENGTH.
+     *
+     * @param record Set to the record, without its delimiter. It points into the client's buffer, and stays valid until the next call for that client or until the connection is closed. If the client disconnects without ending the last record, what it sent is returned as a record.
+     * @param clientIndex An unsigned int indicating the index of the client from whom to receive the record.
+     * @param delimiter An optional parameter indicating the byte that ends each record. Autoinitialized as '\n'.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the client disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return True if a record was received, false if the client disconnected first.
+     */
+    bool receiveRecord(std::string_view& record, unsigned int clientIndex, char delimiter = '\n', bool* socketClosed = nullptr);
+    
+    /*!
+     * A function that receives a given number of bytes from a single client without holding them all at once. Each piece is passed to the sink as it arrives, and its memory is reused after the sink returns, so the memory used stays within RECEIVE_BUFFER_MAX however long the stream is. No byte past the length is read. Errors are thrown in the same cases as receive(), and if no data arrives within the timeout.
+     *
+     * @param sink A function called with each piece of data and its length.
+     * @param length The number of bytes to receive. ULONG_MAX receives until the client disconnects.
+     * @param clientIndex An unsigned int indicating the index of the client from whom to receive.
+     * @param socketClosed An optional pointer to a bool that would be set to true if the client disconnected. Automatically set to a null pointer otherwise.
+     *
+     * @return The number of bytes received. Less than the length if the client disconnected first.
+     */
+    unsigned long receiveStream(const std::function<void(const char*, unsigned long)>& sink, unsigned long length, unsigned int clientIndex, bool* socketClosed = nullptr);
+    
+    /*!
+     * A function that sends data to a single client as a source produces it, without holding it all at once. The source is asked for up to STREAM_CHUNK_SIZE bytes at a time, and each piece is sent in full before the next is asked for. Errors are thrown in the same cases as send(const char*, unsigned int, bool).
+     *
+     * @param source A function that fills the buffer it is given with up to the given number of bytes, and returns how many it filled. Returning 0 ends the stream.
+     * @param clientIndex An unsigned int indicating the index of the client to whom to send.
+     *
+     * @return The number of bytes sent.
+     */
+    unsigned long sendStream(const std::function<unsigned long(char*, unsigned long)>& source, unsigned int clientIndex);
+    
     /*!
      * A function that checks if all clients sent a specific message. This function calls ServerSocket::receive() so if another message has been sent that message may be received instead, and thus will not be read or returned by the server. This function throws no errors other than those called by ServerSocket::receive() or ServerSocket::closeConnection(). Any sockets where connection was lost are automatically closed.
      *
@@ -119,6 +528,51 @@ public:
      */
     void setHostTimeout(unsigned int seconds, unsigned int milliseconds = 0);
     
+    /*!
+     * A function to enable heartbeats on every client connection, including clients added later. Heartbeats are TCP keepalive probes: one is only sent after a connection has been idle for the given time, and it is answered by the client's kernel, so neither program is woken up and busy connections pay nothing. A client that misses the given number of heartbeats in a row is considered dead (see isAlive() and closeDeadConnections()). To disable heartbeats, set idleSeconds to 0.
+     *
+     * @param idleSeconds The number of seconds a connection must be idle before the first heartbeat is sent. If 0, heartbeats are disabled.
+     * @param intervalSeconds An optional parameter indicating the number of seconds between unanswered heartbeats. Autoinitialized as 1.
+     * @param missedHeartbeats An optional parameter indicating how many heartbeats may go unanswered before the connection is considered dead. Autoinitialized as 3.
+     */
+    void setHeartbeat(unsigned int idleSeconds, unsigned int intervalSeconds = 1, unsigned int missedHeartbeats = 3);
+    
+    /*!
+     * A function that returns the last time a client was known to be alive. This is the later of the last time a message was received from the client and the last time the client's kernel acknowledged anything, including a heartbeat. An error is thrown if the index is out of range or if the socket is not set.
+     *
+     * @param clientIndex An unsigned int indicating the index of the client.
+     *
+     * @return The last time the client was seen.
+     */
+    std::chrono::steady_clock::time_point lastSeen(unsigned int clientIndex) const;
+    
+    /*!
+     * A function that checks, without blocking, whether a client connection is still alive. A connection is dead if the client closed it, if it was reset, or if heartbeats or sent data went unanswered (see setHeartbeat()). An error is thrown if the index is out of range or if the socket is not set.
+     *
+     * @param clientIndex An unsigned int indicating the index of the client to check.
+     *
+     * @return True if the connection is alive, false otherwise.
+     */
+    bool isAlive(unsigned int clientIndex) const;
+    
+    /*!
+     * A function that closes every client connection which isAlive() reports as dead. An error is thrown if the socket is not set.
+     *
+     * @return The number of connections that were closed.
+     */
+    unsigned int closeDeadConnections();
+    
+    /*!
+     * A function to shut the server down without losing messages. New clients stop being accepted, the sending side of each connection is closed once everything already sent has been handed to the kernel, and the function waits for each client to finish and close its side. Once every client has finished or the deadline passes, all sockets are closed and the object returns to an unset state, so it can be set again. An error is thrown if the socket is not set.
+     *
+     * @param seconds The number of seconds to wait for clients to finish.
+     * @param milliseconds An optional parameter indicating the number of milliseconds to add to the deadline. Autoinitialized as 0.
+     * @param onMessage An optional function called with the index of a client and a message received from it while draining. Automatically set to nullptr, in which case those messages are discarded.
+     *
+     * @return True if every client finished before the deadline, false if some connections had to be cut off.
+     */
+    bool drain(unsigned int seconds, unsigned int milliseconds = 0, const std::function<void(unsigned int, const std::string&)>& onMessage = nullptr);
+    
     /*!
      * @return The number of clients of this socket.
      */
@@ -147,10 +601,21 @@ private:
      }
      */
     addrinfo serverAddress;
+    HostResolver::Addresses serverAddressList; //The list serverAddress was taken from, which owns the memory it points to
     
     //These are "file descriptors", which store values from both the socket system call and the accept system call
     int hostSocketFD;
     
+    int backlog = LISTEN_BACKLOG; //The backlog given to listen(), which also limits how many clients can be queued
+    OverflowPolicy overflowPolicy = Reject; //What happens to a client that connects while every index is taken
+    
+    struct QueuedClient {
+        int socketFD;
+        sockaddr_storage address;
+        socklen_t addressSize;
+    };
+    std::deque<QueuedClient> overflowQueue; //Clients accepted while every index was taken, oldest first
+    
     std::vector<bool> activeConnections;//[MAX_NUMBER_OF_CONNECTIONS]; //Initialized as all false. True if the connection of that index is an active connection
     
     std::vector<int> clientSocketsFD;//[MAX_NUMBER_OF_CONNECTIONS];
@@ -164,7 +629,73 @@ private:
     std::vector<sockaddr_storage> clientAddresses;//[MAX_NUMBER_OF_CONNECTIONS];
     std::vector<socklen_t> clientAddressSizes;//[MAX_NUMBER_OF_CONNECTIONS];
     
-    char buffer[BUFFER_SIZE];
+    std::vector<std::chrono::steady_clock::time_point> lastSeenTimes; //The last time a message was received from each client
+    
+    std::vector<std::unique_ptr<SharedMemoryRing>> sharedMemoryRings; //The shared memory connection of each client. Null for TCP clients
+    
+    std::vector<std::deque<std::shared_ptr<const std::string>>> outboundQueues; //Posted messages each client has not taken yet. Broadcasts share one string
+    std::vector<size_t> outboundOffsets; //How much of the first message in each client's queue was already sent
+    
+    bool zeroCopy = false; //True if setZeroCopy() turned zero-copy sending on
+    unsigned long zeroCopyThreshold = ZERO_COPY_THRESHOLD; //The smallest message sent without a copy
+    std::vector<bool> zeroCopyClients; //True for each client whose socket accepted SO_ZEROCOPY
+    std::vector<uint32_t> zeroCopyNextIDs; //The ID the kernel will give the next zero-copy send to each client
+    
+    struct ZeroCopyBuffer {
+        uint32_t id; //The ID of the send which used this memory
+        std::shared_ptr<const std::string> message; //Keeps the memory alive until the kernel is done with it
+    };
+    std::vector<std::deque<ZeroCopyBuffer>> zeroCopyPending; //Memory each client's kernel socket may still be sending from, oldest first
+    
+    struct RetiredZeroCopy {
+        int socketFD; //Shut down but left open, since closing it would discard the kernel's notifications
+        std::deque<ZeroCopyBuffer> pending;
+    };
+    std::vector<RetiredZeroCopy> retiredZeroCopy; //Closed connections the kernel may still be sending from. Each socket is closed, and its memory freed, once every send has finished
+    
+    std::map<std::string, unsigned int, std::less<>> topicIDs; //The ID of each topic anyone ever subscribed to. std::less<> allows lookups by std::string_view
+    std::vector<std::vector<unsigned int>> topicSubscribers; //The sorted indices of the clients subscribed to each topic, by ID
+    std::vector<std::vector<unsigned int>> clientTopics; //The IDs of the topics each client subscribed to, so closing a connection only visits those
+    
+    struct PostedMessage {
+        unsigned int clientIndex;
+        bool broadcast;
+        std::string topic; //The topic of a message from postPublish(). Empty otherwise
+        std::shared_ptr<const std::string> message;
+    };
+    MPSCQueue<PostedMessage> postedMessages; //Messages from post(), postBroadcast() and postPublish(), waiting for flushPosted()
+    std::atomic<unsigned int> pendingPosts{0}; //Posts since the last flushPosted(). The first one signals postNotifyFD
+    int postNotifyFD = -1; //An eventfd (or the read end of a pipe) that is readable while posts are pending
+    int postNotifyWriteFD = -1; //The descriptor posts are signaled through. The same as postNotifyFD for an eventfd
+    
+    unsigned long memoryBudget = 0; //0 if there is no budget
+    MemoryPolicy memoryPolicy = DropOldest;
+    size_t receiveMemory = 0; //Held by all the receive buffers, which keep it up to date themselves
+    std::vector<unsigned long> queuedBytes; //The size of the messages in each client's outbound queue
+    unsigned long queuedMemory = 0; //The sum of queuedBytes
+    std::atomic<unsigned long> postedMemory{0}; //The size of the messages posted and not yet handled by flushPosted(). Changed from any thread
+    
+    struct TracedConnection {
+        LatencyTrace trace;
+        bool timestamps = false; //True if the kernel accepted SO_TIMESTAMPING for this client
+        uint32_t bytesSent = 0; //Bytes sent since timestamps were turned on, which is how the kernel numbers transmit timestamps
+        std::deque<std::pair<uint32_t, uint64_t>> pendingSends; //The number of the last byte and the time of each send still waiting for its timestamp
+    };
+    bool tracing = false; //True if setTracing() turned tracing on
+    std::vector<std::unique_ptr<TracedConnection>> traces; //The latency trace of each client while tracing is on. Null otherwise
+    
+    std::unique_ptr<TrafficCapture> capture; //Records traffic between startCapture() and stopCapture(). Null otherwise
+    
+    int timeoutMilliseconds = -1; //The timeout set with setTimeout(), for clients that don't use a socket. -1 if there is none
+    int hostTimeoutMilliseconds = -1; //The timeout set with setHostTimeout(), for clients that don't use a socket. -1 if there is none
+    
+    unsigned int heartbeatIdle = 0; //Seconds of idleness before a heartbeat is sent. 0 if heartbeats are disabled
+    unsigned int heartbeatInterval = 1; //Seconds between unanswered heartbeats
+    unsigned int heartbeatCount = 3; //Number of unanswered heartbeats before a connection is dead
+    
+    std::unique_ptr<char[]> buffer; //BUFFER_SIZE bytes for drain(), allocated by setSocket()
+    std::vector<ReceiveBuffer> receiveBuffers; //What receive() reads each client's data into, sized to its traffic
+    std::vector<RecordBuffer> recordBuffers; //Records received from each client but not yet taken by receiveRecord()
     
     bool setUp = false; //Represents if the socket has already been set. If not, reading and writing will cause errors
     
@@ -177,6 +708,230 @@ private:
      */
     int getNextAvailableIndex() const;
     
+    /*!
+     * A function to get the next index to which a client can connect, adding one if every index is taken and the overflow policy is Grow.
+     *
+     * @return The index, or -1 if there are no more available indices.
+     */
+    int reserveIndex();
+    
+    /*!
+     * A function that adds one more index, with nothing connected at it.
+     */
+    void addSlot();
+    
+    /*!
+     * A function that accepts one connection from the backlog, without waiting.
+     *
+     * @param address Set to the address of the client.
+     * @param addressSize Set to the size of the address.
+     *
+     * @return The file descriptor of the client socket, or -1 with errno set if none could be accepted.
+     */
+    int acceptSocket(sockaddr_storage& address, socklen_t& addressSize);
+    
+    /*!
+     * A function that gives an accepted client an index, or follows the overflow policy if every index is taken.
+     *
+     * @param socketFD The file descriptor of the client socket.
+     * @param address The address of the client.
+     * @param addressSize The size of the address.
+     *
+     * @return The index of the client, or -1 if it was rejected or queued.
+     */
+    int placeClient(int socketFD, const sockaddr_storage& address, socklen_t addressSize);
+    
+    /*!
+     * A function that gives the oldest queued client an index, if one is free.
+     *
+     * @return The index of the client, or -1 if no client was added.
+     */
+    int promoteQueuedClient();
+    
+    /*!
+     * A function that sets up a connected client at an index and applies the current socket options to it.
+     *
+     * @param clientIndex The index, which must be free.
+     * @param socketFD The file descriptor of the client socket.
+     * @param address The address of the client.
+     * @param addressSize The size of the address.
+     */
+    void activateClient(unsigned int clientIndex, int socketFD, const sockaddr_storage& address, socklen_t addressSize);
+    
+    /*!
+     * A function to apply the current heartbeat settings to a client socket.
+     *
+     * @param socketFD The file descriptor of the client socket.
+     */
+    void setHeartbeatOptions(int socketFD) const;
+    
+    /*!
+     * A function that sends as much of a client's queue of posted messages as it can take without waiting. If the connection has failed, the queue is discarded.
+     *
+     * @param clientIndex The index of the client.
+     *
+     * @return True if the queue is now empty.
+     */
+    bool writeQueued(unsigned int clientIndex);
+    
+    /*!
+     * A function that puts a message on the posted queue and wakes the thread that owns this socket if needed. Can be called from any thread.
+     *
+     * @param posted The message.
+     */
+    void pushPosted(PostedMessage posted);
+    
+    /*!
+     * A function that removes a client from the subscribers of a topic, if it is there.
+     *
+     * @param topicID The ID of the topic.
+     * @param clientIndex The index of the client.
+     */
+    void removeSubscriber(unsigned int topicID, unsigned int clientIndex);
+    
+    /*!
+     * A function that writes a message to a single client, continuing from where each write stopped. It does all the checks for the public send functions.
+     *
+     * @param data The bytes to be sent.
+     * @param length The number of bytes to be sent.
+     * @param clientIndex The index of the client.
+     * @param ensureFullStringSent If true, keep writing until the whole message is sent. Otherwise, write once.
+     *
+     * @return The number of bytes sent.
+     */
+    unsigned long sendBytes(const char* data, unsigned long length, unsigned int clientIndex, bool ensureFullStringSent);
+    
+    /*!
+     * A function that reads an exact number of bytes from a single client, waiting for as many reads as it takes. It does all the checks for the public receive functions.
+     *
+     * @param data Where to put the bytes.
+     * @param length The number of bytes to read.
+     * @param clientIndex The index of the client.
+     * @param socketClosed If not a null pointer, set to true and the connection closed if the client disconnected.
+     *
+     * @return True if all the bytes were read, false if the client disconnected first.
+     */
+    bool receiveBytes(char* data, unsigned long length, unsigned int clientIndex, bool* socketClosed);
+    
+    /*!
+     * A function that turns zero-copy sending on or off for one client socket, according to the current settings.
+     *
+     * @param clientIndex The index of the client.
+     */
+    void setZeroCopyOptions(unsigned int clientIndex);
+    
+    /*!
+     * A function that writes part of a message to a client without copying it, and holds the message until the kernel is done with it.
+     *
+     * @param message The message being sent.
+     * @param offset The number of bytes of the message already sent.
+     * @param clientIndex The index of the client.
+     * @param flags Flags passed to send(), along with MSG_ZEROCOPY.
+     *
+     * @return The number of bytes sent, or -1 if an error occurred, with errno set.
+     */
+    long writeZeroCopy(const std::shared_ptr<const std::string>& message, unsigned long offset, unsigned int clientIndex, int flags);
+    
+    /*!
+     * A function that reads a client's kernel notifications from its error queue. Finished zero-copy sends release the memory they were sent from, and transmit timestamps are added to the client's trace.
+     *
+     * @param clientIndex The index of the client.
+     *
+     * @return The number of messages, or parts of messages, released.
+     */
+    unsigned int readErrorQueue(unsigned int clientIndex);
+    
+    /*!
+     * A function that reads notifications from a socket's error queue.
+     *
+     * @param socketFD The socket.
+     * @param pending The memory sent from the socket without a copy. Memory the kernel is done with is removed.
+     * @param traced The trace to add transmit timestamps to, or a null pointer.
+     * @param copied Set to true if the kernel reported copying a zero-copy send anyway. Otherwise left unchanged.
+     *
+     * @return The number of messages, or parts of messages, released.
+     */
+    unsigned int readErrorQueue(int socketFD, std::deque<ZeroCopyBuffer>& pending, TracedConnection* traced, bool& copied);
+    
+    /*!
+     * A function that closes a client's socket. If the kernel may still be sending from memory passed without a copy, the connection is shut down instead, and the socket and memory are moved to retiredZeroCopy until the kernel reports it is done with them.
+     *
+     * @param clientIndex The index of the client.
+     */
+    void closeClientSocket(unsigned int clientIndex);
+    
+    /*!
+     * A function that reads the notifications of each connection in retiredZeroCopy, and closes those whose sends have all finished.
+     *
+     * @return The number of messages, or parts of messages, released.
+     */
+    unsigned int releaseRetiredZeroCopy();
+    
+    /*!
+     * A function that turns kernel timestamps on or off for one client, according to the current settings, and starts or discards its trace.
+     *
+     * @param clientIndex The index of the client.
+     */
+    void setTracingOptions(unsigned int clientIndex);
+    
+    /*!
+     * A function that reads from a client's socket. While the client is traced, the kernel's receive timestamp is read along with the data.
+     *
+     * @param clientIndex The index of the client.
+     * @param data Where to put the bytes.
+     * @param length The most bytes to read.
+     *
+     * @return The number of bytes read, 0 if the client disconnected, or -1 if an error occurred, with errno set.
+     */
+    long readSocket(unsigned int clientIndex, char* data, unsigned long length);
+    
+    /*!
+     * A function that fires the write probes for one write to a client's socket (see Probes.hpp). Nothing fires for a failed write.
+     *
+     * @param clientIndex The index of the client.
+     * @param requested The number of bytes given to the kernel.
+     * @param sentSize What the write returned.
+     */
+    void probeWrite(unsigned int clientIndex, unsigned long requested, long sentSize) const;
+    
+    /*!
+     * A function that adds a message to a client's outbound queue, counting it against the memory budget.
+     *
+     * @param clientIndex The index of the client.
+     * @param message The message.
+     */
+    void enqueue(unsigned int clientIndex, const std::shared_ptr<const std::string>& message);
+    
+    /*!
+     * A function that removes the first message from a client's outbound queue, and stops counting it against the memory budget.
+     *
+     * @param clientIndex The index of the client.
+     */
+    void dequeue(unsigned int clientIndex);
+    
+    /*!
+     * A function that brings memory back under the budget if it is over, by freeing receive buffers and then applying the memory policy (see setMemoryBudget()).
+     */
+    void shedMemory();
+    
+    /*!
+     * A function that reads the clock before a send to a traced client, on the clock the kernel timestamps with. Untraced sends don't read the clock at all.
+     *
+     * @param clientIndex The index of the client.
+     *
+     * @return The time in nanoseconds, or 0 if the client is not traced.
+     */
+    uint64_t tracedSendTime(unsigned int clientIndex) const;
+    
+    /*!
+     * A function that remembers when bytes were sent to a traced client, so the kernel's transmit timestamp can be matched to it later.
+     *
+     * @param clientIndex The index of the client.
+     * @param sentSize The number of bytes sent.
+     * @param sendTime The time from tracedSendTime() just before the send.
+     */
+    void traceSend(unsigned int clientIndex, long sentSize, uint64_t sendTime);
+    
     /*!
      * A function to
      *
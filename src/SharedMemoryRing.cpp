@@ -0,0 +1,387 @@
+#include "SharedMemoryRing.hpp"
+
+SharedMemoryRing::SharedMemoryRing() {}
+
+//Public member functions
+
+void SharedMemoryRing::create(const char* name, size_t capacity) {
+    if (this->setUp)
+        throw std::logic_error("Ring already set");
+    
+    //Round the capacity up to a power of two, so positions can be wrapped with a mask
+    uint64_t roundedCapacity = 4096;
+    while (roundedCapacity < capacity) roundedCapacity <<= 1;
+    
+    this->segmentName = name[0] == '/' ? std::string(name) : "/" + std::string(name);
+    
+    /* shm_open()
+     The shm_open() function opens a named shared memory object, like open() does for files. On Linux these live in /dev/shm. Any segment left behind by a process that died is removed first.
+     */
+    shm_unlink(this->segmentName.c_str());
+    int fileDescriptor = shm_open(this->segmentName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fileDescriptor < 0)
+        throw std::runtime_error(std::string("ERROR creating shared memory: ") + std::string(strerror(errno)));
+    
+    size_t headerSize = (sizeof(Segment) + 63) & ~(size_t)63;
+    size_t size = headerSize + 2 * roundedCapacity;
+    
+    if (ftruncate(fileDescriptor, size) < 0) {
+        int error = errno;
+        ::close(fileDescriptor);
+        shm_unlink(this->segmentName.c_str());
+        throw std::runtime_error(std::string("ERROR sizing shared memory: ") + std::string(strerror(error)));
+    }
+    
+    //A new segment is filled with zeros, so every position, flag and futex word starts at 0
+    this->isHost = true;
+    this->mapSegment(fileDescriptor, size);
+    
+    this->segment->capacity = roundedCapacity;
+    this->segment->hostProcess = getpid();
+    this->mask = roundedCapacity - 1;
+    this->readData = (char*)this->segment + headerSize;
+    this->writeData = this->readData + roundedCapacity;
+    
+    std::atomic_thread_fence(std::memory_order_release);
+    this->segment->magic = SHARED_MEMORY_RING_MAGIC;
+    
+    this->setUp = true;
+}
+
+bool SharedMemoryRing::waitForPeer(int timeoutMilliseconds) {
+    if (!this->setUp || !this->isHost)
+        throw std::logic_error("Ring not created");
+    
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+    
+    while (this->segment->state.load(std::memory_order_acquire) == 0) {
+        long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (timeoutMilliseconds >= 0 && remaining <= 0) return false;
+        
+#if defined(__linux__)
+        timespec time;
+        time.tv_sec = remaining / 1000;
+        time.tv_nsec = (remaining % 1000) * 1000000;
+        syscall(SYS_futex, &this->segment->state, FUTEX_WAIT, 0, timeoutMilliseconds >= 0 ? &time : nullptr, nullptr, 0);
+#else
+        usleep(1000);
+#endif
+    }
+    
+    //The other process is attached, so the name is no longer needed and can be used for the next connection
+    shm_unlink(this->segmentName.c_str());
+    this->connected = true;
+    return true;
+}
+
+void SharedMemoryRing::open(const char* name) {
+    if (this->setUp)
+        throw std::logic_error("Ring already set");
+    
+    this->segmentName = name[0] == '/' ? std::string(name) : "/" + std::string(name);
+    
+    int fileDescriptor = shm_open(this->segmentName.c_str(), O_RDWR, 0600);
+    if (fileDescriptor < 0)
+        throw std::runtime_error(std::string("ERROR opening shared memory: ") + std::string(strerror(errno)));
+    
+    struct stat info;
+    if (fstat(fileDescriptor, &info) < 0 || (size_t)info.st_size < sizeof(Segment)) {
+        ::close(fileDescriptor);
+        throw std::runtime_error("ERROR opening shared memory: Segment is not a ring");
+    }
+    
+    this->isHost = false;
+    this->mapSegment(fileDescriptor, info.st_size);
+    
+    if (this->segment->magic != SHARED_MEMORY_RING_MAGIC) {
+        munmap(this->segment, this->segmentSize);
+        this->segment = nullptr;
+        throw std::runtime_error("ERROR opening shared memory: Segment is not a ring");
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    
+    //A segment too small for the capacity it claims would have this side read and write past the end of the mapping
+    uint64_t capacity = this->segment->capacity;
+    size_t headerSize = (sizeof(Segment) + 63) & ~(size_t)63;
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0 || this->segmentSize < headerSize || capacity > (this->segmentSize - headerSize) / 2) {
+        munmap(this->segment, this->segmentSize);
+        this->segment = nullptr;
+        throw std::runtime_error("ERROR opening shared memory: Segment is not a ring");
+    }
+    
+    //Claim the segment. Only one process can connect to each ring
+    uint32_t expected = 0;
+    if (!this->segment->state.compare_exchange_strong(expected, 1)) {
+        munmap(this->segment, this->segmentSize);
+        this->segment = nullptr;
+        throw std::runtime_error("ERROR opening shared memory: Ring already connected");
+    }
+    this->segment->peerProcess = getpid();
+#if defined(__linux__)
+    syscall(SYS_futex, &this->segment->state, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#endif
+    
+    this->mask = capacity - 1;
+    this->writeData = (char*)this->segment + headerSize;
+    this->readData = this->writeData + capacity;
+    
+    this->connected = true;
+    this->setUp = true;
+}
+
+long SharedMemoryRing::write(const char* data, size_t length, bool waitForSpace) {
+    if (!this->setUp)
+        throw std::logic_error("Ring not set");
+    
+    uint64_t capacity = this->mask + 1;
+    size_t written = 0;
+    
+    while (written < length) {
+        if (this->writeRing->readerClosed.load(std::memory_order_acquire) || this->peerLost) {
+            errno = EPIPE;
+            return -1;
+        }
+        
+        uint64_t head = this->writeRing->head.load(std::memory_order_relaxed); //Only this side changes head
+        uint64_t tail = this->writeRing->tail.load(std::memory_order_acquire);
+        uint64_t space = capacity - (head - tail);
+        
+        if (space == 0) {
+            if (!waitForSpace) break;
+            //Wait for the reader to move tail past where it is now
+            this->waitForChange(&this->writeRing->tail, tail, &this->writeRing->spaceSignal, &this->writeRing->writerWaiting, std::chrono::steady_clock::time_point(), true);
+            continue;
+        }
+        
+        //Copy in at most two pieces, since the free space may wrap around the end of the ring
+        size_t amount = length - written < space ? length - written : space;
+        size_t offset = head & this->mask;
+        size_t firstPiece = amount < capacity - offset ? amount : capacity - offset;
+        memcpy(this->writeData + offset, data + written, firstPiece);
+        memcpy(this->writeData, data + written + firstPiece, amount - firstPiece);
+        
+        this->writeRing->head.store(head + amount, std::memory_order_release);
+        this->wake(&this->writeRing->dataSignal, &this->writeRing->readerWaiting);
+        
+        written += amount;
+    }
+    
+    return written;
+}
+
+long SharedMemoryRing::read(char* buffer, size_t length, int timeoutMilliseconds) {
+    if (!this->setUp)
+        throw std::logic_error("Ring not set");
+    
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+    uint64_t capacity = this->mask + 1;
+    
+    while (true) {
+        uint64_t tail = this->readRing->tail.load(std::memory_order_relaxed); //Only this side changes tail
+        uint64_t head = this->readRing->head.load(std::memory_order_acquire);
+        
+        if (head != tail) {
+            size_t amount = head - tail < length ? head - tail : length;
+            size_t offset = tail & this->mask;
+            size_t firstPiece = amount < capacity - offset ? amount : capacity - offset;
+            memcpy(buffer, this->readData + offset, firstPiece);
+            memcpy(buffer + firstPiece, this->readData, amount - firstPiece);
+            
+            this->readRing->tail.store(tail + amount, std::memory_order_release);
+            this->wake(&this->readRing->spaceSignal, &this->readRing->writerWaiting);
+            
+            return amount;
+        }
+        
+        //The writer sets writerClosed after its last write, so check for data once more before reporting the end
+        if (this->readRing->writerClosed.load(std::memory_order_acquire) || this->peerLost) {
+            if (this->readRing->head.load(std::memory_order_acquire) != tail) continue;
+            return 0;
+        }
+        
+        if (timeoutMilliseconds == 0 || !this->waitForChange(&this->readRing->head, tail, &this->readRing->dataSignal, &this->readRing->readerWaiting, deadline, timeoutMilliseconds < 0)) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+}
+
+bool SharedMemoryRing::waitForData(int timeoutMilliseconds) {
+    if (!this->setUp)
+        throw std::logic_error("Ring not set");
+    
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+    uint64_t tail = this->readRing->tail.load(std::memory_order_relaxed); //Only this side changes tail
+    
+    if (this->readRing->head.load(std::memory_order_acquire) != tail || this->readRing->writerClosed.load(std::memory_order_acquire) || this->peerLost) return true;
+    if (timeoutMilliseconds == 0) return false;
+    
+    return this->waitForChange(&this->readRing->head, tail, &this->readRing->dataSignal, &this->readRing->readerWaiting, deadline, timeoutMilliseconds < 0);
+}
+
+size_t SharedMemoryRing::available() const {
+    if (!this->setUp)
+        throw std::logic_error("Ring not set");
+    
+    return this->readRing->head.load(std::memory_order_acquire) - this->readRing->tail.load(std::memory_order_relaxed);
+}
+
+bool SharedMemoryRing::peerClosed() const {
+    if (!this->setUp)
+        throw std::logic_error("Ring not set");
+    
+    if (!this->connected) return false;
+    
+    if (this->readRing->writerClosed.load(std::memory_order_acquire) || this->writeRing->readerClosed.load(std::memory_order_acquire))
+        return true;
+    
+    //A process that crashed never marks its side closed, so check that it still exists
+    pid_t peer = this->isHost ? this->segment->peerProcess : this->segment->hostProcess;
+    return kill(peer, 0) < 0 && errno == ESRCH;
+}
+
+void SharedMemoryRing::shutdownWrite() {
+    if (!this->setUp)
+        throw std::logic_error("Ring not set");
+    
+    this->writeRing->writerClosed.store(1, std::memory_order_release);
+    this->wake(&this->writeRing->dataSignal, &this->writeRing->readerWaiting);
+}
+
+void SharedMemoryRing::close() {
+    if (!this->setUp)
+        throw std::logic_error("Ring not set");
+    
+    //Tell the other side, and wake it in case it is asleep waiting for this side
+    this->writeRing->writerClosed.store(1, std::memory_order_release);
+    this->readRing->readerClosed.store(1, std::memory_order_release);
+    this->wake(&this->writeRing->dataSignal, &this->writeRing->readerWaiting);
+    this->wake(&this->readRing->spaceSignal, &this->readRing->writerWaiting);
+    
+    //If nobody ever connected, the name would otherwise be left behind
+    if (this->isHost && !this->connected) shm_unlink(this->segmentName.c_str());
+    
+    munmap(this->segment, this->segmentSize);
+    
+    this->segment = nullptr;
+    this->readRing = nullptr;
+    this->writeRing = nullptr;
+    this->readData = nullptr;
+    this->writeData = nullptr;
+    this->connected = false;
+    this->peerLost = false;
+    this->setUp = false;
+}
+
+bool SharedMemoryRing::isSet() const {
+    return this->setUp;
+}
+
+//Private member functions
+
+bool SharedMemoryRing::waitForChange(const std::atomic<uint64_t>* position, uint64_t unchanged, std::atomic<uint32_t>* signal, std::atomic<uint32_t>* waiting, std::chrono::steady_clock::time_point deadline, bool forever) {
+    //Spin first. Waking a sleeping process costs microseconds, while the other side often answers within a few hundred nanoseconds
+    for (unsigned int a = 0; a < this->spinLimit; a++) {
+        if (position->load(std::memory_order_acquire) != unchanged) {
+            if (this->spinLimit < SHARED_MEMORY_RING_MAX_SPIN) this->spinLimit *= 2;
+            return true;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+    
+    //Spinning did not pay off this time, so spin less next time
+    if (this->spinLimit > SHARED_MEMORY_RING_MIN_SPIN) this->spinLimit /= 2;
+    
+    //A process that crashed never marks its side closed, so while asleep, check now and then that the other process still exists
+    std::chrono::steady_clock::time_point nextCheck = std::chrono::steady_clock::now() + std::chrono::milliseconds(SHARED_MEMORY_RING_LIVENESS_CHECK);
+    
+    while (true) {
+        //Read the signal before announcing the wait. If the other side changes the position after this, it also changes the signal, and the futex wait returns immediately
+        uint32_t signalValue = signal->load(std::memory_order_acquire);
+        waiting->store(1, std::memory_order_seq_cst);
+        
+        if (position->load(std::memory_order_seq_cst) != unchanged || this->readRing->writerClosed.load() || this->writeRing->readerClosed.load()) {
+            waiting->store(0, std::memory_order_relaxed);
+            return true;
+        }
+        
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        long remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count();
+        if (!forever && remaining <= 0) {
+            waiting->store(0, std::memory_order_relaxed);
+            return false;
+        }
+        
+        long untilCheck = std::chrono::duration_cast<std::chrono::microseconds>(nextCheck - now).count();
+        if (forever || untilCheck < remaining) remaining = untilCheck > 0 ? untilCheck : 0;
+        
+#if defined(__linux__)
+        timespec time;
+        time.tv_sec = remaining / 1000000;
+        time.tv_nsec = (remaining % 1000000) * 1000;
+        syscall(SYS_futex, signal, FUTEX_WAIT, signalValue, &time, nullptr, 0);
+#else
+        usleep(50);
+#endif
+        waiting->store(0, std::memory_order_relaxed);
+        
+        if (position->load(std::memory_order_acquire) != unchanged) return true;
+        
+        if (std::chrono::steady_clock::now() >= nextCheck) {
+            if (this->peerClosed()) {
+                this->peerLost = true;
+                return true;
+            }
+            nextCheck = std::chrono::steady_clock::now() + std::chrono::milliseconds(SHARED_MEMORY_RING_LIVENESS_CHECK);
+        }
+    }
+}
+
+void SharedMemoryRing::wake(std::atomic<uint32_t>* signal, std::atomic<uint32_t>* waiting) {
+    //Pairs with the store to waiting in waitForChange(), so either this side sees the other is asleep or the other side sees the new position
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    
+    if (waiting->load(std::memory_order_relaxed)) {
+        signal->fetch_add(1, std::memory_order_release);
+#if defined(__linux__)
+        syscall(SYS_futex, signal, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#endif
+    }
+}
+
+void SharedMemoryRing::mapSegment(int fileDescriptor, size_t size) {
+    /* mmap()
+     The mmap() function maps the shared memory object into this process. MAP_SHARED makes writes visible to every other process mapping the same object. The file descriptor is not needed once the mapping exists.
+     */
+    void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+    int error = errno;
+    ::close(fileDescriptor);
+    
+    if (address == MAP_FAILED) {
+        if (this->isHost) shm_unlink(this->segmentName.c_str());
+        throw std::runtime_error(std::string("ERROR mapping shared memory: ") + std::string(strerror(error)));
+    }
+    
+    this->segment = (Segment*)address;
+    this->segmentSize = size;
+    
+    //The host writes to rings[1] and reads from rings[0]. The other process does the opposite
+    this->readRing = &this->segment->rings[this->isHost ? 0 : 1];
+    this->writeRing = &this->segment->rings[this->isHost ? 1 : 0];
+}
+
+//Destructor
+
+SharedMemoryRing::~SharedMemoryRing() {
+    if (this->setUp) {
+        try {
+            this->close();
+        } catch (...) {
+            printf("Error closing shared memory ring");
+        }
+    }
+}
@@ -0,0 +1,206 @@
+#ifndef SharedMemoryRing_hpp
+#define SharedMemoryRing_hpp
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <cerrno>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#define SHARED_MEMORY_RING_CAPACITY 1048576
+#define SHARED_MEMORY_RING_MAGIC 0x534f434b //"SOCK", set once a segment is ready to be opened
+#define SHARED_MEMORY_RING_MIN_SPIN 64
+#define SHARED_MEMORY_RING_MAX_SPIN 16384
+#define SHARED_MEMORY_RING_LIVENESS_CHECK 100 //Milliseconds a blocked read or write sleeps between checks that the other process still exists
+
+/*
+ A SharedMemoryRing is one end of a connection between two processes on the same machine. The connection is a pair of single-producer, single-consumer byte rings in a shared memory segment (in /dev/shm on Linux), one for each direction. Sending or receiving is a copy into or out of the ring, with no system call unless the other side is asleep.
+
+ The host creates the segment with create() and waits for the other process with waitForPeer(). The other process attaches with open(). Once connected, the name is removed, so the host can create another ring with the same name for the next process.
+ */
+class SharedMemoryRing {
+public:
+    //Constructor
+    SharedMemoryRing();
+    
+    //Destructor
+    ~SharedMemoryRing();
+    
+    //Public member functions
+    
+    /*!
+     * A function to create a new segment as the host side of the connection. Any leftover segment with the same name is replaced. Will throw an error if the segment cannot be created, or if the ring is already set.
+     *
+     * @param name The name of the segment. A leading '/' is added if there is none.
+     * @param capacity An optional parameter indicating the number of bytes each direction can hold. It is rounded up to a power of two. Autoinitialized as SHARED_MEMORY_RING_CAPACITY.
+     */
+    void create(const char* name, size_t capacity = SHARED_MEMORY_RING_CAPACITY);
+    
+    /*!
+     * A function that waits for another process to open() the segment made by create(). Will throw an error if the ring was not made by create().
+     *
+     * @param timeoutMilliseconds The maximum time to wait, or a negative number to wait forever.
+     *
+     * @return True if the other process connected, false if the time ran out.
+     */
+    bool waitForPeer(int timeoutMilliseconds);
+    
+    /*!
+     * A function to attach to a segment made by create() in another process. Will throw an error if there is no such segment, if another process already attached to it, or if the ring is already set.
+     *
+     * @param name The name of the segment. A leading '/' is added if there is none.
+     */
+    void open(const char* name);
+    
+    /*!
+     * A function that copies data into the ring for the other side to read. If there is not enough space, either as much as fits is written, or the function waits for the reader to make room.
+     *
+     * @param data The bytes to send.
+     * @param length The number of bytes to send.
+     * @param waitForSpace If true, the function waits until all the data has been written.
+     *
+     * @return The number of bytes written, or -1 with errno set to EPIPE if the other side closed the connection.
+     */
+    long write(const char* data, size_t length, bool waitForSpace);
+    
+    /*!
+     * A function that copies whatever the other side has written, up to the given length, into a buffer. If nothing is waiting, the function spins briefly and then sleeps until data arrives.
+     *
+     * @param buffer The buffer to fill.
+     * @param length The size of the buffer.
+     * @param timeoutMilliseconds The maximum time to wait, or a negative number to wait forever.
+     *
+     * @return The number of bytes read. 0 if the other side closed the connection and everything has been read. -1 with errno set to EAGAIN if the time ran out.
+     */
+    long read(char* buffer, size_t length, int timeoutMilliseconds);
+    
+    /*!
+     * A function that waits until something can be read, without reading it. The end of the connection counts, since read() then returns at once.
+     *
+     * @param timeoutMilliseconds The maximum time to wait, or a negative number to wait forever.
+     *
+     * @return True if read() would return without waiting, false if the time ran out.
+     */
+    bool waitForData(int timeoutMilliseconds);
+    
+    /*!
+     * @return The number of bytes waiting to be read.
+     */
+    size_t available() const;
+    
+    /*!
+     * @return True if the other side closed the connection or its process is gone.
+     */
+    bool peerClosed() const;
+    
+    /*!
+     * A function that tells the other side nothing more will be written. It can still read what has already been written, and this side can still read.
+     */
+    void shutdownWrite();
+    
+    /*!
+     * A function to close this side of the connection and unmap the segment. Data already written stays readable by the other side. Until it is set again, other functions cannot be called.
+     */
+    void close();
+    
+    /*!
+     * @return If this object is set.
+     */
+    bool isSet() const;
+    
+private:
+    //Private types
+    
+    //The header of one direction. The writer owns head and the reader owns tail, and they are kept on separate cache lines so the two processes don't fight over them
+    struct RingHeader {
+        alignas(64) std::atomic<uint64_t> head; //Total number of bytes ever written
+        std::atomic<uint32_t> writerClosed; //Set once the writer will not write any more
+        std::atomic<uint32_t> writerWaiting; //Set while the writer sleeps waiting for space
+        std::atomic<uint32_t> spaceSignal; //Futex word the writer sleeps on
+        alignas(64) std::atomic<uint64_t> tail; //Total number of bytes ever read
+        std::atomic<uint32_t> readerClosed; //Set once the reader will not read any more
+        std::atomic<uint32_t> readerWaiting; //Set while the reader sleeps waiting for data
+        std::atomic<uint32_t> dataSignal; //Futex word the reader sleeps on
+    };
+    
+    //The start of the shared memory segment. The data of both rings follows it
+    struct Segment {
+        alignas(64) uint32_t magic; //Set last by create(), so open() never sees a half made segment
+        uint32_t hostProcess;
+        uint32_t peerProcess;
+        std::atomic<uint32_t> state; //0 while waiting for the other process, 1 once connected. Also the futex word for waitForPeer()
+        uint64_t capacity;
+        RingHeader rings[2]; //rings[0] is written by the process that called open(), rings[1] by the host
+    };
+    
+    //Private properties
+    
+    Segment* segment = nullptr;
+    size_t segmentSize = 0;
+    
+    RingHeader* readRing = nullptr;
+    RingHeader* writeRing = nullptr;
+    char* readData = nullptr;
+    char* writeData = nullptr;
+    uint64_t mask = 0; //capacity - 1, to wrap positions into the ring
+    
+    std::string segmentName;
+    bool isHost = false;
+    bool connected = false;
+    bool peerLost = false; //Set by waitForChange() once the other process is found to be gone without closing its side
+    
+    unsigned int spinLimit = 1024; //Number of checks before sleeping. Grows while spinning pays off and shrinks while it doesn't
+    
+    bool setUp = false; //Represents if the ring has already been set. If not, reading and writing will cause errors
+    
+    //Private member functions
+    
+    /*!
+     * A function that waits until a position in shared memory moves away from a value, until either side closes, or until the other process is found to be gone. It spins for a while first, and then sleeps on a futex, waking every SHARED_MEMORY_RING_LIVENESS_CHECK milliseconds to check on the other process.
+     *
+     * @param position The position to watch.
+     * @param unchanged The value the position has while there is nothing to do.
+     * @param signal The futex word to sleep on.
+     * @param waiting The flag telling the other side this side is asleep.
+     * @param deadline The time to stop waiting.
+     * @param forever If true, the deadline is ignored.
+     *
+     * @return False if the deadline passed, true otherwise.
+     */
+    bool waitForChange(const std::atomic<uint64_t>* position, uint64_t unchanged, std::atomic<uint32_t>* signal, std::atomic<uint32_t>* waiting, std::chrono::steady_clock::time_point deadline, bool forever);
+    
+    /*!
+     * A function that wakes the other side if it is asleep on the given futex word.
+     *
+     * @param signal The futex word to change.
+     * @param waiting The flag which is set if the other side is asleep.
+     */
+    void wake(std::atomic<uint32_t>* signal, std::atomic<uint32_t>* waiting);
+    
+    /*!
+     * A function to map a segment and set up the pointers into it.
+     *
+     * @param fileDescriptor The file descriptor of the segment.
+     * @param size The size of the segment.
+     */
+    void mapSegment(int fileDescriptor, size_t size);
+};
+
+#endif /* SharedMemoryRing_hpp */
@@ -0,0 +1,107 @@
+#include "TrafficCapture.hpp"
+
+TrafficCapture::TrafficCapture() {}
+
+//Public member functions
+
+void TrafficCapture::open(const char* path) {
+    if (this->setUp)
+        throw std::logic_error("Capture already set");
+    
+    this->fileDescriptor = ::open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (this->fileDescriptor < 0)
+        throw std::runtime_error(std::string("ERROR creating capture file: ") + std::string(strerror(errno)));
+    
+    try {
+        this->grow(TRAFFIC_CAPTURE_INITIAL_SIZE);
+    } catch (...) {
+        ::close(this->fileDescriptor);
+        this->fileDescriptor = -1;
+        throw;
+    }
+    
+    this->startTime = std::chrono::steady_clock::now();
+    
+    FileHeader* header = (FileHeader*)this->mapping;
+    header->magic = TRAFFIC_CAPTURE_MAGIC;
+    header->version = TRAFFIC_CAPTURE_VERSION;
+    header->startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    header->length = sizeof(FileHeader);
+    
+    this->setUp = true;
+}
+
+void TrafficCapture::append(unsigned int clientIndex, Direction direction, const char* data, unsigned long length) {
+    if (!this->setUp)
+        throw std::logic_error("Capture not set");
+    
+    FileHeader* header = (FileHeader*)this->mapping;
+    size_t recordSize = sizeof(RecordHeader) + ((length + 7) & ~(unsigned long)7);
+    if (header->length + recordSize > this->mappingSize) {
+        this->grow(header->length + recordSize);
+        header = (FileHeader*)this->mapping;
+    }
+    
+    RecordHeader* record = (RecordHeader*)(this->mapping + header->length);
+    record->time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->startTime).count();
+    record->clientIndex = clientIndex;
+    record->direction = direction;
+    record->length = length;
+    if (length > 0) memcpy((char*)(record + 1), data, length);
+    
+    //The length is moved past the record last, so a reader never sees half of one
+    header->length += recordSize;
+}
+
+void TrafficCapture::close() {
+    if (!this->setUp) return;
+    
+    //Trim the unused space the file grew into
+    size_t length = ((FileHeader*)this->mapping)->length;
+    munmap(this->mapping, this->mappingSize);
+    if (ftruncate(this->fileDescriptor, length) < 0) {} //The file is still readable at its larger size
+    ::close(this->fileDescriptor);
+    
+    this->mapping = nullptr;
+    this->mappingSize = 0;
+    this->fileDescriptor = -1;
+    this->setUp = false;
+}
+
+bool TrafficCapture::isSet() const {
+    return this->setUp;
+}
+
+//Private member functions
+
+void TrafficCapture::grow(size_t size) {
+    //Double the size each time, so the cost of growing is spread over many records
+    size_t newSize = this->mappingSize > 0 ? this->mappingSize * 2 : TRAFFIC_CAPTURE_INITIAL_SIZE;
+    while (newSize < size) newSize *= 2;
+    
+    if (ftruncate(this->fileDescriptor, newSize) < 0)
+        throw std::runtime_error(std::string("ERROR growing capture file: ") + std::string(strerror(errno)));
+    
+    /* mmap()
+     The mmap() function maps the file into memory. MAP_SHARED writes records straight into the page cache, so they reach the file even if the process dies.
+     */
+    void* address = mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, this->fileDescriptor, 0);
+    if (address == MAP_FAILED)
+        throw std::runtime_error(std::string("ERROR mapping capture file: ") + std::string(strerror(errno)));
+    
+    if (this->mapping != nullptr) munmap(this->mapping, this->mappingSize);
+    this->mapping = (char*)address;
+    this->mappingSize = newSize;
+}
+
+//Destructor
+
+TrafficCapture::~TrafficCapture() {
+    if (this->setUp) {
+        try {
+            this->close();
+        } catch (...) {
+            printf("Error closing traffic capture");
+        }
+    }
+}
@@ -0,0 +1,139 @@
+#include "TrafficReplay.hpp"
+
+TrafficReplay::TrafficReplay() {}
+
+//Public member functions
+
+void TrafficReplay::open(const char* path) {
+    if (this->setUp)
+        throw std::logic_error("Replay already set");
+    
+    int fileDescriptor = ::open(path, O_RDONLY);
+    if (fileDescriptor < 0)
+        throw std::runtime_error(std::string("ERROR opening capture file: ") + std::string(strerror(errno)));
+    
+    struct stat fileInfo;
+    if (fstat(fileDescriptor, &fileInfo) < 0 || fileInfo.st_size < (off_t)sizeof(TrafficCapture::FileHeader)) {
+        ::close(fileDescriptor);
+        throw std::runtime_error("ERROR opening capture file: File is not a capture");
+    }
+    
+    void* address = mmap(nullptr, fileInfo.st_size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    int error = errno;
+    ::close(fileDescriptor);
+    
+    if (address == MAP_FAILED)
+        throw std::runtime_error(std::string("ERROR mapping capture file: ") + std::string(strerror(error)));
+    
+    const TrafficCapture::FileHeader* header = (const TrafficCapture::FileHeader*)address;
+    if (header->magic != TRAFFIC_CAPTURE_MAGIC || header->version < 1 || header->version > TRAFFIC_CAPTURE_VERSION) {
+        munmap(address, fileInfo.st_size);
+        throw std::runtime_error("ERROR opening capture file: File is not a capture");
+    }
+    
+    this->mapping = (const char*)address;
+    this->mappingSize = fileInfo.st_size;
+    this->length = std::min((size_t)header->length, this->mappingSize);
+    this->setUp = true;
+}
+
+unsigned long TrafficReplay::replay(const char* hostName, int portNum, double speed, bool waitForReplies) {
+    if (!this->setUp)
+        throw std::logic_error("Replay not set");
+    
+    std::map<uint32_t, std::unique_ptr<ClientSocket>> clients; //The replaying client for each client index in the capture
+    std::vector<char> reply;
+    unsigned long sent = 0;
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    size_t offset = sizeof(TrafficCapture::FileHeader);
+    const TrafficCapture::RecordHeader* record;
+    while ((record = this->nextRecord(offset)) != nullptr) {
+        const char* data = (const char*)(record + 1);
+        std::unique_ptr<ClientSocket>& client = clients[record->clientIndex];
+        
+        //Wait until the record's time, scaled by the speed, before a client connects, sends or closes
+        if (speed > 0 && (!client || record->direction != TrafficCapture::Sent)) {
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds((long long)(record->time / speed)));
+        }
+        
+        //Indices are reused, so the client at an index is replaced whenever the original one was. A capture that stopped early can lack the Closed record
+        if (record->direction == TrafficCapture::Opened || record->direction == TrafficCapture::Closed) client.reset();
+        if (record->direction == TrafficCapture::Closed) continue;
+        
+        //A capture started while the client was already connected has no Opened record for it, so it connects when it first appears
+        if (!client) {
+            client.reset(new ClientSocket(hostName, portNum));
+            client->setTimeout(0, TRAFFIC_REPLAY_REPLY_TIMEOUT);
+        }
+        
+        if (record->direction == TrafficCapture::Received) {
+            //The server received this, so the client sends it
+            client->send(std::string_view(data, record->length), true);
+            sent++;
+        } else if (record->direction == TrafficCapture::Sent && waitForReplies && client->getSet()) {
+            //The server sent this, so the client reads the same amount before going on. A server that replies differently only costs the timeout
+            reply.resize(record->length);
+            try {
+                client->receive(reply.data(), record->length);
+            } catch (const std::runtime_error&) {}
+        }
+    }
+    
+    return sent;
+}
+
+unsigned long TrafficReplay::numberOfRecords() const {
+    if (!this->setUp)
+        throw std::logic_error("Replay not set");
+    
+    unsigned long count = 0;
+    size_t offset = sizeof(TrafficCapture::FileHeader);
+    while (this->nextRecord(offset) != nullptr) count++;
+    return count;
+}
+
+void TrafficReplay::close() {
+    if (!this->setUp) return;
+    
+    munmap((void*)this->mapping, this->mappingSize);
+    this->mapping = nullptr;
+    this->mappingSize = 0;
+    this->length = 0;
+    this->setUp = false;
+}
+
+bool TrafficReplay::isSet() const {
+    return this->setUp;
+}
+
+//Private member functions
+
+const TrafficCapture::RecordHeader* TrafficReplay::nextRecord(size_t& offset) const {
+    if (offset + sizeof(TrafficCapture::RecordHeader) > this->length) return nullptr;
+    
+    const TrafficCapture::RecordHeader* record = (const TrafficCapture::RecordHeader*)(this->mapping + offset);
+    
+    //Check the length before rounding it up, since a corrupt length near the largest value would wrap around to a small one
+    size_t space = this->length - offset - sizeof(TrafficCapture::RecordHeader);
+    if (record->length > space) return nullptr;
+    
+    size_t recordSize = sizeof(TrafficCapture::RecordHeader) + ((record->length + 7) & ~(uint64_t)7);
+    if (recordSize > this->length - offset) return nullptr;
+    
+    offset += recordSize;
+    return record;
+}
+
+//Destructor
+
+TrafficReplay::~TrafficReplay() {
+    if (this->setUp) {
+        try {
+            this->close();
+        } catch (...) {
+            printf("Error closing traffic replay");
+        }
+    }
+}
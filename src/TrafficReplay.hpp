@@ -0,0 +1,98 @@
+#ifndef TrafficReplay_hpp
+#define TrafficReplay_hpp
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <exception>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <cerrno>
+
+#include "ClientSocket.hpp"
+#include "TrafficCapture.hpp"
+
+#define TRAFFIC_REPLAY_REPLY_TIMEOUT 1000
+
+/*
+ A TrafficReplay plays a file recorded with ServerSocket::startCapture() back against a server. Each client in the capture gets its own ClientSocket, which sends what the original client sent, when it sent it.
+ */
+class TrafficReplay {
+public:
+    //Constructor
+    TrafficReplay();
+    
+    //Destructor
+    ~TrafficReplay();
+    
+    //Public member functions
+    
+    /*!
+     * A function to open a capture file for replaying. Will throw an error if the file cannot be read, if it is not a capture, or if the replay is already set.
+     *
+     * @param path The path of the capture file.
+     */
+    void open(const char* path);
+    
+    /*!
+     * A function that replays the capture against a server. A client connects when the original one did, or when it first appears in the capture, and is closed when the original was, so a reused index gets a new connection. It sends each message at its original time, divided by the speed. If replies are waited for, each client reads as many bytes as the original server sent it before going on, for up to TRAFFIC_REPLAY_REPLY_TIMEOUT milliseconds. Will throw an error if the replay is not set, or if a client cannot connect.
+     *
+     * @param hostName The name of the host to connect to.
+     * @param portNum The port to connect to.
+     * @param speed An optional parameter for how many times faster than the original to play. 0 sends everything as fast as possible. Automatically set to 1.
+     * @param waitForReplies An optional parameter that makes clients read the server's replies, so they pace themselves like the original clients. Automatically set to true.
+     *
+     * @return The number of messages sent.
+     */
+    unsigned long replay(const char* hostName, int portNum, double speed = 1, bool waitForReplies = true);
+    
+    /*!
+     * @return The number of records in the capture. Will throw an error if the replay is not set.
+     */
+    unsigned long numberOfRecords() const;
+    
+    /*!
+     * A function to close the capture file. Until it is set again, other functions cannot be called.
+     */
+    void close();
+    
+    /*!
+     * @return If this object is set.
+     */
+    bool isSet() const;
+    
+private:
+    //Private properties
+    
+    const char* mapping = nullptr;
+    size_t mappingSize = 0;
+    size_t length = 0; //The bytes used in the capture, which may be fewer than the file holds if it was not finished
+    
+    bool setUp = false; //Represents if the replay has already been set. If not, replaying will cause errors
+    
+    //Private member functions
+    
+    /*!
+     * A function that reads the record at an offset in the capture, and moves the offset past it.
+     *
+     * @param offset The offset of a record, which is updated to the offset of the next one.
+     *
+     * @return The record at the offset, or a null pointer if there are no more whole records.
+     */
+    const TrafficCapture::RecordHeader* nextRecord(size_t& offset) const;
+};
+
+#endif /* TrafficReplay_hpp */
@@ -0,0 +1,18 @@
+#ifndef Check_hpp
+#define Check_hpp
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*!
+ Fails the running check, naming the file and line, when a condition doesn't hold. Unlike assert() it is never compiled out.
+ */
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1); \
+        } \
+    } while (0)
+
+#endif /* Check_hpp */
@@ -0,0 +1,76 @@
+//Standard library includes
+#include <string>
+#include <vector>
+#include <memory>
+
+//C includes
+#include <unistd.h>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "Check.hpp"
+
+/*
+ Checks batched accepts and each overflow policy: Reject closes clients beyond the maximum, Queue holds them until an index frees up, Grow adds indices, and a timed out addClient() throws without closing the listening socket.
+ */
+
+int main() {
+    {
+        ServerSocket server(3137, 2, 64);
+        std::vector<std::unique_ptr<ClientSocket>> clients;
+        for (int i = 0; i < 5; i++) {
+            clients.emplace_back(new ClientSocket("localhost", 3137));
+        }
+        usleep(50000);
+        std::vector<unsigned int> accepted;
+        CHECK(server.acceptClients([&](unsigned int clientIndex) {accepted.push_back(clientIndex);}) == 2);
+        CHECK(accepted.size() == 2 && server.numberOfClients() == 2);
+        CHECK(server.acceptClients() == 0);
+    }
+    {
+        ServerSocket server(3138, 2);
+        server.setOverflowPolicy(ServerSocket::Queue);
+        std::vector<std::unique_ptr<ClientSocket>> clients;
+        for (int i = 0; i < 5; i++) {
+            clients.emplace_back(new ClientSocket("localhost", 3138));
+        }
+        usleep(50000);
+        CHECK(server.acceptClients() == 2);
+        CHECK(server.numberOfQueuedClients() == 3);
+        server.closeConnection(0);
+        CHECK(server.acceptClients() == 1);
+        CHECK(server.numberOfQueuedClients() == 2);
+        server.closeConnection(1);
+        CHECK(server.addClient() == 1);
+        CHECK(server.numberOfQueuedClients() == 1);
+    }
+    {
+        ServerSocket server(3139, 1);
+        server.setOverflowPolicy(ServerSocket::Grow);
+        std::vector<std::unique_ptr<ClientSocket>> clients;
+        for (int i = 0; i < 100; i++) {
+            clients.emplace_back(new ClientSocket("localhost", 3139));
+        }
+        usleep(50000);
+        unsigned int accepted = 0;
+        while (accepted < 100) {
+            accepted += server.acceptClients();
+        }
+        CHECK(server.numberOfClients() == 100);
+        server.send("x", 99, true);
+        CHECK(clients[99]->receive() == "x");
+        
+        server.setHostTimeout(0, 100);
+        bool threw = false;
+        try {
+            server.addClient();
+        }
+        catch (const std::runtime_error& error) {
+            threw = true;
+        }
+        CHECK(threw);
+        CHECK(server.listeningFD() >= 0);
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+//Standard library includes
+#include <string>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <cstddef>
+
+//C includes
+#include <unistd.h>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "TrafficCapture.hpp"
+#include "TrafficReplay.hpp"
+#include "Check.hpp"
+
+/*
+ Checks traffic capture and replay: a captured conversation has a record for every message and connection, replaying it sends the client's side again at the requested pace, a client that reconnects at the same index is replayed on a new connection, and a record whose length runs past the end of the file ends the log instead of being read.
+ */
+
+int main() {
+    const char* path = "/tmp/socks-check.cap";
+    
+    {
+        ServerSocket server(3109, 1);
+        server.startCapture(path);
+        std::thread client([] {
+            ClientSocket socket("localhost", 3109);
+            char reply[5];
+            for (int i = 0; i < 5; i++) {
+                socket.send(std::string_view("ping" + std::to_string(i)));
+                CHECK(socket.receive(reply, 5));
+                usleep(40000);
+            }
+        });
+        server.addClient();
+        for (int i = 0; i < 5; i++) {
+            CHECK(server.receive(0) == "ping" + std::to_string(i));
+            server.send(std::string_view("pong" + std::to_string(i)), 0);
+        }
+        client.join();
+        server.stopCapture();
+    }
+    
+    //Replay at twice the speed against a new server
+    {
+        TrafficReplay replay;
+        replay.open(path);
+        CHECK(replay.numberOfRecords() == 11);
+        ServerSocket server(3110, 1);
+        std::string received;
+        std::thread thread([&] {
+            server.addClient();
+            char message[5];
+            for (int i = 0; i < 5; i++) {
+                CHECK(server.receive(message, 5, 0));
+                received.append(message, 5);
+                server.send(std::string_view("pong" + std::to_string(i)), 0);
+            }
+        });
+        auto start = std::chrono::steady_clock::now();
+        CHECK(replay.replay("localhost", 3110, 2) == 5);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        thread.join();
+        CHECK(received == "ping0ping1ping2ping3ping4");
+        CHECK(seconds > 0.06 && seconds < 1);
+    }
+    
+    //Two clients in turn at the only index
+    {
+        ServerSocket server(3111, 1);
+        server.startCapture(path);
+        for (int i = 0; i < 2; i++) {
+            ClientSocket socket("localhost", 3111);
+            socket.send(std::string_view("hello" + std::to_string(i)), true);
+            CHECK(server.addClient() == 0);
+            CHECK(server.receive(0) == "hello" + std::to_string(i));
+            socket.close();
+            bool closed = false;
+            server.receive(0, &closed);
+            CHECK(closed);
+        }
+        server.stopCapture();
+    }
+    {
+        TrafficReplay replay;
+        replay.open(path);
+        CHECK(replay.numberOfRecords() == 6);
+        ServerSocket server(3112, 1);
+        std::string received;
+        std::thread thread([&] {
+            for (int i = 0; i < 2; i++) {
+                CHECK(server.addClient() == 0);
+                char message[6];
+                CHECK(server.receive(message, 6, 0));
+                received.append(message, 6);
+                bool closed = false;
+                server.receive(0, &closed);
+                CHECK(closed);
+            }
+        });
+        CHECK(replay.replay("localhost", 3112, 0) == 2);
+        thread.join();
+        CHECK(received == "hello0hello1");
+    }
+    
+    //Corrupt the length of the second record
+    {
+        TrafficCapture capture;
+        capture.open(path);
+        capture.append(0, TrafficCapture::Received, "hello", 5);
+        capture.append(0, TrafficCapture::Sent, "world!", 6);
+        capture.append(1, TrafficCapture::Received, "x", 1);
+        capture.close();
+    }
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        size_t second = sizeof(TrafficCapture::FileHeader) + sizeof(TrafficCapture::RecordHeader) + 8;
+        uint64_t length = UINT64_MAX - 3;
+        file.seekp(second + offsetof(TrafficCapture::RecordHeader, length));
+        file.write((const char*)&length, sizeof(length));
+    }
+    {
+        TrafficReplay replay;
+        replay.open(path);
+        CHECK(replay.numberOfRecords() == 1);
+    }
+    unlink(path);
+    return 0;
+}
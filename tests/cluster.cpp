@@ -0,0 +1,99 @@
+//Standard library includes
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+
+//C includes
+#include <unistd.h>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClusterClient.hpp"
+#include "Check.hpp"
+
+/*
+ Checks the cluster client: keys spread evenly over the healthy nodes, marking a node down only moves its own keys and reconnecting moves them back, a hot key spills to other nodes past the load bound, and a node whose server closes is found by checkHealth().
+ */
+
+int main() {
+    std::vector<std::unique_ptr<ServerSocket>> servers;
+    std::vector<std::thread> threads;
+    ClusterClient cluster;
+    for (int i = 0; i < 4; i++) {
+        servers.emplace_back(new ServerSocket(3160 + i, 4));
+    }
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([&servers, i] {servers[i]->addClient();});
+        CHECK(cluster.addNode("127.0.0.1", 3160 + i) == (unsigned int)i);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    //Nothing listens here, so the node is added but unhealthy
+    unsigned int dead = cluster.addNode("127.0.0.1", 3199, 500);
+    CHECK(!cluster.isHealthy(dead));
+    CHECK(cluster.numberOfHealthyNodes() == 4);
+    
+    std::map<std::string, unsigned int> before;
+    unsigned int keys[5] = {0};
+    for (int i = 0; i < 10000; i++) {
+        std::string key = "key" + std::to_string(i);
+        unsigned int node = cluster.route(key);
+        cluster.finished(node);
+        before[key] = node;
+        keys[node]++;
+    }
+    for (int i = 0; i < 4; i++) {
+        CHECK(keys[i] > 1800 && keys[i] < 3200);
+    }
+    
+    cluster.markDown(2);
+    for (auto& [key, node] : before) {
+        unsigned int now = cluster.route(key);
+        cluster.finished(now);
+        CHECK(now != 2);
+        CHECK(now == node || node == 2);
+    }
+    servers[2]->closeConnection(0);
+    std::thread thread([&servers] {servers[2]->addClient();});
+    CHECK(cluster.reconnect(2));
+    thread.join();
+    for (auto& [key, node] : before) {
+        unsigned int now = cluster.route(key);
+        cluster.finished(now);
+        CHECK(now == node);
+    }
+    
+    //100 calls in flight on one key
+    std::map<unsigned int, int> hot;
+    for (int i = 0; i < 100; i++) {
+        hot[cluster.route("hot")]++;
+    }
+    CHECK(hot.size() > 1);
+    for (auto& [node, calls] : hot) {
+        CHECK(calls <= 32);
+        for (int i = 0; i < calls; i++) {
+            cluster.finished(node);
+        }
+    }
+    
+    //Keyless calls go round the healthy nodes
+    unsigned int calls[5] = {0};
+    for (int i = 0; i < 8; i++) {
+        unsigned int node = cluster.route();
+        calls[node]++;
+        cluster.finished(node);
+    }
+    for (int i = 0; i < 4; i++) {
+        CHECK(calls[i] == 2);
+    }
+    
+    servers[1]->closeConnection(0);
+    usleep(50000);
+    CHECK(cluster.checkHealth() == 1);
+    CHECK(!cluster.isHealthy(1));
+    return 0;
+}
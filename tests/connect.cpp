@@ -0,0 +1,81 @@
+//Standard library includes
+#include <string>
+#include <vector>
+#include <chrono>
+
+//C includes
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "Check.hpp"
+
+/*
+ Checks connecting: a client reaches a listening server, a refused connection fails at once, and a host that never answers fails after the connect timeout rather than the kernel's.
+ */
+
+static long millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    {
+        ServerSocket server(3140, 2);
+        ClientSocket client("localhost", 3140);
+        CHECK(server.addClient() == 0);
+        client.send("hi");
+        CHECK(server.receive(0) == "hi");
+        server.send("yo", 0);
+        CHECK(client.receive() == "yo");
+    }
+    
+    //Nothing listens on this port
+    auto start = std::chrono::steady_clock::now();
+    bool threw = false;
+    try {
+        ClientSocket client("localhost", 3141);
+    }
+    catch (const std::runtime_error& error) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(millisecondsSince(start) < 1000);
+    
+    //A listener whose backlog is full drops new connection requests, so they are never answered
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(3142);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(bind(listener, (sockaddr*)&address, sizeof(address)) == 0);
+    CHECK(listen(listener, 0) == 0);
+    std::vector<int> backlog;
+    for (int i = 0; i < 4; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        connect(fd, (sockaddr*)&address, sizeof(address));
+        backlog.push_back(fd);
+    }
+    start = std::chrono::steady_clock::now();
+    threw = false;
+    try {
+        ClientSocket client("127.0.0.1", 3142, 400);
+    }
+    catch (const std::runtime_error& error) {
+        threw = true;
+    }
+    long elapsed = millisecondsSince(start);
+    CHECK(threw);
+    CHECK(elapsed >= 350 && elapsed < 2000);
+    
+    for (int fd : backlog) {
+        close(fd);
+    }
+    close(listener);
+    return 0;
+}
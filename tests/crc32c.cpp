@@ -0,0 +1,84 @@
+//Standard library includes
+#include <string>
+#include <thread>
+#include <random>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "RPCServer.hpp"
+#include "RPCClient.hpp"
+#include "CRC32C.hpp"
+#include "Check.hpp"
+
+/*
+ Checks CRC32C: the standard check value, agreement between the hardware path and the tables at every length and alignment, continuing a checksum, and copying while checksumming. Then RPC calls with checksums on succeed, and a damaged request is answered with RPC_CHECKSUM_FAILED without reaching its handler.
+ */
+
+int main() {
+    CHECK(crc32c("123456789", 9) == 0xE3069283);
+    CHECK(crc32c("", 0) == 0);
+    
+    std::mt19937 random(1);
+    std::string bytes(1024, '\0');
+    for (char& byte : bytes) {
+        byte = (char)random();
+    }
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t length = 0; length + offset <= 300; length++) {
+            uint32_t expected = ~CRC32CDetail::software(~0u, nullptr, bytes.data() + offset, length);
+            CHECK(crc32c(bytes.data() + offset, length) == expected);
+        }
+    }
+    for (size_t split = 0; split <= bytes.size(); split += 37) {
+        CHECK(crc32c(bytes.data() + split, bytes.size() - split, crc32c(bytes.data(), split)) == crc32c(bytes.data(), bytes.size()));
+    }
+    std::string copy(bytes.size(), '\0');
+    CHECK(crc32cCopy(copy.data(), bytes.data(), bytes.size()) == crc32c(bytes.data(), bytes.size()));
+    CHECK(copy == bytes);
+    
+    ServerSocket server(3210, 2);
+    std::thread client([] {
+        ClientSocket socket("127.0.0.1", 3210);
+        RPCClient rpc(socket);
+        rpc.setChecksums(true);
+        std::string response;
+        CHECK(rpc.call(1, "hello", response) == RPC_OK && response == "hello");
+        std::string big(3 << 20, 'q');
+        CHECK(rpc.call(1, big, response) == RPC_OK && response == big);
+        CHECK(rpc.call(1, "", response) == RPC_OK && response.empty());
+        
+        //Flip a bit in the payload of a request made by hand
+        RPCHeader header = {};
+        header.callID = 77;
+        header.method = 1;
+        header.flags = RPC_FLAG_CHECKSUM;
+        std::string frame;
+        size_t length = writeRPCFrame(header, "payload", frame);
+        frame[length - 1] ^= 1;
+        socket.send(std::string_view(frame.data(), length), true);
+        MessageBuffer<RPCHeader> reply;
+        CHECK(socket.receiveMessage(reply));
+        RPCHeader replyHeader = reply.view().decode();
+        CHECK(replyHeader.status == RPC_CHECKSUM_FAILED && replyHeader.callID == 77 && replyHeader.length == 0);
+        
+        rpc.setChecksums(false);
+        CHECK(rpc.call(1, "plain", response) == RPC_OK && response == "plain");
+    });
+    server.addClient();
+    server.setTimeout(5);
+    RPCServer rpc(server);
+    int ran = 0;
+    rpc.registerMethod(1, [&ran](std::string_view request, std::string& response) {
+        ran++;
+        response.assign(request);
+        return (uint16_t)RPC_OK;
+    });
+    int handled = 0;
+    while (rpc.handle(0)) {
+        handled++;
+    }
+    client.join();
+    CHECK(handled == 5 && ran == 4);
+    return 0;
+}
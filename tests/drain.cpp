@@ -0,0 +1,47 @@
+//Standard library includes
+#include <string>
+#include <vector>
+#include <thread>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "Check.hpp"
+
+/*
+ Checks drain(): a reply sent just before draining still reaches the client, a message the client sends while the server drains is handed to onMessage, and the server ends up unset and can be set again.
+ */
+
+int main() {
+    ServerSocket server(3102, 2);
+    
+    std::thread client([] {
+        ClientSocket socket("localhost", 3102);
+        socket.send("request");
+        CHECK(socket.receive() == "reply");
+        
+        //The server has stopped sending, but still reads what arrives
+        socket.send("late");
+        bool closed = false;
+        std::string rest = socket.receive(&closed);
+        CHECK(closed && rest.empty());
+        socket.close();
+    });
+    
+    server.addClient();
+    CHECK(server.receive(0) == "request");
+    server.send("reply", 0, true);
+    
+    std::vector<std::string> late;
+    CHECK(server.drain(2, 0, [&](unsigned int clientIndex, const std::string& message) {
+        CHECK(clientIndex == 0);
+        late.push_back(message);
+    }));
+    client.join();
+    CHECK(late.size() == 1 && late[0] == "late");
+    CHECK(!server.isSet());
+    
+    server.setSocket(3102, 1);
+    CHECK(server.isSet());
+    return 0;
+}
@@ -0,0 +1,98 @@
+//Standard library includes
+#include <string>
+#include <fstream>
+#include <sstream>
+
+//C includes
+#include <string.h>
+#include <dlfcn.h>
+#include <netdb.h>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "Check.hpp"
+
+/*
+ Checks TCP Fast Open: with it on at both ends, repeated connections carry their first message and get replies as usual, both to a numeric address and to a name with an IPv4 and an IPv6 address. Where the kernel allows Fast Open for both clients and servers (net.ipv4.tcp_fastopen = 3), the later connections must also have put their data in the SYN.
+ */
+
+//Makes dualstack.socks resolve to 127.0.0.1 and then ::1, like a name with both kinds of record. Defined here, it is called instead of the C library's getaddrinfo(), which it passes every other name to
+extern "C" int getaddrinfo(const char* node, const char* service, const addrinfo* hints, addrinfo** result) {
+    typedef int (*Lookup)(const char*, const char*, const addrinfo*, addrinfo**);
+    static Lookup lookup = (Lookup)dlsym(RTLD_NEXT, "getaddrinfo");
+    if (node == nullptr || strcmp(node, "dualstack.socks") != 0) return lookup(node, service, hints, result);
+    
+    addrinfo numeric;
+    memset(&numeric, 0, sizeof(numeric));
+    if (hints != nullptr) numeric = *hints;
+    numeric.ai_flags |= AI_NUMERICHOST;
+    
+    addrinfo* ipv4;
+    addrinfo* ipv6;
+    numeric.ai_family = AF_INET;
+    int error = lookup("127.0.0.1", service, &numeric, &ipv4);
+    if (error != 0) return error;
+    numeric.ai_family = AF_INET6;
+    error = lookup("::1", service, &numeric, &ipv6);
+    if (error != 0) {
+        freeaddrinfo(ipv4);
+        return error;
+    }
+    
+    //freeaddrinfo() frees each entry on its own, so the lists can be joined
+    addrinfo* last = ipv4;
+    while (last->ai_next != nullptr) last = last->ai_next;
+    last->ai_next = ipv6;
+    *result = ipv4;
+    return 0;
+}
+
+//Reads a counter from the TcpExt section of /proc/net/netstat. -1 if it isn't there
+static long netstatCounter(const std::string& name) {
+    std::ifstream file("/proc/net/netstat");
+    std::string names, values;
+    while (std::getline(file, names) && std::getline(file, values)) {
+        std::istringstream nameStream(names), valueStream(values);
+        std::string counter, value;
+        while (nameStream >> counter && valueStream >> value) {
+            if (counter == name) return std::stol(value);
+        }
+    }
+    return -1;
+}
+
+int main() {
+    int mode = 0;
+    std::ifstream("/proc/sys/net/ipv4/tcp_fastopen") >> mode;
+    long before = netstatCounter("TCPFastOpenPassive");
+    
+    ServerSocket server(3144, 4);
+    server.setFastOpen(true);
+    const char* hosts[] = {"127.0.0.1", "dualstack.socks"};
+    for (const char* host : hosts) {
+        for (int i = 0; i < 3; i++) {
+            ClientSocket client;
+            client.setFastOpen(true);
+            client.setSocket(host, 3144);
+            bool usedFastOpen = client.usedFastOpen();
+            client.send("ping", true);
+            int clientIndex = server.addClient();
+            CHECK(server.receive(clientIndex) == "ping");
+            server.send("pong", clientIndex, true);
+            CHECK(client.receive() == "pong");
+            server.closeConnection(clientIndex);
+            
+            //The first connection may only fetch the cookie, unless an earlier run left one. The name's first address is 127.0.0.1 too, so it shares the cookie
+            if ((mode & 3) == 3 && i > 0) {
+                CHECK(usedFastOpen);
+            }
+        }
+    }
+    
+    if ((mode & 3) == 3 && before >= 0) {
+        CHECK(netstatCounter("TCPFastOpenPassive") - before >= 5);
+    }
+    server.setFastOpen(false);
+    return 0;
+}
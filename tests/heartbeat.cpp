@@ -0,0 +1,42 @@
+//Standard library includes
+#include <string>
+#include <thread>
+#include <chrono>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "Check.hpp"
+
+/*
+ Checks liveness tracking: a connected peer is alive and recently seen, and once it closes the other side reports it dead and closeDeadConnections() removes it.
+ */
+
+int main() {
+    ServerSocket server(3101, 2);
+    server.setHeartbeat(1, 1, 2);
+    
+    std::thread client([] {
+        ClientSocket socket("localhost", 3101);
+        socket.setHeartbeat(1);
+        socket.send("hi");
+        CHECK(socket.receive() == "bye");
+        CHECK(socket.isAlive());
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    });
+    
+    auto start = std::chrono::steady_clock::now();
+    server.addClient();
+    CHECK(server.receive(0) == "hi");
+    CHECK(server.isAlive(0));
+    CHECK(server.lastSeen(0) >= start);
+    server.send("bye", 0, true);
+    
+    //Once the client closes its side, the connection is dead
+    client.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(!server.isAlive(0));
+    CHECK(server.closeDeadConnections() == 1);
+    CHECK(server.numberOfClients() == 0);
+    return 0;
+}
@@ -0,0 +1,62 @@
+//Standard library includes
+#include <string>
+#include <thread>
+
+//C includes
+#include <unistd.h>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "LatencyHistogram.hpp"
+#include "Check.hpp"
+
+/*
+ Checks latency tracing: histogram percentiles are accurate to within a bucket and survive merging, and with tracing on both sockets every received message after the first, most sent ones and every round trip are timed.
+ */
+
+int main() {
+    //1 to 100000 microseconds, evenly
+    LatencyHistogram histogram, other;
+    for (uint64_t a = 1; a <= 100000; a++) {
+        (a % 2 ? histogram : other).record(a * 1000);
+    }
+    histogram.merge(other);
+    CHECK(histogram.count() == 100000);
+    CHECK(histogram.max() == 100000000);
+    CHECK(histogram.percentile(0.5) >= 50000000 && histogram.percentile(0.5) < 50000000 * 1.05);
+    CHECK(histogram.percentile(0.99) >= 99000000 && histogram.percentile(0.99) <= 100000000);
+    histogram.reset();
+    CHECK(histogram.count() == 0 && histogram.percentile(0.5) == 0);
+    
+    ServerSocket server(3112, 1);
+    std::thread client([] {
+        ClientSocket socket("localhost", 3112);
+        socket.setTracing(true);
+        char reply[4];
+        for (int i = 0; i < 200; i++) {
+            socket.send(std::string_view("ping"));
+            CHECK(socket.receive(reply, 4));
+        }
+        const LatencyTrace& trace = socket.latencyTrace();
+        CHECK(trace.roundTrip.count() == 200);
+        CHECK(trace.roundTrip.percentile(0.5) > 0);
+        CHECK(trace.receiveQueue.count() > 0);
+        bool closed = false;
+        socket.receive(reply, 1, &closed);
+    });
+    server.setTracing(true);
+    server.addClient();
+    for (int i = 0; i < 200; i++) {
+        CHECK(server.receive(0) == "ping");
+        server.send(std::string_view("pong"), 0);
+    }
+    usleep(50000);
+    const LatencyTrace& trace = server.latencyTrace(0);
+    //The first ping can arrive before accepting turns timestamps on
+    CHECK(trace.receiveQueue.count() >= 199);
+    CHECK(trace.transmit.count() > 150);
+    server.closeConnection(0);
+    client.join();
+    return 0;
+}
@@ -0,0 +1,70 @@
+//Standard library includes
+#include <string>
+#include <vector>
+#include <thread>
+
+//C includes
+#include <stdio.h>
+#include <stdlib.h>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "Check.hpp"
+
+/*
+ Checks tools/loadgen against an echo server: closed-loop clients all connect and get their messages answered, and an open-loop run sends close to the requested rate. tests/run.sh builds the tool and passes its directory in SOCKS_TOOLS.
+ */
+
+//Echoes everything the given number of clients send until they all close
+static void echo(ServerSocket& server, unsigned int clients) {
+    std::vector<unsigned int> open;
+    for (unsigned int a = 0; a < clients; a++) {
+        server.addClient(); //Takes the lowest free index
+        open.push_back(a);
+    }
+    while (!open.empty()) {
+        for (size_t a = 0; a < open.size(); a++) {
+            bool closed = false;
+            std::string message = server.receive(open[a], &closed);
+            if (closed) open.erase(open.begin() + a--); //receive() has closed the connection
+            else server.send(std::string_view(message), open[a], true);
+        }
+    }
+}
+
+//Runs loadgen, and returns the number of messages it sent and had answered
+static void runLoadgen(const std::string& options, unsigned long& sent, unsigned long& answered) {
+    std::string command = std::string(getenv("SOCKS_TOOLS")) + "/loadgen 127.0.0.1 3111 " + options;
+    FILE* output = popen(command.c_str(), "r");
+    CHECK(output != nullptr);
+    
+    char line[256];
+    unsigned long clients = 0, failed = 1;
+    sent = answered = 0;
+    while (fgets(line, sizeof(line), output)) {
+        sscanf(line, "Clients: %lu (%lu failed to connect", &clients, &failed);
+        sscanf(line, "Messages: %lu sent, %lu answered", &sent, &answered);
+    }
+    CHECK(pclose(output) == 0);
+    CHECK(clients > 0 && failed == 0);
+}
+
+int main() {
+    CHECK(getenv("SOCKS_TOOLS") != nullptr);
+    ServerSocket server(3111, 8);
+    unsigned long sent, answered;
+    
+    //Closed-loop: every message but the last of each client is answered
+    std::thread thread(echo, std::ref(server), 4);
+    runLoadgen("--connections 4 --threads 2 --sizes 64:3,1000:1 --duration 1", sent, answered);
+    thread.join();
+    CHECK(answered > 20 && sent - answered <= 4);
+    
+    //Open-loop at 200 messages per second
+    thread = std::thread(echo, std::ref(server), 2);
+    runLoadgen("--connections 2 --threads 1 --rate 200 --duration 1", sent, answered);
+    thread.join();
+    CHECK(sent > 150 && sent < 250);
+    CHECK(answered > 150);
+    return 0;
+}
@@ -0,0 +1,68 @@
+//Standard library includes
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+//C includes
+#include <unistd.h>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "Check.hpp"
+
+/*
+ Checks the memory budget with one client that reads and one that never does. DropOldest and DisconnectLargest keep memory near the budget while the reading client still gets every broadcast, DisconnectLargest drops the slow client, and PauseReading reports being over budget.
+ */
+
+static void broadcastToSlowClient(ServerSocket::MemoryPolicy policy, int portNum) {
+    const unsigned long budget = 4 << 20;
+    const std::string message(64 << 10, 'm');
+    
+    ServerSocket server(portNum, 2);
+    std::atomic<bool> stop(false);
+    std::atomic<unsigned long> received(0);
+    std::thread reader([&] {
+        ClientSocket socket("127.0.0.1", portNum);
+        while (!stop) {
+            if (socket.waitForData(100)) received += socket.receive().size();
+        }
+    });
+    server.addClient();
+    ClientSocket slow("127.0.0.1", portNum);
+    server.addClient();
+    server.setMemoryBudget(budget, policy);
+    
+    unsigned long mostInUse = 0;
+    for (int i = 0; i < 400; i++) {
+        server.postBroadcast(message);
+        server.flushPosted();
+        mostInUse = std::max(mostInUse, server.memoryInUse());
+        usleep(500);
+    }
+    if (policy != ServerSocket::PauseReading) {
+        for (int i = 0; i < 200 && server.flushPosted() > 0; i++) {
+            usleep(5000);
+        }
+    }
+    usleep(300000);
+    stop = true;
+    reader.join();
+    
+    if (policy == ServerSocket::PauseReading) {
+        CHECK(server.isOverBudget());
+        return;
+    }
+    CHECK(mostInUse <= budget + 2 * message.size() + 65536);
+    CHECK(received == 400 * message.size());
+    if (policy == ServerSocket::DisconnectLargest) CHECK(server.numberOfClients() == 1);
+    else CHECK(server.numberOfClients() == 2);
+}
+
+int main() {
+    broadcastToSlowClient(ServerSocket::DropOldest, 3190);
+    broadcastToSlowClient(ServerSocket::DisconnectLargest, 3191);
+    broadcastToSlowClient(ServerSocket::PauseReading, 3192);
+    return 0;
+}
@@ -0,0 +1,65 @@
+//Standard library includes
+#include <string>
+#include <thread>
+#include <tuple>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "Check.hpp"
+
+/*
+ Checks typed messages: the layout is packed and little-endian at compile time, views read fields in place, and messages sent back to back are received whole and in order.
+ */
+
+enum class Side : uint8_t {Buy = 1, Sell = 2};
+
+struct Quote {
+    uint32_t id;
+    double price;
+    int64_t time;
+    Side side;
+    bool live;
+};
+
+template <>
+struct MessageSchema<Quote> {
+    static constexpr auto fields = std::make_tuple(&Quote::id, &Quote::price, &Quote::time, &Quote::side, &Quote::live);
+};
+
+static_assert(MessageLayout<Quote>::size == 22);
+static_assert(MessageLayout<Quote>::offset<2> == 12);
+
+int main() {
+    std::string encoded = encodeMessage(Quote{0x01020304, 1.5, -7, Side::Sell, true});
+    CHECK(encoded.size() == 22);
+    CHECK(encoded[0] == 0x04 && encoded[3] == 0x01);
+    MessageView<Quote> view(encoded.data());
+    CHECK(view.get<0>() == 0x01020304);
+    CHECK(view.get<1>() == 1.5);
+    CHECK(view.get<2>() == -7);
+    CHECK(view.get<3>() == Side::Sell);
+    CHECK(view.get<4>());
+    
+    ServerSocket server(3108, 1);
+    std::thread client([] {
+        ClientSocket socket("localhost", 3108);
+        for (int i = 0; i < 1000; i++) {
+            socket.sendMessage(Quote{(uint32_t)i, i * 0.5, -i, Side::Buy, i % 2 == 0});
+        }
+        MessageBuffer<Quote> buffer;
+        bool closed = false;
+        CHECK(!socket.receiveMessage(buffer, &closed) && closed);
+    });
+    server.addClient();
+    MessageBuffer<Quote> buffer;
+    for (int i = 0; i < 1000; i++) {
+        CHECK(server.receiveMessage(buffer, 0));
+        Quote quote = buffer.view().decode();
+        CHECK(quote.id == (uint32_t)i && quote.price == i * 0.5 && quote.time == -i);
+        CHECK(quote.side == Side::Buy && quote.live == (i % 2 == 0));
+    }
+    server.closeConnection(0);
+    client.join();
+    return 0;
+}
@@ -0,0 +1,67 @@
+//Standard library includes
+#include <string>
+#include <thread>
+
+//C includes
+#include <sched.h>
+#include <unistd.h>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "Check.hpp"
+
+/*
+ Checks core placement: placing a socket leaves the calling thread's affinity as it was, even when placement fails, two steered sockets can share a port and serve clients, bad placements are refused, and pinThread() pins.
+ */
+
+int main() {
+    cpu_set_t before, after;
+    CHECK(sched_getaffinity(0, sizeof(before), &before) == 0);
+    
+    {
+        ServerSocket first(3145, 2, LISTEN_BACKLOG, ServerSocket::Placement(0, true));
+        CHECK(sched_getaffinity(0, sizeof(after), &after) == 0);
+        CHECK(CPU_EQUAL(&before, &after));
+        
+        //A second socket on the same port, from another thread
+        std::thread thread([] {
+            ServerSocket second(3145, 2, LISTEN_BACKLOG, ServerSocket::Placement(0, true));
+            usleep(200000);
+        });
+        usleep(50000);
+        ClientSocket client("127.0.0.1", 3145);
+        client.send("x", true);
+        usleep(20000);
+        if (first.acceptClients() == 1) {
+            CHECK(first.receive(0) == "x");
+        }
+        thread.join();
+    }
+    
+    bool threw = false;
+    try {
+        ServerSocket server(3146, 1, 16, ServerSocket::Placement(-1, true));
+    }
+    catch (const std::logic_error& error) {
+        threw = true;
+    }
+    CHECK(threw);
+    
+    threw = false;
+    try {
+        ServerSocket server(3147, 1, 16, ServerSocket::Placement(CPU_SETSIZE - 1));
+    }
+    catch (const std::logic_error& error) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(sched_getaffinity(0, sizeof(after), &after) == 0);
+    CHECK(CPU_EQUAL(&before, &after));
+    
+    ServerSocket::pinThread(0);
+    CHECK(sched_getaffinity(0, sizeof(after), &after) == 0);
+    CHECK(CPU_COUNT(&after) == 1 && CPU_ISSET(0, &after));
+    CHECK(sched_getcpu() == 0);
+    return 0;
+}
@@ -0,0 +1,92 @@
+//Standard library includes
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+
+//C includes
+#include <poll.h>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "Check.hpp"
+
+/*
+ Checks post() from many threads at once: every message arrives, each thread's messages keep their order, and postBroadcast() is delivered while an empty broadcast is dropped.
+ */
+
+int main() {
+    const int threads = 8;
+    const int messagesPerThread = 20000;
+    
+    ServerSocket server(3104, 2);
+    
+    size_t expected = 2 * std::string("BROADCAST\n").size();
+    for (int thread = 0; thread < threads; thread++) {
+        for (int i = 0; i < messagesPerThread; i++) {
+            expected += (std::to_string(thread) + ":" + std::to_string(i) + "\n").size();
+        }
+    }
+    std::string received;
+    std::thread client([&] {
+        ClientSocket socket("localhost", 3104);
+        while (received.size() < expected) {
+            received += socket.receive();
+        }
+    });
+    server.addClient();
+    
+    std::vector<std::thread> producers;
+    for (int thread = 0; thread < threads; thread++) {
+        producers.emplace_back([&server, thread] {
+            for (int i = 0; i < messagesPerThread; i++) {
+                server.post(std::to_string(thread) + ":" + std::to_string(i) + "\n", 0);
+            }
+        });
+    }
+    server.postBroadcast("BROADCAST\n");
+    server.postBroadcast("");
+    
+    //Flush while the producers run, then until everything is written
+    bool producing = true;
+    while (true) {
+        pollfd posted = {server.postedFD(), POLLIN, 0};
+        poll(&posted, 1, 10);
+        unsigned long queued = server.flushPosted();
+        if (!producing && queued == 0) {
+            break;
+        }
+        if (producing) {
+            for (auto& producer : producers) {
+                producer.join();
+            }
+            producing = false;
+            server.postBroadcast("BROADCAST\n");
+        }
+    }
+    client.join();
+    CHECK(received.size() == expected);
+    
+    std::map<int, int> last;
+    int broadcasts = 0;
+    size_t position = 0;
+    while (position < received.size()) {
+        size_t end = received.find('\n', position);
+        std::string line = received.substr(position, end - position);
+        position = end + 1;
+        if (line == "BROADCAST") {
+            broadcasts++;
+            continue;
+        }
+        int thread = std::stoi(line);
+        int i = std::stoi(line.substr(line.find(':') + 1));
+        CHECK(last.count(thread) ? i == last[thread] + 1 : i == 0);
+        last[thread] = i;
+    }
+    CHECK(broadcasts == 2);
+    for (int thread = 0; thread < threads; thread++) {
+        CHECK(last[thread] == messagesPerThread - 1);
+    }
+    return 0;
+}
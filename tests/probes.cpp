@@ -0,0 +1,54 @@
+//Standard library includes
+#include <string>
+#include <thread>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "Check.hpp"
+
+/*
+ Checks that the tracepoints fire on their paths: accepting, reading, writing, broadcasting, timing out and closing. Built with the counting stand-in for <sys/sdt.h> in tests/sdt.
+ */
+
+int main() {
+#if !defined(SOCKS_PROBES_ENABLED)
+    CHECK(!"Built without <sys/sdt.h>. Build with -Itests/sdt, as tests/run.sh does");
+#else
+    ServerSocket server(3180, 2);
+    std::thread client([] {
+        ClientSocket socket("127.0.0.1", 3180);
+        socket.send("hello", true);
+        std::string received;
+        while (received.size() < 3) {
+            received += socket.receive();
+        }
+        socket.close();
+    });
+    server.addClient();
+    CHECK(probeCount("accept") == 1);
+    CHECK(server.receive(0) == "hello");
+    CHECK(probeCount("read") >= 1);
+    server.broadcast("bye", true);
+    CHECK(probeCount("broadcast_start") == 1 && probeCount("broadcast_end") == 1);
+    CHECK(probeCount("write") >= 2); //The client's and the server's
+    client.join();
+    
+    bool closed = false;
+    server.receive(0, &closed);
+    CHECK(closed);
+    CHECK(probeCount("close") >= 2);
+    
+    server.setHostTimeout(0, 100);
+    bool threw = false;
+    try {
+        server.addClient();
+    }
+    catch (const std::runtime_error& error) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(probeCount("timeout") == 1);
+#endif
+    return 0;
+}
@@ -0,0 +1,72 @@
+//Standard library includes
+#include <string>
+#include <map>
+#include <thread>
+#include <functional>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "Check.hpp"
+
+/*
+ Checks publish/subscribe: a message reaches each subscriber of its topic once, even if it subscribed twice, unsubscribing and closing remove subscribers, and postPublish() goes through flushPosted() the same way.
+ */
+
+int main() {
+    ServerSocket server(3107, 3);
+    
+    //Each client says who it is, then collects everything until the server closes
+    std::string receivedA, receivedB, receivedC;
+    auto client = [](std::string name, std::string& received) {
+        ClientSocket socket("localhost", 3107);
+        socket.send(name.c_str());
+        std::string all;
+        bool closed = false;
+        while (!closed) {
+            all += socket.receive(&closed);
+        }
+        received = all;
+    };
+    std::thread a(client, "a", std::ref(receivedA));
+    std::thread b(client, "b", std::ref(receivedB));
+    std::thread c(client, "c", std::ref(receivedC));
+    
+    std::map<std::string, unsigned int> index;
+    for (unsigned int i = 0; i < 3; i++) {
+        server.addClient(); //Takes the lowest free index
+        index[server.receive(i)] = i;
+    }
+    
+    server.subscribe("x", index["a"]);
+    server.subscribe("x", index["b"]);
+    server.subscribe("x", index["b"]);
+    server.subscribe("y", index["c"]);
+    CHECK(server.numberOfSubscribers("x") == 2);
+    CHECK(server.numberOfSubscribers("z") == 0);
+    
+    CHECK(server.publish("x", std::string_view("1"), true) == 2);
+    CHECK(server.publish("y", std::make_shared<const std::string>("2"), true) == 1);
+    CHECK(server.publish("z", std::string_view("3"), true) == 0);
+    
+    server.unsubscribe("y", index["c"]);
+    CHECK(server.numberOfSubscribers("y") == 0);
+    server.subscribe("y", index["b"]);
+    server.closeConnection(index["a"]);
+    CHECK(server.numberOfSubscribers("x") == 1);
+    
+    server.postPublish("x", "4");
+    server.postPublish("y", "5");
+    server.postPublish("z", "6");
+    while (server.flushPosted() > 0);
+    server.closeConnection(index["b"]);
+    server.closeConnection(index["c"]);
+    a.join();
+    b.join();
+    c.join();
+    
+    CHECK(receivedA == "1");
+    CHECK(receivedB == "145");
+    CHECK(receivedC == "2");
+    return 0;
+}
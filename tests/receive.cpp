@@ -0,0 +1,72 @@
+//Standard library includes
+#include <string>
+#include <thread>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "ReceiveBuffer.hpp"
+#include "Check.hpp"
+
+/*
+ Checks receive sizing: a buffer grows to what is waiting, capped, shrinks after a run of small reads, and accounts for its size. Then a large message and many small ones in both directions are received intact.
+ */
+
+int main() {
+    size_t total = 0;
+    ReceiveBuffer buffer;
+    buffer.setAccount(&total);
+    buffer.reserve(0);
+    CHECK(buffer.size() == RECEIVE_BUFFER_MIN && total == RECEIVE_BUFFER_MIN);
+    buffer.reserve(100000);
+    CHECK(buffer.size() == 131072 && total == 131072);
+    buffer.reserve(RECEIVE_BUFFER_MAX * 4);
+    CHECK(buffer.size() == RECEIVE_BUFFER_MAX);
+    for (int i = 0; i < RECEIVE_BUFFER_SHRINK_READS; i++) {
+        buffer.used(100);
+    }
+    CHECK(buffer.size() == RECEIVE_BUFFER_MAX / 2 && total == RECEIVE_BUFFER_MAX / 2);
+    buffer.used(RECEIVE_BUFFER_MAX / 4);
+    for (int i = 0; i < RECEIVE_BUFFER_SHRINK_READS - 1; i++) {
+        buffer.used(100);
+    }
+    CHECK(buffer.size() == RECEIVE_BUFFER_MAX / 2);
+    buffer.release();
+    CHECK(buffer.size() == 0 && total == 0);
+    
+    std::string big(5 << 20, 'a');
+    for (size_t a = 0; a < big.size(); a++) {
+        big[a] = 'a' + a % 26;
+    }
+    ServerSocket server(3148, 2);
+    std::thread client([&] {
+        ClientSocket socket("127.0.0.1", 3148);
+        socket.send(std::string_view(big), true);
+        std::string received;
+        while (received.size() < big.size()) {
+            received += socket.receive();
+        }
+        CHECK(received == big);
+        for (int i = 0; i < 200; i++) {
+            socket.send("hi", true);
+            CHECK(socket.receive() == "yo");
+        }
+        bool closed = false;
+        socket.receive(&closed);
+        CHECK(closed);
+    });
+    server.addClient();
+    std::string received;
+    while (received.size() < big.size()) {
+        received += server.receive(0);
+    }
+    CHECK(received == big);
+    server.send(std::string_view(big), 0, true);
+    for (int i = 0; i < 200; i++) {
+        CHECK(server.receive(0) == "hi");
+        server.send("yo", 0, true);
+    }
+    server.closeConnection(0);
+    client.join();
+    return 0;
+}
@@ -0,0 +1,63 @@
+//Standard library includes
+#include <string>
+#include <thread>
+#include <random>
+#include <algorithm>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "RecordBuffer.hpp"
+#include "Check.hpp"
+
+/*
+ Checks delimiter framing: the vectorized scan finds the same byte as a plain search at every length and position, records split across reads at random points come out whole and in order, a record larger than a read is kept until it ends, and a last record without a delimiter is returned when the connection closes.
+ */
+
+int main() {
+    std::mt19937 random(1);
+    for (int i = 0; i < 20000; i++) {
+        std::string bytes(random() % 200, 'a');
+        for (char& byte : bytes) {
+            byte = 'a' + random() % 3;
+        }
+        size_t expected = std::min(bytes.find('c'), bytes.size());
+        CHECK(RecordBuffer::findByte(bytes.data(), bytes.size(), 'c') == expected);
+    }
+    
+    const int lines = 200000;
+    ServerSocket server(3200, 2);
+    std::thread client([] {
+        ClientSocket socket("127.0.0.1", 3200);
+        std::string all;
+        for (int i = 0; i < lines; i++) {
+            all += "line " + std::to_string(i) + "\n";
+        }
+        all += std::string(300000, 'x') + "\n";
+        std::mt19937 random(2);
+        for (size_t position = 0; position < all.size();) {
+            size_t length = std::min<size_t>(1 + random() % 7000, all.size() - position);
+            socket.send(std::string_view(all.data() + position, length), true);
+            position += length;
+        }
+        
+        std::string_view record;
+        CHECK(socket.receiveRecord(record, '\0') && record == "a");
+        CHECK(socket.receiveRecord(record, '\0') && record == "bb");
+        CHECK(socket.receiveRecord(record, '\0') && record == "cc");
+        bool closed = false;
+        CHECK(!socket.receiveRecord(record, '\0', &closed) && closed);
+    });
+    server.addClient();
+    std::string_view record;
+    for (int i = 0; i < lines; i++) {
+        CHECK(server.receiveRecord(record, 0));
+        CHECK(record == "line " + std::to_string(i));
+    }
+    CHECK(server.receiveRecord(record, 0));
+    CHECK(record == std::string(300000, 'x'));
+    server.send(std::string_view("a\0bb\0cc", 7), 0, true);
+    server.closeConnection(0);
+    client.join();
+    return 0;
+}
@@ -0,0 +1,93 @@
+//Standard library includes
+#include <string>
+#include <thread>
+#include <climits>
+
+//C includes
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "Relay.hpp"
+#include "Check.hpp"
+
+/*
+ Checks the relay: data goes both ways intact and counted, a half close is passed on so run() ends once both sides have closed, and a relay with no traffic ends at its idle timeout.
+ */
+
+const unsigned long uploadSize = 64ul << 20;
+
+int main() {
+    ServerSocket upstreamServer(3171, 2), front(3170, 2);
+    
+    //The upstream reads everything, then answers with half as much and closes
+    std::thread upstream([&] {
+        upstreamServer.addClient();
+        upstreamServer.setTimeout(10);
+        unsigned long received = 0;
+        bool intact = true;
+        upstreamServer.receiveStream([&](const char* data, unsigned long length) {
+            for (unsigned long a = 0; a < length; a++) {
+                if (data[a] != (char)((received + a) % 251)) intact = false;
+            }
+            received += length;
+        }, ULONG_MAX, 0);
+        CHECK(intact && received == uploadSize);
+        unsigned long position = 0;
+        upstreamServer.sendStream([&](char* buffer, unsigned long capacity) {
+            unsigned long length = std::min(capacity, uploadSize / 2 - position);
+            memset(buffer, 7, length);
+            position += length;
+            return length;
+        }, 0);
+        upstreamServer.closeConnection(0);
+    });
+    std::thread client([] {
+        ClientSocket socket("127.0.0.1", 3170);
+        unsigned long position = 0;
+        socket.sendStream([&](char* buffer, unsigned long capacity) {
+            unsigned long length = std::min(capacity, uploadSize - position);
+            for (unsigned long a = 0; a < length; a++) {
+                buffer[a] = (char)((position + a) % 251);
+            }
+            position += length;
+            return length;
+        });
+        shutdown(socket.connectionFD(), SHUT_WR);
+        bool closed = false;
+        bool intact = true;
+        unsigned long received = socket.receiveStream([&](const char* data, unsigned long length) {
+            for (unsigned long a = 0; a < length; a++) {
+                if (data[a] != 7) intact = false;
+            }
+        }, ULONG_MAX, &closed);
+        CHECK(closed && intact && received == uploadSize / 2);
+    });
+    
+    front.addClient();
+    ClientSocket upstreamClient("127.0.0.1", 3171);
+    Relay relay(front, 0, upstreamClient);
+    CHECK(relay.run(5000) == Relay::Closed);
+    CHECK(relay.bytesToUpstream() == uploadSize);
+    CHECK(relay.bytesToClient() == uploadSize / 2);
+    client.join();
+    upstream.join();
+    
+    //Both ends connected, neither sending
+    ServerSocket idleFront(3172, 2), idleUpstream(3173, 2);
+    std::thread accept([&] {idleUpstream.addClient();});
+    std::thread idleClient([] {
+        ClientSocket socket("127.0.0.1", 3172);
+        sleep(1);
+    });
+    idleFront.addClient();
+    ClientSocket idleUpstreamClient("127.0.0.1", 3173);
+    accept.join();
+    Relay idle(idleFront, 0, idleUpstreamClient);
+    CHECK(idle.run(200) == Relay::IdleTimeout);
+    idleClient.join();
+    return 0;
+}
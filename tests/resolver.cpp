@@ -0,0 +1,77 @@
+//Standard library includes
+#include <string>
+#include <vector>
+#include <future>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "HostResolver.hpp"
+#include "Check.hpp"
+
+/*
+ Checks the resolver cache: repeated and asynchronous lookups share one result until it is forgotten or caching is off, failed lookups are remembered, and destroying a resolver fails the lookups it never started instead of leaving them waiting.
+ */
+
+int main() {
+    {
+        HostResolver resolver;
+        HostResolver::Addresses first = resolver.resolve("localhost", 3143);
+        CHECK(first != nullptr);
+        CHECK(resolver.resolve("localhost", 3143).get() == first.get());
+        CHECK(resolver.resolveAsync("localhost", 3143).get().get() == first.get());
+        CHECK(resolver.resolve("localhost", 3144).get() != first.get());
+        
+        resolver.forget("localhost", 3143);
+        HostResolver::Addresses second = resolver.resolve("localhost", 3143);
+        CHECK(second.get() != first.get());
+        resolver.setTTL(0, 1000);
+        CHECK(resolver.resolve("localhost", 3143).get() == second.get()); //Results already cached keep their time
+        resolver.clear();
+        HostResolver::Addresses third = resolver.resolve("localhost", 3143);
+        CHECK(resolver.resolve("localhost", 3143).get() != third.get());
+        
+        //The failure is cached, and comes back from the future as well
+        bool threw = false;
+        try {
+            resolver.resolve("no.such.host.invalid", 1);
+        }
+        catch (const std::runtime_error& error) {
+            threw = true;
+        }
+        CHECK(threw);
+        threw = false;
+        try {
+            resolver.resolveAsync("no.such.host.invalid", 1).get();
+        }
+        catch (const std::runtime_error& error) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+    
+    //Queue far more lookups than the helpers can finish before the resolver is destroyed
+    std::vector<std::shared_future<HostResolver::Addresses>> lookups;
+    {
+        HostResolver resolver;
+        for (int i = 0; i < 500; i++) {
+            lookups.push_back(resolver.resolveAsync("localhost", 1000 + i));
+        }
+    }
+    for (auto& lookup : lookups) {
+        CHECK(lookup.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+        try {
+            CHECK(lookup.get() != nullptr);
+        }
+        catch (const std::runtime_error& error) {
+            CHECK(std::string(error.what()).find("Resolver stopped") != std::string::npos);
+        }
+    }
+    
+    //ClientSocket resolves through the shared resolver
+    ServerSocket server(3143, 1);
+    HostResolver::shared().resolve("localhost", 3143);
+    ClientSocket client("localhost", 3143);
+    CHECK(server.addClient() == 0);
+    return 0;
+}
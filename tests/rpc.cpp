@@ -0,0 +1,59 @@
+//Standard library includes
+#include <string>
+#include <thread>
+#include <chrono>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "RPCServer.hpp"
+#include "RPCClient.hpp"
+#include "Check.hpp"
+
+/*
+ Checks the RPC layer: calls echo small, empty and large payloads, unknown methods and throwing handlers get their statuses, a call past its deadline returns without breaking the next one, and handlers can return their own statuses.
+ */
+
+int main() {
+    ServerSocket server(3150, 2);
+    std::thread client([] {
+        ClientSocket socket("127.0.0.1", 3150);
+        RPCClient rpc(socket);
+        std::string response;
+        CHECK(rpc.call(1, "hello", response) == RPC_OK && response == "hello");
+        std::string big(1 << 20, 'x');
+        CHECK(rpc.call(1, big, response) == RPC_OK && response == big);
+        CHECK(rpc.call(1, "", response) == RPC_OK && response.empty());
+        CHECK(rpc.call(9, "x", response) == RPC_UNKNOWN_METHOD);
+        CHECK(rpc.call(2, "boom", response) == RPC_HANDLER_FAILED && response == "boom");
+        CHECK(rpc.call(3, "slow", response, 100) == RPC_DEADLINE_EXCEEDED);
+        CHECK(rpc.call(1, "after", response, 2000) == RPC_OK && response == "after");
+        CHECK(rpc.call(4, "", response) == RPC_FIRST_USER_STATUS + 4);
+    });
+    server.addClient();
+    server.setTimeout(5);
+    
+    RPCServer rpc(server);
+    rpc.registerMethod(1, [](std::string_view request, std::string& response) {
+        response.assign(request);
+        return (uint16_t)RPC_OK;
+    });
+    rpc.registerMethod(2, [](std::string_view request, std::string& response) -> uint16_t {
+        throw std::runtime_error(std::string(request));
+    });
+    rpc.registerMethod(3, [](std::string_view request, std::string& response) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        response = "late";
+        return (uint16_t)RPC_OK;
+    });
+    rpc.registerMethod(4, [](std::string_view request, std::string& response) {
+        return (uint16_t)(RPC_FIRST_USER_STATUS + 4);
+    });
+    int handled = 0;
+    while (rpc.handle(0)) {
+        handled++;
+    }
+    client.join();
+    CHECK(handled == 8);
+    return 0;
+}
@@ -0,0 +1,48 @@
+#!/bin/sh
+#Builds each behavior check in tests/ and runs it.
+#Usage: tests/run.sh [src | header_only] [check ...]
+#The checks are built against src/ unless header_only is given. With no names every check is run.
+
+cd "$(dirname "$0")/.." || exit 1
+
+tree=src
+if [ "$1" = src ] || [ "$1" = header_only ]; then
+    tree=$1
+    shift
+fi
+
+checks="$*"
+if [ -z "$checks" ]; then
+    checks=$(ls tests/*.cpp | sed 's|tests/\(.*\)\.cpp|\1|')
+fi
+
+build=$(mktemp -d) || exit 1
+trap 'rm -rf "$build"' EXIT
+#tests/sdt holds a stand-in <sys/sdt.h> that counts each probe as it fires
+flags="-std=c++20 -O1 -g -pthread -Itests/sdt"
+
+objects=""
+if [ "$tree" = src ]; then
+    for source in src/*.cpp; do
+        [ "$source" = src/main.cpp ] && continue
+        object="$build/$(basename "$source" .cpp).o"
+        g++ $flags -c "$source" -o "$object" || exit 1
+        objects="$objects $object"
+    done
+fi
+
+#Tools the checks run are found through SOCKS_TOOLS
+mkdir "$build/tools" || exit 1
+g++ $flags tools/loadgen.cpp -o "$build/tools/loadgen" || exit 1
+export SOCKS_TOOLS="$build/tools"
+
+failed=0
+for check in $checks; do
+    if g++ $flags -I"$tree" -Itests "tests/$check.cpp" $objects -o "$build/$check" && timeout 120 "$build/$check"; then
+        echo "$check: ok"
+    else
+        echo "$check: FAILED"
+        failed=1
+    fi
+done
+exit $failed
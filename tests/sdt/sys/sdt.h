@@ -0,0 +1,42 @@
+#ifndef sdt_h
+#define sdt_h
+
+#include <string>
+#include <map>
+#include <mutex>
+
+/*
+ A stand-in for systemtap's <sys/sdt.h>, which tests/run.sh builds everything with. Instead of leaving a nop for a tracer to attach to, each probe counts how often it fired, so tests/probes.cpp can check that the probes are on the right paths.
+ */
+
+inline std::mutex& probeMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+inline std::map<std::string, long>& probeCounts() {
+    static std::map<std::string, long> counts;
+    return counts;
+}
+
+inline void fireProbe(const char* name) {
+    std::lock_guard<std::mutex> lock(probeMutex());
+    probeCounts()[name]++;
+}
+
+/*!
+ * @param name The name of a probe, like "read".
+ *
+ * @return The number of times the probe has fired.
+ */
+inline long probeCount(const char* name) {
+    std::lock_guard<std::mutex> lock(probeMutex());
+    auto count = probeCounts().find(name);
+    return count == probeCounts().end() ? 0 : count->second;
+}
+
+#define DTRACE_PROBE2(provider, name, a, b) do {(void)(a); (void)(b); fireProbe(#name);} while (0)
+#define DTRACE_PROBE3(provider, name, a, b, c) do {(void)(a); (void)(b); (void)(c); fireProbe(#name);} while (0)
+#define DTRACE_PROBE4(provider, name, a, b, c, d) do {(void)(a); (void)(b); (void)(c); (void)(d); fireProbe(#name);} while (0)
+
+#endif /* sdt_h */
@@ -0,0 +1,44 @@
+//Standard library includes
+#include <string>
+#include <string_view>
+#include <span>
+#include <cstddef>
+#include <thread>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "Check.hpp"
+
+/*
+ Checks the binary-safe send overloads: embedded zero bytes survive, string_view, span and moved strings all send their whole length, and a large message sent with ensureFullStringSent arrives complete.
+ */
+
+int main() {
+    const std::string binary("a\0b\0c", 5);
+    const size_t bigSize = 8 << 20;
+    
+    ServerSocket server(3105, 2);
+    std::thread client([&] {
+        ClientSocket socket("localhost", 3105);
+        CHECK(socket.send(std::string_view(binary)) == binary.size());
+        CHECK(socket.send(std::string("xyz")).empty());
+        std::byte bytes[3] = {std::byte{0}, std::byte{1}, std::byte{2}};
+        CHECK(socket.send(std::span<const std::byte>(bytes, 3), true) == 3);
+        std::string big(bigSize, 'q');
+        CHECK(socket.send(std::string_view(big), true) == big.size());
+        socket.close();
+    });
+    
+    server.addClient();
+    bool closed = false;
+    std::string received;
+    while (!closed) {
+        received += server.receive(0, &closed);
+    }
+    client.join();
+    CHECK(received.size() == binary.size() + 3 + 3 + bigSize);
+    CHECK(received.compare(0, 11, binary + "xyz" + std::string("\0\1\2", 3)) == 0);
+    CHECK(received.find_first_not_of('q', 11) == std::string::npos);
+    return 0;
+}
@@ -0,0 +1,142 @@
+//Standard library includes
+#include <string>
+#include <chrono>
+
+//C includes
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "SharedMemoryRing.hpp"
+#include "Check.hpp"
+
+/*
+ Checks the shared memory transport: messages larger than a ring cross between two processes in order, a blocked read or write returns once the other process dies, and open() refuses a segment whose capacity doesn't fit it.
+ */
+
+//The ring is a byte stream, so one receive() can return part of a message or run into the next. The echo sends lines, and this takes one whole line at a time
+template <typename Receive>
+static std::string nextLine(std::string& pending, Receive receive) {
+    size_t end;
+    while ((end = pending.find('\n')) == std::string::npos) {
+        pending += receive();
+    }
+    std::string line = pending.substr(0, end);
+    pending.erase(0, end + 1);
+    return line;
+}
+
+static long millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    const size_t bigSize = 3 << 20;
+    
+    //A client in another process, through ServerSocket and ClientSocket
+    pid_t child = fork();
+    if (child == 0) {
+        usleep(100000);
+        ClientSocket socket;
+        socket.setSharedMemory("socks-check");
+        socket.send("hello");
+        std::string big(bigSize, 'x');
+        socket.send(big.c_str(), true);
+        std::string pending;
+        for (int i = 0; i < 1000; i++) {
+            std::string line = nextLine(pending, [&socket] {return socket.receive();});
+            socket.send((line + "\n").c_str(), true);
+        }
+        socket.close();
+        _exit(0);
+    }
+    {
+        ServerSocket server(3103, 2);
+        server.setHostTimeout(5);
+        server.addSharedMemoryClient("socks-check");
+        std::string received;
+        while (received.size() < 5 + bigSize) {
+            received += server.receive(0);
+        }
+        CHECK(received.size() == 5 + bigSize);
+        CHECK(received.compare(0, 5, "hello") == 0);
+        CHECK(received.find_first_not_of('x', 5) == std::string::npos);
+        std::string pending;
+        for (int i = 0; i < 1000; i++) {
+            server.send((std::to_string(i) + "\n").c_str(), 0, true);
+            CHECK(nextLine(pending, [&server] {return server.receive(0);}) == std::to_string(i));
+        }
+        CHECK(pending.empty());
+        bool closed = false;
+        server.receive(0, &closed);
+        CHECK(closed);
+        int status = 0;
+        waitpid(child, &status, 0);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    
+    signal(SIGCHLD, SIG_IGN);
+    
+    //A peer that dies without closing wakes a blocked read
+    if (fork() == 0) {
+        usleep(50000);
+        SharedMemoryRing ring;
+        ring.open("socks-check-read");
+        ring.write("a", 1, true);
+        usleep(100000);
+        _exit(0);
+    }
+    {
+        SharedMemoryRing ring;
+        ring.create("socks-check-read", 4096);
+        CHECK(ring.waitForPeer(2000));
+        char buffer[16];
+        CHECK(ring.read(buffer, sizeof(buffer), -1) == 1);
+        auto start = std::chrono::steady_clock::now();
+        CHECK(ring.read(buffer, sizeof(buffer), -1) == 0);
+        CHECK(millisecondsSince(start) < 1000);
+    }
+    
+    //And a blocked write
+    if (fork() == 0) {
+        usleep(50000);
+        SharedMemoryRing ring;
+        ring.open("socks-check-write");
+        usleep(100000);
+        _exit(0);
+    }
+    {
+        SharedMemoryRing ring;
+        ring.create("socks-check-write", 4096);
+        CHECK(ring.waitForPeer(2000));
+        std::string big(100000, 'x');
+        CHECK(ring.write(big.data(), big.size(), true) == -1 && errno == EPIPE);
+    }
+    
+    //A segment claiming a 1 GB ring in 4 KB. The magic number is at offset 0 and the capacity at offset 16
+    shm_unlink("/socks-check-bad");
+    int fd = shm_open("/socks-check-bad", O_CREAT | O_RDWR, 0600);
+    CHECK(fd >= 0 && ftruncate(fd, 4096) == 0);
+    char* bad = (char*)mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    CHECK(bad != MAP_FAILED);
+    close(fd);
+    *(uint32_t*)bad = SHARED_MEMORY_RING_MAGIC;
+    *(uint64_t*)(bad + 16) = 1ull << 30;
+    bool threw = false;
+    try {
+        SharedMemoryRing ring;
+        ring.open("socks-check-bad");
+    }
+    catch (const std::runtime_error& error) {
+        threw = true;
+    }
+    CHECK(threw);
+    munmap(bad, 4096);
+    shm_unlink("/socks-check-bad");
+    return 0;
+}
@@ -0,0 +1,76 @@
+//Standard library includes
+#include <string>
+#include <thread>
+#include <climits>
+
+//C includes
+#include <string.h>
+#include <sys/resource.h>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "Check.hpp"
+
+/*
+ Checks streaming: 256 MB goes each way through sendStream() and receiveStream() intact, a message sent after a stream is read on its own, and the process never holds more than a fraction of the data.
+ */
+
+const unsigned long streamSize = 256ul << 20;
+
+int main() {
+    ServerSocket server(3149, 2);
+    std::thread client([] {
+        ClientSocket socket("127.0.0.1", 3149);
+        unsigned long position = 0;
+        unsigned long sent = socket.sendStream([&](char* buffer, unsigned long capacity) {
+            unsigned long length = std::min(capacity, streamSize - position);
+            for (unsigned long a = 0; a < length; a++) {
+                buffer[a] = (char)((position + a) * 7);
+            }
+            position += length;
+            return length;
+        });
+        CHECK(sent == streamSize);
+        socket.send("tail", true);
+        
+        //Until the server closes
+        unsigned long ones = 0;
+        bool closed = false;
+        unsigned long received = socket.receiveStream([&](const char* data, unsigned long length) {
+            for (unsigned long a = 0; a < length; a++) {
+                ones += data[a] == 1;
+            }
+        }, ULONG_MAX, &closed);
+        CHECK(closed);
+        CHECK(received == streamSize / 4 && ones == received);
+    });
+    server.addClient();
+    server.setTimeout(5);
+    
+    unsigned long position = 0;
+    bool intact = true;
+    unsigned long received = server.receiveStream([&](const char* data, unsigned long length) {
+        for (unsigned long a = 0; a < length; a++) {
+            if (data[a] != (char)((position + a) * 7)) intact = false;
+        }
+        position += length;
+    }, streamSize, 0);
+    CHECK(received == streamSize && intact);
+    CHECK(server.receive(0) == "tail");
+    
+    position = 0;
+    CHECK(server.sendStream([&](char* buffer, unsigned long capacity) {
+        unsigned long length = std::min(capacity, streamSize / 4 - position);
+        memset(buffer, 1, length);
+        position += length;
+        return length;
+    }, 0) == streamSize / 4);
+    server.closeConnection(0);
+    client.join();
+    
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    CHECK(usage.ru_maxrss < 100 * 1024);
+    return 0;
+}
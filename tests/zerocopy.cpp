@@ -0,0 +1,80 @@
+//Standard library includes
+#include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
+
+//C includes
+#include <unistd.h>
+
+//Local includes
+#include "ServerSocket.hpp"
+#include "ClientSocket.hpp"
+#include "Check.hpp"
+
+/*
+ Checks zero-copy sending: the bytes arrive intact, the message is released once the kernel is done with it, and it is kept alive while the kernel may still read it even though the connection was closed first.
+ */
+
+int main() {
+    const size_t size = 1 << 20;
+    
+    ServerSocket server(3106, 2);
+    std::thread client([&] {
+        ClientSocket socket("localhost", 3106);
+        size_t received = 0;
+        while (received < 3 * size) {
+            std::string message = socket.receive();
+            CHECK(message.find_first_not_of('z') == std::string::npos);
+            received += message.size();
+        }
+        socket.send("done");
+        bool closed = false;
+        socket.receive(&closed);
+    });
+    server.addClient();
+    server.setZeroCopy(true);
+    
+    auto message = std::make_shared<const std::string>(size, 'z');
+    std::weak_ptr<const std::string> released = message;
+    CHECK(server.sendZeroCopy(message, 0, true) == size);
+    CHECK(server.sendZeroCopy(message, 0, true) == size);
+    server.broadcastZeroCopy(message, true);
+    message.reset();
+    CHECK(server.receive(0) == "done");
+    usleep(50000);
+    server.releaseZeroCopyBuffers();
+    CHECK(released.expired());
+    server.closeConnection(0);
+    client.join();
+    
+    //Close before the client has read anything
+    std::atomic<bool> startReading(false);
+    const size_t smallSize = 200 << 10;
+    client = std::thread([&] {
+        ClientSocket socket("localhost", 3106);
+        while (!startReading) {
+            usleep(1000);
+        }
+        size_t received = 0;
+        bool closed = false;
+        while (!closed) {
+            received += socket.receive(&closed).size();
+        }
+        CHECK(received == smallSize);
+    });
+    unsigned int clientIndex = server.addClient();
+    message = std::make_shared<const std::string>(smallSize, 'z');
+    released = message;
+    CHECK(server.sendZeroCopy(message, clientIndex, true) == smallSize);
+    message.reset();
+    server.closeConnection(clientIndex);
+    CHECK(!released.expired());
+    
+    startReading = true;
+    client.join();
+    usleep(20000);
+    server.releaseZeroCopyBuffers();
+    CHECK(released.expired());
+    return 0;
+}
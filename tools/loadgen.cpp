@@ -0,0 +1,390 @@
+//Standard library includes
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+//C includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <cerrno>
+
+//Local includes
+#include "../src/LatencyHistogram.hpp"
+
+/*
+ A load generator for a ServerSocket, or any server that answers each message it receives.
+
+ Every simulated client is a non-blocking connection, and a few threads each run an event loop over their share of them, so thousands of clients don't need thousands of threads.
+
+ By default the generator is closed-loop: each client sends a message, waits for the reply, thinks, and sends again. With --rate it is open-loop instead: messages are scheduled at random (Poisson) times at the given total rate, whether or not earlier replies have come back. In both cases latency is measured from when a message was meant to be sent, not when it actually went out. Otherwise a stalled server would delay the sends that would have measured the stall, and hide it (coordinated omission).
+
+ Usage: loadgen <host> <port> [options]
+   --connections N    Number of simulated clients. Default 100
+   --threads N        Number of event loop threads. Default 2
+   --connect-rate N   New connections per second. Default 1000
+   --sizes LIST       Message size mix, as size:weight pairs, e.g. 64:9,4096:1. Default 64
+   --reply N          Bytes in each reply. Default 0, which expects an echo of the message
+   --think MS         Closed-loop pause between a reply and the next message. Default 0
+   --rate N           Open-loop messages per second across all clients. Default 0, which is closed-loop
+   --duration S       Seconds to send for. Default 10
+ */
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 //SIGPIPE is ignored instead
+#endif
+
+struct Options {
+    const char* host = nullptr;
+    const char* port = nullptr;
+    unsigned int connections = 100;
+    unsigned int threads = 2;
+    double connectRate = 1000;
+    std::vector<std::pair<size_t, double>> sizes = {{64, 1}};
+    size_t replySize = 0;
+    double thinkMilliseconds = 0;
+    double rate = 0;
+    double duration = 10;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+struct Connection {
+    int fd = -1;
+    bool connected = false;
+    Clock::time_point connectTime; //When this client is due to connect
+    Clock::time_point nextSend; //When the next message is meant to be sent
+    std::string outbound; //Bytes waiting to be written
+    size_t outboundOffset = 0;
+    std::deque<std::pair<Clock::time_point, size_t>> awaiting; //The intended send time and remaining reply bytes of each message not yet answered
+};
+
+struct Results {
+    LatencyHistogram latency;
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    uint64_t connectFailures = 0;
+    uint64_t disconnects = 0;
+};
+
+/*!
+ * A function that prints how to use the tool.
+ *
+ * @param name The name the program was run as.
+ */
+void printUsage(const char* name) {
+    std::cout << "Usage: " << name << " <host> <port> [--connections N] [--threads N] [--connect-rate N] [--sizes SIZE:WEIGHT,...] [--reply N] [--think MS] [--rate N] [--duration S]" << std::endl;
+}
+
+/*!
+ * A function that starts a non-blocking connection to the server.
+ *
+ * @param address The server's address.
+ *
+ * @return The socket's file descriptor, or -1 if it could not be started.
+ */
+int startConnection(const addrinfo* address) {
+    int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd < 0) return -1;
+    
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    
+    if (connect(fd, address->ai_addr, address->ai_addrlen) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*!
+ * A function that runs one event loop thread over its share of the clients until the deadline, and then until outstanding replies arrive or a grace period passes.
+ *
+ * @param options The options.
+ * @param address The server's address.
+ * @param first The index of this thread's first client, out of all clients.
+ * @param count The number of clients this thread runs.
+ * @param start When the run started.
+ * @param seed A seed for this thread's random numbers.
+ * @param results Filled with what this thread saw.
+ */
+void runClients(const Options& options, const addrinfo* address, unsigned int first, unsigned int count, Clock::time_point start, unsigned int seed, Results& results) {
+    std::mt19937_64 random(seed);
+    
+    std::vector<double> weights;
+    for (size_t a = 0; a < options.sizes.size(); a++) weights.push_back(options.sizes[a].second);
+    std::discrete_distribution<int> pickSize(weights.begin(), weights.end());
+    
+    //Open-loop clients each get an equal share of the total rate
+    double perClientRate = options.rate / options.connections;
+    std::exponential_distribution<double> interArrival(perClientRate > 0 ? perClientRate : 1);
+    
+    Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration));
+    Clock::time_point finish = deadline + std::chrono::seconds(2); //Time allowed for outstanding replies
+    
+    std::vector<Connection> connections(count);
+    for (unsigned int a = 0; a < count; a++) {
+        //Connections are spread evenly over time at the connect rate, across all threads
+        connections[a].connectTime = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>((first + a) / options.connectRate));
+    }
+    
+    std::string payload(std::max_element(options.sizes.begin(), options.sizes.end())->first, 'x');
+    char buffer[65536];
+    std::vector<pollfd> pollInfo;
+    std::vector<unsigned int> polled;
+    
+    while (true) {
+        Clock::time_point now = Clock::now();
+        if (now >= finish) break;
+        
+        bool outstanding = false;
+        Clock::time_point wake = finish;
+        pollInfo.clear();
+        polled.clear();
+        
+        for (unsigned int a = 0; a < count; a++) {
+            Connection& connection = connections[a];
+            
+            //Start connections that are due
+            if (connection.fd < 0 && !connection.connected) {
+                if (now >= deadline) continue;
+                if (now < connection.connectTime) {
+                    wake = std::min(wake, connection.connectTime);
+                    continue;
+                }
+                connection.fd = startConnection(address);
+                if (connection.fd < 0) {
+                    results.connectFailures++;
+                    connection.connected = true; //Don't try again
+                    continue;
+                }
+                connection.nextSend = now;
+            }
+            if (connection.fd < 0) continue;
+            
+            //Queue every message that is due. Open-loop clients queue on schedule, closed-loop clients only once the last reply is in
+            if (connection.connected && now < deadline) {
+                while (now >= connection.nextSend && (options.rate > 0 || connection.awaiting.empty())) {
+                    size_t size = options.sizes[pickSize(random)].first;
+                    connection.outbound.append(payload.data(), size);
+                    connection.awaiting.push_back(std::make_pair(connection.nextSend, options.replySize > 0 ? options.replySize : size));
+                    results.sent++;
+                    
+                    if (options.rate > 0) {
+                        connection.nextSend += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interArrival(random)));
+                    } else {
+                        connection.nextSend = Clock::time_point::max();
+                    }
+                }
+                if (connection.nextSend != Clock::time_point::max()) wake = std::min(wake, connection.nextSend);
+            }
+            
+            if (!connection.awaiting.empty()) outstanding = true;
+            
+            pollfd info;
+            info.fd = connection.fd;
+            info.events = POLLIN;
+            if (!connection.connected || connection.outboundOffset < connection.outbound.size()) info.events |= POLLOUT;
+            info.revents = 0;
+            pollInfo.push_back(info);
+            polled.push_back(a);
+        }
+        
+        //Stop early once sending is over and everything has been answered
+        if (now >= deadline && !outstanding) break;
+        
+        int timeout = (int)std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count();
+        if (poll(pollInfo.data(), pollInfo.size(), std::max(timeout, 0)) < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        
+        now = Clock::now();
+        for (size_t a = 0; a < pollInfo.size(); a++) {
+            if (pollInfo[a].revents == 0) continue;
+            Connection& connection = connections[polled[a]];
+            bool failed = false;
+            
+            if (!connection.connected) {
+                int error = 0;
+                socklen_t length = sizeof(error);
+                getsockopt(connection.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+                if (error != 0) {
+                    results.connectFailures++;
+                    close(connection.fd);
+                    connection.fd = -1;
+                    connection.connected = true; //Don't try again
+                    continue;
+                }
+                connection.connected = true;
+            }
+            
+            if ((pollInfo[a].revents & POLLOUT) && connection.outboundOffset < connection.outbound.size()) {
+                long sentSize = send(connection.fd, connection.outbound.data() + connection.outboundOffset, connection.outbound.size() - connection.outboundOffset, MSG_NOSIGNAL);
+                if (sentSize > 0) {
+                    connection.outboundOffset += sentSize;
+                    if (connection.outboundOffset == connection.outbound.size()) {
+                        connection.outbound.clear();
+                        connection.outboundOffset = 0;
+                    }
+                } else if (sentSize < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    failed = true;
+                }
+            }
+            
+            if (!failed && (pollInfo[a].revents & (POLLIN | POLLHUP | POLLERR))) {
+                long messageSize = recv(connection.fd, buffer, sizeof(buffer), 0);
+                if (messageSize > 0) {
+                    //Replies arrive in order, so the bytes answer the oldest messages first
+                    size_t remaining = messageSize;
+                    while (remaining > 0 && !connection.awaiting.empty()) {
+                        std::pair<Clock::time_point, size_t>& oldest = connection.awaiting.front();
+                        size_t used = std::min(remaining, oldest.second);
+                        oldest.second -= used;
+                        remaining -= used;
+                        if (oldest.second == 0) {
+                            results.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - oldest.first).count());
+                            results.received++;
+                            connection.awaiting.pop_front();
+                            
+                            //Closed-loop clients think, then send again
+                            if (options.rate <= 0 && connection.awaiting.empty()) {
+                                connection.nextSend = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(options.thinkMilliseconds));
+                            }
+                        }
+                    }
+                } else if (messageSize == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                    failed = true;
+                }
+            }
+            
+            if (failed) {
+                results.disconnects++;
+                close(connection.fd);
+                connection.fd = -1;
+                connection.awaiting.clear();
+            }
+        }
+    }
+    
+    for (unsigned int a = 0; a < count; a++) {
+        if (connections[a].fd >= 0) close(connections[a].fd);
+    }
+}
+
+/*!
+ * A function that reads the options from the command line.
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments.
+ * @param options Filled with the options.
+ *
+ * @return False if the arguments are not valid.
+ */
+bool parseOptions(int argc, const char* argv[], Options& options) {
+    if (argc < 3) return false;
+    options.host = argv[1];
+    options.port = argv[2];
+    
+    for (int a = 3; a + 1 < argc; a += 2) {
+        std::string name = argv[a];
+        const char* value = argv[a + 1];
+        
+        if (name == "--connections") options.connections = atoi(value);
+        else if (name == "--threads") options.threads = atoi(value);
+        else if (name == "--connect-rate") options.connectRate = atof(value);
+        else if (name == "--reply") options.replySize = atol(value);
+        else if (name == "--think") options.thinkMilliseconds = atof(value);
+        else if (name == "--rate") options.rate = atof(value);
+        else if (name == "--duration") options.duration = atof(value);
+        else if (name == "--sizes") {
+            options.sizes.clear();
+            std::string list = value;
+            size_t position = 0;
+            while (position < list.size()) {
+                size_t end = list.find(',', position);
+                if (end == std::string::npos) end = list.size();
+                std::string item = list.substr(position, end - position);
+                size_t colon = item.find(':');
+                size_t size = atol(item.substr(0, colon).c_str());
+                double weight = colon == std::string::npos ? 1 : atof(item.substr(colon + 1).c_str());
+                if (size == 0 || weight <= 0) return false;
+                options.sizes.push_back(std::make_pair(size, weight));
+                position = end + 1;
+            }
+            if (options.sizes.empty()) return false;
+        } else return false;
+    }
+    
+    return options.connections > 0 && options.threads > 0 && options.connectRate > 0 && options.duration > 0;
+}
+
+int main(int argc, const char * argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    options.threads = std::min(options.threads, options.connections);
+    
+    //A server closing a connection mid-write should be counted, not kill the process
+    signal(SIGPIPE, SIG_IGN);
+    
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    
+    addrinfo* address;
+    int returnVal = getaddrinfo(options.host, options.port, &hints, &address);
+    if (returnVal != 0) {
+        std::cout << "ERROR getting host address: " << gai_strerror(returnVal) << std::endl;
+        return 1;
+    }
+    
+    std::vector<Results> results(options.threads);
+    std::vector<std::thread> threads;
+    Clock::time_point start = Clock::now() + std::chrono::milliseconds(10);
+    
+    //Each thread gets a contiguous share of the clients
+    unsigned int first = 0;
+    for (unsigned int a = 0; a < options.threads; a++) {
+        unsigned int count = options.connections / options.threads + (a < options.connections % options.threads ? 1 : 0);
+        threads.push_back(std::thread(runClients, std::cref(options), address, first, count, start, 1234 + a, std::ref(results[a])));
+        first += count;
+    }
+    for (size_t a = 0; a < threads.size(); a++) threads[a].join();
+    freeaddrinfo(address);
+    
+    Results total;
+    for (size_t a = 0; a < results.size(); a++) {
+        total.latency.merge(results[a].latency);
+        total.sent += results[a].sent;
+        total.received += results[a].received;
+        total.connectFailures += results[a].connectFailures;
+        total.disconnects += results[a].disconnects;
+    }
+    
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << "Clients:      " << options.connections << " (" << total.connectFailures << " failed to connect, " << total.disconnects << " disconnected)" << std::endl;
+    std::cout << "Messages:     " << total.sent << " sent, " << total.received << " answered" << std::endl;
+    std::cout << "Throughput:   " << (uint64_t)(total.received / seconds) << " replies per second" << std::endl;
+    std::cout << "Latency (us): p50 " << total.latency.percentile(0.5) / 1000.0 << ", p90 " << total.latency.percentile(0.9) / 1000.0 << ", p99 " << total.latency.percentile(0.99) / 1000.0 << ", p99.9 " << total.latency.percentile(0.999) / 1000.0 << ", max " << total.latency.max() / 1000.0 << std::endl;
+    return 0;
+}
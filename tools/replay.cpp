@@ -0,0 +1,31 @@
+//Standard library includes
+#include <iostream>
+
+//Local includes
+#include "../src/TrafficReplay.hpp"
+
+int main(int argc, const char * argv[]) {
+    /*
+     Plays a capture made with ServerSocket::startCapture() back against a running server.
+     
+     Usage: replay <capture file> <host> <port> [speed]
+     A speed of 2 plays twice as fast as the original, and 0 plays as fast as possible.
+     */
+    
+    if (argc < 4) {
+        std::cout << "Usage: " << argv[0] << " <capture file> <host> <port> [speed]" << std::endl;
+        return 1;
+    }
+    
+    double speed = argc > 4 ? atof(argv[4]) : 1;
+    
+    TrafficReplay replay;
+    replay.open(argv[1]);
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    unsigned long sent = replay.replay(argv[2], atoi(argv[3]), speed);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    std::cout << "Replayed " << sent << " of " << replay.numberOfRecords() << " records in " << seconds << " seconds" << std::endl;
+    return 0;
+}